@@ -28,7 +28,12 @@ LOCAL_SRC_FILES := \
 		android_os_cts_HardwareName.cpp \
 		android_os_cts_OSFeatures.cpp \
 		android_os_cts_NoExecutePermissionTest.cpp \
-		android_os_cts_SeccompTest.cpp
+		code_regions.cpp \
+		proc_maps.cpp \
+		proc_scanner.cpp \
+		android_os_cts_SeccompTest.cpp \
+		android_os_cts_NativeResults.cpp \
+		native_result_buffer.cpp
 
 # Select the architectures on which seccomp-bpf are supported. This is used to
 # include extra test files that will not compile on architectures where it is
@@ -43,10 +48,15 @@ endif
 
 ifeq ($(ARCH_SUPPORTS_SECCOMP),1)
 	LOCAL_SRC_FILES += seccomp-tests/tests/seccomp_bpf_tests.c \
+			seccomp_filter_chain.cpp \
 			seccomp_sample_program.cpp
 
 	# This define controls the behavior of OSFeatures.needsSeccompSupport().
 	LOCAL_CFLAGS += -DARCH_SUPPORTS_SECCOMP
+
+	# Report failed ASSERTs and expected test deaths without going through
+	# abort() and debuggerd; see TH_FAST_FAIL in test_harness.h.
+	LOCAL_CFLAGS += -DTH_FAST_FAIL=1
 endif
 
 LOCAL_C_INCLUDES := $(JNI_H_INCLUDE)
@@ -54,8 +64,86 @@ LOCAL_C_INCLUDES := $(JNI_H_INCLUDE)
 LOCAL_SHARED_LIBRARIES := libnativehelper_compat_libc++ liblog libdl
 LOCAL_CXX_STL := none
 
-LOCAL_SRC_FILES += android_os_cts_CpuFeatures.cpp
+LOCAL_SRC_FILES += android_os_cts_CpuFeatures.cpp \
+		auxv_cpu_features.cpp
 LOCAL_C_INCLUDES += ndk/sources/cpufeatures
 LOCAL_STATIC_LIBRARIES := cpufeatures libc++_static
 
 include $(BUILD_SHARED_LIBRARY)
+
+ifeq ($(ARCH_SUPPORTS_SECCOMP),1)
+
+include $(CLEAR_VARS)
+
+# The seccomp sandboxing code that benchmarks/ and tools/ exercise. The tests
+# only need the filter chain and the sample program, which libctsos_jni
+# builds itself. Modules that link this also need proc_scanner.cpp.
+LOCAL_MODULE := libctsos_seccomp
+
+# Don't include this package in any configuration by default.
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_SRC_FILES := \
+		exec_mapping_monitor.cpp \
+		fd_passing.cpp \
+		sandbox_executor.cpp \
+		seccomp_arg_filter.cpp \
+		seccomp_filter_chain.cpp \
+		seccomp_filter_eval.cpp \
+		seccomp_policy_query.cpp \
+		seccomp_sample_program.cpp \
+		seccomp_supervisor.cpp \
+		seccomp_worker_pool.cpp \
+		syscall_resumption.cpp
+
+LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_CXX_STL := none
+
+include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+
+# The kernel tests that SeccompTest runs one at a time, as a program that
+# can run them in parallel:
+#   adb shell /data/nativetest/CtsOsSeccompBpfTests [-j jobs] [-s stats_file] [-v]
+LOCAL_MODULE := CtsOsSeccompBpfTests
+
+# Don't include this package in any configuration by default.
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE_PATH := $(TARGET_OUT_DATA_NATIVE_TESTS)
+
+LOCAL_SRC_FILES := \
+		seccomp-tests/tests/seccomp_bpf_tests.c \
+		seccomp-tests/tests/test_harness_main.c
+
+LOCAL_CFLAGS := -DTH_FAST_FAIL=1
+
+LOCAL_SHARED_LIBRARIES := liblog
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+# Tests for test_harness.h itself.
+LOCAL_MODULE := CtsOsTestHarnessTests
+
+# Don't include this package in any configuration by default.
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE_PATH := $(TARGET_OUT_DATA_NATIVE_TESTS)
+
+LOCAL_SRC_FILES := \
+		seccomp-tests/tests/test_harness_tests.c \
+		seccomp-tests/tests/test_harness_main.c
+
+# Some of these test what TH_FAST_FAIL changes.
+LOCAL_CFLAGS := -DTH_FAST_FAIL=1
+
+LOCAL_SHARED_LIBRARIES := liblog
+
+include $(BUILD_EXECUTABLE)
+
+endif
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
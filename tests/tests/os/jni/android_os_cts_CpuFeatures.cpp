@@ -14,50 +14,51 @@
  * limitations under the License.
  *
  */
-#include <cpu-features.h>
 #include <jni.h>
 #include <string.h>
 #include <sys/auxv.h>
 
+#include "auxv_cpu_features.h"
+
 jboolean android_os_cts_CpuFeatures_isArmCpu(JNIEnv* env, jobject thiz)
 {
-    AndroidCpuFamily cpuFamily = android_getCpuFamily();
+    AndroidCpuFamily cpuFamily = auxv_getCpuFamily();
     return cpuFamily == ANDROID_CPU_FAMILY_ARM;
 }
 
 jboolean android_os_cts_CpuFeatures_isArm7Compatible(JNIEnv* env, jobject thiz)
 {
-    uint64_t cpuFeatures = android_getCpuFeatures();
+    uint64_t cpuFeatures = auxv_getCpuFeatures();
     return (cpuFeatures & ANDROID_CPU_ARM_FEATURE_ARMv7) == ANDROID_CPU_ARM_FEATURE_ARMv7;
 }
 
 jboolean android_os_cts_CpuFeatures_isMipsCpu(JNIEnv* env, jobject thiz)
 {
-    AndroidCpuFamily cpuFamily = android_getCpuFamily();
+    AndroidCpuFamily cpuFamily = auxv_getCpuFamily();
     return cpuFamily == ANDROID_CPU_FAMILY_MIPS;
 }
 
 jboolean android_os_cts_CpuFeatures_isX86Cpu(JNIEnv* env, jobject thiz)
 {
-    AndroidCpuFamily cpuFamily = android_getCpuFamily();
+    AndroidCpuFamily cpuFamily = auxv_getCpuFamily();
     return cpuFamily == ANDROID_CPU_FAMILY_X86;
 }
 
 jboolean android_os_cts_CpuFeatures_isArm64Cpu(JNIEnv* env, jobject thiz)
 {
-    AndroidCpuFamily cpuFamily = android_getCpuFamily();
+    AndroidCpuFamily cpuFamily = auxv_getCpuFamily();
     return cpuFamily == ANDROID_CPU_FAMILY_ARM64;
 }
 
 jboolean android_os_cts_CpuFeatures_isMips64Cpu(JNIEnv* env, jobject thiz)
 {
-    AndroidCpuFamily cpuFamily = android_getCpuFamily();
+    AndroidCpuFamily cpuFamily = auxv_getCpuFamily();
     return cpuFamily == ANDROID_CPU_FAMILY_MIPS64;
 }
 
 jboolean android_os_cts_CpuFeatures_isX86_64Cpu(JNIEnv* env, jobject thiz)
 {
-    AndroidCpuFamily cpuFamily = android_getCpuFamily();
+    AndroidCpuFamily cpuFamily = auxv_getCpuFamily();
     return cpuFamily == ANDROID_CPU_FAMILY_X86_64;
 }
 
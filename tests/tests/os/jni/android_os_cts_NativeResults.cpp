@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <jni.h>
+#include <string.h>
+#include <sys/auxv.h>
+
+#include "auxv_cpu_features.h"
+#include "native_result_buffer.h"
+#include "proc_scanner.h"
+
+#if defined(ARCH_SUPPORTS_SECCOMP)
+#include "seccomp-tests/tests/test_harness.h"
+
+// Forward declare from seccomp_bpf_tests.c.
+extern "C" {
+struct __test_metadata* get_seccomp_test_list();
+}
+#endif
+
+#ifndef AT_HWCAP2
+#define AT_HWCAP2 26
+#endif
+
+static jobject android_os_cts_NativeResults_getArena(JNIEnv* env, jclass)
+{
+    return nativeResultArena(env);
+}
+
+// One NATIVE_RESULT_MAPPING record per line of /proc/self/maps.
+static jint android_os_cts_NativeResults_auditMappings(JNIEnv* env, jclass, jobject out)
+{
+    NativeResultBuffer buffer;
+    if (!nativeResultBufferInit(env, out, &buffer)) {
+        return 0;
+    }
+    ProcScanner scanner;
+    if (procScannerOpen(&scanner, "/proc/self/maps")) {
+        const char* line;
+        size_t length;
+        while ((line = procScannerNextLine(&scanner, &length)) != NULL) {
+            // "start-end perms offset dev inode name"
+            const char* p = line;
+            const char* end = line + length;
+            NativeResultMapping mapping;
+            if (!procScannerParseHex(&p, end, &mapping.start) || p == end || *p++ != '-' ||
+                    !procScannerParseHex(&p, end, &mapping.end)) {
+                continue;
+            }
+            p = procScannerSkipSpaces(p, end);
+            if (end - p < 4) {
+                continue;
+            }
+            mapping.flags = ((p[0] == 'r') ? NATIVE_RESULT_MAPPING_READ : 0) |
+                    ((p[1] == 'w') ? NATIVE_RESULT_MAPPING_WRITE : 0) |
+                    ((p[2] == 'x') ? NATIVE_RESULT_MAPPING_EXECUTE : 0) |
+                    ((p[3] == 's') ? NATIVE_RESULT_MAPPING_SHARED : 0);
+            // Skip the permissions, offset, device and inode to the name.
+            for (int field = 0; field < 4 && p != end; field++) {
+                p = procScannerSkipSpaces(procScannerFind(p, end, ' '), end);
+            }
+            mapping.nameLength = end - p;
+            nativeResultBufferAppend(&buffer, NATIVE_RESULT_MAPPING, &mapping, sizeof(mapping),
+                                     p, mapping.nameLength);
+        }
+        procScannerClose(&scanner);
+    }
+    return nativeResultBufferFinish(&buffer);
+}
+
+// A single NATIVE_RESULT_CPU record.
+static jint android_os_cts_NativeResults_getCpuCapabilities(JNIEnv* env, jclass, jobject out)
+{
+    NativeResultBuffer buffer;
+    if (!nativeResultBufferInit(env, out, &buffer)) {
+        return 0;
+    }
+    NativeResultCpu cpu;
+    cpu.family = auxv_getCpuFamily();
+    cpu.cpuCount = auxv_getCpuCount();
+    cpu.features = auxv_getCpuFeatures();
+    cpu.hwcap = getauxval(AT_HWCAP);
+    cpu.hwcap2 = getauxval(AT_HWCAP2);
+    nativeResultBufferAppend(&buffer, NATIVE_RESULT_CPU, &cpu, sizeof(cpu), NULL, 0);
+    return nativeResultBufferFinish(&buffer);
+}
+
+// Runs every seccomp kernel unit test, with one NATIVE_RESULT_TEST record
+// each, instead of one runKernelUnitTest() call per test.
+static jint android_os_cts_NativeResults_runKernelUnitTests(JNIEnv* env, jclass, jobject out)
+{
+    NativeResultBuffer buffer;
+    if (!nativeResultBufferInit(env, out, &buffer)) {
+        return 0;
+    }
+#if defined(ARCH_SUPPORTS_SECCOMP)
+    for (struct __test_metadata* t = get_seccomp_test_list(); t; t = t->next) {
+        __run_test(t);
+        NativeResultTest test;
+        test.status = t->skipped ? NATIVE_RESULT_TEST_SKIPPED :
+                (t->passed ? NATIVE_RESULT_TEST_PASSED : NATIVE_RESULT_TEST_FAILED);
+        test.nameLength = strlen(t->name);
+        test.durationNs = t->duration_ns;
+        nativeResultBufferAppend(&buffer, NATIVE_RESULT_TEST, &test, sizeof(test),
+                                 t->name, test.nameLength);
+    }
+#endif  // ARCH_SUPPORTS_SECCOMP
+    return nativeResultBufferFinish(&buffer);
+}
+
+static JNINativeMethod gMethods[] = {
+    {  "getArena", "()Ljava/nio/ByteBuffer;",
+            (void *) android_os_cts_NativeResults_getArena  },
+    {  "auditMappings", "(Ljava/nio/ByteBuffer;)I",
+            (void *) android_os_cts_NativeResults_auditMappings  },
+    {  "getCpuCapabilities", "(Ljava/nio/ByteBuffer;)I",
+            (void *) android_os_cts_NativeResults_getCpuCapabilities  },
+    {  "runKernelUnitTests", "(Ljava/nio/ByteBuffer;)I",
+            (void *) android_os_cts_NativeResults_runKernelUnitTests  },
+};
+
+// JNI_OnLoad doesn't call this yet: android.os.cts.NativeResults isn't
+// part of the test APK, and failing to register it would keep the whole
+// library from loading. Add the call back with the Java class.
+int register_android_os_cts_NativeResults(JNIEnv* env)
+{
+    jclass clazz = env->FindClass("android/os/cts/NativeResults");
+    if (clazz == NULL) {
+        return JNI_ERR;
+    }
+
+    return env->RegisterNatives(clazz, gMethods,
+            sizeof(gMethods) / sizeof(JNINativeMethod));
+}
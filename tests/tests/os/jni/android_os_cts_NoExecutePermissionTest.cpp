@@ -22,32 +22,29 @@
 #include <unistd.h>
 #include <cutils/log.h>
 #include <inttypes.h>
+#include <link.h>
+
+#include "code_regions.h"
+#include "proc_maps.h"
 
 static jboolean isAddressExecutable(uintptr_t address) {
-    char line[1024];
-    jboolean retval = false;
-    FILE *fp = fopen("/proc/self/maps", "re");
-    if (fp == NULL) {
-        ALOGE("Unable to open /proc/self/maps: %s", strerror(errno));
+    MapsEntry entry;
+    if (!findMapping(address, &entry)) {
         return false;
     }
-    while(fgets(line, sizeof(line), fp) != NULL) {
-        uintptr_t start;
-        uintptr_t end;
-        char permissions[10];
-        int scan = sscanf(line, "%" SCNxPTR "-%" SCNxPTR " %9s ", &start, &end, permissions);
-        if ((scan == 3) && (start <= address) && (address < end)) {
-            retval = (permissions[2] == 'x');
-            break;
-        }
-    }
-    fclose(fp);
-    return retval;
+    return entry.executable;
 }
 
 static jboolean android_os_cts_NoExecutePermissionTest_isMyCodeExecutable(JNIEnv*, jobject)
 {
-    return isAddressExecutable((uintptr_t) __builtin_return_address(0));
+    uintptr_t address = (uintptr_t) __builtin_return_address(0);
+    uint32_t flags;
+    // Code loaded by the dynamic linker is described by its program headers,
+    // so there is no need to go through /proc/self/maps for it.
+    if (findCodeRegion(address, &flags)) {
+        return (flags & PF_X) != 0;
+    }
+    return isAddressExecutable(address);
 }
 
 static jboolean android_os_cts_NoExecutePermissionTest_isStackExecutable(JNIEnv*, jobject)
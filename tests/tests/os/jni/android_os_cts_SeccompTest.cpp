@@ -23,6 +23,8 @@
 #include <linux/filter.h>
 #include <linux/seccomp.h>
 #include <sys/syscall.h>
+
+#include "seccomp_filter_chain.h"
 #endif
 
 #include "seccomp_sample_program.h"
@@ -44,9 +46,11 @@ jboolean android_security_cts_SeccompBpfTest_runKernelUnitTest(
         if (strcmp(t->name, nameStr) == 0) {
             __android_log_print(ANDROID_LOG_INFO, TAG, "Start: %s", t->name);
             __run_test(t);
+            // Skipped tests lack a kernel feature that CTS requires, so they
+            // still fail here; REQUIRES() only spares them the fork.
             __android_log_print(ANDROID_LOG_INFO, TAG, "%s: %s",
-                t->passed ? "PASS" : "FAIL", t->name);
-            return t->passed;
+                t->skipped ? "SKIP" : (t->passed ? "PASS" : "FAIL"), t->name);
+            return t->passed && !t->skipped;
         }
     }
 #endif  // ARCH_SUPPORTS_SECCOMP
@@ -63,8 +67,8 @@ jboolean android_security_cts_SeccompBpfTest_installTestFilter(JNIEnv*, jclass)
   if (prog.len == 0)
     return false;
 
-  int rv = syscall(__NR_seccomp, SECCOMP_SET_MODE_FILTER, SECCOMP_FILTER_FLAG_TSYNC, &prog);
-  return rv == 0;
+  // Recorded, so that seccomp_policy_query.h knows about it.
+  return seccompFilterInstallRecordedWithFlags(&prog, SECCOMP_FILTER_FLAG_TSYNC);
 #endif
 }
 
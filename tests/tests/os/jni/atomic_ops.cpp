@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "atomic_ops.h"
+
+#include <stddef.h>
+#include <sys/auxv.h>
+
+#define ARM64_HWCAP_ATOMICS (1 << 8)
+
+static uint64_t fetchAddCompiler(volatile uint64_t* address, uint64_t value) {
+    return __atomic_fetch_add(address, value, __ATOMIC_SEQ_CST);
+}
+
+static bool compareExchangeCompiler(volatile uint64_t* address, uint64_t* expected,
+                                    uint64_t desired) {
+    return __atomic_compare_exchange_n(address, expected, desired, false, __ATOMIC_SEQ_CST,
+                                       __ATOMIC_SEQ_CST);
+}
+
+static const AtomicOps kCompiler = {
+    ATOMIC_OPS_COMPILER, "compiler", fetchAddCompiler, compareExchangeCompiler,
+};
+
+#if defined(__aarch64__)
+// Written out, rather than left to the compiler, which picks one or the
+// other depending on -march and -moutline-atomics.
+static uint64_t fetchAddLlsc(volatile uint64_t* address, uint64_t value) {
+    uint64_t old;
+    uint64_t sum;
+    uint32_t failed;
+    asm volatile("1: ldaxr %[old], %[mem]\n"
+                 "   add %[sum], %[old], %[value]\n"
+                 "   stlxr %w[failed], %[sum], %[mem]\n"
+                 "   cbnz %w[failed], 1b\n"
+                 : [old] "=&r"(old), [sum] "=&r"(sum), [failed] "=&r"(failed),
+                   [mem] "+Q"(*address)
+                 : [value] "r"(value)
+                 : "memory");
+    return old;
+}
+
+static bool compareExchangeLlsc(volatile uint64_t* address, uint64_t* expected,
+                                uint64_t desired) {
+    uint64_t old;
+    uint32_t failed;
+    asm volatile("1: ldaxr %[old], %[mem]\n"
+                 "   cmp %[old], %[expected]\n"
+                 "   b.ne 2f\n"
+                 "   stlxr %w[failed], %[desired], %[mem]\n"
+                 "   cbnz %w[failed], 1b\n"
+                 "   b 3f\n"
+                 "2: clrex\n"
+                 "3:\n"
+                 : [old] "=&r"(old), [failed] "=&r"(failed), [mem] "+Q"(*address)
+                 : [expected] "r"(*expected), [desired] "r"(desired)
+                 : "cc", "memory");
+    if (old == *expected) {
+        return true;
+    }
+    *expected = old;
+    return false;
+}
+
+static uint64_t fetchAddLse(volatile uint64_t* address, uint64_t value) {
+    uint64_t old;
+    asm volatile(".arch_extension lse\n"
+                 "ldaddal %[value], %[old], %[mem]\n"
+                 : [old] "=r"(old), [mem] "+Q"(*address)
+                 : [value] "r"(value)
+                 : "memory");
+    return old;
+}
+
+static bool compareExchangeLse(volatile uint64_t* address, uint64_t* expected,
+                               uint64_t desired) {
+    uint64_t old = *expected;
+    asm volatile(".arch_extension lse\n"
+                 "casal %[old], %[desired], %[mem]\n"
+                 : [old] "+r"(old), [mem] "+Q"(*address)
+                 : [desired] "r"(desired)
+                 : "memory");
+    if (old == *expected) {
+        return true;
+    }
+    *expected = old;
+    return false;
+}
+
+static const AtomicOps kLlsc = {
+    ATOMIC_OPS_LLSC, "llsc", fetchAddLlsc, compareExchangeLlsc,
+};
+
+static const AtomicOps kLse = {
+    ATOMIC_OPS_LSE, "lse", fetchAddLse, compareExchangeLse,
+};
+#endif
+
+static const AtomicOps* gSelected;
+
+const AtomicOps* atomicOpsGet(AtomicOpsImpl impl) {
+    switch (impl) {
+    case ATOMIC_OPS_COMPILER:
+        return &kCompiler;
+#if defined(__aarch64__)
+    case ATOMIC_OPS_LLSC:
+        return &kLlsc;
+    case ATOMIC_OPS_LSE:
+        return (getauxval(AT_HWCAP) & ARM64_HWCAP_ATOMICS) != 0 ? &kLse : NULL;
+#else
+    default:
+        break;
+#endif
+    }
+    return NULL;
+}
+
+const AtomicOps* atomicOpsSelected() {
+    const AtomicOps* ops = __atomic_load_n(&gSelected, __ATOMIC_ACQUIRE);
+    if (ops != NULL) {
+        return ops;
+    }
+    // Racing threads all come to the same answer.
+    ops = atomicOpsGet(ATOMIC_OPS_LSE);
+    if (ops == NULL) {
+        ops = atomicOpsGet(ATOMIC_OPS_LLSC);
+    }
+    if (ops == NULL) {
+        ops = &kCompiler;
+    }
+    __atomic_store_n(&gSelected, ops, __ATOMIC_RELEASE);
+    return ops;
+}
+
+bool atomicOpsSelect(AtomicOpsImpl impl) {
+    const AtomicOps* ops = atomicOpsGet(impl);
+    if (ops == NULL) {
+        return false;
+    }
+    __atomic_store_n(&gSelected, ops, __ATOMIC_RELEASE);
+    return true;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ATOMIC_OPS_H_
+#define ATOMIC_OPS_H_
+
+#include <stdint.h>
+
+// Sequentially consistent read-modify-write operations on 64-bit words,
+// chosen at run time from the implementations this CPU has.
+//
+// On arm64 the choice is between the exclusive-load/store-exclusive loops
+// of ARMv8.0 and the single-instruction atomics of ARMv8.1 (LSE), which
+// HWCAP_ATOMICS says are there. LSE atomics are executed at the cache, so
+// they stay fast when several cores fight over a line, where LL/SC loops
+// retry; uncontended, the two are close, with LL/SC ahead on some cores.
+// So LSE is chosen whenever it is available. The atomics benchmarks show
+// both, uncontended and contended, to check that on a given device.
+//
+// Elsewhere there is one implementation, the compiler's: lock-prefixed
+// instructions on x86, and LDREXD/STREXD loops on 32-bit ARM.
+
+enum AtomicOpsImpl {
+    ATOMIC_OPS_COMPILER,  // the __atomic builtins
+    ATOMIC_OPS_LLSC,      // arm64 LDAXR/STLXR loops
+    ATOMIC_OPS_LSE,       // arm64 LDADDAL and CASAL
+};
+
+struct AtomicOps {
+    AtomicOpsImpl impl;
+    const char* name;
+    // Adds |value| to |*address| and returns what was there before.
+    uint64_t (*fetchAdd)(volatile uint64_t* address, uint64_t value);
+    // Replaces |*address| with |desired| if it is |*expected|, and returns
+    // true; otherwise stores it in |*expected| and returns false.
+    bool (*compareExchange)(volatile uint64_t* address, uint64_t* expected, uint64_t desired);
+};
+
+// Returns |impl|, or NULL if this CPU can't run it.
+const AtomicOps* atomicOpsGet(AtomicOpsImpl impl);
+
+// Returns the implementation in use, choosing it on first use.
+const AtomicOps* atomicOpsSelected();
+
+// Uses |impl| from now on, for comparing them. Only safe before other
+// threads use these operations. Returns false if |impl| isn't available.
+bool atomicOpsSelect(AtomicOpsImpl impl);
+
+static inline uint64_t atomicFetchAdd(volatile uint64_t* address, uint64_t value) {
+    return atomicOpsSelected()->fetchAdd(address, value);
+}
+
+static inline bool atomicCompareExchange(volatile uint64_t* address, uint64_t* expected,
+                                         uint64_t desired) {
+    return atomicOpsSelected()->compareExchange(address, expected, desired);
+}
+
+#endif  // ATOMIC_OPS_H_
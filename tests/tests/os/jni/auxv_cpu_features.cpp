@@ -0,0 +1,329 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "auxv_cpu_features.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/auxv.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#include "proc_scanner.h"
+
+// Kernel hwcap bits, from arch/<arch>/include/uapi/asm/hwcap.h. They are
+// spelled out here since the uapi headers are not available for every
+// target we build for.
+#if defined(__arm__)
+#define ARM_HWCAP_VFP       (1 << 6)
+#define ARM_HWCAP_IWMMXT    (1 << 9)
+#define ARM_HWCAP_NEON      (1 << 12)
+#define ARM_HWCAP_VFPv3     (1 << 13)
+#define ARM_HWCAP_VFPv4     (1 << 16)
+#define ARM_HWCAP_IDIVA     (1 << 17)
+#define ARM_HWCAP_IDIVT     (1 << 18)
+#define ARM_HWCAP_VFPD32    (1 << 19)
+
+#define ARM_HWCAP2_AES      (1 << 0)
+#define ARM_HWCAP2_PMULL    (1 << 1)
+#define ARM_HWCAP2_SHA1     (1 << 2)
+#define ARM_HWCAP2_SHA2     (1 << 3)
+#define ARM_HWCAP2_CRC32    (1 << 4)
+#elif defined(__aarch64__)
+#define ARM64_HWCAP_FP      (1 << 0)
+#define ARM64_HWCAP_ASIMD   (1 << 1)
+#define ARM64_HWCAP_AES     (1 << 3)
+#define ARM64_HWCAP_PMULL   (1 << 4)
+#define ARM64_HWCAP_SHA1    (1 << 5)
+#define ARM64_HWCAP_SHA2    (1 << 6)
+#define ARM64_HWCAP_CRC32   (1 << 7)
+#endif
+
+#ifndef AT_HWCAP2
+#define AT_HWCAP2 26
+#endif
+
+static pthread_once_t gInitOnce = PTHREAD_ONCE_INIT;
+static uint64_t gCpuFeatures;
+static int gCpuCount;
+
+// Reads up to |size| - 1 bytes of a small sysfs or procfs file into |buf|
+// and NUL-terminates it. Returns the number of bytes read, or -1.
+static ssize_t readSmallFile(const char* path, char* buf, size_t size) {
+    int fd = TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t len = TEMP_FAILURE_RETRY(read(fd, buf, size - 1));
+    close(fd);
+    if (len < 0) {
+        return -1;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+// Returns the number of CPUs in a sysfs CPU list such as "0-3,6,8-11", or 0
+// if it cannot be parsed.
+static int countCpuList(const char* list) {
+    int count = 0;
+    const char* p = list;
+    while (*p != '\0' && *p != '\n') {
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p) {
+            return 0;
+        }
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) {
+                return 0;
+            }
+        }
+        count += last - first + 1;
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+static int getCpuCount() {
+    char buf[256];
+    if (readSmallFile("/sys/devices/system/cpu/present", buf, sizeof(buf)) > 0) {
+        int count = countCpuList(buf);
+        if (count > 0) {
+            return count;
+        }
+    }
+    long count = sysconf(_SC_NPROCESSORS_CONF);
+    return count > 0 ? (int) count : 1;
+}
+
+#if defined(__arm__)
+// Returns the ARM architecture version from the "CPU architecture" field of
+// /proc/cpuinfo, or 0. Only used when nothing cheaper says.
+static int getArmArchitectureFromCpuInfo() {
+    ProcScanner scanner;
+    int arch = 0;
+    if (!procScannerOpen(&scanner, "/proc/cpuinfo")) {
+        return 0;
+    }
+    const char* line;
+    size_t length;
+    while ((line = procScannerNextLine(&scanner, &length)) != NULL) {
+        if (strncmp(line, "CPU architecture", 16) == 0) {
+            const char* end = line + length;
+            const char* value = procScannerFind(line, end, ':');
+            uint64_t version;
+            if (value != end) {
+                value = procScannerSkipSpaces(value + 1, end);
+                // 64-bit kernels may report "AArch64" here.
+                if (strncmp(value, "AArch64", 7) == 0) {
+                    arch = 8;
+                } else if (procScannerParseDecimal(&value, end, &version)) {
+                    arch = (int) version;
+                }
+            }
+            break;
+        }
+    }
+    procScannerClose(&scanner);
+    return arch;
+}
+
+// Returns the ARM architecture version the kernel reports for this process.
+static int getArmArchitecture() {
+    // AT_PLATFORM is "v7l", "v8l" and so on.
+    const char* platform = (const char*) getauxval(AT_PLATFORM);
+    if (platform != NULL && platform[0] == 'v' && platform[1] >= '1' && platform[1] <= '9') {
+        return atoi(platform + 1);
+    }
+    // uname() says "armv7l", or "armv8l" or "aarch64" on a 64-bit kernel.
+    struct utsname name;
+    if (uname(&name) == 0) {
+        if (strncmp(name.machine, "armv", 4) == 0 && atoi(name.machine + 4) > 0) {
+            return atoi(name.machine + 4);
+        }
+        if (strcmp(name.machine, "aarch64") == 0) {
+            return 8;
+        }
+    }
+    return getArmArchitectureFromCpuInfo();
+}
+
+static uint64_t getArmFeatures() {
+    uint64_t features = 0;
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    unsigned long hwcap2 = getauxval(AT_HWCAP2);
+    int arch = getArmArchitecture();
+
+    // VFPv3 and NEON only exist from ARMv7 on.
+    if (arch >= 7 || (hwcap & (ARM_HWCAP_VFPv3 | ARM_HWCAP_NEON)) != 0) {
+        features |= ANDROID_CPU_ARM_FEATURE_ARMv7;
+    }
+    if (arch >= 6 || (features & ANDROID_CPU_ARM_FEATURE_ARMv7) != 0) {
+        features |= ANDROID_CPU_ARM_FEATURE_LDREX_STREX;
+    }
+    if (hwcap & ARM_HWCAP_VFP) {
+        features |= ANDROID_CPU_ARM_FEATURE_VFPv2;
+    }
+    if (hwcap & (ARM_HWCAP_VFPv3 | ARM_HWCAP_NEON)) {
+        features |= ANDROID_CPU_ARM_FEATURE_VFPv3;
+    }
+    if (hwcap & ARM_HWCAP_VFPD32) {
+        features |= ANDROID_CPU_ARM_FEATURE_VFP_D32;
+    }
+    if (hwcap & ARM_HWCAP_NEON) {
+        features |= ANDROID_CPU_ARM_FEATURE_NEON | ANDROID_CPU_ARM_FEATURE_VFP_D32;
+    }
+    if (hwcap & ARM_HWCAP_VFPv4) {
+        features |= ANDROID_CPU_ARM_FEATURE_VFP_FP16 | ANDROID_CPU_ARM_FEATURE_VFP_FMA;
+        if (hwcap & ARM_HWCAP_NEON) {
+            features |= ANDROID_CPU_ARM_FEATURE_NEON_FMA;
+        }
+    }
+    if (hwcap & ARM_HWCAP_IDIVA) {
+        features |= ANDROID_CPU_ARM_FEATURE_IDIV_ARM;
+    }
+    if (hwcap & ARM_HWCAP_IDIVT) {
+        features |= ANDROID_CPU_ARM_FEATURE_IDIV_THUMB2;
+    }
+    if (hwcap & ARM_HWCAP_IWMMXT) {
+        features |= ANDROID_CPU_ARM_FEATURE_iWMMXt;
+    }
+    if (hwcap2 & ARM_HWCAP2_AES) {
+        features |= ANDROID_CPU_ARM_FEATURE_AES;
+    }
+    if (hwcap2 & ARM_HWCAP2_PMULL) {
+        features |= ANDROID_CPU_ARM_FEATURE_PMULL;
+    }
+    if (hwcap2 & ARM_HWCAP2_SHA1) {
+        features |= ANDROID_CPU_ARM_FEATURE_SHA1;
+    }
+    if (hwcap2 & ARM_HWCAP2_SHA2) {
+        features |= ANDROID_CPU_ARM_FEATURE_SHA2;
+    }
+    if (hwcap2 & ARM_HWCAP2_CRC32) {
+        features |= ANDROID_CPU_ARM_FEATURE_CRC32;
+    }
+    return features;
+}
+#elif defined(__aarch64__)
+static uint64_t getArm64Features() {
+    uint64_t features = 0;
+    unsigned long hwcap = getauxval(AT_HWCAP);
+
+    if (hwcap & ARM64_HWCAP_FP) {
+        features |= ANDROID_CPU_ARM64_FEATURE_FP;
+    }
+    if (hwcap & ARM64_HWCAP_ASIMD) {
+        features |= ANDROID_CPU_ARM64_FEATURE_ASIMD;
+    }
+    if (hwcap & ARM64_HWCAP_AES) {
+        features |= ANDROID_CPU_ARM64_FEATURE_AES;
+    }
+    if (hwcap & ARM64_HWCAP_PMULL) {
+        features |= ANDROID_CPU_ARM64_FEATURE_PMULL;
+    }
+    if (hwcap & ARM64_HWCAP_SHA1) {
+        features |= ANDROID_CPU_ARM64_FEATURE_SHA1;
+    }
+    if (hwcap & ARM64_HWCAP_SHA2) {
+        features |= ANDROID_CPU_ARM64_FEATURE_SHA2;
+    }
+    if (hwcap & ARM64_HWCAP_CRC32) {
+        features |= ANDROID_CPU_ARM64_FEATURE_CRC32;
+    }
+    return features;
+}
+#elif defined(__i386__) || defined(__x86_64__)
+// AT_HWCAP on x86 only carries CPUID.1:EDX, so ask the CPU directly.
+static uint64_t getX86Features() {
+    uint64_t features = 0;
+    unsigned int eax, ebx, ecx, edx;
+
+    // cpufeatures only reports MOVBE on Intel parts.
+    if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    bool intel = ebx == 0x756e6547 && edx == 0x49656e69 && ecx == 0x6c65746e;  // GenuineIntel
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    if (ecx & (1 << 9)) {
+        features |= ANDROID_CPU_X86_FEATURE_SSSE3;
+    }
+    if (intel && (ecx & (1 << 22))) {
+        features |= ANDROID_CPU_X86_FEATURE_MOVBE;
+    }
+    if (ecx & (1 << 23)) {
+        features |= ANDROID_CPU_X86_FEATURE_POPCNT;
+    }
+    return features;
+}
+#endif
+
+static void initCpuFeatures() {
+#if defined(__arm__)
+    gCpuFeatures = getArmFeatures();
+#elif defined(__aarch64__)
+    gCpuFeatures = getArm64Features();
+#elif defined(__i386__) || defined(__x86_64__)
+    gCpuFeatures = getX86Features();
+#else
+    // No feature bits are reported for MIPS.
+    gCpuFeatures = 0;
+#endif
+    gCpuCount = getCpuCount();
+}
+
+AndroidCpuFamily auxv_getCpuFamily() {
+    // Like cpufeatures, report the ABI this code was built for rather than
+    // what the kernel runs on.
+#if defined(__arm__)
+    return ANDROID_CPU_FAMILY_ARM;
+#elif defined(__aarch64__)
+    return ANDROID_CPU_FAMILY_ARM64;
+#elif defined(__i386__)
+    return ANDROID_CPU_FAMILY_X86;
+#elif defined(__x86_64__)
+    return ANDROID_CPU_FAMILY_X86_64;
+#elif defined(__mips__) && defined(__LP64__)
+    return ANDROID_CPU_FAMILY_MIPS64;
+#elif defined(__mips__)
+    return ANDROID_CPU_FAMILY_MIPS;
+#else
+    return ANDROID_CPU_FAMILY_UNKNOWN;
+#endif
+}
+
+uint64_t auxv_getCpuFeatures() {
+    pthread_once(&gInitOnce, initCpuFeatures);
+    return gCpuFeatures;
+}
+
+int auxv_getCpuCount() {
+    pthread_once(&gInitOnce, initCpuFeatures);
+    return gCpuCount;
+}
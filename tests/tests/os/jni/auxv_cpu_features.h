@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AUXV_CPU_FEATURES_H_
+#define AUXV_CPU_FEATURES_H_
+
+#include <cpu-features.h>
+#include <stdint.h>
+
+// Drop-in replacements for android_getCpuFamily(), android_getCpuFeatures()
+// and android_getCpuCount() from the NDK cpufeatures library, returning the
+// same values.
+//
+// Instead of text-parsing /proc/cpuinfo on first use, features come from the
+// kernel's hwcaps in the auxiliary vector (or CPUID on x86), the architecture
+// version from AT_PLATFORM or uname(), and the CPU count from sysfs.
+// /proc/cpuinfo is only read when none of those say which ARM architecture
+// version we are running on.
+
+AndroidCpuFamily auxv_getCpuFamily();
+
+uint64_t auxv_getCpuFeatures();
+
+int auxv_getCpuCount();
+
+#endif  // AUXV_CPU_FEATURES_H_
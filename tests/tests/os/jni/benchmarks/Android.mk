@@ -0,0 +1,64 @@
+# Copyright (C) 2015 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+
+# Native microbenchmarks for the code in libctsos_jni. Run on a device with
+#   adb shell /data/nativetest/CtsOsNativeBenchmarks [-f filter] [-o results]
+# See benchmark_harness.h for the options and the output format.
+LOCAL_MODULE := CtsOsNativeBenchmarks
+
+# Don't include this package in any configuration by default.
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE_PATH := $(TARGET_OUT_DATA_NATIVE_TESTS)
+
+LOCAL_SRC_FILES := \
+		benchmark_main.cpp \
+		atomics_benchmark.cpp.arm \
+		code_regions_benchmark.cpp \
+		cpu_features_benchmark.cpp \
+		proc_maps_benchmark.cpp \
+		../atomic_ops.cpp \
+		../auxv_cpu_features.cpp \
+		../code_regions.cpp \
+		../proc_maps.cpp \
+		../proc_scanner.cpp
+
+# ARCH_SUPPORTS_SECCOMP is set by ../Android.mk, which includes this file.
+ifeq ($(ARCH_SUPPORTS_SECCOMP),1)
+	LOCAL_SRC_FILES += arg_filter_benchmark.cpp \
+			exec_mapping_monitor_benchmark.cpp \
+			exec_startup_benchmark.cpp \
+			io_batching_benchmark.cpp \
+			policy_query_benchmark.cpp \
+			sandbox_executor_benchmark.cpp \
+			seccomp_supervisor_benchmark.cpp \
+			sleep_latency_benchmark.cpp \
+			syscall_resumption_benchmark.cpp \
+			worker_pool_benchmark.cpp
+	LOCAL_STATIC_LIBRARIES += libctsos_seccomp
+endif
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+
+LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_CXX_STL := none
+
+LOCAL_C_INCLUDES += ndk/sources/cpufeatures
+LOCAL_STATIC_LIBRARIES += cpufeatures libc++_static
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <linux/seccomp.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "benchmark_harness.h"
+#include "seccomp_arg_filter.h"
+
+#ifndef PR_SET_NO_NEW_PRIVS
+#define PR_SET_NO_NEW_PRIVS 38
+#endif
+
+#ifndef PR_SET_VMA
+#define PR_SET_VMA 0x53564d41
+#define PR_SET_VMA_ANON_NAME 0
+#endif
+
+// Argument-filtered syscalls under a policy from seccompArgFilterGenerate(),
+// against the same policy generated unoptimized, with the checks laid out
+// one predicate at a time the way the filters of seccomp_bpf_tests.c are
+// written, and against no filter at all.
+
+#ifdef __NR_mmap2
+#define MMAP_NR __NR_mmap2
+#else
+#define MMAP_NR __NR_mmap
+#endif
+
+#define MAX_FILTER 512
+
+static const uint64_t kProts[] = {
+    PROT_NONE, PROT_READ, PROT_READ | PROT_WRITE, PROT_READ | PROT_EXEC,
+};
+
+static const uint64_t kIoctls[] = {
+    FIONREAD, FIONBIO, FIOCLEX, FIONCLEX, FIOASYNC, TCGETS, TCSETS, TIOCGWINSZ,
+    TIOCSWINSZ, TIOCGPGRP, TIOCSPGRP, TIOCOUTQ, TIOCINQ, TIOCSCTTY, TIOCNOTTY,
+};
+
+static const uint64_t kPrctls[] = {
+    PR_GET_DUMPABLE, PR_SET_DUMPABLE, PR_GET_NAME, PR_SET_NAME, PR_GET_TIMERSLACK,
+    PR_SET_TIMERSLACK, PR_GET_NO_NEW_PRIVS, PR_SET_NO_NEW_PRIVS, PR_GET_SECCOMP,
+    PR_SET_SECCOMP, PR_GET_PDEATHSIG, PR_SET_PDEATHSIG, PR_CAPBSET_READ,
+};
+
+static bool installPolicy(int flags) {
+    // Anonymous mappings, or file mappings at page-aligned offsets below
+    // 1 TiB; never writable and executable.
+    const SeccompArgPredicate anonymousMmap[] = {
+        seccompArgLowWord(seccompArgInSet(2, kProts, sizeof(kProts) / sizeof(kProts[0]))),
+        seccompArgLowWord(seccompArgMaskedEq(3, MAP_ANONYMOUS, MAP_ANONYMOUS)),
+        seccompArgLowWord(seccompArgEq(4, -1)),
+    };
+    const SeccompArgPredicate fileMmap[] = {
+        seccompArgLowWord(seccompArgInSet(2, kProts, sizeof(kProts) / sizeof(kProts[0]))),
+        seccompArgLowWord(seccompArgRange(4, 0, 65535)),
+        seccompArgRange(5, 0, 1ULL << 40),
+        seccompArgMaskedEq(5, 4095, 0),
+    };
+    const SeccompArgPredicate ioctls[] = {
+        seccompArgLowWord(seccompArgRange(0, 0, 65535)),
+        seccompArgLowWord(seccompArgInSet(1, kIoctls, sizeof(kIoctls) / sizeof(kIoctls[0]))),
+    };
+    const SeccompArgPredicate nameVma[] = {
+        seccompArgLowWord(seccompArgEq(0, PR_SET_VMA)),
+        seccompArgEq(1, PR_SET_VMA_ANON_NAME),
+    };
+    const SeccompArgPredicate prctls[] = {
+        seccompArgLowWord(seccompArgInSet(0, kPrctls, sizeof(kPrctls) / sizeof(kPrctls[0]))),
+    };
+    const SeccompArgRule rules[] = {
+        { MMAP_NR, SECCOMP_RET_ALLOW, anonymousMmap, 3 },
+        { MMAP_NR, SECCOMP_RET_ALLOW, fileMmap, 4 },
+        { __NR_ioctl, SECCOMP_RET_ALLOW, ioctls, 2 },
+        { __NR_prctl, SECCOMP_RET_ALLOW, nameVma, 2 },
+        { __NR_prctl, SECCOMP_RET_ALLOW, prctls, 1 },
+    };
+    struct sock_filter filter[MAX_FILTER];
+    int length = seccompArgFilterGenerate(rules, sizeof(rules) / sizeof(rules[0]),
+                                          SECCOMP_RET_ERRNO | EPERM, SECCOMP_RET_ALLOW,
+                                          flags, filter, MAX_FILTER);
+    if (length < 0) {
+        return false;
+    }
+    struct sock_fprog prog = { static_cast<unsigned short>(length), filter };
+    return prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 &&
+            prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) == 0;
+}
+
+// Checks that the policy allows what it should and nothing more.
+static bool policyHolds() {
+    void* p = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    munmap(p, 4096);
+    p = mmap(NULL, 4096, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS,
+             -1, 0);
+    if (p != MAP_FAILED || errno != EPERM) {
+        return false;
+    }
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    int bytes;
+    // A pipe isn't a tty, so only the filter can make TIOCSTI fail with EPERM.
+    bool ioctlsHold = ioctl(fds[0], FIONREAD, &bytes) == 0 &&
+            ioctl(fds[0], TIOCSTI, "x") != 0 && errno == EPERM;
+    close(fds[0]);
+    close(fds[1]);
+    return ioctlsHold && prctl(PR_GET_DUMPABLE, 0, 0, 0, 0) >= 0 &&
+            prctl(PR_SET_KEEPCAPS, 0, 0, 0, 0) != 0 && errno == EPERM;
+}
+
+static void mmapBody(struct __benchmark_state* _state) {
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        void* p = mmap(NULL, 4096, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            BENCHMARK_ERROR("mmap: %s", strerror(errno));
+        }
+        munmap(p, 4096);
+    }
+}
+
+static void ioctlBody(struct __benchmark_state* _state) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        BENCHMARK_ERROR("pipe: %s", strerror(errno));
+    }
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        int bytes;
+        if (ioctl(fds[0], FIONREAD, &bytes) != 0) {
+            BENCHMARK_ERROR("ioctl: %s", strerror(errno));
+        }
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void prctlBody(struct __benchmark_state* _state) {
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        if (prctl(PR_GET_DUMPABLE, 0, 0, 0, 0) < 0) {
+            BENCHMARK_ERROR("prctl: %s", strerror(errno));
+        }
+    }
+}
+
+// Each benchmark runs in its own process, so the filter goes away with it.
+#define ARG_FILTER_BENCHMARKS(call) \
+    BENCHMARK(arg_filter_##call##_unfiltered) { \
+        call##Body(_state); \
+    } \
+    BENCHMARK(arg_filter_##call##_unoptimized) { \
+        static bool installed; \
+        if (!installed) { \
+            if (!installPolicy(SECCOMP_ARG_FILTER_UNOPTIMIZED) || !policyHolds()) { \
+                BENCHMARK_ERROR("unable to install the policy"); \
+            } \
+            installed = true; \
+        } \
+        call##Body(_state); \
+    } \
+    BENCHMARK(arg_filter_##call##_generated) { \
+        static bool installed; \
+        if (!installed) { \
+            if (!installPolicy(0) || !policyHolds()) { \
+                BENCHMARK_ERROR("unable to install the policy"); \
+            } \
+            installed = true; \
+        } \
+        call##Body(_state); \
+    }
+
+ARG_FILTER_BENCHMARKS(mmap)
+ARG_FILTER_BENCHMARKS(ioctl)
+ARG_FILTER_BENCHMARKS(prctl)
@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/auxv.h>
+#include <unistd.h>
+
+#include "atomic_ops.h"
+#include "benchmark_harness.h"
+
+// What memory barriers, ordered loads and stores, and atomic
+// read-modify-writes cost, which decides between lock-free algorithms.
+//
+//   barrier_*         each barrier instruction this architecture has, after
+//                     barrier_none, an empty compiler barrier
+//   load_* store_*    plain, acquire, release and sequentially consistent
+//   atomic_*          fetch-add and compare-exchange through each of the
+//                     implementations in atomic_ops.h, uncontended and with
+//                     a second thread hammering the same word from a
+//                     nearby CPU (0 and 1) or a far one (0 and the last,
+//                     which is in another cluster on big.LITTLE parts)
+
+#define BARRIER_BENCHMARK(name, insn) \
+    BENCHMARK(barrier_##name) { \
+        for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) { \
+            asm volatile(insn ::: "memory"); \
+        } \
+    }
+
+BARRIER_BENCHMARK(none, "")
+
+#if defined(__aarch64__)
+BARRIER_BENCHMARK(dmb_ish, "dmb ish")
+BARRIER_BENCHMARK(dmb_ishld, "dmb ishld")
+BARRIER_BENCHMARK(dmb_ishst, "dmb ishst")
+BARRIER_BENCHMARK(dmb_sy, "dmb sy")
+BARRIER_BENCHMARK(dsb_ish, "dsb ish")
+BARRIER_BENCHMARK(dsb_sy, "dsb sy")
+BARRIER_BENCHMARK(isb, "isb")
+#elif defined(__arm__)
+BARRIER_BENCHMARK(dmb_ish, "dmb ish")
+BARRIER_BENCHMARK(dmb_ishst, "dmb ishst")
+BARRIER_BENCHMARK(dsb_ish, "dsb ish")
+BARRIER_BENCHMARK(isb, "isb")
+#elif defined(__x86_64__)
+BARRIER_BENCHMARK(mfence, "mfence")
+BARRIER_BENCHMARK(lfence, "lfence")
+BARRIER_BENCHMARK(sfence, "sfence")
+// What compilers use for a full fence instead of mfence.
+BARRIER_BENCHMARK(lock_or, "lock orl $0, (%%rsp)")
+#elif defined(__i386__)
+BARRIER_BENCHMARK(mfence, "mfence")
+BARRIER_BENCHMARK(lfence, "lfence")
+BARRIER_BENCHMARK(sfence, "sfence")
+BARRIER_BENCHMARK(lock_or, "lock orl $0, (%%esp)")
+#endif
+
+#if defined(__arm__)
+// The CP15 barriers that android_os_cts_CpuInstructions.cpp probes for. An
+// arm64 kernel emulates them for 32-bit processes, if it was told to, and
+// otherwise they raise SIGILL. It only emulates them in A32 code, so this
+// file is built as ARM rather than Thumb, as that one is.
+static sigjmp_buf gSigillJump;
+
+static void onSigill(int) {
+    siglongjmp(gSigillJump, 1);
+}
+
+static bool cp15BarriersWork() {
+    struct sigaction action;
+    struct sigaction old;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onSigill;
+    if (sigaction(SIGILL, &action, &old) != 0) {
+        return false;
+    }
+    bool works = false;
+    if (sigsetjmp(gSigillJump, 1) == 0) {
+        asm volatile("mcr p15, 0, %0, c7, c10, 5" : : "r"(0) : "memory");
+        works = true;
+    }
+    sigaction(SIGILL, &old, NULL);
+    return works;
+}
+
+#define CP15_BARRIER_BENCHMARK(name, crm, opc2) \
+    BENCHMARK(barrier_cp15_##name) { \
+        if (!cp15BarriersWork()) { \
+            BENCHMARK_SKIP("CP15 barriers raise SIGILL"); \
+        } \
+        for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) { \
+            asm volatile("mcr p15, 0, %0, c7, " #crm ", " #opc2 : : "r"(0) : "memory"); \
+        } \
+    }
+
+CP15_BARRIER_BENCHMARK(dmb, c10, 5)
+CP15_BARRIER_BENCHMARK(dsb, c10, 4)
+CP15_BARRIER_BENCHMARK(isb, c5, 4)
+#endif
+
+// Spread out, so that the benchmarks don't share cache lines by accident.
+static volatile uint64_t gWord __attribute__((aligned(128)));
+
+#define LOAD_BENCHMARK(name, order) \
+    BENCHMARK(load_##name) { \
+        for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) { \
+            BENCHMARK_DO_NOT_OPTIMIZE(__atomic_load_n(&gWord, order)); \
+        } \
+    }
+
+#define STORE_BENCHMARK(name, order) \
+    BENCHMARK(store_##name) { \
+        for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) { \
+            __atomic_store_n(&gWord, i, order); \
+        } \
+    }
+
+// LDAR on arm64, and a plain load elsewhere, followed by a DMB on 32-bit
+// ARM.
+LOAD_BENCHMARK(relaxed, __ATOMIC_RELAXED)
+LOAD_BENCHMARK(acquire, __ATOMIC_ACQUIRE)
+LOAD_BENCHMARK(seq_cst, __ATOMIC_SEQ_CST)
+// STLR on arm64, a plain store on x86, but XCHG for seq_cst there.
+STORE_BENCHMARK(relaxed, __ATOMIC_RELAXED)
+STORE_BENCHMARK(release, __ATOMIC_RELEASE)
+STORE_BENCHMARK(seq_cst, __ATOMIC_SEQ_CST)
+
+#if defined(__aarch64__)
+#define ARM64_HWCAP_LRCPC (1 << 15)
+
+// The weaker acquire of ARMv8.3, which C++ memory_order_acquire allows.
+BENCHMARK(load_acquire_pc) {
+    if ((getauxval(AT_HWCAP) & ARM64_HWCAP_LRCPC) == 0) {
+        BENCHMARK_SKIP("no LDAPR");
+    }
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        uint64_t value;
+        asm volatile(".arch_extension rcpc\n"
+                     "ldapr %[value], %[mem]\n"
+                     : [value] "=r"(value)
+                     : [mem] "Q"(gWord)
+                     : "memory");
+        BENCHMARK_DO_NOT_OPTIMIZE(value);
+    }
+}
+#endif
+
+enum Operation {
+    FETCH_ADD,
+    COMPARE_EXCHANGE,  // an increment, retried until it sticks
+};
+
+static void runOperation(const AtomicOps* ops, Operation operation) {
+    if (operation == FETCH_ADD) {
+        ops->fetchAdd(&gWord, 1);
+        return;
+    }
+    uint64_t expected = gWord;
+    while (!ops->compareExchange(&gWord, &expected, expected + 1)) {
+    }
+}
+
+static bool pinTo(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+struct Contender {
+    const AtomicOps* ops;
+    Operation operation;
+    int cpu;
+    bool pinned;
+    volatile bool started;
+    volatile bool stop;
+};
+
+static void* contend(void* arg) {
+    Contender* contender = reinterpret_cast<Contender*>(arg);
+    contender->pinned = pinTo(contender->cpu);
+    __atomic_store_n(&contender->started, true, __ATOMIC_RELEASE);
+    while (!__atomic_load_n(&contender->stop, __ATOMIC_ACQUIRE)) {
+        runOperation(contender->ops, contender->operation);
+    }
+    return NULL;
+}
+
+enum Contention {
+    UNCONTENDED,
+    NEAR,
+    FAR,
+};
+
+static void measureAtomic(struct __benchmark_state* _state, AtomicOpsImpl impl,
+                          Operation operation, Contention contention) {
+    const AtomicOps* ops = atomicOpsGet(impl);
+    if (ops == NULL) {
+        BENCHMARK_SKIP("%s atomics aren't available", impl == ATOMIC_OPS_LSE ? "LSE" : "LL/SC");
+    }
+    if (contention == UNCONTENDED) {
+        for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+            runOperation(ops, operation);
+        }
+        return;
+    }
+
+    BENCHMARK_PAUSE();
+    int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 2) {
+        BENCHMARK_SKIP("only one CPU");
+    }
+    if (!pinTo(0)) {
+        BENCHMARK_SKIP("unable to run on CPU 0: %s", strerror(errno));
+    }
+    Contender contender;
+    memset(&contender, 0, sizeof(contender));
+    contender.ops = ops;
+    contender.operation = operation;
+    contender.cpu = contention == NEAR ? 1 : cpus - 1;
+    pthread_t thread;
+    errno = pthread_create(&thread, NULL, contend, &contender);
+    if (errno != 0) {
+        BENCHMARK_ERROR("pthread_create: %s", strerror(errno));
+    }
+    while (!__atomic_load_n(&contender.started, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+    BENCHMARK_RESUME();
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        runOperation(ops, operation);
+    }
+    BENCHMARK_PAUSE();
+    __atomic_store_n(&contender.stop, true, __ATOMIC_RELEASE);
+    pthread_join(thread, NULL);
+    BENCHMARK_RESUME();
+    if (!contender.pinned) {
+        BENCHMARK_SKIP("unable to run on CPU %d", contender.cpu);
+    }
+}
+
+#define ATOMIC_BENCHMARKS(impl, implName, operation, operationName) \
+    BENCHMARK(atomic_##operationName##_##implName) { \
+        measureAtomic(_state, impl, operation, UNCONTENDED); \
+    } \
+    BENCHMARK(atomic_##operationName##_##implName##_contended_near) { \
+        measureAtomic(_state, impl, operation, NEAR); \
+    } \
+    BENCHMARK(atomic_##operationName##_##implName##_contended_far) { \
+        measureAtomic(_state, impl, operation, FAR); \
+    }
+
+ATOMIC_BENCHMARKS(ATOMIC_OPS_COMPILER, compiler, FETCH_ADD, fetch_add)
+ATOMIC_BENCHMARKS(ATOMIC_OPS_COMPILER, compiler, COMPARE_EXCHANGE, cas)
+#if defined(__aarch64__)
+ATOMIC_BENCHMARKS(ATOMIC_OPS_LLSC, llsc, FETCH_ADD, fetch_add)
+ATOMIC_BENCHMARKS(ATOMIC_OPS_LLSC, llsc, COMPARE_EXCHANGE, cas)
+ATOMIC_BENCHMARKS(ATOMIC_OPS_LSE, lse, FETCH_ADD, fetch_add)
+ATOMIC_BENCHMARKS(ATOMIC_OPS_LSE, lse, COMPARE_EXCHANGE, cas)
+#endif
+
+// The same through atomicFetchAdd(), to show what choosing at run time
+// costs over calling one implementation directly.
+BENCHMARK(atomic_fetch_add_selected) {
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        atomicFetchAdd(&gWord, 1);
+    }
+}
+
+// And what the compiler makes of it inline, with no call at all.
+BENCHMARK(atomic_fetch_add_inline) {
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        __atomic_fetch_add(&gWord, 1, __ATOMIC_SEQ_CST);
+    }
+}
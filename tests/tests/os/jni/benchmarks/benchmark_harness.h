@@ -0,0 +1,438 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * benchmark_harness.h: simple C/C++ microbenchmark helper, in the spirit of
+ * seccomp-tests/tests/test_harness.h.
+ *
+ * Usage:
+ *   #include "benchmark_harness.h"
+ *
+ *   BENCHMARK(getppid) {
+ *     unsigned long long i;
+ *     for (i = 0; i < BENCHMARK_ITERATIONS; i++)
+ *       BENCHMARK_DO_NOT_OPTIMIZE(getppid());
+ *   }
+ *
+ *   BENCHMARK_MANUAL_TIME(first_open) {
+ *     unsigned long long i;
+ *     for (i = 0; i < BENCHMARK_ITERATIONS; i++)
+ *       BENCHMARK_ADD_TIME(time_one_cold_open());
+ *   }
+ *
+ * and, in exactly one file of the executable:
+ *
+ *   BENCHMARK_MAIN
+ *
+ * Every benchmark runs in a child process of its own, so it is free to
+ * install seccomp filters, change signal dispositions or leak.  The number
+ * of iterations is grown until one run takes at least the minimum time, then
+ * the benchmark is run that many times more and each run is reported as a
+ * line of the form
+ *
+ *   sample <name> <ns per iteration> <iterations> [<cycles per iteration>]
+ *
+ * or, when it could not run,
+ *
+ *   skip <name> <reason>
+ *   error <name> <reason>
+ *
+ * While the child runs, the harness samples CPU frequencies and thermal state
+ * (see cpu_state_sampler.h).  The cycle estimate uses the average frequency
+ * of the CPU the child was on during that run, and is left out when cpufreq
+ * can't be read.  After the samples come
+ *
+ *   cpufreq <name> <cpu> <min kHz> <mean kHz> <max kHz> <ticks on cpu>
+ *   thermal <name> <before> <peak> <after>   (hottest zone, m°C)
+ *   throttled <name> <what changed>
+ *
+ * with a throttled line for each frequency cap that went down or cooling
+ * device that stepped up during the run; such results are suspect.  Pinning
+ * benchmarks to one CPU with -c makes them more comparable.
+ *
+ * Lines starting with '#' are comments.
+ */
+#ifndef BENCHMARK_HARNESS_H_
+#define BENCHMARK_HARNESS_H_
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpu_state_sampler.h"
+
+#define BENCHMARK_DEFAULT_MIN_TIME_MS 100
+#define BENCHMARK_DEFAULT_REPETITIONS 5
+#define BENCHMARK_MAX_ITERATIONS 1000000000ULL
+
+/* Defines a benchmark timed by the harness.  The body runs with
+ * BENCHMARK_ITERATIONS set and should repeat the operation that many times.
+ */
+#define BENCHMARK(bench_name) _BENCHMARK(bench_name, 0)
+
+/* Defines a benchmark that measures its own iterations and reports their
+ * cost with BENCHMARK_ADD_TIME(), for operations that can't simply be
+ * repeated in a loop (e.g. the first call in a fresh process).
+ */
+#define BENCHMARK_MANUAL_TIME(bench_name) _BENCHMARK(bench_name, 1)
+
+#define _BENCHMARK(bench_name, manual) \
+  static void __benchmark_##bench_name(struct __benchmark_state *); \
+  static struct __benchmark_metadata __benchmark_##bench_name##_object = { \
+    name: #bench_name, \
+    fn: &__benchmark_##bench_name, \
+    manual_time: manual, \
+  }; \
+  static void __attribute__((constructor)) \
+      __benchmark_register_##bench_name(void) { \
+    __register_benchmark(&__benchmark_##bench_name##_object); \
+  } \
+  static void __benchmark_##bench_name( \
+      struct __benchmark_state __attribute__((unused)) *_state)
+
+#define BENCHMARK_ITERATIONS (_state->iterations)
+
+/* Excludes work from a harness-timed benchmark, e.g. per-iteration setup. */
+#define BENCHMARK_PAUSE() __benchmark_pause(_state)
+#define BENCHMARK_RESUME() __benchmark_resume(_state)
+
+/* Adds |ns| to the time of a BENCHMARK_MANUAL_TIME() run. */
+#define BENCHMARK_ADD_TIME(ns) (_state->manual_ns += (ns))
+
+#define BENCHMARK_NOW_NS() __benchmark_now_ns()
+
+/* Ends the benchmark body, reporting it as skipped or broken. */
+#define BENCHMARK_SKIP(...) do { \
+  __benchmark_set_status(_state, BENCHMARK_SKIPPED, __VA_ARGS__); \
+  return; \
+} while (0)
+#define BENCHMARK_ERROR(...) do { \
+  __benchmark_set_status(_state, BENCHMARK_FAILED, __VA_ARGS__); \
+  return; \
+} while (0)
+
+/* Keeps the compiler from discarding the computation of |value|. */
+#define BENCHMARK_DO_NOT_OPTIMIZE(value) \
+  __asm__ __volatile__("" : : "g"(value) : "memory")
+
+#define BENCHMARK_MAIN \
+  int main(int argc, char **argv) { \
+    return benchmark_harness_run(argc, argv); \
+  }
+
+enum {
+  BENCHMARK_OK = 0,
+  BENCHMARK_SKIPPED,
+  BENCHMARK_FAILED,
+};
+
+struct __benchmark_state {
+  unsigned long long iterations;
+  unsigned long long start_ns; /* 0 while paused or stopped */
+  unsigned long long elapsed_ns;
+  unsigned long long manual_ns;
+  int status;
+  char message[256];
+};
+
+struct __benchmark_metadata {
+  const char *name;
+  void (*fn)(struct __benchmark_state *);
+  int manual_time;
+  struct __benchmark_metadata *prev, *next;
+};
+
+/* Benchmarks may be spread over several files of one executable, so they
+ * all share this one list.
+ */
+struct __benchmark_metadata *__benchmark_list __attribute__((weak)) = NULL;
+
+static inline void __register_benchmark(struct __benchmark_metadata *b) {
+  /* Keep the list in definition order, like test_harness.h. */
+  b->next = NULL;
+  if (__benchmark_list == NULL) {
+    __benchmark_list = b;
+    b->prev = b;
+    return;
+  }
+  b->prev = __benchmark_list->prev;
+  b->prev->next = b;
+  __benchmark_list->prev = b;
+}
+
+static inline unsigned long long __benchmark_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void __benchmark_pause(struct __benchmark_state *s) {
+  if (s->start_ns) {
+    s->elapsed_ns += __benchmark_now_ns() - s->start_ns;
+    s->start_ns = 0;
+  }
+}
+
+static inline void __benchmark_resume(struct __benchmark_state *s) {
+  if (!s->start_ns)
+    s->start_ns = __benchmark_now_ns();
+}
+
+static inline void __attribute__((format(printf, 3, 4)))
+    __benchmark_set_status(struct __benchmark_state *s, int status,
+                           const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  s->status = status;
+  vsnprintf(s->message, sizeof(s->message), fmt, args);
+  va_end(args);
+}
+
+/* Runs |b| once for |iterations| and returns the time it took, or 0 with
+ * |s->status| set if it didn't complete.
+ */
+static inline unsigned long long __benchmark_run_once(
+    struct __benchmark_metadata *b, struct __benchmark_state *s,
+    unsigned long long iterations) {
+  memset(s, 0, sizeof(*s));
+  s->iterations = iterations;
+  __benchmark_resume(s);
+  b->fn(s);
+  __benchmark_pause(s);
+  if (s->status != BENCHMARK_OK)
+    return 0;
+  return b->manual_time ? s->manual_ns : s->elapsed_ns;
+}
+
+/* Body of the child process running |b|; returns its final status. */
+static inline int __benchmark_child(struct __benchmark_metadata *b,
+                                     FILE *out, unsigned long long min_ns,
+                                     unsigned int repetitions) {
+  struct __benchmark_state state;
+  unsigned long long iterations = 1, next, ns;
+  unsigned int i;
+
+  /* Find an iteration count that runs for at least |min_ns|. */
+  for (;;) {
+    ns = __benchmark_run_once(b, &state, iterations);
+    if (state.status != BENCHMARK_OK)
+      goto report;
+    if (ns >= min_ns || iterations >= BENCHMARK_MAX_ITERATIONS)
+      break;
+    /* Aim a bit past the target, growing by at most 10x per step. */
+    next = ns ? (unsigned long long)((double)iterations * min_ns * 1.4 / ns)
+              : iterations * 10;
+    if (next > iterations * 10)
+      next = iterations * 10;
+    if (next <= iterations)
+      next = iterations + 1;
+    if (next > BENCHMARK_MAX_ITERATIONS)
+      next = BENCHMARK_MAX_ITERATIONS;
+    iterations = next;
+  }
+  /* Also marks the end of calibration for the frequency sampler. */
+  fprintf(out, "# %s: %llu iterations\n", b->name, iterations);
+  fflush(out);
+
+  for (i = 0; i < repetitions; i++) {
+    ns = __benchmark_run_once(b, &state, iterations);
+    if (state.status != BENCHMARK_OK)
+      goto report;
+    fprintf(out, "sample %s %.3f %llu\n", b->name, (double)ns / iterations,
+            iterations);
+    fflush(out);
+  }
+  return BENCHMARK_OK;
+
+report:
+  fprintf(out, "%s %s %s\n",
+          state.status == BENCHMARK_SKIPPED ? "skip" : "error",
+          b->name, state.message);
+  fflush(out);
+  return state.status;
+}
+
+/* Copies the records a benchmark child writes to |in| over to |out|,
+ * adding the cycle estimate to its samples.
+ */
+static inline void __benchmark_copy_records(FILE *in, FILE *out,
+                                            struct __cpu_state_sampler *s) {
+  char *line = NULL, *ns;
+  size_t size = 0;
+  ssize_t len;
+  unsigned long long khz;
+
+  while ((len = getline(&line, &size, in)) > 0) {
+    khz = cpu_sampler_window_khz(s);
+    if (khz && strncmp(line, "sample ", 7) == 0 && line[len - 1] == '\n' &&
+        (ns = strchr(line + 7, ' ')) != NULL) {
+      line[len - 1] = '\0';
+      fprintf(out, "%s %.1f\n", line, strtod(ns + 1, NULL) * khz / 1e6);
+    } else {
+      fputs(line, out);
+    }
+  }
+  free(line);
+}
+
+/* Runs |b| in a child process, pinned to |cpu| unless that is negative.
+ * Returns 0 if it completed, 1 if it completed but was throttled, and -1 if
+ * it failed.
+ */
+static inline int __benchmark_run(struct __benchmark_metadata *b, FILE *out,
+                                  unsigned long long min_ns,
+                                  unsigned int repetitions, int cpu) {
+  struct __cpu_state_sampler sampler;
+  int status, throttled, fds[2];
+  FILE *in;
+  pid_t pid;
+
+  fflush(out);
+  if (pipe(fds) != 0) {
+    fprintf(out, "error %s pipe failed\n", b->name);
+    return -1;
+  }
+  cpu_sampler_init(&sampler);
+  pid = fork();
+  if (pid == 0) {
+    FILE *records = fdopen(fds[1], "w");
+    close(fds[0]);
+    if (cpu >= 0) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        fprintf(records, "error %s unable to pin to cpu %d\n", b->name, cpu);
+        fflush(records);
+        _exit(1);
+      }
+    }
+    _exit(__benchmark_child(b, records, min_ns, repetitions) ==
+          BENCHMARK_FAILED);
+  }
+  close(fds[1]);
+  if (pid < 0) {
+    close(fds[0]);
+    cpu_sampler_destroy(&sampler);
+    fprintf(out, "error %s fork failed\n", b->name);
+    return -1;
+  }
+  cpu_sampler_start(&sampler, pid);
+  in = fdopen(fds[0], "r");
+  __benchmark_copy_records(in, out, &sampler);
+  fclose(in);
+  if (waitpid(pid, &status, 0) != pid)
+    status = -1;
+  cpu_sampler_stop(&sampler);
+  throttled = cpu_sampler_report(&sampler, out, b->name);
+  cpu_sampler_destroy(&sampler);
+
+  if (status == -1) {
+    fprintf(out, "error %s waitpid failed\n", b->name);
+    return -1;
+  }
+  if (WIFSIGNALED(status)) {
+    fprintf(out, "error %s terminated by signal %d\n", b->name,
+            WTERMSIG(status));
+    return -1;
+  }
+  /* The child already reported BENCHMARK_ERROR()s itself. */
+  if (WIFEXITED(status) && WEXITSTATUS(status) == 1)
+    return -1;
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(out, "error %s exited with status %d\n", b->name,
+            WEXITSTATUS(status));
+    return -1;
+  }
+  return throttled;
+}
+
+/* Usage: [-f filter] [-r repetitions] [-t min_time_ms] [-c cpu] [-o output]
+ *        [-l]
+ * Only benchmarks whose name contains |filter| are run; -l just lists them.
+ */
+static inline int benchmark_harness_run(int argc, char **argv) {
+  struct __benchmark_metadata *b;
+  const char *filter = NULL, *out_path = NULL;
+  unsigned long long min_ns = BENCHMARK_DEFAULT_MIN_TIME_MS * 1000000ULL;
+  unsigned int repetitions = BENCHMARK_DEFAULT_REPETITIONS;
+  unsigned int count = 0, failed = 0, throttled = 0;
+  int opt, list = 0, cpu = -1, ret;
+  FILE *out = stdout;
+
+  while ((opt = getopt(argc, argv, "f:r:t:c:o:l")) != -1) {
+    switch (opt) {
+    case 'f':
+      filter = optarg;
+      break;
+    case 'r':
+      repetitions = atoi(optarg) > 0 ? atoi(optarg) : 1;
+      break;
+    case 't':
+      min_ns = strtoull(optarg, NULL, 10) * 1000000ULL;
+      break;
+    case 'c':
+      cpu = atoi(optarg);
+      break;
+    case 'o':
+      out_path = optarg;
+      break;
+    case 'l':
+      list = 1;
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-f filter] [-r repetitions] "
+              "[-t min_time_ms] [-c cpu] [-o output] [-l]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  if (out_path && (out = fopen(out_path, "we")) == NULL) {
+    perror(out_path);
+    return 2;
+  }
+  for (b = __benchmark_list; b; b = b->next) {
+    if (filter && !strstr(b->name, filter))
+      continue;
+    count++;
+    if (list) {
+      fprintf(out, "%s\n", b->name);
+      continue;
+    }
+    ret = __benchmark_run(b, out, min_ns, repetitions, cpu);
+    if (ret < 0)
+      failed++;
+    else if (ret > 0)
+      throttled++;
+  }
+  if (!list)
+    fprintf(out, "# %u benchmarks run, %u failed, %u throttled\n", count,
+            failed, throttled);
+  if (out != stdout)
+    fclose(out);
+  return failed ? 1 : 0;
+}
+
+#endif  /* BENCHMARK_HARNESS_H_ */
@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <link.h>
+
+#include "benchmark_harness.h"
+#include "code_regions.h"
+
+// Cost of asking whether our own code is executable, the question
+// NoExecutePermissionTest.isMyCodeExecutable() asks.
+BENCHMARK(code_region_lookup) {
+    uintptr_t address = (uintptr_t) __builtin_return_address(0);
+    uint32_t flags;
+    if (!findCodeRegion(address, &flags) || (flags & PF_X) == 0) {
+        BENCHMARK_ERROR("return address %p not in an executable segment", (void*) address);
+    }
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        BENCHMARK_DO_NOT_OPTIMIZE(findCodeRegion(address, &flags));
+    }
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cpu-features.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "auxv_cpu_features.h"
+#include "benchmark_harness.h"
+
+// Both backends detect features once per process, on first use. The
+// benchmark processes never call them themselves, so every iteration forks
+// and times the first call in a child that starts out cold.
+static long long timeFirstCall(void (*detect)()) {
+    unsigned long long ns = 0;
+    int fds[2];
+    int status;
+
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        unsigned long long start = BENCHMARK_NOW_NS();
+        detect();
+        ns = BENCHMARK_NOW_NS() - start;
+        _exit(write(fds[1], &ns, sizeof(ns)) == sizeof(ns) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t len = (pid > 0) ? TEMP_FAILURE_RETRY(read(fds[0], &ns, sizeof(ns))) : -1;
+    close(fds[0]);
+    if (pid > 0) {
+        TEMP_FAILURE_RETRY(waitpid(pid, &status, 0));
+    }
+    return (len == sizeof(ns)) ? (long long) ns : -1;
+}
+
+static void detectWithCpuFeatures() {
+    BENCHMARK_DO_NOT_OPTIMIZE(android_getCpuFamily());
+    BENCHMARK_DO_NOT_OPTIMIZE(android_getCpuFeatures());
+    BENCHMARK_DO_NOT_OPTIMIZE(android_getCpuCount());
+}
+
+static void detectWithAuxv() {
+    BENCHMARK_DO_NOT_OPTIMIZE(auxv_getCpuFamily());
+    BENCHMARK_DO_NOT_OPTIMIZE(auxv_getCpuFeatures());
+    BENCHMARK_DO_NOT_OPTIMIZE(auxv_getCpuCount());
+}
+
+BENCHMARK_MANUAL_TIME(cpufeatures_first_call) {
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        long long ns = timeFirstCall(detectWithCpuFeatures);
+        if (ns < 0) {
+            BENCHMARK_ERROR("unable to time the first call in a child");
+        }
+        BENCHMARK_ADD_TIME(ns);
+    }
+}
+
+BENCHMARK_MANUAL_TIME(auxv_first_call) {
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        long long ns = timeFirstCall(detectWithAuxv);
+        if (ns < 0) {
+            BENCHMARK_ERROR("unable to time the first call in a child");
+        }
+        BENCHMARK_ADD_TIME(ns);
+    }
+}
+
+// Later calls only read the cached results; kept as a baseline.
+BENCHMARK(auxv_cached_call) {
+    detectWithAuxv();
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        detectWithAuxv();
+    }
+}
@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * cpu_state_sampler.h: watches CPU frequency and thermal state while a
+ * benchmark child runs, for benchmark_harness.h.
+ *
+ * Before the child starts, the sampler notes every CPU's scaling_max_freq,
+ * each thermal cooling device's state and the hottest thermal zone.  While
+ * the child runs, a thread of the (otherwise idle) parent re-reads each
+ * CPU's scaling_cur_freq, which CPU the child is on and, less often, the
+ * thermal zones.  All files are opened once and re-read with pread(), so a
+ * tick costs a few small sysfs reads.  Afterwards the run counts as
+ * throttled if a CPU's frequency cap went down or a cooling device stepped
+ * up in between.
+ *
+ * The frequency of the CPU the child was seen on, averaged over a window,
+ * turns nanoseconds into an estimate of cycles.
+ */
+#ifndef CPU_STATE_SAMPLER_H_
+#define CPU_STATE_SAMPLER_H_
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Overridable to point at a fake tree when testing on a host. */
+#ifndef CPU_SAMPLER_SYSFS
+#define CPU_SAMPLER_SYSFS "/sys"
+#endif
+
+#define CPU_SAMPLER_PERIOD_MS 10
+/* Thermal sensors can be slow to read, so only look every few ticks. */
+#define CPU_SAMPLER_THERMAL_TICKS 10
+/* Stop looking for thermal_zoneN or cooling_deviceN after this many gaps. */
+#define CPU_SAMPLER_MAX_GAP 4
+
+struct __cpu_freq_stats {
+  int cur_fd;            /* scaling_cur_freq, or -1 */
+  int max_fd;            /* scaling_max_freq, or -1 */
+  long max_before;       /* scaling_max_freq before the run, kHz */
+  long min_khz, max_khz; /* observed over the run */
+  unsigned long long sum_khz, ticks;
+  unsigned long long child_ticks; /* ticks the child was on this CPU */
+};
+
+struct __cpu_state_sampler {
+  int ncpus;
+  struct __cpu_freq_stats *cpus;
+  int nzones;
+  int *zone_fds;
+  int ncooling;
+  int *cooling_fds;
+  long *cooling_before;
+  long temp_before, temp_peak, temp_after; /* hottest zone, m°C */
+
+  int stat_fd; /* /proc/<child>/stat */
+  pthread_t thread;
+  int running;
+  int stop;
+  pthread_mutex_t lock;
+  /* Frequency of the CPU the child was on, summed over ticks. */
+  unsigned long long child_khz_sum, child_ticks;
+  unsigned long long window_khz_sum, window_ticks;
+};
+
+/* Reads a decimal value from |fd| at offset 0, or returns -1. */
+static inline long __cpu_sampler_read_long(int fd) {
+  char buf[32];
+  ssize_t len;
+  if (fd < 0)
+    return -1;
+  len = pread(fd, buf, sizeof(buf) - 1, 0);
+  if (len <= 0)
+    return -1;
+  buf[len] = '\0';
+  return strtol(buf, NULL, 10);
+}
+
+static inline int __cpu_sampler_open(const char *fmt, int n) {
+  char path[128];
+  snprintf(path, sizeof(path), fmt, CPU_SAMPLER_SYSFS, n);
+  return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+/* Opens |fmt| for n = 0, 1, ... until CPU_SAMPLER_MAX_GAP numbers in a row
+ * are missing, returning the open fds (and their number in |count|).
+ */
+static inline int *__cpu_sampler_open_all(const char *fmt, int *count) {
+  int *fds = NULL;
+  int n, gap = 0, fd;
+  *count = 0;
+  for (n = 0; gap < CPU_SAMPLER_MAX_GAP; n++) {
+    fd = __cpu_sampler_open(fmt, n);
+    if (fd < 0) {
+      gap++;
+      continue;
+    }
+    gap = 0;
+    fds = (int *)realloc(fds, (*count + 1) * sizeof(*fds));
+    fds[(*count)++] = fd;
+  }
+  return fds;
+}
+
+static inline long __cpu_sampler_hottest(struct __cpu_state_sampler *s) {
+  long hottest = -1, temp;
+  int i;
+  for (i = 0; i < s->nzones; i++) {
+    temp = __cpu_sampler_read_long(s->zone_fds[i]);
+    if (temp > hottest)
+      hottest = temp;
+  }
+  return hottest;
+}
+
+/* Returns the CPU the process behind |stat_fd| last ran on, or -1. */
+static inline int __cpu_sampler_child_cpu(int stat_fd) {
+  char buf[1024];
+  char *p;
+  ssize_t len;
+  int field;
+  if (stat_fd < 0)
+    return -1;
+  len = pread(stat_fd, buf, sizeof(buf) - 1, 0);
+  if (len <= 0)
+    return -1;
+  buf[len] = '\0';
+  /* The command name may contain spaces; count fields after its ')'.
+   * "processor" is field 39, and the ')' ends field 2.
+   */
+  p = strrchr(buf, ')');
+  for (field = 2; p && field < 39; field++)
+    p = strchr(p + 1, ' ');
+  return p ? atoi(p + 1) : -1;
+}
+
+/* Opens the sysfs files and takes the "before" readings. */
+static inline void cpu_sampler_init(struct __cpu_state_sampler *s) {
+  int i;
+  memset(s, 0, sizeof(*s));
+  s->stat_fd = -1;
+  pthread_mutex_init(&s->lock, NULL);
+  s->ncpus = sysconf(_SC_NPROCESSORS_CONF);
+  if (s->ncpus < 1)
+    s->ncpus = 1;
+  s->cpus = (struct __cpu_freq_stats *)calloc(s->ncpus, sizeof(*s->cpus));
+  for (i = 0; i < s->ncpus; i++) {
+    s->cpus[i].cur_fd = __cpu_sampler_open(
+        "%s/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", i);
+    s->cpus[i].max_fd = __cpu_sampler_open(
+        "%s/devices/system/cpu/cpu%d/cpufreq/scaling_max_freq", i);
+    s->cpus[i].max_before = __cpu_sampler_read_long(s->cpus[i].max_fd);
+    s->cpus[i].min_khz = -1;
+    s->cpus[i].max_khz = -1;
+  }
+  s->zone_fds = __cpu_sampler_open_all(
+      "%s/class/thermal/thermal_zone%d/temp", &s->nzones);
+  s->cooling_fds = __cpu_sampler_open_all(
+      "%s/class/thermal/cooling_device%d/cur_state", &s->ncooling);
+  s->cooling_before = (long *)calloc(s->ncooling + 1, sizeof(long));
+  for (i = 0; i < s->ncooling; i++)
+    s->cooling_before[i] = __cpu_sampler_read_long(s->cooling_fds[i]);
+  s->temp_before = __cpu_sampler_hottest(s);
+  s->temp_peak = s->temp_before;
+  s->temp_after = -1;
+}
+
+static inline void __cpu_sampler_tick(struct __cpu_state_sampler *s,
+                                      unsigned long long tick) {
+  int i, cpu = __cpu_sampler_child_cpu(s->stat_fd);
+  long khz, temp;
+  pthread_mutex_lock(&s->lock);
+  for (i = 0; i < s->ncpus; i++) {
+    struct __cpu_freq_stats *c = &s->cpus[i];
+    if ((khz = __cpu_sampler_read_long(c->cur_fd)) <= 0)
+      continue;
+    if (c->min_khz < 0 || khz < c->min_khz)
+      c->min_khz = khz;
+    if (khz > c->max_khz)
+      c->max_khz = khz;
+    c->sum_khz += khz;
+    c->ticks++;
+    if (i == cpu) {
+      c->child_ticks++;
+      s->child_khz_sum += khz;
+      s->child_ticks++;
+    }
+  }
+  if (tick % CPU_SAMPLER_THERMAL_TICKS == 0 &&
+      (temp = __cpu_sampler_hottest(s)) > s->temp_peak)
+    s->temp_peak = temp;
+  pthread_mutex_unlock(&s->lock);
+}
+
+static inline void *__cpu_sampler_thread(void *arg) {
+  struct __cpu_state_sampler *s = (struct __cpu_state_sampler *)arg;
+  struct timespec period = { 0, CPU_SAMPLER_PERIOD_MS * 1000000L };
+  unsigned long long tick = 0;
+  while (!__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE)) {
+    __cpu_sampler_tick(s, tick++);
+    nanosleep(&period, NULL);
+  }
+  return NULL;
+}
+
+/* Starts sampling while |pid| runs. */
+static inline void cpu_sampler_start(struct __cpu_state_sampler *s,
+                                     pid_t pid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+  s->stat_fd = open(path, O_RDONLY | O_CLOEXEC);
+  s->stop = 0;
+  s->running = pthread_create(&s->thread, NULL, __cpu_sampler_thread, s) == 0;
+}
+
+/* Returns the average frequency, in kHz, of the CPU the child was on since
+ * the last call, or 0 if it is unknown.
+ */
+static inline unsigned long long cpu_sampler_window_khz(
+    struct __cpu_state_sampler *s) {
+  unsigned long long khz = 0;
+  pthread_mutex_lock(&s->lock);
+  if (s->child_ticks > s->window_ticks)
+    khz = (s->child_khz_sum - s->window_khz_sum) /
+          (s->child_ticks - s->window_ticks);
+  s->window_khz_sum = s->child_khz_sum;
+  s->window_ticks = s->child_ticks;
+  pthread_mutex_unlock(&s->lock);
+  return khz;
+}
+
+/* Stops sampling and takes the "after" readings. */
+static inline void cpu_sampler_stop(struct __cpu_state_sampler *s) {
+  if (s->running) {
+    __atomic_store_n(&s->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(s->thread, NULL);
+    s->running = 0;
+  }
+  s->temp_after = __cpu_sampler_hottest(s);
+  if (s->temp_after > s->temp_peak)
+    s->temp_peak = s->temp_after;
+}
+
+/* Writes what was seen as records for benchmark |name| and returns whether
+ * the run was throttled.
+ */
+static inline int cpu_sampler_report(struct __cpu_state_sampler *s,
+                                     FILE *out, const char *name) {
+  int i, throttled = 0;
+  long now;
+  for (i = 0; i < s->ncpus; i++) {
+    struct __cpu_freq_stats *c = &s->cpus[i];
+    if (c->child_ticks)
+      fprintf(out, "cpufreq %s %d %ld %llu %ld %llu\n", name, i, c->min_khz,
+              c->sum_khz / c->ticks, c->max_khz, c->child_ticks);
+    now = __cpu_sampler_read_long(c->max_fd);
+    if (c->max_before > 0 && now > 0 && now < c->max_before) {
+      fprintf(out, "throttled %s cpu%d scaling_max_freq %ld -> %ld\n", name,
+              i, c->max_before, now);
+      throttled = 1;
+    }
+  }
+  for (i = 0; i < s->ncooling; i++) {
+    now = __cpu_sampler_read_long(s->cooling_fds[i]);
+    if (now > s->cooling_before[i]) {
+      fprintf(out, "throttled %s cooling_device%d %ld -> %ld\n", name, i,
+              s->cooling_before[i], now);
+      throttled = 1;
+    }
+  }
+  if (s->temp_before >= 0)
+    fprintf(out, "thermal %s %ld %ld %ld\n", name, s->temp_before,
+            s->temp_peak, s->temp_after);
+  return throttled;
+}
+
+static inline void cpu_sampler_destroy(struct __cpu_state_sampler *s) {
+  int i;
+  for (i = 0; i < s->ncpus; i++) {
+    if (s->cpus[i].cur_fd >= 0)
+      close(s->cpus[i].cur_fd);
+    if (s->cpus[i].max_fd >= 0)
+      close(s->cpus[i].max_fd);
+  }
+  for (i = 0; i < s->nzones; i++)
+    close(s->zone_fds[i]);
+  for (i = 0; i < s->ncooling; i++)
+    close(s->cooling_fds[i]);
+  if (s->stat_fd >= 0)
+    close(s->stat_fd);
+  free(s->cpus);
+  free(s->zone_fds);
+  free(s->cooling_fds);
+  free(s->cooling_before);
+  pthread_mutex_destroy(&s->lock);
+}
+
+#endif  /* CPU_STATE_SAMPLER_H_ */
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "benchmark_harness.h"
+#include "exec_mapping_monitor.h"
+
+// What the exec mapping monitor costs: nothing much for syscalls it doesn't
+// look at, a JSET more for mprotect without PROT_EXEC, and a round trip
+// through the supervisor thread for mprotect with it.
+
+enum Monitor {
+    UNMONITORED,
+    MONITORED,
+};
+
+// The body runs once per batch of iterations, and the monitor can only be
+// started once.
+static bool startMonitor(Monitor monitor) {
+    static bool started;
+    if (monitor == UNMONITORED || started) {
+        return true;
+    }
+    started = execMappingMonitorStart(NULL, NULL);
+    return started;
+}
+
+static void measureGetppid(struct __benchmark_state* _state, Monitor monitor) {
+    if (!startMonitor(monitor)) {
+        BENCHMARK_SKIP("unable to start the monitor: %s", strerror(errno));
+    }
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        BENCHMARK_DO_NOT_OPTIMIZE(syscall(__NR_getppid));
+    }
+}
+
+static void measureMprotect(struct __benchmark_state* _state, Monitor monitor, int prot) {
+    if (!startMonitor(monitor)) {
+        BENCHMARK_SKIP("unable to start the monitor: %s", strerror(errno));
+    }
+    size_t size = sysconf(_SC_PAGESIZE);
+    void* page = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (page == MAP_FAILED) {
+        BENCHMARK_ERROR("mmap: %s", strerror(errno));
+    }
+    uint64_t before = execMappingMonitorCount();
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        if (mprotect(page, size, prot) != 0) {
+            BENCHMARK_ERROR("mprotect: %s", strerror(errno));
+        }
+    }
+    uint64_t expected = monitor == MONITORED && (prot & PROT_EXEC) != 0 ?
+            BENCHMARK_ITERATIONS : 0;
+    if (execMappingMonitorCount() - before != expected) {
+        BENCHMARK_ERROR("%llu events, expected %llu",
+                        (unsigned long long) (execMappingMonitorCount() - before),
+                        (unsigned long long) expected);
+    }
+    munmap(page, size);
+}
+
+BENCHMARK(exec_monitor_getppid_unmonitored) {
+    measureGetppid(_state, UNMONITORED);
+}
+
+BENCHMARK(exec_monitor_getppid_monitored) {
+    measureGetppid(_state, MONITORED);
+}
+
+BENCHMARK(exec_monitor_mprotect_read_unmonitored) {
+    measureMprotect(_state, UNMONITORED, PROT_READ);
+}
+
+BENCHMARK(exec_monitor_mprotect_read_monitored) {
+    measureMprotect(_state, MONITORED, PROT_READ);
+}
+
+BENCHMARK(exec_monitor_mprotect_exec_unmonitored) {
+    measureMprotect(_state, UNMONITORED, PROT_READ | PROT_EXEC);
+}
+
+BENCHMARK(exec_monitor_mprotect_exec_monitored) {
+    measureMprotect(_state, MONITORED, PROT_READ | PROT_EXEC);
+}
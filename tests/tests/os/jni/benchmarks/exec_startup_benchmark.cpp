@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "benchmark_harness.h"
+#include "seccomp_sample_program.h"
+
+#ifndef PR_SET_NO_NEW_PRIVS
+#define PR_SET_NO_NEW_PRIVS 38
+#endif
+
+// What a sandboxed process pays to start: fork, then execve this
+// executable and have the dynamic linker load it, under no filter, under a
+// filter that allows everything, and under the sample policy. The helper
+// exits from a constructor, once loading is done.
+//
+// The sample policy refuses execve, and on x86 the syscall that sets up
+// thread-local storage, which no process starts without, so a prefix lets
+// those through before it. The rest of the prefix sends each of the
+// syscalls listed below on to the policy, except, in
+// exec_startup_sample_policy_skip_<class>, those of <class>. What that
+// saves over exec_startup_sample_policy is what the policy costs those
+// syscalls; the prefix costs the same either way for everything else.
+// "other" is every syscall not listed.
+//
+// A SIGSYS handler doesn't survive execve, so the sample policy's TRAPs,
+// such as the one for rseq, which C libraries register at startup, return
+// ENOSYS instead here.
+
+#define HELPER_ENV "CTS_OS_EXEC_STARTUP_HELPER"
+
+// Largest filter built here, in instructions; the sample policy has a few
+// hundred.
+#define MAX_FILTER 1024
+
+static void __attribute__((constructor)) exitIfHelper() {
+    if (getenv(HELPER_ENV) != NULL) {
+        _exit(0);
+    }
+}
+
+enum SyscallClass {
+    CLASS_OPEN,
+    CLASS_STAT,
+    CLASS_MMAP,
+    CLASS_MPROTECT,
+    CLASS_READ,
+    CLASS_CLOSE,
+    CLASS_OTHER,
+    CLASS_NONE,     // no class skips the policy
+    CLASS_STARTUP,  // always skips it
+};
+
+struct ClassSyscall {
+    SyscallClass syscallClass;
+    int nr;
+};
+
+static const ClassSyscall kClassSyscalls[] = {
+    { CLASS_STARTUP, __NR_execve },
+#ifdef __NR_arch_prctl
+    { CLASS_STARTUP, __NR_arch_prctl },
+#endif
+#ifdef __NR_set_thread_area
+    { CLASS_STARTUP, __NR_set_thread_area },
+#endif
+#ifdef __NR_open
+    { CLASS_OPEN, __NR_open },
+#endif
+    { CLASS_OPEN, __NR_openat },
+#ifdef __NR_stat
+    { CLASS_STAT, __NR_stat },
+#endif
+#ifdef __NR_stat64
+    { CLASS_STAT, __NR_stat64 },
+#endif
+#ifdef __NR_fstat
+    { CLASS_STAT, __NR_fstat },
+#endif
+#ifdef __NR_fstat64
+    { CLASS_STAT, __NR_fstat64 },
+#endif
+#ifdef __NR_newfstatat
+    { CLASS_STAT, __NR_newfstatat },
+#endif
+#ifdef __NR_fstatat64
+    { CLASS_STAT, __NR_fstatat64 },
+#endif
+#ifdef __NR_statx
+    { CLASS_STAT, __NR_statx },
+#endif
+#ifdef __NR_mmap
+    { CLASS_MMAP, __NR_mmap },
+#endif
+#ifdef __NR_mmap2
+    { CLASS_MMAP, __NR_mmap2 },
+#endif
+    { CLASS_MMAP, __NR_munmap },
+    { CLASS_MPROTECT, __NR_mprotect },
+    { CLASS_READ, __NR_read },
+    { CLASS_READ, __NR_pread64 },
+    { CLASS_CLOSE, __NR_close },
+};
+
+#define CLASS_SYSCALLS (sizeof(kClassSyscalls) / sizeof(kClassSyscalls[0]))
+
+// Copies the sample policy to |filter| at |offset|, with TRAP made
+// ERRNO(ENOSYS). Returns its length, or -1 if it doesn't fit.
+static int copySamplePolicy(struct sock_filter* filter, int offset) {
+    struct sock_fprog prog = GetTestSeccompFilterProgram();
+    if (prog.len == 0 || offset + prog.len > MAX_FILTER) {
+        return -1;
+    }
+    for (int i = 0; i < prog.len; i++) {
+        struct sock_filter insn = prog.filter[i];
+        if (insn.code == (BPF_RET | BPF_K) &&
+                (insn.k & SECCOMP_RET_ACTION) == SECCOMP_RET_TRAP) {
+            insn.k = SECCOMP_RET_ERRNO | ENOSYS;
+        }
+        filter[offset + i] = insn;
+    }
+    return prog.len;
+}
+
+// The sample policy behind the prefix described above, letting the
+// syscalls of |skipped| through without it. Returns its length, or -1.
+static int buildRoutedPolicy(struct sock_filter* filter, SyscallClass skipped) {
+    int count = CLASS_SYSCALLS;
+    int otherJump = count + 1;
+    int allow = count + 2;
+    int policy = count + 3;
+    filter[0] = (struct sock_filter)
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr));
+    for (int i = 0; i < count; i++) {
+        SyscallClass syscallClass = kClassSyscalls[i].syscallClass;
+        int target = syscallClass == skipped || syscallClass == CLASS_STARTUP ? allow : policy;
+        filter[1 + i] = (struct sock_filter)
+                BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t) kClassSyscalls[i].nr,
+                         (uint8_t) (target - (i + 2)), 0);
+    }
+    int otherTarget = skipped == CLASS_OTHER ? allow : policy;
+    filter[otherJump] = (struct sock_filter)
+            BPF_STMT(BPF_JMP | BPF_JA, (uint32_t) (otherTarget - (otherJump + 1)));
+    filter[allow] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+    int length = copySamplePolicy(filter, policy);
+    return length < 0 ? -1 : policy + length;
+}
+
+static char** gHelperEnvironment;
+
+static bool initHelperEnvironment() {
+    if (gHelperEnvironment != NULL) {
+        return true;
+    }
+    extern char** environ;
+    int count = 0;
+    while (environ[count] != NULL) {
+        count++;
+    }
+    char** envp = reinterpret_cast<char**>(malloc((count + 2) * sizeof(char*)));
+    if (envp == NULL) {
+        return false;
+    }
+    memcpy(envp, environ, count * sizeof(char*));
+    envp[count] = const_cast<char*>(HELPER_ENV "=1");
+    envp[count + 1] = NULL;
+    gHelperEnvironment = envp;
+    return true;
+}
+
+// Returns how long it took to start the helper under |filter|, or -1 if it
+// didn't exit cleanly.
+static long long timeStartup(const struct sock_fprog* filter) {
+    char helper[] = "/proc/self/exe";
+    char* argv[] = { helper, NULL };
+    unsigned long long start = BENCHMARK_NOW_NS();
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (filter != NULL && (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0 ||
+                prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, filter) != 0)) {
+            _exit(2);
+        }
+        execve(helper, argv, gHelperEnvironment);
+        _exit(3);
+    }
+    int status;
+    if (pid < 0 || TEMP_FAILURE_RETRY(waitpid(pid, &status, 0)) != pid ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return -1;
+    }
+    return BENCHMARK_NOW_NS() - start;
+}
+
+enum Filter {
+    NO_FILTER,
+    ALLOW_ALL,
+    SAMPLE_POLICY,
+};
+
+static void measureStartup(struct __benchmark_state* _state, Filter kind,
+                           SyscallClass skipped) {
+    static struct sock_filter filter[MAX_FILTER];
+    struct sock_fprog prog = { 0, filter };
+    if (kind == ALLOW_ALL) {
+        filter[0] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+        prog.len = 1;
+    } else if (kind == SAMPLE_POLICY) {
+        int length = buildRoutedPolicy(filter, skipped);
+        if (length < 0) {
+            BENCHMARK_SKIP("no sample policy for this architecture");
+        }
+        prog.len = length;
+    }
+    if (!initHelperEnvironment()) {
+        BENCHMARK_ERROR("out of memory");
+    }
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        long long ns = timeStartup(kind == NO_FILTER ? NULL : &prog);
+        if (ns < 0) {
+            BENCHMARK_ERROR("the helper didn't exit cleanly");
+        }
+        BENCHMARK_ADD_TIME(ns);
+    }
+}
+
+BENCHMARK_MANUAL_TIME(exec_startup_unfiltered) {
+    measureStartup(_state, NO_FILTER, CLASS_NONE);
+}
+
+BENCHMARK_MANUAL_TIME(exec_startup_allow_all) {
+    measureStartup(_state, ALLOW_ALL, CLASS_NONE);
+}
+
+BENCHMARK_MANUAL_TIME(exec_startup_sample_policy) {
+    measureStartup(_state, SAMPLE_POLICY, CLASS_NONE);
+}
+
+#define SKIP_BENCHMARK(name, syscallClass) \
+    BENCHMARK_MANUAL_TIME(exec_startup_sample_policy_skip_##name) { \
+        measureStartup(_state, SAMPLE_POLICY, syscallClass); \
+    }
+
+SKIP_BENCHMARK(open, CLASS_OPEN)
+SKIP_BENCHMARK(stat, CLASS_STAT)
+SKIP_BENCHMARK(mmap, CLASS_MMAP)
+SKIP_BENCHMARK(mprotect, CLASS_MPROTECT)
+SKIP_BENCHMARK(read, CLASS_READ)
+SKIP_BENCHMARK(close, CLASS_CLOSE)
+SKIP_BENCHMARK(other, CLASS_OTHER)
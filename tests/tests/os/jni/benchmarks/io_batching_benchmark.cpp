@@ -0,0 +1,325 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/seccomp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/ucontext.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "benchmark_harness.h"
+#include "seccomp_sample_program.h"
+
+#if defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+
+#ifndef PR_SET_NO_NEW_PRIVS
+#define PR_SET_NO_NEW_PRIVS 38
+#endif
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+// Small-block I/O on a tmpfs file and on a pipe, one syscall per block
+// against one syscall per IO_BATCH blocks, with and without the sample
+// policy from seccomp_sample_program.cpp. Under the policy every syscall
+// also runs the filter, so batching saves IO_BATCH - 1 filter runs for
+// every IO_BATCH blocks. Times are per block.
+//
+// The policy traps some of the batched calls (preadv, pwritev and io_uring
+// on x86_64, for instance). Here trapped calls fail with ENOSYS, and their
+// benchmarks are skipped.
+
+#define IO_BLOCK_SIZE 512
+#define IO_BATCH 64
+
+enum Method {
+    PER_CALL,    // pread() or write() on files, write() and read() on pipes
+    VECTORED,    // readv()/writev(), from the start of the file
+    POSITIONED,  // preadv()/pwritev()
+    IO_URING,    // IO_BATCH IORING_OP_READV/WRITEVs per io_uring_enter()
+};
+
+#if defined(__i386__)
+#define REG_RESULT REG_EAX
+#elif defined(__x86_64__)
+#define REG_RESULT REG_RAX
+#endif
+
+// Makes a trapped syscall return -ENOSYS instead of killing us.
+static void returnEnosys(int, siginfo_t*, void* context) {
+    ucontext_t* uc = reinterpret_cast<ucontext_t*>(context);
+#if defined(REG_RESULT)
+    uc->uc_mcontext.gregs[REG_RESULT] = -ENOSYS;
+#elif defined(__aarch64__)
+    uc->uc_mcontext.regs[0] = -ENOSYS;
+#elif defined(__arm__)
+    uc->uc_mcontext.arm_r0 = -ENOSYS;
+#endif
+}
+
+struct IoFixture {
+    int file;
+    int pipe[2];
+    char buffers[IO_BATCH][IO_BLOCK_SIZE];
+    struct iovec iov[IO_BATCH];
+};
+
+static IoFixture gFixture;
+
+// Sets up the file and the pipe, which the sample policy wouldn't let us
+// create, and then enters the sandbox if asked to. Each benchmark has a
+// process of its own, so this happens once per benchmark.
+static bool setUp(bool sandboxed) {
+    static bool done;
+    if (done) {
+        return true;
+    }
+    // A memfd lives in tmpfs; fall back to a temporary file without one.
+    gFixture.file = syscall(__NR_memfd_create, "io_batching", MFD_CLOEXEC);
+    if (gFixture.file < 0) {
+        FILE* file = tmpfile();
+        gFixture.file = (file != NULL) ? dup(fileno(file)) : -1;
+    }
+    if (gFixture.file < 0 || pipe(gFixture.pipe) != 0) {
+        return false;
+    }
+    for (int i = 0; i < IO_BATCH; i++) {
+        memset(gFixture.buffers[i], i, IO_BLOCK_SIZE);
+        gFixture.iov[i].iov_base = gFixture.buffers[i];
+        gFixture.iov[i].iov_len = IO_BLOCK_SIZE;
+    }
+    if (TEMP_FAILURE_RETRY(pwritev(gFixture.file, gFixture.iov, IO_BATCH, 0)) !=
+            IO_BATCH * IO_BLOCK_SIZE) {
+        return false;
+    }
+
+    if (sandboxed) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = returnEnosys;
+        action.sa_flags = SA_SIGINFO;
+        struct sock_fprog prog = GetTestSeccompFilterProgram();
+        if (prog.len == 0 || sigaction(SIGSYS, &action, NULL) != 0 ||
+                prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0 ||
+                prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) != 0) {
+            return false;
+        }
+    }
+    done = true;
+    return true;
+}
+
+#if defined(HAVE_IO_URING)
+struct Uring {
+    int fd;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    struct io_uring_sqe* sqes;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+};
+
+static bool setUpUring(Uring* ring) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = syscall(__NR_io_uring_setup, IO_BATCH, &params);
+    if (ring->fd < 0) {
+        return false;
+    }
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    char* sq = reinterpret_cast<char*>(mmap(NULL, sqSize, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ring->fd,
+                                            IORING_OFF_SQ_RING));
+    char* cq = reinterpret_cast<char*>(mmap(NULL, cqSize, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ring->fd,
+                                            IORING_OFF_CQ_RING));
+    void* sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                      IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+        return false;
+    }
+    ring->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring->sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    ring->sqes = reinterpret_cast<struct io_uring_sqe*>(sqes);
+    ring->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring->cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring->cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+// Reads or writes the whole file, a block per entry, with one syscall.
+static bool submitBatch(Uring* ring, bool write) {
+    unsigned tail = *ring->sqTail;
+    for (int i = 0; i < IO_BATCH; i++) {
+        unsigned index = (tail + i) & *ring->sqMask;
+        struct io_uring_sqe* sqe = &ring->sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = write ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe->fd = gFixture.file;
+        sqe->addr = (uintptr_t) &gFixture.iov[i];
+        sqe->len = 1;
+        sqe->off = (uint64_t) i * IO_BLOCK_SIZE;
+        ring->sqArray[index] = index;
+    }
+    __atomic_store_n(ring->sqTail, tail + IO_BATCH, __ATOMIC_RELEASE);
+    if (syscall(__NR_io_uring_enter, ring->fd, IO_BATCH, IO_BATCH, IORING_ENTER_GETEVENTS,
+                NULL, 0) != IO_BATCH) {
+        return false;
+    }
+    bool ok = true;
+    unsigned head = *ring->cqHead;
+    unsigned end = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    for (; head != end; head++) {
+        ok &= ring->cqes[head & *ring->cqMask].res == IO_BLOCK_SIZE;
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    return ok;
+}
+#endif  // HAVE_IO_URING
+
+static void fileIo(struct __benchmark_state* _state, bool write, Method method,
+                   bool sandboxed) {
+    if (!setUp(sandboxed)) {
+        BENCHMARK_ERROR("unable to set up: %s", strerror(errno));
+    }
+    int fd = gFixture.file;
+    ssize_t batchSize = IO_BATCH * IO_BLOCK_SIZE;
+#if defined(HAVE_IO_URING)
+    static Uring ring;
+    if (method == IO_URING && ring.sqes == NULL && !setUpUring(&ring)) {
+        if (errno == ENOSYS) {
+            BENCHMARK_SKIP(sandboxed ? "not allowed by the sample filter" :
+                                       "io_uring not available");
+        }
+        BENCHMARK_ERROR("io_uring: %s", strerror(errno));
+    }
+#else
+    if (method == IO_URING) {
+        BENCHMARK_SKIP("built without io_uring");
+    }
+#endif
+
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i += IO_BATCH) {
+        bool ok = true;
+        switch (method) {
+        case PER_CALL:
+            if (write) {
+                ok = lseek(fd, 0, SEEK_SET) == 0;
+            }
+            for (int j = 0; j < IO_BATCH && ok; j++) {
+                if (write) {
+                    ok = ::write(fd, gFixture.buffers[j], IO_BLOCK_SIZE) == IO_BLOCK_SIZE;
+                } else {
+                    ok = pread(fd, gFixture.buffers[j], IO_BLOCK_SIZE,
+                               (off_t) j * IO_BLOCK_SIZE) == IO_BLOCK_SIZE;
+                }
+            }
+            break;
+        case VECTORED:
+            ok = lseek(fd, 0, SEEK_SET) == 0 &&
+                    (write ? writev(fd, gFixture.iov, IO_BATCH) :
+                             readv(fd, gFixture.iov, IO_BATCH)) == batchSize;
+            break;
+        case POSITIONED:
+            ok = (write ? pwritev(fd, gFixture.iov, IO_BATCH, 0) :
+                          preadv(fd, gFixture.iov, IO_BATCH, 0)) == batchSize;
+            break;
+        case IO_URING:
+#if defined(HAVE_IO_URING)
+            ok = submitBatch(&ring, write);
+#endif
+            break;
+        }
+        if (!ok) {
+            if (errno == ENOSYS) {
+                BENCHMARK_SKIP("not allowed by the sample filter");
+            }
+            BENCHMARK_ERROR("I/O failed: %s", strerror(errno));
+        }
+    }
+}
+
+static void pipeIo(struct __benchmark_state* _state, Method method, bool sandboxed) {
+    if (!setUp(sandboxed)) {
+        BENCHMARK_ERROR("unable to set up: %s", strerror(errno));
+    }
+    int in = gFixture.pipe[0];
+    int out = gFixture.pipe[1];
+    ssize_t batchSize = IO_BATCH * IO_BLOCK_SIZE;
+
+    // A batch, IO_BATCH * IO_BLOCK_SIZE bytes, fits in the pipe's buffer.
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i += IO_BATCH) {
+        bool ok = true;
+        if (method == PER_CALL) {
+            for (int j = 0; j < IO_BATCH && ok; j++) {
+                ok = write(out, gFixture.buffers[j], IO_BLOCK_SIZE) == IO_BLOCK_SIZE &&
+                        read(in, gFixture.buffers[j], IO_BLOCK_SIZE) == IO_BLOCK_SIZE;
+            }
+        } else {
+            ok = writev(out, gFixture.iov, IO_BATCH) == batchSize &&
+                    readv(in, gFixture.iov, IO_BATCH) == batchSize;
+        }
+        if (!ok) {
+            BENCHMARK_ERROR("I/O failed: %s", strerror(errno));
+        }
+    }
+}
+
+#define FILE_IO_BENCHMARKS(bench_name, write, method) \
+    BENCHMARK(bench_name) { \
+        fileIo(_state, write, method, false); \
+    } \
+    BENCHMARK(bench_name##_sample_filter) { \
+        fileIo(_state, write, method, true); \
+    }
+
+#define PIPE_IO_BENCHMARKS(bench_name, method) \
+    BENCHMARK(bench_name) { \
+        pipeIo(_state, method, false); \
+    } \
+    BENCHMARK(bench_name##_sample_filter) { \
+        pipeIo(_state, method, true); \
+    }
+
+FILE_IO_BENCHMARKS(io_file_pread_512, false, PER_CALL)
+FILE_IO_BENCHMARKS(io_file_readv_512, false, VECTORED)
+FILE_IO_BENCHMARKS(io_file_preadv_512, false, POSITIONED)
+FILE_IO_BENCHMARKS(io_file_uring_read_512, false, IO_URING)
+FILE_IO_BENCHMARKS(io_file_write_512, true, PER_CALL)
+FILE_IO_BENCHMARKS(io_file_writev_512, true, VECTORED)
+FILE_IO_BENCHMARKS(io_file_pwritev_512, true, POSITIONED)
+FILE_IO_BENCHMARKS(io_file_uring_write_512, true, IO_URING)
+PIPE_IO_BENCHMARKS(io_pipe_write_read_512, PER_CALL)
+PIPE_IO_BENCHMARKS(io_pipe_writev_readv_512, VECTORED)
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <linux/seccomp.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "benchmark_harness.h"
+#include "seccomp_filter_chain.h"
+#include "seccomp_policy_query.h"
+#include "seccomp_sample_program.h"
+
+// What asking seccomp_policy_query.h costs under the sample policy, instead
+// of making the syscall and seeing:
+//
+//   policy_query_syscall          a syscall that doesn't depend on its
+//                                 arguments, answered from the cache
+//   policy_query_allows_cached    mmap, which does, with arguments asked
+//                                 about before
+//   policy_query_allows_uncached  mmap with new arguments each time, which
+//                                 runs the filter
+
+#ifdef __NR_mmap2
+#define MMAP_NR __NR_mmap2
+#else
+#define MMAP_NR __NR_mmap
+#endif
+
+// The body runs once per batch of iterations, and the filter can only be
+// installed once.
+static bool installPolicy() {
+    static bool installed;
+    if (!installed) {
+        struct sock_fprog prog = GetTestSeccompFilterProgram();
+        installed = prog.len != 0 && seccompFilterInstallRecorded(&prog);
+    }
+    return installed;
+}
+
+BENCHMARK(policy_query_syscall) {
+    if (!installPolicy()) {
+        BENCHMARK_SKIP("unable to install the sample policy: %s", strerror(errno));
+    }
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        BENCHMARK_DO_NOT_OPTIMIZE(seccompPolicyQuerySyscall(__NR_getrandom));
+    }
+}
+
+BENCHMARK(policy_query_allows_cached) {
+    if (!installPolicy()) {
+        BENCHMARK_SKIP("unable to install the sample policy: %s", strerror(errno));
+    }
+    uint64_t args[6] = { 0, 4096, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, (uint64_t) -1, 0 };
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        BENCHMARK_DO_NOT_OPTIMIZE(seccompPolicyAllows(MMAP_NR, args));
+    }
+}
+
+BENCHMARK(policy_query_allows_uncached) {
+    if (!installPolicy()) {
+        BENCHMARK_SKIP("unable to install the sample policy: %s", strerror(errno));
+    }
+    static uint64_t length;
+    uint64_t args[6] = { 0, 0, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, (uint64_t) -1, 0 };
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        args[1] = length += 4096;
+        BENCHMARK_DO_NOT_OPTIMIZE(seccompPolicyAllows(MMAP_NR, args));
+    }
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "benchmark_harness.h"
+#include "proc_maps.h"
+#include "proc_scanner.h"
+
+// Apps have thousands of mappings, and the text of /proc/self/maps grows
+// with every one of them. Each benchmark runs in its own process, so the
+// extra mappings only need to be made once and go away with it.
+static bool addMappings(int count) {
+    static bool added;
+    if (added) {
+        return true;
+    }
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    // Alternate the protection so that neighbouring mappings don't merge.
+    char* base = (char*) mmap(NULL, 2 * count * pageSize, PROT_READ,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        if (mprotect(base + 2 * i * pageSize, pageSize, PROT_NONE) != 0) {
+            return false;
+        }
+    }
+    added = true;
+    return true;
+}
+
+// The stack is listed near the end of /proc/self/maps, the worst case for
+// the text scanner.
+static void lookUpStack(struct __benchmark_state* _state, bool query) {
+    MapsEntry entry;
+    uintptr_t address = (uintptr_t) &entry;
+
+    if (query && findMappingWithQuery(address, &entry) < 0) {
+        BENCHMARK_SKIP("PROCMAP_QUERY not supported by this kernel");
+    }
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        if (query) {
+            BENCHMARK_DO_NOT_OPTIMIZE(findMappingWithQuery(address, &entry));
+        } else {
+            BENCHMARK_DO_NOT_OPTIMIZE(findMappingInText(address, &entry));
+        }
+    }
+}
+
+BENCHMARK(maps_query_lookup) {
+    lookUpStack(_state, true);
+}
+
+BENCHMARK(maps_text_lookup) {
+    lookUpStack(_state, false);
+}
+
+BENCHMARK(maps_query_lookup_10000_mappings) {
+    BENCHMARK_PAUSE();
+    if (!addMappings(10000)) {
+        BENCHMARK_ERROR("unable to create mappings");
+    }
+    BENCHMARK_RESUME();
+    lookUpStack(_state, true);
+}
+
+BENCHMARK(maps_text_lookup_10000_mappings) {
+    BENCHMARK_PAUSE();
+    if (!addMappings(10000)) {
+        BENCHMARK_ERROR("unable to create mappings");
+    }
+    BENCHMARK_RESUME();
+    lookUpStack(_state, false);
+}
+
+// Parsing every line of a large /proc/self/maps, the old way and with
+// ProcScanner.
+BENCHMARK(maps_parse_stdio_10000_mappings) {
+    BENCHMARK_PAUSE();
+    if (!addMappings(10000)) {
+        BENCHMARK_ERROR("unable to create mappings");
+    }
+    BENCHMARK_RESUME();
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        char line[1024];
+        uintptr_t sum = 0;
+        FILE* fp = fopen("/proc/self/maps", "re");
+        if (fp == NULL) {
+            BENCHMARK_ERROR("unable to open /proc/self/maps");
+        }
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            uintptr_t start;
+            uintptr_t end;
+            char permissions[10];
+            if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR " %9s ", &start, &end, permissions) == 3) {
+                sum += end - start;
+            }
+        }
+        fclose(fp);
+        BENCHMARK_DO_NOT_OPTIMIZE(sum);
+    }
+}
+
+BENCHMARK(maps_parse_scanner_10000_mappings) {
+    BENCHMARK_PAUSE();
+    if (!addMappings(10000)) {
+        BENCHMARK_ERROR("unable to create mappings");
+    }
+    BENCHMARK_RESUME();
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        ProcScanner scanner;
+        uint64_t sum = 0;
+        if (!procScannerOpen(&scanner, "/proc/self/maps")) {
+            BENCHMARK_ERROR("unable to open /proc/self/maps");
+        }
+        const char* line;
+        size_t length;
+        while ((line = procScannerNextLine(&scanner, &length)) != NULL) {
+            const char* p = line;
+            const char* end = line + length;
+            uint64_t start;
+            uint64_t stop;
+            if (procScannerParseHex(&p, end, &start) && p != end && *p++ == '-' &&
+                    procScannerParseHex(&p, end, &stop)) {
+                sum += stop - start;
+            }
+        }
+        procScannerClose(&scanner);
+        BENCHMARK_DO_NOT_OPTIMIZE(sum);
+    }
+}
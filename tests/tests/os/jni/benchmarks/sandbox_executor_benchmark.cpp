@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "benchmark_harness.h"
+#include "sandbox_executor.h"
+#include "seccomp_sample_program.h"
+
+// Jobs through a SandboxExecutor whose workers run in strict mode, against
+// the same jobs with workers under the sample policy from
+// seccomp_sample_program.cpp, and against running them in-process. A job
+// hashes 1 KiB of input.
+//
+// The latency benchmarks wait for each result before submitting the next
+// job, so every job rings both doorbells. The throughput benchmarks keep
+// every worker's queue full, so the doorbells are seldom needed.
+
+#define INPUT_SIZE 1024
+
+static uint32_t hashJob(const void* in, uint32_t inSize, void* out, uint32_t outCapacity) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(in);
+    // 64-bit FNV-1a.
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (uint32_t i = 0; i < inSize; i++) {
+        hash = (hash ^ p[i]) * 0x100000001b3ULL;
+    }
+    if (outCapacity < sizeof(hash)) {
+        return 0;
+    }
+    memcpy(out, &hash, sizeof(hash));
+    return sizeof(hash);
+}
+
+static uint8_t gInput[INPUT_SIZE];
+static uint64_t gExpected;
+
+// Each benchmark runs in its own process, so its executor is made once and
+// goes away with it.
+static SandboxExecutor* getExecutor(int workers, bool strict) {
+    static SandboxExecutor* executor;
+    if (executor == NULL) {
+        for (int i = 0; i < INPUT_SIZE; i++) {
+            gInput[i] = i * 7;
+        }
+        hashJob(gInput, INPUT_SIZE, &gExpected, sizeof(gExpected));
+        struct sock_fprog prog = GetTestSeccompFilterProgram();
+        executor = sandboxExecutorCreate(workers, hashJob, strict ? NULL : &prog);
+    }
+    return executor;
+}
+
+static bool receiveResult(SandboxExecutor* executor) {
+    uint64_t id;
+    uint64_t hash;
+    uint32_t size;
+    return sandboxExecutorReceive(executor, &id, &hash, sizeof(hash), &size) &&
+            size == sizeof(hash) && hash == gExpected;
+}
+
+static void measureLatency(struct __benchmark_state* _state, bool strict) {
+    if (!strict && GetTestSeccompFilterProgram().len == 0) {
+        BENCHMARK_SKIP("no sample filter for this architecture");
+    }
+    SandboxExecutor* executor = getExecutor(1, strict);
+    if (executor == NULL) {
+        BENCHMARK_ERROR("unable to start the worker");
+    }
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        if (!sandboxExecutorSubmit(executor, 0, i, gInput, INPUT_SIZE) ||
+                !receiveResult(executor)) {
+            BENCHMARK_ERROR("job %llu failed", i);
+        }
+    }
+}
+
+static void measureThroughput(struct __benchmark_state* _state, int workers, bool strict) {
+    if (!strict && GetTestSeccompFilterProgram().len == 0) {
+        BENCHMARK_SKIP("no sample filter for this architecture");
+    }
+    SandboxExecutor* executor = getExecutor(workers, strict);
+    if (executor == NULL) {
+        BENCHMARK_ERROR("unable to start the workers");
+    }
+    unsigned long long submitted = 0;
+    unsigned long long received = 0;
+    int worker = 0;
+    while (received < BENCHMARK_ITERATIONS) {
+        // Top up the queues, then take a result.
+        while (submitted < BENCHMARK_ITERATIONS &&
+                sandboxExecutorSubmit(executor, worker, submitted, gInput, INPUT_SIZE)) {
+            submitted++;
+            worker = (worker + 1) % workers;
+        }
+        if (!receiveResult(executor)) {
+            BENCHMARK_ERROR("job failed");
+        }
+        received++;
+    }
+}
+
+BENCHMARK(sandbox_job_inline) {
+    uint64_t hash;
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        hashJob(gInput, INPUT_SIZE, &hash, sizeof(hash));
+        BENCHMARK_DO_NOT_OPTIMIZE(hash);
+    }
+}
+
+BENCHMARK(sandbox_job_latency_strict) {
+    measureLatency(_state, true);
+}
+
+BENCHMARK(sandbox_job_latency_filter) {
+    measureLatency(_state, false);
+}
+
+BENCHMARK(sandbox_job_throughput_strict_1_worker) {
+    measureThroughput(_state, 1, true);
+}
+
+BENCHMARK(sandbox_job_throughput_filter_1_worker) {
+    measureThroughput(_state, 1, false);
+}
+
+BENCHMARK(sandbox_job_throughput_strict_4_workers) {
+    measureThroughput(_state, 4, true);
+}
+
+BENCHMARK(sandbox_job_throughput_filter_4_workers) {
+    measureThroughput(_state, 4, false);
+}
@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <linux/filter.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "benchmark_harness.h"
+#include "fd_passing.h"
+#include "seccomp_supervisor.h"
+
+#ifndef PR_SET_NO_NEW_PRIVS
+#define PR_SET_NO_NEW_PRIVS 38
+#endif
+
+#ifndef SECCOMP_SET_MODE_FILTER
+#define SECCOMP_SET_MODE_FILTER 1
+#endif
+
+// Notifications per second through one supervisor as the number of
+// supervised processes grows. Each process installs its own filter, with
+// its own listener, and the notified syscalls mirror TRACE_syscall and
+// TRACE_poke in seccomp_bpf_tests.c:
+//   getpid   redirected to getppid
+//   gettid   skipped, returning 1
+//   getppid  allowed to continue
+//   read     from POKE_FD pokes 0x1001 into gPoked, then continues
+
+#define POKE_FD 1000
+#define MAX_PROCESSES 256
+
+static const long kPokeValue = 0x1001;
+
+enum Operation {
+    REDIRECT,
+    SKIP,
+    CONTINUE,
+    POKE,
+};
+
+static long gPoked;
+
+static struct sock_filter gFilter[] = {
+    BPF_STMT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, nr)),
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_getpid, 3, 0),
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_gettid, 2, 0),
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_getppid, 1, 0),
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_read, 1, 2),
+    BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_USER_NOTIF),
+    BPF_STMT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, args[0])),
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, POKE_FD, 0, 1),
+    BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_USER_NOTIF),
+    BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+};
+
+static void handleNotification(int listener, const struct seccomp_notif* request,
+                               struct seccomp_notif_resp* response, void*) {
+    switch (request->data.nr) {
+    case __NR_getpid:
+        // The supervised processes are our children, so their getppid()
+        // is our getpid().
+        response->val = getpid();
+        break;
+    case __NR_gettid:
+        response->val = 1;
+        break;
+    case __NR_read:
+        if (!seccompNotifyWriteMemory(listener, request, (uintptr_t) &gPoked,
+                                      &kPokeValue, sizeof(kPokeValue))) {
+            response->error = -EIO;
+            break;
+        }
+        response->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+        break;
+    default:
+        response->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+        break;
+    }
+}
+
+// Installs the filter and hands its listener to the supervisor over
+// |socket|, then makes |count| notified syscalls once |start| is closed.
+static void __attribute__((noreturn)) runSupervised(int socket, int start, Operation operation,
+                                                    unsigned long long count) {
+    struct sock_fprog prog = { sizeof(gFilter) / sizeof(gFilter[0]), gFilter };
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0) {
+        _exit(1);
+    }
+    int listener = syscall(__NR_seccomp, SECCOMP_SET_MODE_FILTER,
+                           SECCOMP_FILTER_FLAG_NEW_LISTENER, &prog);
+    if (listener < 0 || !sendFd(socket, listener)) {
+        _exit(1);
+    }
+    close(listener);
+    char c;
+    TEMP_FAILURE_RETRY(read(start, &c, sizeof(c)));
+
+    pid_t parent = getppid();
+    bool ok = true;
+    for (unsigned long long i = 0; i < count; i++) {
+        switch (operation) {
+        case REDIRECT:
+            ok &= syscall(__NR_getpid) == parent;
+            break;
+        case SKIP:
+            ok &= syscall(__NR_gettid) == 1;
+            break;
+        case CONTINUE:
+            ok &= syscall(__NR_getppid) == parent;
+            break;
+        case POKE:
+            gPoked = 0;
+            ok &= syscall(__NR_read, POKE_FD, &c, 0) == -1 && errno == EBADF &&
+                    gPoked == kPokeValue;
+            break;
+        }
+    }
+    _exit(ok ? 0 : 2);
+}
+
+static void superviseProcesses(struct __benchmark_state* _state, int processes,
+                               Operation operation, int slowThreads) {
+    pid_t pids[MAX_PROCESSES];
+    int listeners[MAX_PROCESSES];
+    int started = 0;
+    int start[2];
+    int sv[2];
+    if (pipe(start) != 0) {
+        BENCHMARK_ERROR("pipe: %s", strerror(errno));
+    }
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) != 0) {
+        close(start[0]);
+        close(start[1]);
+        BENCHMARK_ERROR("socketpair: %s", strerror(errno));
+    }
+
+    // Share the iterations out among the processes.
+    unsigned long long each = BENCHMARK_ITERATIONS / processes;
+    unsigned long long extra = BENCHMARK_ITERATIONS % processes;
+    bool supported = true;
+    for (; supported && started < processes; started++) {
+        unsigned long long count = each + (started < (int) extra ? 1 : 0);
+        pids[started] = fork();
+        if (pids[started] == 0) {
+            close(start[1]);
+            close(sv[0]);
+            for (int i = 0; i < started; i++) {
+                close(listeners[i]);
+            }
+            runSupervised(sv[1], start[0], operation, count);
+        }
+        if (pids[started] < 0) {
+            break;
+        }
+        listeners[started] = receiveFd(sv[0]);
+        supported = listeners[started] >= 0;
+    }
+    close(start[0]);
+    close(sv[0]);
+    close(sv[1]);
+
+    // Start the supervisor once the processes are forked, so that none of
+    // them inherits its threads or its epoll set.
+    SeccompSupervisor* supervisor = supported ? seccompSupervisorCreate(slowThreads) : NULL;
+    bool added = supervisor != NULL;
+    for (int i = 0; i < started; i++) {
+        if (listeners[i] < 0) {
+            continue;
+        }
+        if (supervisor == NULL) {
+            close(listeners[i]);
+        } else {
+            added &= seccompSupervisorAdd(supervisor, listeners[i], handleNotification, NULL,
+                                          slowThreads > 0);
+        }
+    }
+
+    // Closing the pipe releases every process at once.
+    unsigned long long begin = BENCHMARK_NOW_NS();
+    close(start[1]);
+    bool ok = true;
+    for (int i = 0; i < started; i++) {
+        int status;
+        ok &= TEMP_FAILURE_RETRY(waitpid(pids[i], &status, 0)) == pids[i] &&
+                WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    BENCHMARK_ADD_TIME(BENCHMARK_NOW_NS() - begin);
+    if (supervisor != NULL) {
+        seccompSupervisorDestroy(supervisor);
+    }
+
+    if (!supported) {
+        BENCHMARK_SKIP("seccomp user notification not supported");
+    }
+    if (!added) {
+        BENCHMARK_ERROR("unable to supervise the processes");
+    }
+    if (!ok) {
+        BENCHMARK_ERROR("a supervised process got a wrong answer");
+    }
+}
+
+#define SUPERVISOR_BENCHMARK(bench_name, processes, operation, slowThreads) \
+    BENCHMARK_MANUAL_TIME(bench_name) { \
+        superviseProcesses(_state, processes, operation, slowThreads); \
+    }
+
+SUPERVISOR_BENCHMARK(supervisor_skip_1_process, 1, SKIP, 0)
+SUPERVISOR_BENCHMARK(supervisor_skip_4_processes, 4, SKIP, 0)
+SUPERVISOR_BENCHMARK(supervisor_skip_16_processes, 16, SKIP, 0)
+SUPERVISOR_BENCHMARK(supervisor_skip_64_processes, 64, SKIP, 0)
+SUPERVISOR_BENCHMARK(supervisor_skip_256_processes, 256, SKIP, 0)
+SUPERVISOR_BENCHMARK(supervisor_redirect_1_process, 1, REDIRECT, 0)
+SUPERVISOR_BENCHMARK(supervisor_redirect_64_processes, 64, REDIRECT, 0)
+SUPERVISOR_BENCHMARK(supervisor_continue_1_process, 1, CONTINUE, 0)
+SUPERVISOR_BENCHMARK(supervisor_continue_64_processes, 64, CONTINUE, 0)
+SUPERVISOR_BENCHMARK(supervisor_poke_1_process, 1, POKE, 0)
+SUPERVISOR_BENCHMARK(supervisor_poke_64_processes, 64, POKE, 0)
+// Pokes open /proc/pid/mem, so they can also go to the slow threads.
+SUPERVISOR_BENCHMARK(supervisor_poke_64_processes_4_slow_threads, 64, POKE, 4)
@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <linux/filter.h>
+#include <linux/futex.h>
+#include <linux/seccomp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "benchmark_harness.h"
+#include "seccomp_sample_program.h"
+
+#ifndef PR_SET_NO_NEW_PRIVS
+#define PR_SET_NO_NEW_PRIVS 38
+#endif
+
+#ifndef PTRACE_O_TRACESECCOMP
+#define PTRACE_O_TRACESECCOMP 0x00000080
+#endif
+
+#ifndef PTRACE_O_EXITKILL
+#define PTRACE_O_EXITKILL 0x00100000
+#endif
+
+#ifndef PTRACE_EVENT_SECCOMP
+#define PTRACE_EVENT_SECCOMP 7
+#endif
+
+// How long a thread that asks for a 1 ms timeout actually sleeps, under
+// the seccomp configurations an app thread might run in. The samples are
+// the whole time slept; the wakeup latency is whatever exceeds 1 ms.
+//
+// The interrupted configurations follow syscall_restart in
+// seccomp_bpf_tests.c: the sleeper is traced, and another thread signals
+// it halfway through each sleep. The tracer suppresses the signal, so the
+// kernel restarts nanosleep, clock_nanosleep and futex with
+// restart_syscall, which a filter may then send to the tracer as well.
+// (epoll_wait fails with EINTR instead, and is waited again for the rest.)
+
+#define SLEEP_NS 1000000LL
+
+enum SleepKind {
+    NANOSLEEP,
+    CLOCK_NANOSLEEP,
+    FUTEX,
+    EPOLL,
+};
+
+enum Config {
+    UNFILTERED,
+    SAMPLE_FILTER,        // the policy from seccomp_sample_program.cpp
+    TRACE_RESTART,        // traced, with restart_syscall sent to the tracer
+    INTERRUPTED,          // traced and interrupted, without a filter
+    INTERRUPTED_TRACE_RESTART,
+};
+
+static struct sock_filter gTraceRestartFilter[] = {
+    BPF_STMT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, nr)),
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_restart_syscall, 0, 1),
+    BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_TRACE),
+    BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+};
+
+static int gSleepSequence;  // futex the interrupting thread waits on
+
+static void toTimespec(long long ns, struct timespec* ts) {
+    ts->tv_sec = ns / 1000000000LL;
+    ts->tv_nsec = ns % 1000000000LL;
+}
+
+static long long remainingNs(unsigned long long start) {
+    return SLEEP_NS - (long long) (BENCHMARK_NOW_NS() - start);
+}
+
+// Sleeps for SLEEP_NS, picking up after any EINTR the way callers do.
+static bool sleepOnce(SleepKind kind, int epollFd) {
+    unsigned long long start = BENCHMARK_NOW_NS();
+    struct timespec ts;
+    toTimespec(SLEEP_NS, &ts);
+    for (;;) {
+        long rc;
+        switch (kind) {
+        case NANOSLEEP:
+            rc = syscall(__NR_nanosleep, &ts, &ts);
+            break;
+        case CLOCK_NANOSLEEP:
+            rc = syscall(__NR_clock_nanosleep, CLOCK_MONOTONIC, 0, &ts, &ts);
+            break;
+        case FUTEX: {
+            int word = 0;
+            rc = syscall(__NR_futex, &word, FUTEX_WAIT_PRIVATE, 0, &ts, NULL, 0);
+            if (rc == -1 && errno == ETIMEDOUT) {
+                return true;
+            }
+            toTimespec(remainingNs(start), &ts);
+            break;
+        }
+        case EPOLL: {
+            struct epoll_event event;
+            long long ns = remainingNs(start);
+            rc = epoll_wait(epollFd, &event, 1, ns > 0 ? (ns + 999999) / 1000000 : 0);
+            break;
+        }
+        }
+        if (rc != -1 || errno != EINTR) {
+            return rc != -1;
+        }
+        if (remainingNs(start) <= 0) {
+            return true;
+        }
+    }
+}
+
+// Signals the sleeper halfway through each of its sleeps.
+static void* interruptSleeps(void*) {
+    pid_t pid = getpid();
+    int seen = 0;
+    for (;;) {
+        syscall(__NR_futex, &gSleepSequence, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+        int sequence = __atomic_load_n(&gSleepSequence, __ATOMIC_ACQUIRE);
+        if (sequence == seen) {
+            continue;
+        }
+        seen = sequence;
+        struct timespec ts;
+        toTimespec(SLEEP_NS / 2, &ts);
+        syscall(__NR_nanosleep, &ts, NULL);
+        syscall(__NR_tgkill, pid, pid, SIGUSR1);
+    }
+    return NULL;
+}
+
+// Runs in the traced or untraced child; writes the total time slept to
+// |resultFd|.
+static void __attribute__((noreturn)) runSleeper(int resultFd, SleepKind kind, Config config,
+                                                 unsigned long long iterations) {
+    bool traced = config >= TRACE_RESTART;
+    bool interrupted = config == INTERRUPTED || config == INTERRUPTED_TRACE_RESTART;
+    if (traced && (ptrace(PTRACE_TRACEME, 0, NULL, NULL) != 0 || raise(SIGSTOP) != 0)) {
+        _exit(1);
+    }
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+    struct sock_fprog prog;
+    if (config == SAMPLE_FILTER) {
+        prog = GetTestSeccompFilterProgram();
+    } else {
+        prog.len = sizeof(gTraceRestartFilter) / sizeof(gTraceRestartFilter[0]);
+        prog.filter = gTraceRestartFilter;
+    }
+    if ((config == SAMPLE_FILTER || config == TRACE_RESTART ||
+            config == INTERRUPTED_TRACE_RESTART) &&
+            (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0 ||
+             prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) != 0)) {
+        _exit(1);
+    }
+    pthread_t thread;
+    if (interrupted && pthread_create(&thread, NULL, interruptSleeps, NULL) != 0) {
+        _exit(1);
+    }
+
+    unsigned long long total = 0;
+    for (unsigned long long i = 0; i < iterations; i++) {
+        if (interrupted) {
+            __atomic_add_fetch(&gSleepSequence, 1, __ATOMIC_RELEASE);
+            syscall(__NR_futex, &gSleepSequence, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+        }
+        unsigned long long start = BENCHMARK_NOW_NS();
+        if (!sleepOnce(kind, epollFd)) {
+            _exit(1);
+        }
+        total += BENCHMARK_NOW_NS() - start;
+    }
+    _exit(write(resultFd, &total, sizeof(total)) == sizeof(total) ? 0 : 1);
+}
+
+static void measureSleep(struct __benchmark_state* _state, SleepKind kind, Config config) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        BENCHMARK_ERROR("pipe: %s", strerror(errno));
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        runSleeper(fds[1], kind, config, BENCHMARK_ITERATIONS);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        BENCHMARK_ERROR("fork: %s", strerror(errno));
+    }
+
+    // Play tracer until the sleeper exits: let seccomp stops continue, and
+    // swallow the interruptions so that the sleeps are restarted.
+    bool traced = config >= TRACE_RESTART;
+    bool attached = !traced;
+    int status;
+    while (TEMP_FAILURE_RETRY(waitpid(pid, &status, 0)) == pid && WIFSTOPPED(status)) {
+        int signal = WSTOPSIG(status);
+        if (!attached) {
+            ptrace(PTRACE_SETOPTIONS, pid, NULL, PTRACE_O_TRACESECCOMP | PTRACE_O_EXITKILL);
+            attached = true;
+            signal = 0;
+        } else if (signal == SIGUSR1 || (status >> 16) == PTRACE_EVENT_SECCOMP) {
+            signal = 0;
+        }
+        ptrace(PTRACE_CONT, pid, NULL, (void*) (long) signal);
+    }
+
+    unsigned long long total;
+    bool ok = TEMP_FAILURE_RETRY(read(fds[0], &total, sizeof(total))) == sizeof(total);
+    close(fds[0]);
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGSYS && config == SAMPLE_FILTER) {
+        BENCHMARK_SKIP("the sample filter doesn't allow this syscall");
+    }
+    if (!ok) {
+        BENCHMARK_ERROR("sleeper failed with status %#x", status);
+    }
+    BENCHMARK_ADD_TIME(total);
+}
+
+#define SLEEP_BENCHMARKS(kind_name, kind) \
+    BENCHMARK_MANUAL_TIME(sleep_##kind_name##_1ms) { \
+        measureSleep(_state, kind, UNFILTERED); \
+    } \
+    BENCHMARK_MANUAL_TIME(sleep_##kind_name##_1ms_sample_filter) { \
+        measureSleep(_state, kind, SAMPLE_FILTER); \
+    } \
+    BENCHMARK_MANUAL_TIME(sleep_##kind_name##_1ms_trace_restart) { \
+        measureSleep(_state, kind, TRACE_RESTART); \
+    } \
+    BENCHMARK_MANUAL_TIME(sleep_##kind_name##_1ms_interrupted) { \
+        measureSleep(_state, kind, INTERRUPTED); \
+    } \
+    BENCHMARK_MANUAL_TIME(sleep_##kind_name##_1ms_interrupted_trace_restart) { \
+        measureSleep(_state, kind, INTERRUPTED_TRACE_RESTART); \
+    }
+
+SLEEP_BENCHMARKS(nanosleep, NANOSLEEP)
+SLEEP_BENCHMARKS(clock_nanosleep, CLOCK_NANOSLEEP)
+SLEEP_BENCHMARKS(futex, FUTEX)
+SLEEP_BENCHMARKS(epoll, EPOLL)
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "benchmark_harness.h"
+#include "syscall_resumption.h"
+
+// What a trapped syscall costs per call, from the trap through the SIGSYS
+// handler to the caller carrying on, with each bypass in
+// syscall_resumption.h:
+//
+//   syscall_trap_*_ip    a seccomp filter that lets the thunk's syscall
+//                        instruction through
+//   syscall_trap_*_flag  syscall user dispatch and a thread-local flag
+//
+// getppid is trapped, and either emulated, which is the cost of the trap
+// and the handler alone, or resumed, which makes it for real as well.
+// syscall_untrapped_* is getpid, which isn't listed: a few filter
+// instructions for one bypass, and a full trap for the other.
+
+enum Resumption {
+    EMULATE,
+    RESUME,
+};
+
+static pid_t gParent;
+static Resumption gResumption;
+
+static bool emulateGetppid(const TrappedSyscall* call, long* result) {
+    if (gResumption != EMULATE || call->nr != __NR_getppid) {
+        return false;
+    }
+    *result = gParent;
+    return true;
+}
+
+// The body runs once per batch of iterations, and trapping can only be
+// started once.
+static bool startTrapping(SyscallBypass bypass, Resumption resumption) {
+    static bool started;
+    if (started) {
+        return true;
+    }
+    gParent = getppid();
+    gResumption = resumption;
+    int trapped[] = { __NR_getppid };
+    started = syscallResumptionStart(bypass, trapped, 1, emulateGetppid);
+    return started;
+}
+
+static void measureTrap(struct __benchmark_state* _state, SyscallBypass bypass,
+                        Resumption resumption, int nr) {
+    if (!startTrapping(bypass, resumption)) {
+        BENCHMARK_SKIP("unable to trap syscalls: %s", strerror(errno));
+    }
+    long expected = nr == __NR_getppid ? gParent : getpid();
+    uint64_t before = syscallResumptionCount();
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        if (syscall(nr) != expected) {
+            BENCHMARK_ERROR("syscall %d returned the wrong value", nr);
+        }
+    }
+    unsigned long long trapped = syscallResumptionCount() - before;
+    unsigned long long expectedTraps =
+            nr == __NR_getppid || bypass == SYSCALL_BYPASS_THREAD_FLAG ? BENCHMARK_ITERATIONS : 0;
+    if (trapped != expectedTraps) {
+        BENCHMARK_ERROR("%llu syscalls trapped, expected %llu", trapped, expectedTraps);
+    }
+}
+
+BENCHMARK(syscall_getppid) {
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        BENCHMARK_DO_NOT_OPTIMIZE(syscall(__NR_getppid));
+    }
+}
+
+BENCHMARK(syscall_trap_emulate_ip) {
+    measureTrap(_state, SYSCALL_BYPASS_INSTRUCTION_POINTER, EMULATE, __NR_getppid);
+}
+
+BENCHMARK(syscall_trap_resume_ip) {
+    measureTrap(_state, SYSCALL_BYPASS_INSTRUCTION_POINTER, RESUME, __NR_getppid);
+}
+
+BENCHMARK(syscall_untrapped_ip) {
+    measureTrap(_state, SYSCALL_BYPASS_INSTRUCTION_POINTER, RESUME, __NR_getpid);
+}
+
+BENCHMARK(syscall_trap_emulate_flag) {
+    measureTrap(_state, SYSCALL_BYPASS_THREAD_FLAG, EMULATE, __NR_getppid);
+}
+
+BENCHMARK(syscall_trap_resume_flag) {
+    measureTrap(_state, SYSCALL_BYPASS_THREAD_FLAG, RESUME, __NR_getppid);
+}
+
+BENCHMARK(syscall_untrapped_flag) {
+    measureTrap(_state, SYSCALL_BYPASS_THREAD_FLAG, RESUME, __NR_getpid);
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <linux/seccomp.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "benchmark_harness.h"
+#include "seccomp_sample_program.h"
+#include "seccomp_worker_pool.h"
+
+#ifndef PR_SET_NO_NEW_PRIVS
+#define PR_SET_NO_NEW_PRIVS 38
+#endif
+
+// Worker startup latency: the time from asking for a sandboxed worker to
+// hearing from it, under the sample policy from seccomp_sample_program.cpp.
+
+static void reportReady(int fd, void*) {
+    char ready = 0;
+    TEMP_FAILURE_RETRY(write(fd, &ready, sizeof(ready)));
+}
+
+static bool waitReady(int fd) {
+    char ready;
+    return TEMP_FAILURE_RETRY(read(fd, &ready, sizeof(ready))) == sizeof(ready);
+}
+
+// Forks a worker that installs |filter| itself, if there is one.
+static void spawnDirect(struct __benchmark_state* _state, const struct sock_fprog* filter) {
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+            BENCHMARK_ERROR("socketpair: %s", strerror(errno));
+        }
+        unsigned long long start = BENCHMARK_NOW_NS();
+        pid_t pid = fork();
+        if (pid == 0) {
+            if (filter != NULL && (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0 ||
+                    prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, filter) != 0)) {
+                _exit(1);
+            }
+            reportReady(sv[1], NULL);
+            _exit(0);
+        }
+        bool ready = pid > 0 && waitReady(sv[0]);
+        BENCHMARK_ADD_TIME(BENCHMARK_NOW_NS() - start);
+        close(sv[0]);
+        close(sv[1]);
+        if (pid > 0) {
+            TEMP_FAILURE_RETRY(waitpid(pid, NULL, 0));
+        }
+        if (!ready) {
+            BENCHMARK_ERROR("worker didn't start");
+        }
+    }
+}
+
+// Unsandboxed, for the cost of fork() alone.
+BENCHMARK_MANUAL_TIME(worker_spawn_unfiltered) {
+    spawnDirect(_state, NULL);
+}
+
+// Every worker sets PR_SET_NO_NEW_PRIVS and installs the filter.
+BENCHMARK_MANUAL_TIME(worker_spawn_install_filter) {
+    struct sock_fprog prog = GetTestSeccompFilterProgram();
+    if (prog.len == 0) {
+        BENCHMARK_SKIP("no sample filter for this architecture");
+    }
+    spawnDirect(_state, &prog);
+}
+
+// Workers forked from a template that installed the filter once.
+BENCHMARK_MANUAL_TIME(worker_spawn_from_template) {
+    // Each benchmark runs in its own process, so the template is started
+    // once and goes away with it.
+    static SeccompWorkerPool pool;
+    static bool started;
+    if (!started) {
+        struct sock_fprog prog = GetTestSeccompFilterProgram();
+        if (prog.len == 0) {
+            BENCHMARK_SKIP("no sample filter for this architecture");
+        }
+        if (!seccompWorkerPoolStart(&pool, &prog, reportReady, NULL)) {
+            BENCHMARK_ERROR("unable to start the template process");
+        }
+        started = true;
+    }
+    for (unsigned long long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        int fd;
+        unsigned long long start = BENCHMARK_NOW_NS();
+        bool ready = seccompWorkerPoolSpawn(&pool, &fd) > 0 && waitReady(fd);
+        BENCHMARK_ADD_TIME(BENCHMARK_NOW_NS() - start);
+        if (!ready) {
+            BENCHMARK_ERROR("worker didn't start");
+        }
+        close(fd);
+    }
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "code_regions.h"
+
+#include <link.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct CodeRegion {
+    uintptr_t start;
+    uintptr_t end;
+    uint32_t flags;
+};
+
+// Identifies a set of loaded objects: the dynamic linker's load and unload
+// counters where dl_phdr_info has them, otherwise the number of objects and
+// the sum of their load biases, which also changes when one object is
+// swapped for another.
+struct ObjectSet {
+    unsigned long long count;
+    unsigned long long biasSum;
+};
+
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+static CodeRegion* gRegions;
+static size_t gRegionCount;
+static size_t gRegionCapacity;
+static ObjectSet gIndexedObjects;
+static bool gIndexed;
+
+static int identifyObject(struct dl_phdr_info* info, size_t size, void* data) {
+    ObjectSet* set = reinterpret_cast<ObjectSet*>(data);
+#if defined(__GLIBC__) || (defined(__BIONIC__) && __ANDROID_API__ >= 30)
+    if (size >= offsetof(struct dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs)) {
+        set->count = info->dlpi_adds;
+        set->biasSum = info->dlpi_subs;
+        return 1;  // The first object is enough.
+    }
+#else
+    (void) size;
+#endif
+    set->count++;
+    set->biasSum += info->dlpi_addr;
+    return 0;
+}
+
+static int addObjectSegments(struct dl_phdr_info* info, size_t, void*) {
+    uintptr_t pageMask = ~(uintptr_t) (sysconf(_SC_PAGESIZE) - 1);
+
+    for (int i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr)* phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type != PT_LOAD || phdr->p_memsz == 0) {
+            continue;
+        }
+        if (gRegionCount == gRegionCapacity) {
+            size_t capacity = gRegionCapacity ? gRegionCapacity * 2 : 64;
+            CodeRegion* regions = reinterpret_cast<CodeRegion*>(
+                    realloc(gRegions, capacity * sizeof(CodeRegion)));
+            if (regions == NULL) {
+                return 1;
+            }
+            gRegions = regions;
+            gRegionCapacity = capacity;
+        }
+        // The kernel maps whole pages, so that is what the address space
+        // really looks like.
+        uintptr_t start = info->dlpi_addr + phdr->p_vaddr;
+        CodeRegion* region = &gRegions[gRegionCount++];
+        region->start = start & pageMask;
+        region->end = (start + phdr->p_memsz + ~pageMask) & pageMask;
+        region->flags = phdr->p_flags;
+    }
+    return 0;
+}
+
+static int compareRegions(const void* lhs, const void* rhs) {
+    uintptr_t a = reinterpret_cast<const CodeRegion*>(lhs)->start;
+    uintptr_t b = reinterpret_cast<const CodeRegion*>(rhs)->start;
+    return (a < b) ? -1 : (a > b);
+}
+
+// Rebuilds the index if objects were loaded or unloaded since it was built.
+// Called with gLock held.
+static bool refreshIndexLocked() {
+    ObjectSet current = { 0, 0 };
+    dl_iterate_phdr(identifyObject, &current);
+    if (gIndexed && current.count == gIndexedObjects.count &&
+            current.biasSum == gIndexedObjects.biasSum) {
+        return true;
+    }
+
+    // An object loaded from here on makes the next lookup rebuild again.
+    gRegionCount = 0;
+    if (dl_iterate_phdr(addObjectSegments, NULL) != 0) {
+        gIndexed = false;
+        return false;
+    }
+    qsort(gRegions, gRegionCount, sizeof(CodeRegion), compareRegions);
+    gIndexedObjects = current;
+    gIndexed = true;
+    return true;
+}
+
+bool findCodeRegion(uintptr_t address, uint32_t* flags) {
+    bool found = false;
+
+    pthread_mutex_lock(&gLock);
+    if (refreshIndexLocked()) {
+        // Find the last region starting at or below |address|.
+        size_t lo = 0;
+        size_t hi = gRegionCount;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (gRegions[mid].start <= address) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo > 0 && address < gRegions[lo - 1].end) {
+            *flags = gRegions[lo - 1].flags;
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(&gLock);
+    return found;
+}
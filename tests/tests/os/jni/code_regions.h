@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CODE_REGIONS_H_
+#define CODE_REGIONS_H_
+
+#include <stdint.h>
+
+// An index of the PT_LOAD segments of every ELF object the dynamic linker
+// has loaded, built with dl_iterate_phdr(). It answers "which segment, if
+// any, holds this code address" without reading /proc/self/maps.
+//
+// The index is rebuilt when the set of loaded objects changes, which is
+// checked on every lookup without any file I/O.
+
+// Looks up |address| in the index. If a loaded object's PT_LOAD segment
+// covers it, stores that segment's PF_R/PF_W/PF_X flags in |flags| and
+// returns true. Returns false for addresses outside any loaded object, such
+// as the stack, the heap or code that was mapped by hand.
+bool findCodeRegion(uintptr_t address, uint32_t* flags);
+
+#endif  // CODE_REGIONS_H_
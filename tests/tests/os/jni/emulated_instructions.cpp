@@ -0,0 +1,446 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "emulated_instructions.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <link.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__LP64__)
+#define ELF_CLASS ELFCLASS64
+#else
+#define ELF_CLASS ELFCLASS32
+#endif
+
+#ifndef ELF_ST_TYPE
+#define ELF_ST_TYPE(info) ((info) & 0xf)
+#endif
+
+static const char* const kNames[EMULATED_INSTRUCTION_KINDS] = {
+    "swp", "setend", "cp15-barrier", "cp15-thumb", "id-register", "cache-type", "counter",
+};
+
+const char* emulatedInstructionName(EmulatedInstruction kind) {
+    return kind >= 0 && kind < EMULATED_INSTRUCTION_KINDS ? kNames[kind] : "?";
+}
+
+static uint32_t read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint16_t read16(const uint8_t* p) {
+    uint16_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// The encodings the arm64 kernel matches in arch/arm64/kernel/armv8_deprecated.c,
+// leaving out the unconditional space, where they mean something else.
+static bool matchA32(uint32_t insn, EmulatedInstruction* kind) {
+    if ((insn & 0xfffffdff) == 0xf1010000) {
+        *kind = EMULATED_SETEND;
+        return true;
+    }
+    if ((insn >> 28) == 0xf) {
+        return false;
+    }
+    if ((insn & 0x0fb00ff0) == 0x01000090) {
+        *kind = EMULATED_SWP;
+        return true;
+    }
+    // mcr p15, 0, Rt, c7, c10, {4, 5} and mcr p15, 0, Rt, c7, c5, 4.
+    if ((insn & 0x0fff0fdf) == 0x0e070f9a || (insn & 0x0fff0fff) == 0x0e070f95) {
+        *kind = EMULATED_CP15_BARRIER;
+        return true;
+    }
+    return false;
+}
+
+// MRS of op0 3: 1101 0101 0011 op1 CRn CRm op2 Rt.
+static bool matchA64(uint32_t insn, EmulatedInstruction* kind) {
+    if ((insn & 0xfff00000) != 0xd5300000) {
+        return false;
+    }
+    uint32_t sysreg = (insn >> 5) & 0x7fff;  // op0:op1:CRn:CRm:op2
+    // op1 0, CRn 0 and CRm 0 to 7 is the ID register space.
+    if ((sysreg & 0x7fc0) == 0x4000) {
+        *kind = EMULATED_ID_REGISTER;
+        return true;
+    }
+    switch (sysreg) {
+    case 0x5801:  // CTR_EL0
+        *kind = EMULATED_CACHE_TYPE;
+        return true;
+    case 0x5f00:  // CNTFRQ_EL0
+    case 0x5f02:  // CNTVCT_EL0
+    case 0x5f06:  // CNTVCTSS_EL0
+        *kind = EMULATED_COUNTER;
+        return true;
+    }
+    return false;
+}
+
+void emulatedInstructionScanCode(const void* code, size_t size, EmulatedInstructionIsa isa,
+                                 uintptr_t address, EmulatedInstructionCallback callback,
+                                 void* arg) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(code);
+    size_t alignment = isa == EMULATED_ISA_T32 ? 2 : 4;
+    size_t offset = (alignment - address % alignment) % alignment;
+    EmulatedInstruction kind;
+    if (isa != EMULATED_ISA_T32) {
+        for (; offset + 4 <= size; offset += 4) {
+            uint32_t insn = read32(bytes + offset);
+            if (isa == EMULATED_ISA_A32 ? matchA32(insn, &kind) : matchA64(insn, &kind)) {
+                callback(address + offset, kind, arg);
+            }
+        }
+        return;
+    }
+    // Thumb-2 mixes 16- and 32-bit instructions, so it has to be walked one
+    // instruction at a time to stay in step.
+    while (offset + 2 <= size) {
+        uint16_t first = read16(bytes + offset);
+        if ((first >> 11) < 0x1d) {
+            if ((first & 0xfff7) == 0xb650) {
+                callback(address + offset, EMULATED_SETEND, arg);
+            }
+            offset += 2;
+            continue;
+        }
+        if (offset + 4 > size) {
+            break;
+        }
+        // The same mcr as in A32, split into halves, which the kernel
+        // leaves undefined.
+        uint16_t second = read16(bytes + offset + 2);
+        if (first == 0xee07 && ((second & 0x0fdf) == 0x0f9a || (second & 0x0fff) == 0x0f95)) {
+            callback(address + offset, EMULATED_CP15_THUMB, arg);
+        }
+        offset += 4;
+    }
+}
+
+#if defined(__arm__) || defined(__aarch64__)
+struct Symbol {
+    uintptr_t start;
+    uintptr_t end;
+    const char* name;
+    bool thumb;
+};
+
+struct SymbolTable {
+    char* strings;
+    Symbol* symbols;  // by start address
+    int count;
+};
+
+static int compareSymbols(const void* lhs, const void* rhs) {
+    uintptr_t a = reinterpret_cast<const Symbol*>(lhs)->start;
+    uintptr_t b = reinterpret_cast<const Symbol*>(rhs)->start;
+    return (a < b) ? -1 : (a > b);
+}
+
+// Reads the function symbols of an ELF file loaded at |bias| from its
+// section headers, which aren't loaded into memory.
+static bool readSymbols(const uint8_t* file, size_t size, uintptr_t bias, SymbolTable* table) {
+    if (size < sizeof(ElfW(Ehdr))) {
+        return false;
+    }
+    const ElfW(Ehdr)* ehdr = reinterpret_cast<const ElfW(Ehdr)*>(file);
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != ELF_CLASS ||
+            ehdr->e_shentsize != sizeof(ElfW(Shdr)) || ehdr->e_shoff > size ||
+            ehdr->e_shnum > (size - ehdr->e_shoff) / sizeof(ElfW(Shdr))) {
+        return false;
+    }
+    const ElfW(Shdr)* shdrs = reinterpret_cast<const ElfW(Shdr)*>(file + ehdr->e_shoff);
+    const ElfW(Shdr)* symtab = NULL;
+    for (int i = 0; i < ehdr->e_shnum; i++) {
+        if (shdrs[i].sh_type == SHT_SYMTAB ||
+                (shdrs[i].sh_type == SHT_DYNSYM && symtab == NULL)) {
+            symtab = &shdrs[i];
+        }
+    }
+    if (symtab == NULL || symtab->sh_link >= ehdr->e_shnum ||
+            symtab->sh_entsize != sizeof(ElfW(Sym)) || symtab->sh_offset > size ||
+            symtab->sh_size > size - symtab->sh_offset) {
+        return false;
+    }
+    const ElfW(Shdr)* strtab = &shdrs[symtab->sh_link];
+    if (strtab->sh_offset > size || strtab->sh_size > size - strtab->sh_offset ||
+            strtab->sh_size == 0) {
+        return false;
+    }
+    const ElfW(Sym)* syms = reinterpret_cast<const ElfW(Sym)*>(file + symtab->sh_offset);
+    size_t symCount = symtab->sh_size / sizeof(ElfW(Sym));
+
+    table->strings = reinterpret_cast<char*>(malloc(strtab->sh_size + 1));
+    table->symbols = reinterpret_cast<Symbol*>(malloc((symCount + 1) * sizeof(Symbol)));
+    if (table->strings == NULL || table->symbols == NULL) {
+        return false;
+    }
+    memcpy(table->strings, file + strtab->sh_offset, strtab->sh_size);
+    table->strings[strtab->sh_size] = '\0';
+    for (size_t i = 0; i < symCount; i++) {
+        const ElfW(Sym)* sym = &syms[i];
+        if (ELF_ST_TYPE(sym->st_info) != STT_FUNC || sym->st_shndx == SHN_UNDEF ||
+                sym->st_size == 0 || sym->st_name >= strtab->sh_size) {
+            continue;
+        }
+        Symbol* symbol = &table->symbols[table->count++];
+#if defined(__arm__)
+        // Thumb functions have the low bit of their address set.
+        symbol->thumb = (sym->st_value & 1) != 0;
+        symbol->start = bias + (sym->st_value & ~1);
+#else
+        symbol->thumb = false;
+        symbol->start = bias + sym->st_value;
+#endif
+        symbol->end = symbol->start + sym->st_size;
+        symbol->name = table->strings + sym->st_name;
+    }
+    qsort(table->symbols, table->count, sizeof(Symbol), compareSymbols);
+    return true;
+}
+
+static bool loadSymbols(const char* path, uintptr_t bias, SymbolTable* table) {
+    memset(table, 0, sizeof(*table));
+    int fd = TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC));
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    void* file = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (file == MAP_FAILED) {
+        return false;
+    }
+    bool ok = readSymbols(reinterpret_cast<const uint8_t*>(file), st.st_size, bias, table);
+    munmap(file, st.st_size);
+    if (!ok) {
+        free(table->strings);
+        free(table->symbols);
+        memset(table, 0, sizeof(*table));
+    }
+    return ok;
+}
+
+// Returns the index of the symbol covering |address|, or |table->count| if
+// there isn't one.
+static int findSymbol(const SymbolTable* table, uintptr_t address) {
+    int lo = 0;
+    int hi = table->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (table->symbols[mid].start <= address) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo > 0 && address < table->symbols[lo - 1].end) {
+        return lo - 1;
+    }
+    return table->count;
+}
+
+struct LibraryScan {
+    EmulatedLibraryCounts* library;
+    const SymbolTable* symbols;
+    // EMULATED_INSTRUCTION_KINDS counts for each symbol, and then for the
+    // code outside them.
+    int* counts;
+};
+
+static void countCandidate(uintptr_t address, EmulatedInstruction kind, void* arg) {
+    LibraryScan* scan = reinterpret_cast<LibraryScan*>(arg);
+    int symbol = findSymbol(scan->symbols, address);
+    scan->counts[symbol * EMULATED_INSTRUCTION_KINDS + kind]++;
+    scan->library->counts[kind]++;
+}
+
+static void scanRange(LibraryScan* scan, uintptr_t start, uintptr_t end,
+                      EmulatedInstructionIsa isa) {
+    if (start < end) {
+        emulatedInstructionScanCode(reinterpret_cast<const void*>(start), end - start, isa,
+                                    start, countCandidate, scan);
+    }
+}
+
+#if defined(__arm__)
+// A32 and Thumb-2 code can't be told apart by looking at it. Functions say
+// which they are, and code outside them is scanned as both.
+static void scanSegment(LibraryScan* scan, uintptr_t start, uintptr_t end) {
+    const SymbolTable* table = scan->symbols;
+    uintptr_t cursor = start;
+    for (int i = 0; i < table->count && cursor < end; i++) {
+        const Symbol* symbol = &table->symbols[i];
+        if (symbol->end <= cursor || symbol->start >= end) {
+            continue;
+        }
+        if (symbol->start > cursor) {
+            scanRange(scan, cursor, symbol->start, EMULATED_ISA_A32);
+            scanRange(scan, cursor, symbol->start, EMULATED_ISA_T32);
+            cursor = symbol->start;
+        }
+        uintptr_t symbolEnd = symbol->end < end ? symbol->end : end;
+        scanRange(scan, cursor, symbolEnd, symbol->thumb ? EMULATED_ISA_T32 : EMULATED_ISA_A32);
+        cursor = symbolEnd;
+    }
+    scanRange(scan, cursor, end, EMULATED_ISA_A32);
+    scanRange(scan, cursor, end, EMULATED_ISA_T32);
+}
+#else
+static void scanSegment(LibraryScan* scan, uintptr_t start, uintptr_t end) {
+    scanRange(scan, start, end, EMULATED_ISA_A64);
+}
+#endif
+
+static int totalCount(const int* counts) {
+    int total = 0;
+    for (int i = 0; i < EMULATED_INSTRUCTION_KINDS; i++) {
+        total += counts[i];
+    }
+    return total;
+}
+
+// Keeps the symbols with candidates, most first.
+static bool collectSymbols(LibraryScan* scan) {
+    const SymbolTable* table = scan->symbols;
+    EmulatedLibraryCounts* library = scan->library;
+    int found = 0;
+    for (int i = 0; i <= table->count; i++) {
+        if (totalCount(&scan->counts[i * EMULATED_INSTRUCTION_KINDS]) != 0) {
+            found++;
+        }
+    }
+    if (found == 0) {
+        return true;
+    }
+    library->symbols = reinterpret_cast<EmulatedSymbolCounts*>(
+            calloc(found, sizeof(EmulatedSymbolCounts)));
+    if (library->symbols == NULL) {
+        return false;
+    }
+    for (int i = 0; i <= table->count; i++) {
+        const int* counts = &scan->counts[i * EMULATED_INSTRUCTION_KINDS];
+        int total = totalCount(counts);
+        if (total == 0) {
+            continue;
+        }
+        EmulatedSymbolCounts entry;
+        entry.name = strdup(i < table->count ? table->symbols[i].name : "?");
+        if (entry.name == NULL) {
+            return false;
+        }
+        entry.address = i < table->count ? table->symbols[i].start : 0;
+        memcpy(entry.counts, counts, sizeof(entry.counts));
+        int j = library->symbolCount++;
+        for (; j > 0 && totalCount(library->symbols[j - 1].counts) < total; j--) {
+            library->symbols[j] = library->symbols[j - 1];
+        }
+        library->symbols[j] = entry;
+    }
+    return true;
+}
+
+static int scanObject(struct dl_phdr_info* info, size_t, void* data) {
+    EmulatedInstructionReport* report = reinterpret_cast<EmulatedInstructionReport*>(data);
+    EmulatedLibraryCounts* libraries = reinterpret_cast<EmulatedLibraryCounts*>(
+            realloc(report->libraries, (report->libraryCount + 1) * sizeof(*libraries)));
+    if (libraries == NULL) {
+        return 1;
+    }
+    report->libraries = libraries;
+    EmulatedLibraryCounts* library = &libraries[report->libraryCount++];
+    memset(library, 0, sizeof(*library));
+
+    // The main executable has no name in some C libraries.
+    const char* path = info->dlpi_name;
+    char exe[PATH_MAX];
+    if (path == NULL || path[0] == '\0') {
+        ssize_t length = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+        exe[length > 0 ? length : 0] = '\0';
+        path = exe;
+    }
+    library->path = strdup(path);
+    if (library->path == NULL) {
+        return 1;
+    }
+    SymbolTable table;
+    library->symbolsMissing = !loadSymbols(path, info->dlpi_addr, &table);
+    LibraryScan scan = { library, &table, NULL };
+    scan.counts = reinterpret_cast<int*>(
+            calloc((table.count + 1) * EMULATED_INSTRUCTION_KINDS, sizeof(int)));
+    bool ok = scan.counts != NULL;
+    for (int i = 0; ok && i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr)* phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type != PT_LOAD || (phdr->p_flags & PF_X) == 0) {
+            continue;
+        }
+        if ((phdr->p_flags & PF_R) == 0) {
+            library->unreadable = true;
+            continue;
+        }
+        uintptr_t start = info->dlpi_addr + phdr->p_vaddr;
+        scanSegment(&scan, start, start + phdr->p_filesz);
+    }
+    ok = ok && collectSymbols(&scan);
+    free(scan.counts);
+    free(table.strings);
+    free(table.symbols);
+    return ok ? 0 : 1;
+}
+#endif
+
+bool emulatedInstructionScan(EmulatedInstructionReport* report) {
+    memset(report, 0, sizeof(*report));
+#if defined(__arm__) || defined(__aarch64__)
+    if (dl_iterate_phdr(scanObject, report) != 0) {
+        emulatedInstructionReportFree(report);
+        errno = ENOMEM;
+        return false;
+    }
+    return true;
+#else
+    errno = ENOSYS;
+    return false;
+#endif
+}
+
+void emulatedInstructionReportFree(EmulatedInstructionReport* report) {
+    for (int i = 0; i < report->libraryCount; i++) {
+        EmulatedLibraryCounts* library = &report->libraries[i];
+        for (int j = 0; j < library->symbolCount; j++) {
+            free(const_cast<char*>(library->symbols[j].name));
+        }
+        free(library->symbols);
+        free(const_cast<char*>(library->path));
+    }
+    free(report->libraries);
+    memset(report, 0, sizeof(*report));
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EMULATED_INSTRUCTIONS_H_
+#define EMULATED_INSTRUCTIONS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Finds instructions in loaded code that the kernel may have to emulate
+// after an undefined-instruction trap, which costs microseconds each time
+// instead of a cycle or two. CpuInstructions checks that swp, setend and
+// the CP15 barriers still run at all; this finds the code that uses them.
+//
+// The code of every object the dynamic linker has loaded is read from its
+// executable PT_LOAD segments, found with dl_iterate_phdr(), and each match
+// is put down to the function symbol that covers it, from the object's
+// .symtab, or its .dynsym if it is stripped.
+//
+// The CP15 barriers are only emulated in A32 code; in Thumb code they are
+// undefined whatever abi.cp15_barrier says, and raise SIGILL, so they are
+// counted apart.
+//
+// The scan is a linear sweep, so literal pools and other data in the text
+// can match too: the counts are of candidates, to look at more closely.
+
+enum EmulatedInstruction {
+    // AArch32, emulated by arm64 kernels for 32-bit processes if at all
+    // (abi.swp, abi.setend and abi.cp15_barrier in /proc/sys).
+    EMULATED_SWP,            // swp and swpb
+    EMULATED_SETEND,         // setend
+    EMULATED_CP15_BARRIER,   // mcr p15 forms of isb, dsb and dmb, in A32
+    EMULATED_CP15_THUMB,     // the same in Thumb-2, which isn't emulated
+    // AArch64, trapped by the kernel on every CPU.
+    EMULATED_ID_REGISTER,    // mrs of MIDR_EL1, ID_AA64*_EL1 and the like
+    // AArch64, trapped only on CPUs with errata that need it.
+    EMULATED_CACHE_TYPE,     // mrs of CTR_EL0
+    EMULATED_COUNTER,        // mrs of CNTVCT_EL0, CNTVCTSS_EL0 or CNTFRQ_EL0
+    EMULATED_INSTRUCTION_KINDS,
+};
+
+enum EmulatedInstructionIsa {
+    EMULATED_ISA_A32,  // 32-bit ARM
+    EMULATED_ISA_T32,  // Thumb-2
+    EMULATED_ISA_A64,
+};
+
+// Short names, like "swp" or "id-register".
+const char* emulatedInstructionName(EmulatedInstruction kind);
+
+typedef void (*EmulatedInstructionCallback)(uintptr_t address, EmulatedInstruction kind,
+                                            void* arg);
+
+// Calls |callback| for each candidate in the |size| bytes of |isa| code at
+// |code|, passing its offset from |code| plus |address|.
+void emulatedInstructionScanCode(const void* code, size_t size, EmulatedInstructionIsa isa,
+                                 uintptr_t address, EmulatedInstructionCallback callback,
+                                 void* arg);
+
+struct EmulatedSymbolCounts {
+    const char* name;  // or "?", for code no symbol covers
+    uintptr_t address;
+    int counts[EMULATED_INSTRUCTION_KINDS];
+};
+
+struct EmulatedLibraryCounts {
+    const char* path;
+    int counts[EMULATED_INSTRUCTION_KINDS];
+    // Execute-only segments can't be read, and aren't scanned.
+    bool unreadable;
+    bool symbolsMissing;
+    // Only the symbols with candidates, most first.
+    EmulatedSymbolCounts* symbols;
+    int symbolCount;
+};
+
+struct EmulatedInstructionReport {
+    EmulatedLibraryCounts* libraries;
+    int libraryCount;
+};
+
+// Scans every loaded object. Returns false, with nothing to free, if memory
+// runs out (errno ENOMEM) or there is nothing to look for on this
+// architecture (ENOSYS).
+bool emulatedInstructionScan(EmulatedInstructionReport* report);
+
+void emulatedInstructionReportFree(EmulatedInstructionReport* report);
+
+#endif  // EMULATED_INSTRUCTIONS_H_
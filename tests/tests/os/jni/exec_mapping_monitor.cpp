@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "exec_mapping_monitor.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cutils/log.h>
+
+#include "seccomp_supervisor.h"
+
+#if defined(__aarch64__)
+#define ARCH_NR AUDIT_ARCH_AARCH64
+#elif defined(__arm__)
+#define ARCH_NR AUDIT_ARCH_ARM
+#elif defined(__x86_64__)
+#define ARCH_NR AUDIT_ARCH_X86_64
+#elif defined(__i386__)
+#define ARCH_NR AUDIT_ARCH_I386
+#endif
+
+#ifndef PR_SET_NO_NEW_PRIVS
+#define PR_SET_NO_NEW_PRIVS 38
+#endif
+
+#ifndef SECCOMP_SET_MODE_FILTER
+#define SECCOMP_SET_MODE_FILTER 1
+#endif
+
+// Linux 4.9 and later.
+#ifndef __NR_pkey_mprotect
+#if defined(__aarch64__)
+#define __NR_pkey_mprotect 288
+#elif defined(__arm__)
+#define __NR_pkey_mprotect 394
+#elif defined(__x86_64__)
+#define __NR_pkey_mprotect 329
+#elif defined(__i386__)
+#define __NR_pkey_mprotect 380
+#endif
+#endif
+
+// 32-bit C libraries map with mmap2. The old i386 mmap takes its arguments
+// in memory, where a filter can't see them, and nothing uses it any more.
+#ifdef __NR_mmap2
+#define NR_MMAP __NR_mmap2
+#else
+#define NR_MMAP __NR_mmap
+#endif
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define LOW_WORD 4
+#else
+#define LOW_WORD 0
+#endif
+
+// Recent events kept for execMappingMonitorRecent().
+#define MAX_EVENTS 64
+
+// Events logged one by one, before only every LOG_INTERVAL-th is, so that a
+// JIT remapping its code over and over doesn't flood the log.
+#define LOGGED_EVENTS 64
+#define LOG_INTERVAL 1024
+
+#ifdef ARCH_NR
+// Syscalls of another architecture, and x32 ones, whose numbers have
+// __X32_SYSCALL_BIT set, go through unchecked: this is a monitor, not a
+// policy.
+static struct sock_filter gFilter[] = {
+    BPF_STMT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, arch)),
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, ARCH_NR, 1, 0),
+    BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+    BPF_STMT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, nr)),
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, NR_MMAP, 2, 0),
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_mprotect, 1, 0),
+    BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_pkey_mprotect, 0, 3),
+    // prot is the third argument of all three, and an int.
+    BPF_STMT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, args[2]) + LOW_WORD),
+    BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, PROT_EXEC, 0, 1),
+    BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_USER_NOTIF),
+    BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+};
+#endif
+
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+static bool gStarted;
+static ExecMappingCallback gCallback;
+static void* gCallbackArg;
+static ExecMappingEvent gEvents[MAX_EVENTS];
+static uint64_t gCount;
+
+static const char* syscallName(int nr) {
+    switch (nr) {
+    case NR_MMAP:
+        return "mmap";
+    case __NR_mprotect:
+        return "mprotect";
+    case __NR_pkey_mprotect:
+        return "pkey_mprotect";
+    }
+    return "?";
+}
+
+static void handleNotification(int, const struct seccomp_notif* request,
+                               struct seccomp_notif_resp* response, void*) {
+    ExecMappingEvent event;
+    event.tid = request->pid;
+    event.syscall = request->data.nr;
+    event.address = request->data.args[0];
+    event.length = request->data.args[1];
+    event.prot = request->data.args[2];
+    event.instructionPointer = request->data.instruction_pointer;
+
+    pthread_mutex_lock(&gLock);
+    gEvents[gCount % MAX_EVENTS] = event;
+    uint64_t count = ++gCount;
+    pthread_mutex_unlock(&gLock);
+    if (count <= LOGGED_EVENTS || count % LOG_INTERVAL == 0) {
+        ALOGW("thread %d made memory executable: %s(0x%" PRIx64 ", %" PRIu64 ", 0x%x) "
+              "from 0x%" PRIx64 "; %" PRIu64 " so far", event.tid, syscallName(event.syscall),
+              event.address, event.length, event.prot, event.instructionPointer, count);
+    }
+    // Set before the filter was installed, and never changed after.
+    if (gCallback != NULL) {
+        gCallback(&event, gCallbackArg);
+    }
+    response->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+}
+
+// Answering with SECCOMP_USER_NOTIF_FLAG_CONTINUE on a kernel that doesn't
+// know it fails, and leaves the call waiting for good. So it is tried first
+// on a thread that exits afterwards, taking its filter with it: a response
+// to no notification at all gets ENOENT once the flags are accepted, and
+// EINVAL before.
+static void* probeContinue(void* arg) {
+    bool* supported = reinterpret_cast<bool*>(arg);
+    struct sock_filter allow = BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW);
+    struct sock_fprog prog = { 1, &allow };
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0) {
+        return NULL;
+    }
+    int listener = syscall(__NR_seccomp, SECCOMP_SET_MODE_FILTER,
+                           SECCOMP_FILTER_FLAG_NEW_LISTENER, &prog);
+    if (listener < 0) {
+        return NULL;
+    }
+    struct seccomp_notif_resp response;
+    memset(&response, 0, sizeof(response));
+    response.id = ~0ULL;
+    response.flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+    *supported = ioctl(listener, SECCOMP_IOCTL_NOTIF_SEND, &response) != 0 && errno == ENOENT;
+    close(listener);
+    return NULL;
+}
+
+bool execMappingMonitorStart(ExecMappingCallback callback, void* arg) {
+#ifndef ARCH_NR
+    (void) callback;
+    (void) arg;
+    errno = ENOSYS;
+    return false;
+#else
+    pthread_mutex_lock(&gLock);
+    if (gStarted) {
+        pthread_mutex_unlock(&gLock);
+        errno = EBUSY;
+        return false;
+    }
+    bool supported = false;
+    pthread_t probe;
+    if (pthread_create(&probe, NULL, probeContinue, &supported) == 0) {
+        pthread_join(probe, NULL);
+    }
+    if (!supported) {
+        pthread_mutex_unlock(&gLock);
+        errno = ENOSYS;
+        return false;
+    }
+
+    // The supervisor's thread has to exist before the filter does, or it
+    // would wait for itself.
+    SeccompSupervisor* supervisor = seccompSupervisorCreate(0);
+    if (supervisor == NULL) {
+        pthread_mutex_unlock(&gLock);
+        return false;
+    }
+    gCallback = callback;
+    gCallbackArg = arg;
+    struct sock_fprog prog = { sizeof(gFilter) / sizeof(gFilter[0]), gFilter };
+    int listener = -1;
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0) {
+        listener = syscall(__NR_seccomp, SECCOMP_SET_MODE_FILTER,
+                           SECCOMP_FILTER_FLAG_NEW_LISTENER, &prog);
+    }
+    if (listener < 0) {
+        int error = errno;
+        seccompSupervisorDestroy(supervisor);
+        pthread_mutex_unlock(&gLock);
+        errno = error;
+        return false;
+    }
+    // The supervisor is never destroyed; see exec_mapping_monitor.h.
+    if (!seccompSupervisorAdd(supervisor, listener, handleNotification, NULL, false)) {
+        ALOGE("Unable to supervise the exec mapping filter; PROT_EXEC mappings will fail");
+        pthread_mutex_unlock(&gLock);
+        return false;
+    }
+    gStarted = true;
+    pthread_mutex_unlock(&gLock);
+    return true;
+#endif
+}
+
+uint64_t execMappingMonitorCount() {
+    pthread_mutex_lock(&gLock);
+    uint64_t count = gCount;
+    pthread_mutex_unlock(&gLock);
+    return count;
+}
+
+int execMappingMonitorRecent(ExecMappingEvent* events, int capacity) {
+    pthread_mutex_lock(&gLock);
+    int count = gCount < MAX_EVENTS ? gCount : MAX_EVENTS;
+    if (count > capacity) {
+        count = capacity;
+    }
+    for (int i = 0; i < count; i++) {
+        events[i] = gEvents[(gCount - count + i) % MAX_EVENTS];
+    }
+    pthread_mutex_unlock(&gLock);
+    return count;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EXEC_MAPPING_MONITOR_H_
+#define EXEC_MAPPING_MONITOR_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Watches for memory being made executable, where NoExecutePermissionTest
+// only looks at a few addresses in /proc/self/maps at one moment.
+//
+// A seccomp filter checks the prot argument of mmap, mprotect and
+// pkey_mprotect with a single JSET, and sends the calls that include
+// PROT_EXEC to a SECCOMP_RET_USER_NOTIF listener. A supervisor thread logs
+// each of them and lets it continue unchanged. Every other syscall costs
+// the few instructions it takes to see that it isn't one of those.
+//
+// This needs SECCOMP_USER_NOTIF_FLAG_CONTINUE, Linux 5.5 and later. The
+// filter can't be removed, and the listener has to outlive everything it
+// covers, because once it is closed the calls it would have been told about
+// fail with ENOSYS. So the monitor, once started, lasts as long as the
+// process.
+
+struct ExecMappingEvent {
+    pid_t tid;
+    int syscall;  // __NR_mmap (or __NR_mmap2), __NR_mprotect or __NR_pkey_mprotect
+    uint64_t address;  // as passed, so the hint, if any, for mmap
+    uint64_t length;
+    uint32_t prot;
+    uint64_t instructionPointer;  // of the caller
+};
+
+// Called on the supervisor thread for each event, before the call goes
+// ahead. It mustn't wait for the thread that made the call.
+typedef void (*ExecMappingCallback)(const ExecMappingEvent* event, void* arg);
+
+// Starts monitoring the calling thread, and the threads and processes it
+// creates from now on, reporting each event to |callback| if it isn't NULL
+// as well as to the log. Threads that already exist aren't monitored.
+// Returns false, with errno set, if the kernel can't do it or the monitor
+// is already running.
+bool execMappingMonitorStart(ExecMappingCallback callback, void* arg);
+
+// The number of events so far.
+uint64_t execMappingMonitorCount();
+
+// Copies up to |capacity| of the most recent events to |events|, oldest
+// first, and returns how many it copied.
+int execMappingMonitorRecent(ExecMappingEvent* events, int capacity);
+
+#endif  // EXEC_MAPPING_MONITOR_H_
@@ -0,0 +1,28 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FD_PASSING_H_
+#define FD_PASSING_H_
+
+// Passes a descriptor over a connected AF_UNIX socket with SCM_RIGHTS,
+// along with a single byte of data. Returns false on failure.
+bool sendFd(int socket, int fd);
+
+// Returns a descriptor sent with sendFd(), or -1 at the end of the stream
+// or on failure.
+int receiveFd(int socket);
+
+#endif  // FD_PASSING_H_
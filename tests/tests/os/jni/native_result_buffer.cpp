@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "native_result_buffer.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define HEADER_SIZE 16
+#define RECORD_HEADER_SIZE 8
+#define ARENA_SIZE (1024 * 1024)
+
+static pthread_mutex_t gArenaLock = PTHREAD_MUTEX_INITIALIZER;
+static void* gArena;
+
+// The buffer may not be aligned, so everything is written with memcpy().
+static void put16(uint8_t* p, uint16_t value) {
+    memcpy(p, &value, sizeof(value));
+}
+
+static void put32(uint8_t* p, uint32_t value) {
+    memcpy(p, &value, sizeof(value));
+}
+
+bool nativeResultBufferInit(JNIEnv* env, jobject byteBuffer, NativeResultBuffer* buffer) {
+    void* data = env->GetDirectBufferAddress(byteBuffer);
+    jlong capacity = env->GetDirectBufferCapacity(byteBuffer);
+    if (data == NULL || capacity < HEADER_SIZE) {
+        jclass iae = env->FindClass("java/lang/IllegalArgumentException");
+        if (iae != NULL) {
+            env->ThrowNew(iae, "need a direct ByteBuffer of at least 16 bytes");
+        }
+        return false;
+    }
+    buffer->data = reinterpret_cast<uint8_t*>(data);
+    buffer->capacity = capacity;
+    buffer->used = HEADER_SIZE;
+    buffer->needed = HEADER_SIZE;
+    buffer->count = 0;
+    return true;
+}
+
+void nativeResultBufferAppend(NativeResultBuffer* buffer, uint16_t type,
+                              const void* payload, size_t payloadSize,
+                              const void* tail, size_t tailSize) {
+    size_t size = payloadSize + tailSize;
+    size_t padded = (RECORD_HEADER_SIZE + size + 7) & ~(size_t) 7;
+
+    buffer->needed += padded;
+    // Once a record is dropped, later ones are only counted.
+    if (buffer->needed != buffer->used + padded || buffer->used + padded > buffer->capacity) {
+        return;
+    }
+    uint8_t* record = buffer->data + buffer->used;
+    put16(record, type);
+    put16(record + 2, 0);
+    put32(record + 4, size);
+    memcpy(record + RECORD_HEADER_SIZE, payload, payloadSize);
+    if (tailSize != 0) {
+        memcpy(record + RECORD_HEADER_SIZE + payloadSize, tail, tailSize);
+    }
+    memset(record + RECORD_HEADER_SIZE + size, 0, padded - RECORD_HEADER_SIZE - size);
+    buffer->used += padded;
+    buffer->count++;
+}
+
+jint nativeResultBufferFinish(NativeResultBuffer* buffer) {
+    put32(buffer->data, NATIVE_RESULT_MAGIC);
+    put16(buffer->data + 4, NATIVE_RESULT_VERSION);
+    put16(buffer->data + 6, HEADER_SIZE);
+    put32(buffer->data + 8, buffer->count);
+    put32(buffer->data + 12, buffer->used);
+    if (buffer->needed > buffer->used) {
+        return -(jint) buffer->needed;
+    }
+    return buffer->count;
+}
+
+jobject nativeResultArena(JNIEnv* env) {
+    pthread_mutex_lock(&gArenaLock);
+    if (gArena == NULL) {
+        void* arena = mmap(NULL, ARENA_SIZE, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (arena != MAP_FAILED) {
+            gArena = arena;
+        }
+    }
+    void* arena = gArena;
+    pthread_mutex_unlock(&gArenaLock);
+    if (arena == NULL) {
+        return NULL;
+    }
+    return env->NewDirectByteBuffer(arena, ARENA_SIZE);
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NATIVE_RESULT_BUFFER_H_
+#define NATIVE_RESULT_BUFFER_H_
+
+#include <jni.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bulk results for Java in one JNI call: native code writes fixed-layout
+// records into a direct ByteBuffer, which Java reads in place with
+// ByteBuffer.order(ByteOrder.nativeOrder()), allocating nothing per record.
+//
+// Layout, in native byte order:
+//
+//   header (16 bytes)
+//     u32 magic            NATIVE_RESULT_MAGIC
+//     u16 version          NATIVE_RESULT_VERSION
+//     u16 header size      16
+//     u32 record count
+//     u32 bytes used       including this header
+//   records, each starting at a multiple of 8 bytes
+//     u16 type             NATIVE_RESULT_*
+//     u16 reserved
+//     u32 payload size     not including this 8-byte record header
+//     payload              see the NativeResult* structs below
+//
+// Records that don't fit are not written, but are still counted: the
+// producer then returns the negated number of bytes it needed, so the
+// caller can retry with a larger buffer.
+
+#define NATIVE_RESULT_MAGIC 0x5345524e  // "NRES"
+#define NATIVE_RESULT_VERSION 1
+
+enum {
+    NATIVE_RESULT_MAPPING = 1,
+    NATIVE_RESULT_CPU = 2,
+    NATIVE_RESULT_TEST = 3,
+};
+
+// NATIVE_RESULT_MAPPING, followed by |nameLength| bytes of the mapping's
+// name (its path, "[stack]" and so on; not NUL-terminated).
+struct NativeResultMapping {
+    uint64_t start;
+    uint64_t end;
+    uint32_t flags;  // NATIVE_RESULT_MAPPING_*
+    uint32_t nameLength;
+};
+
+#define NATIVE_RESULT_MAPPING_READ    0x1
+#define NATIVE_RESULT_MAPPING_WRITE   0x2
+#define NATIVE_RESULT_MAPPING_EXECUTE 0x4
+#define NATIVE_RESULT_MAPPING_SHARED  0x8
+
+// NATIVE_RESULT_CPU.
+struct NativeResultCpu {
+    uint32_t family;  // AndroidCpuFamily
+    uint32_t cpuCount;
+    uint64_t features;  // ANDROID_CPU_*_FEATURE_*
+    uint64_t hwcap;
+    uint64_t hwcap2;
+};
+
+// NATIVE_RESULT_TEST, followed by |nameLength| bytes of the test's name.
+struct NativeResultTest {
+    uint32_t status;  // NATIVE_RESULT_TEST_*
+    uint32_t nameLength;
+    uint64_t durationNs;
+};
+
+#define NATIVE_RESULT_TEST_PASSED  0
+#define NATIVE_RESULT_TEST_FAILED  1
+#define NATIVE_RESULT_TEST_SKIPPED 2
+
+struct NativeResultBuffer {
+    uint8_t* data;
+    size_t capacity;
+    size_t used;    // bytes written
+    size_t needed;  // bytes that would have been written given the room
+    uint32_t count;
+};
+
+// Starts writing results into the direct ByteBuffer |byteBuffer|. Throws
+// IllegalArgumentException and returns false if it isn't direct or can't
+// hold a header.
+bool nativeResultBufferInit(JNIEnv* env, jobject byteBuffer, NativeResultBuffer* buffer);
+
+// Appends a record of |type| made of |payload| followed by |tail|.
+void nativeResultBufferAppend(NativeResultBuffer* buffer, uint16_t type,
+                              const void* payload, size_t payloadSize,
+                              const void* tail, size_t tailSize);
+
+// Completes the header. Returns the number of records, or the negated
+// number of bytes needed if some didn't fit.
+jint nativeResultBufferFinish(NativeResultBuffer* buffer);
+
+// Returns a direct ByteBuffer over a native arena shared by the whole
+// process, for callers that want to reuse one buffer without allocating it
+// on the Java heap. Only one result may be written into it at a time.
+jobject nativeResultArena(JNIEnv* env);
+
+#endif  // NATIVE_RESULT_BUFFER_H_
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "proc_maps.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/ioctl.h>
+#include <linux/types.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <cutils/log.h>
+
+#include "proc_scanner.h"
+
+// From include/uapi/linux/fs.h, Linux 6.11 and later.
+#ifndef PROCMAP_QUERY
+struct procmap_query {
+    __u64 size;
+    __u64 query_flags;
+    __u64 query_addr;
+    __u64 vma_start;
+    __u64 vma_end;
+    __u64 vma_flags;
+    __u64 vma_page_size;
+    __u64 vma_offset;
+    __u64 inode;
+    __u32 dev_major;
+    __u32 dev_minor;
+    __u32 vma_name_size;
+    __u32 build_id_size;
+    __u64 vma_name_addr;
+    __u64 build_id_addr;
+};
+
+#define PROCMAP_QUERY _IOWR('f', 17, struct procmap_query)
+
+#define PROCMAP_QUERY_VMA_READABLE   0x01
+#define PROCMAP_QUERY_VMA_WRITABLE   0x02
+#define PROCMAP_QUERY_VMA_EXECUTABLE 0x04
+#define PROCMAP_QUERY_VMA_SHARED     0x08
+#endif
+
+static pthread_mutex_t gMapsLock = PTHREAD_MUTEX_INITIALIZER;
+static int gMapsFd = -1;
+static pid_t gMapsPid;
+static bool gQueryUnsupported;
+
+// Returns a descriptor for /proc/self/maps to query, kept open across calls.
+// A descriptor inherited over fork() still describes the parent, so it is
+// reopened when our pid changes.
+static int getMapsFd() {
+    pthread_mutex_lock(&gMapsLock);
+    pid_t pid = getpid();
+    if (gMapsFd >= 0 && gMapsPid != pid) {
+        close(gMapsFd);
+        gMapsFd = -1;
+    }
+    if (gMapsFd < 0) {
+        gMapsFd = TEMP_FAILURE_RETRY(open("/proc/self/maps", O_RDONLY | O_CLOEXEC));
+        gMapsPid = pid;
+    }
+    int fd = gMapsFd;
+    pthread_mutex_unlock(&gMapsLock);
+    return fd;
+}
+
+int findMappingWithQuery(uintptr_t address, MapsEntry* entry) {
+    if (gQueryUnsupported) {
+        return -1;
+    }
+    int fd = getMapsFd();
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct procmap_query query;
+    memset(&query, 0, sizeof(query));
+    query.size = sizeof(query);
+    query.query_addr = address;
+    if (ioctl(fd, PROCMAP_QUERY, &query) != 0) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        if (errno == ENOTTY) {
+            gQueryUnsupported = true;
+        }
+        return -1;
+    }
+    entry->start = query.vma_start;
+    entry->end = query.vma_end;
+    entry->readable = (query.vma_flags & PROCMAP_QUERY_VMA_READABLE) != 0;
+    entry->writable = (query.vma_flags & PROCMAP_QUERY_VMA_WRITABLE) != 0;
+    entry->executable = (query.vma_flags & PROCMAP_QUERY_VMA_EXECUTABLE) != 0;
+    entry->shared = (query.vma_flags & PROCMAP_QUERY_VMA_SHARED) != 0;
+    return 1;
+}
+
+bool findMappingInText(uintptr_t address, MapsEntry* entry) {
+    ProcScanner scanner;
+    if (!procScannerOpen(&scanner, "/proc/self/maps")) {
+        ALOGE("Unable to open /proc/self/maps: %s", strerror(errno));
+        return false;
+    }
+    bool found = false;
+    const char* line;
+    size_t length;
+    while ((line = procScannerNextLine(&scanner, &length)) != NULL) {
+        // "start-end perms offset dev inode path"
+        const char* p = line;
+        const char* end = line + length;
+        uint64_t start;
+        uint64_t stop;
+        if (!procScannerParseHex(&p, end, &start) || p == end || *p++ != '-' ||
+                !procScannerParseHex(&p, end, &stop)) {
+            continue;
+        }
+        // Mappings are listed in address order.
+        if (start > address) {
+            break;
+        }
+        if (address >= stop) {
+            continue;
+        }
+        p = procScannerSkipSpaces(p, end);
+        if (end - p < 4) {
+            break;
+        }
+        entry->start = start;
+        entry->end = stop;
+        entry->readable = (p[0] == 'r');
+        entry->writable = (p[1] == 'w');
+        entry->executable = (p[2] == 'x');
+        entry->shared = (p[3] == 's');
+        found = true;
+        break;
+    }
+    procScannerClose(&scanner);
+    return found;
+}
+
+bool findMapping(uintptr_t address, MapsEntry* entry) {
+    int result = findMappingWithQuery(address, entry);
+    if (result >= 0) {
+        return result == 1;
+    }
+    return findMappingInText(address, entry);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROC_MAPS_H_
+#define PROC_MAPS_H_
+
+#include <stdint.h>
+
+// One mapping of this process, as listed in /proc/self/maps.
+struct MapsEntry {
+    uintptr_t start;
+    uintptr_t end;
+    bool readable;
+    bool writable;
+    bool executable;
+    bool shared;
+};
+
+// Finds the mapping of this process that contains |address|. Returns false
+// if there is none, or if /proc/self/maps could not be read.
+//
+// Uses the PROCMAP_QUERY ioctl on /proc/self/maps, which returns the one
+// mapping without generating any text, and falls back to scanning the text
+// of /proc/self/maps on kernels without it (before Linux 6.11).
+bool findMapping(uintptr_t address, MapsEntry* entry);
+
+// The two backends of findMapping(), for benchmarks. The ioctl backend
+// returns 1 if it found a mapping, 0 if there is none, and -1 if the kernel
+// doesn't support the query.
+int findMappingWithQuery(uintptr_t address, MapsEntry* entry);
+bool findMappingInText(uintptr_t address, MapsEntry* entry);
+
+#endif  // PROC_MAPS_H_
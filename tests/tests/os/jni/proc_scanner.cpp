@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "proc_scanner.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+bool procScannerOpen(ProcScanner* scanner, const char* path) {
+    scanner->fd = TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC));
+    scanner->eof = false;
+    scanner->start = 0;
+    scanner->end = 0;
+    return scanner->fd >= 0;
+}
+
+void procScannerClose(ProcScanner* scanner) {
+    if (scanner->fd >= 0) {
+        close(scanner->fd);
+        scanner->fd = -1;
+    }
+}
+
+const char* procScannerFind(const char* p, const char* end, char c) {
+#if defined(__SSE2__)
+    const __m128i needle = _mm_set1_epi8(c);
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#elif defined(__ARM_NEON__) || defined(__aarch64__)
+    const uint8x16_t needle = vdupq_n_u8(c);
+    while (end - p >= 16) {
+        uint8x16_t matches = vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(p)), needle);
+        // Narrow each byte of the comparison to four bits of a 64-bit mask.
+        uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(matches), 4);
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+        if (mask != 0) {
+            return p + (__builtin_ctzll(mask) >> 2);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p != c) {
+        p++;
+    }
+    return p;
+}
+
+const char* procScannerNextLine(ProcScanner* scanner, size_t* length) {
+    char* buffer = scanner->buffer;
+    // Leave room to NUL-terminate a last line that has no '\n'.
+    const size_t capacity = sizeof(scanner->buffer) - 1;
+    size_t scanned = scanner->start;
+
+    for (;;) {
+        const char* newline = procScannerFind(buffer + scanned, buffer + scanner->end, '\n');
+        size_t lineEnd = newline - buffer;
+        if (lineEnd == scanner->end) {
+            if (scanner->eof || scanner->end - scanner->start == capacity) {
+                // The last line, or one too long to fit: hand out what we have.
+                if (scanner->start == scanner->end) {
+                    return NULL;
+                }
+            } else {
+                // Move the partial line to the front and read some more.
+                size_t pending = scanner->end - scanner->start;
+                memmove(buffer, buffer + scanner->start, pending);
+                scanner->start = 0;
+                scanner->end = pending;
+                scanned = pending;
+                ssize_t count = TEMP_FAILURE_RETRY(
+                        read(scanner->fd, buffer + scanner->end, capacity - scanner->end));
+                if (count < 0) {
+                    return NULL;
+                }
+                if (count == 0) {
+                    scanner->eof = true;
+                }
+                scanner->end += count;
+                continue;
+            }
+        }
+        char* line = buffer + scanner->start;
+        buffer[lineEnd] = '\0';
+        *length = lineEnd - scanner->start;
+        scanner->start = (lineEnd < scanner->end) ? lineEnd + 1 : lineEnd;
+        return line;
+    }
+}
+
+const char* procScannerSkipSpaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    return p;
+}
+
+bool procScannerParseHex(const char** p, const char* end, uint64_t* value) {
+    const char* q = *p;
+    uint64_t result = 0;
+    for (; q < end; q++) {
+        unsigned digit = static_cast<unsigned char>(*q) - '0';
+        if (digit > 9) {
+            digit = (static_cast<unsigned char>(*q) | 0x20) - 'a';
+            if (digit > 5) {
+                break;
+            }
+            digit += 10;
+        }
+        result = (result << 4) | digit;
+    }
+    if (q == *p) {
+        return false;
+    }
+    *p = q;
+    *value = result;
+    return true;
+}
+
+bool procScannerParseDecimal(const char** p, const char* end, uint64_t* value) {
+    const char* q = *p;
+    uint64_t result = 0;
+    for (; q < end; q++) {
+        unsigned digit = static_cast<unsigned char>(*q) - '0';
+        if (digit > 9) {
+            break;
+        }
+        result = result * 10 + digit;
+    }
+    if (q == *p) {
+        return false;
+    }
+    *p = q;
+    *value = result;
+    return true;
+}
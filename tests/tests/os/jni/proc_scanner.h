@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROC_SCANNER_H_
+#define PROC_SCANNER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A line reader for the text files in /proc (maps, smaps, status, cpuinfo
+// and so on), shared by everything in this library that parses them.
+//
+// It reads in large chunks straight into its own buffer, without stdio or
+// any allocation, and finds line and field boundaries 16 bytes at a time
+// with SSE2 or NEON. The field decoders are locale-independent and stop at
+// the first byte that doesn't belong to the number.
+//
+// Usage:
+//   ProcScanner scanner;
+//   if (procScannerOpen(&scanner, "/proc/self/maps")) {
+//       const char* line;
+//       size_t length;
+//       while ((line = procScannerNextLine(&scanner, &length)) != NULL) {
+//           ...
+//       }
+//       procScannerClose(&scanner);
+//   }
+
+// Small enough to live on the stack of a JNI call.
+#define PROC_SCANNER_BUFFER_SIZE (16 * 1024)
+
+struct ProcScanner {
+    int fd;
+    bool eof;
+    size_t start;  // of the unread data in |buffer|
+    size_t end;
+    char buffer[PROC_SCANNER_BUFFER_SIZE];
+};
+
+bool procScannerOpen(ProcScanner* scanner, const char* path);
+void procScannerClose(ProcScanner* scanner);
+
+// Returns the next line, without its '\n' but NUL-terminated, and stores its
+// length in |length|. Returns NULL at the end of the file or on an error.
+// The line stays valid until the next call. Lines longer than the buffer
+// are split.
+const char* procScannerNextLine(ProcScanner* scanner, size_t* length);
+
+// Returns the first |c| in [p, end), or |end|.
+const char* procScannerFind(const char* p, const char* end, char c);
+
+// Returns the first byte in [p, end) that isn't a space or a tab, or |end|.
+const char* procScannerSkipSpaces(const char* p, const char* end);
+
+// Decode a hexadecimal or decimal number at |*p|, advancing |*p| past it.
+// Return false, leaving |*p| alone, if there are no digits there.
+bool procScannerParseHex(const char** p, const char* end, uint64_t* value);
+bool procScannerParseDecimal(const char** p, const char* end, uint64_t* value);
+
+#endif  // PROC_SCANNER_H_
@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sandbox_executor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/seccomp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef PR_SET_NO_NEW_PRIVS
+#define PR_SET_NO_NEW_PRIVS 38
+#endif
+
+#define CACHE_LINE 64
+
+struct Slot {
+    uint64_t id;
+    uint32_t size;
+    uint32_t reserved;
+    char payload[SANDBOX_MAX_PAYLOAD];
+};
+
+// Single producer, single consumer. The indices only grow; a slot is
+// |index| % SANDBOX_RING_SLOTS.
+struct Ring {
+    uint32_t head;  // next slot to consume
+    char headPadding[CACHE_LINE - sizeof(uint32_t)];
+    uint32_t tail;  // next slot to produce
+    char tailPadding[CACHE_LINE - sizeof(uint32_t)];
+    Slot slots[SANDBOX_RING_SLOTS];
+};
+
+// Shared with one worker, in a mapping of its own that no other worker
+// has, so that a worker can't read another's jobs or forge its results.
+struct Channel {
+    Ring jobs;
+    Ring results;
+    int jobWaiting;  // the worker is asleep on its doorbell
+    int resultWaiting;  // the parent is asleep on the result doorbell
+    int stop;
+    char padding[CACHE_LINE - 3 * sizeof(int)];
+};
+
+struct SandboxExecutor {
+    int workerCount;
+    pid_t* pids;
+    int* jobBells;  // write ends, one per worker
+    int resultBell;  // read end, shared by the workers
+    int nextWorker;  // where sandboxExecutorReceive() looks first
+    Channel** channels;
+};
+
+// Wakes a peer that went to sleep with |*waiting| set. Called after the
+// peer's ring changed; the fence orders that change before reading the flag,
+// and the peer's own fence orders setting the flag before its last look at
+// the ring, so one of the two sees the other.
+static void wakePeer(int* waiting, int bell) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_RELAXED) &&
+            __atomic_exchange_n(waiting, 0, __ATOMIC_ACQ_REL)) {
+        char c = 0;
+        TEMP_FAILURE_RETRY(write(bell, &c, sizeof(c)));
+    }
+}
+
+// Sleeps on |bell| unless |ready| becomes true once |*waiting| is set.
+// Returns false if the bell was closed.
+static bool waitUntil(bool (*ready)(void*), void* arg, int* waiting, int bell) {
+    __atomic_store_n(waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    // If the peer cleared the flag before we could, it also rang the bell,
+    // and that byte has to be taken either way.
+    if (ready(arg) && __atomic_exchange_n(waiting, 0, __ATOMIC_ACQ_REL)) {
+        return true;
+    }
+    char c;
+    return TEMP_FAILURE_RETRY(read(bell, &c, sizeof(c))) == sizeof(c);
+}
+
+static bool ringEmpty(const Ring* ring) {
+    return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) ==
+            __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+}
+
+static bool ringFull(const Ring* ring) {
+    return __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) -
+            __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == SANDBOX_RING_SLOTS;
+}
+
+// The worker can go on when it has a job and room for the result, or when
+// it has been told to stop.
+static bool workerReady(void* arg) {
+    Channel* channel = reinterpret_cast<Channel*>(arg);
+    return (!ringEmpty(&channel->jobs) && !ringFull(&channel->results)) ||
+            __atomic_load_n(&channel->stop, __ATOMIC_ACQUIRE);
+}
+
+// Runs in the sandbox: only read(), write() and exit() from here on.
+static void __attribute__((noreturn)) runWorker(Channel* channel, SandboxJob job, int jobBell,
+                                                int resultBell) {
+    Ring* jobs = &channel->jobs;
+    Ring* results = &channel->results;
+    for (;;) {
+        if (ringEmpty(jobs) || ringFull(results)) {
+            if (__atomic_load_n(&channel->stop, __ATOMIC_ACQUIRE) ||
+                    !waitUntil(workerReady, channel, &channel->jobWaiting, jobBell)) {
+                break;
+            }
+            continue;
+        }
+        uint32_t head = jobs->head;
+        uint32_t tail = results->tail;
+        const Slot* in = &jobs->slots[head % SANDBOX_RING_SLOTS];
+        Slot* out = &results->slots[tail % SANDBOX_RING_SLOTS];
+        out->id = in->id;
+        out->size = job(in->payload, in->size, out->payload, SANDBOX_MAX_PAYLOAD);
+        __atomic_store_n(&jobs->head, head + 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&results->tail, tail + 1, __ATOMIC_RELEASE);
+        wakePeer(&channel->resultWaiting, resultBell);
+    }
+    // exit_group() isn't allowed in strict mode, but exit() is.
+    syscall(__NR_exit, 0);
+    __builtin_unreachable();
+}
+
+SandboxExecutor* sandboxExecutorCreate(int workers, SandboxJob job,
+                                       const struct sock_fprog* filter) {
+    SandboxExecutor* executor =
+            reinterpret_cast<SandboxExecutor*>(calloc(1, sizeof(SandboxExecutor)));
+    if (executor == NULL) {
+        return NULL;
+    }
+    executor->pids = reinterpret_cast<pid_t*>(calloc(workers, sizeof(pid_t)));
+    executor->jobBells = reinterpret_cast<int*>(calloc(workers, sizeof(int)));
+    executor->channels = reinterpret_cast<Channel**>(calloc(workers, sizeof(Channel*)));
+    int resultBell[2];
+    if (executor->pids == NULL || executor->jobBells == NULL || executor->channels == NULL ||
+            pipe2(resultBell, O_CLOEXEC) != 0) {
+        free(executor->pids);
+        free(executor->jobBells);
+        free(executor->channels);
+        free(executor);
+        return NULL;
+    }
+    executor->resultBell = resultBell[0];
+
+    for (; executor->workerCount < workers; executor->workerCount++) {
+        int i = executor->workerCount;
+        // Mapped before this worker is forked and after the ones before it,
+        // so no other worker inherits it.
+        void* channel = mmap(NULL, sizeof(Channel), PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (channel == MAP_FAILED) {
+            break;
+        }
+        int jobBell[2];
+        if (pipe2(jobBell, O_CLOEXEC) != 0) {
+            munmap(channel, sizeof(Channel));
+            break;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            // Keep only our own ends of our own doorbells, and only our own
+            // channel, which the workers forked before us also left mapped.
+            close(resultBell[0]);
+            close(jobBell[1]);
+            for (int j = 0; j < i; j++) {
+                close(executor->jobBells[j]);
+                munmap(executor->channels[j], sizeof(Channel));
+            }
+            bool sandboxed = (filter == NULL) ?
+                    prctl(PR_SET_SECCOMP, SECCOMP_MODE_STRICT, 0, 0, 0) == 0 :
+                    prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 &&
+                    prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, filter) == 0;
+            if (!sandboxed) {
+                _exit(1);
+            }
+            runWorker(reinterpret_cast<Channel*>(channel), job, jobBell[0], resultBell[1]);
+        }
+        close(jobBell[0]);
+        if (pid < 0) {
+            close(jobBell[1]);
+            munmap(channel, sizeof(Channel));
+            break;
+        }
+        executor->pids[i] = pid;
+        executor->jobBells[i] = jobBell[1];
+        executor->channels[i] = reinterpret_cast<Channel*>(channel);
+    }
+    close(resultBell[1]);
+    if (executor->workerCount < workers) {
+        sandboxExecutorDestroy(executor);
+        return NULL;
+    }
+    return executor;
+}
+
+bool sandboxExecutorSubmit(SandboxExecutor* executor, int worker, uint64_t id,
+                           const void* data, uint32_t size) {
+    worker %= executor->workerCount;
+    Channel* channel = executor->channels[worker];
+    Ring* jobs = &channel->jobs;
+    if (size > SANDBOX_MAX_PAYLOAD || ringFull(jobs)) {
+        return false;
+    }
+    uint32_t tail = jobs->tail;
+    Slot* slot = &jobs->slots[tail % SANDBOX_RING_SLOTS];
+    slot->id = id;
+    slot->size = size;
+    memcpy(slot->payload, data, size);
+    __atomic_store_n(&jobs->tail, tail + 1, __ATOMIC_RELEASE);
+    wakePeer(&channel->jobWaiting, executor->jobBells[worker]);
+    return true;
+}
+
+static bool anyResult(SandboxExecutor* executor) {
+    for (int i = 0; i < executor->workerCount; i++) {
+        if (!ringEmpty(&executor->channels[i]->results)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// waitUntil() for the parent, which sets the flag in every channel. A
+// worker only clears its own, and rings the shared bell if it was set, so
+// more than one may ring for one sleep. The bytes left over only make a
+// later sleep end early, and the caller look at the rings again, like a
+// byte written by a worker that has nothing to report.
+static bool waitForResult(SandboxExecutor* executor) {
+    for (int i = 0; i < executor->workerCount; i++) {
+        __atomic_store_n(&executor->channels[i]->resultWaiting, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (anyResult(executor)) {
+        for (int i = 0; i < executor->workerCount; i++) {
+            __atomic_store_n(&executor->channels[i]->resultWaiting, 0, __ATOMIC_RELAXED);
+        }
+        return true;
+    }
+    char c;
+    return TEMP_FAILURE_RETRY(read(executor->resultBell, &c, sizeof(c))) == sizeof(c);
+}
+
+bool sandboxExecutorReceive(SandboxExecutor* executor, uint64_t* id, void* out,
+                            uint32_t capacity, uint32_t* size) {
+    for (;;) {
+        for (int n = 0; n < executor->workerCount; n++) {
+            int worker = (executor->nextWorker + n) % executor->workerCount;
+            Channel* channel = executor->channels[worker];
+            Ring* results = &channel->results;
+            if (ringEmpty(results)) {
+                continue;
+            }
+            uint32_t head = results->head;
+            const Slot* slot = &results->slots[head % SANDBOX_RING_SLOTS];
+            // The worker is untrusted, so don't believe its size either.
+            uint32_t length = slot->size;
+            if (length > SANDBOX_MAX_PAYLOAD) {
+                length = SANDBOX_MAX_PAYLOAD;
+            }
+            *id = slot->id;
+            *size = length;
+            memcpy(out, slot->payload, length < capacity ? length : capacity);
+            __atomic_store_n(&results->head, head + 1, __ATOMIC_RELEASE);
+            // The worker may be waiting for room for its next result.
+            wakePeer(&channel->jobWaiting, executor->jobBells[worker]);
+            executor->nextWorker = worker + 1;
+            return true;
+        }
+        if (!waitForResult(executor)) {
+            return false;
+        }
+    }
+}
+
+int sandboxExecutorDestroy(SandboxExecutor* executor) {
+    for (int i = 0; i < executor->workerCount; i++) {
+        __atomic_store_n(&executor->channels[i]->stop, 1, __ATOMIC_RELEASE);
+        wakePeer(&executor->channels[i]->jobWaiting, executor->jobBells[i]);
+        close(executor->jobBells[i]);
+    }
+    int failed = 0;
+    for (int i = 0; i < executor->workerCount; i++) {
+        int status;
+        if (TEMP_FAILURE_RETRY(waitpid(executor->pids[i], &status, 0)) != executor->pids[i] ||
+                !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed++;
+        }
+    }
+    close(executor->resultBell);
+    for (int i = 0; i < executor->workerCount; i++) {
+        munmap(executor->channels[i], sizeof(Channel));
+    }
+    free(executor->pids);
+    free(executor->jobBells);
+    free(executor->channels);
+    free(executor);
+    return failed;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SANDBOX_EXECUTOR_H_
+#define SANDBOX_EXECUTOR_H_
+
+#include <linux/filter.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Runs pure computations on untrusted input in sandboxed worker processes.
+//
+// In SECCOMP_MODE_STRICT (see mode_strict_support in seccomp_bpf_tests.c) a
+// worker may only read(), write(), exit() and sigreturn(), and the kernel
+// checks that with a comparison rather than a filter. That is enough for a
+// worker that computes: jobs and results travel through rings in memory
+// that each worker shares with the parent alone, mapped before the fork,
+// and the pipes are only doorbells, rung when the other side has gone to
+// sleep waiting. Workers can also run under a filter instead, for
+// comparison.
+//
+// A job function runs in the worker and must not make any other syscalls,
+// which includes allocating memory; a worker that does is killed.
+
+// Reads |inSize| bytes at |in| and writes at most |outCapacity| bytes of
+// result to |out|, returning the result's size.
+typedef uint32_t (*SandboxJob)(const void* in, uint32_t inSize, void* out,
+                               uint32_t outCapacity);
+
+// Largest job input or result.
+#define SANDBOX_MAX_PAYLOAD 4080
+
+// Jobs that may be waiting for each worker.
+#define SANDBOX_RING_SLOTS 64
+
+struct SandboxExecutor;
+
+// Forks |workers| processes that run |job|, in strict mode if |filter| is
+// NULL and under |filter| otherwise. Returns NULL on failure.
+SandboxExecutor* sandboxExecutorCreate(int workers, SandboxJob job,
+                                       const struct sock_fprog* filter);
+
+// Queues a job for |worker| (taken modulo the number of workers), with
+// |id| to recognize its result by. Returns false if that worker's queue is
+// full or the job is too large.
+bool sandboxExecutorSubmit(SandboxExecutor* executor, int worker, uint64_t id,
+                           const void* data, uint32_t size);
+
+// Waits for a result from any worker, copying at most |capacity| bytes of
+// it to |out|. Returns false if every worker has died.
+bool sandboxExecutorReceive(SandboxExecutor* executor, uint64_t* id, void* out,
+                            uint32_t capacity, uint32_t* size);
+
+// Stops the workers and waits for them. Returns the number of workers that
+// didn't exit cleanly, e.g. were killed for making a forbidden syscall.
+int sandboxExecutorDestroy(SandboxExecutor* executor);
+
+#endif  // SANDBOX_EXECUTOR_H_
@@ -158,6 +158,8 @@ TEST(mode_filter_without_nnp) {
 
 #define MAX_INSNS_PER_PATH 32768
 
+TEST_SIZE(filter_size_limits, TH_SIZE_MEDIUM);
+
 TEST(filter_size_limits) {
 	int i;
 	int count = BPF_MAXINSNS + 1;
@@ -194,6 +196,9 @@ TEST(filter_size_limits) {
 	}
 }
 
+/* Installs up to MAX_INSNS_PER_PATH filters. */
+TEST_SIZE(filter_chain_limits, TH_SIZE_LARGE);
+
 TEST(filter_chain_limits) {
 	int i;
 	int count = BPF_MAXINSNS;
@@ -541,6 +546,10 @@ FIXTURE_DATA(TRAP) {
 };
 
 FIXTURE_SETUP(TRAP) {
+}
+
+/* The program is built once and inherited by every TRAP test child. */
+FIXTURE_SETUP_ONCE(TRAP) {
 	struct sock_filter filter[] = {
 		BPF_STMT(BPF_LD|BPF_W|BPF_ABS,
 			offsetof(struct seccomp_data, nr)),
@@ -556,8 +565,7 @@ FIXTURE_SETUP(TRAP) {
 }
 
 FIXTURE_TEARDOWN(TRAP) {
-	if (self->prog.filter)
-		free(self->prog.filter);
+	/* self->prog belongs to FIXTURE_SETUP_ONCE. */
 };
 
 TEST_F_SIGNAL(TRAP, dfl, SIGSYS) {
@@ -646,6 +654,10 @@ FIXTURE_DATA(precedence) {
 };
 
 FIXTURE_SETUP(precedence) {
+}
+
+/* The programs are built once and inherited by every precedence test child. */
+FIXTURE_SETUP_ONCE(precedence) {
 	struct sock_filter allow_insns[] = {
 		BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
 	};
@@ -691,12 +703,7 @@ FIXTURE_SETUP(precedence) {
 }
 
 FIXTURE_TEARDOWN(precedence) {
-#define FILTER_FREE(_x) if (self->_x.filter) free(self->_x.filter)
-	FILTER_FREE(allow);
-	FILTER_FREE(trace);
-	FILTER_FREE(error);
-	FILTER_FREE(trap);
-	FILTER_FREE(kill);
+	/* The programs belong to FIXTURE_SETUP_ONCE. */
 }
 
 TEST_F(precedence, allow_ok) {
@@ -1011,6 +1018,8 @@ void tracer_poke(struct __test_metadata *_metadata, pid_t tracee, int status,
 	EXPECT_EQ(0, ret);
 }
 
+REQUIRES(TRACE_poke, .features = TH_FEATURE_PTRACE);
+
 FIXTURE_DATA(TRACE_poke) {
 	struct sock_fprog prog;
 	pid_t tracer;
@@ -1178,6 +1187,8 @@ void tracer_syscall(struct __test_metadata *_metadata, pid_t tracee,
 
 }
 
+REQUIRES(TRACE_syscall, .features = TH_FEATURE_PTRACE);
+
 FIXTURE_DATA(TRACE_syscall) {
 	struct sock_fprog prog;
 	pid_t tracer, mytid, mypid, parent;
@@ -1269,21 +1280,6 @@ TEST_F(TRACE_syscall, syscall_dropped) {
 	EXPECT_NE(self->mytid, syscall(__NR_gettid));
 }
 
-#ifndef __NR_seccomp
-# if defined(__i386__)
-#  define __NR_seccomp 354
-# elif defined(__x86_64__)
-#  define __NR_seccomp 317
-# elif defined(__arm__)
-#  define __NR_seccomp 383
-# elif defined(__aarch64__)
-#  define __NR_seccomp 277
-# else
-#  warning "seccomp syscall number unknown for this architecture"
-#  define __NR_seccomp 0xffff
-# endif
-#endif
-
 #ifndef SECCOMP_SET_MODE_STRICT
 #define SECCOMP_SET_MODE_STRICT 0
 #endif
@@ -1304,6 +1300,8 @@ int seccomp(unsigned int op, unsigned int flags, struct sock_fprog *filter)
 }
 #endif
 
+REQUIRES(seccomp_syscall, .features = TH_FEATURE_SECCOMP_SYSCALL);
+
 TEST(seccomp_syscall) {
 	struct sock_filter filter[] = {
 		BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
@@ -1350,6 +1348,8 @@ TEST(seccomp_syscall) {
 	}
 }
 
+REQUIRES(seccomp_syscall_mode_lock, .features = TH_FEATURE_SECCOMP_SYSCALL);
+
 TEST(seccomp_syscall_mode_lock) {
 	struct sock_filter filter[] = {
 		BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
@@ -1380,6 +1380,8 @@ TEST(seccomp_syscall_mode_lock) {
 	}
 }
 
+REQUIRES(TSYNC_first, .features = TH_FEATURE_TSYNC);
+
 TEST(TSYNC_first) {
 	struct sock_filter filter[] = {
 		BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
@@ -1413,6 +1415,8 @@ struct tsync_sibling {
 	struct __test_metadata *metadata;
 };
 
+REQUIRES(TSYNC, .features = TH_FEATURE_TSYNC);
+
 FIXTURE_DATA(TSYNC) {
 	struct sock_fprog root_prog, apply_prog;
 	struct tsync_sibling sibling[TSYNC_SIBLINGS];
@@ -1798,6 +1802,9 @@ TEST_F(TSYNC, two_siblings_not_under_filter) {
 }
 
 /* Make sure restarted syscalls are seen directly as "restart_syscall". */
+REQUIRES(syscall_restart, .features = TH_FEATURE_PTRACE);
+TEST_SIZE(syscall_restart, TH_SIZE_MEDIUM);
+
 TEST(syscall_restart)
 {
 	long ret;
@@ -30,6 +30,9 @@
  *   FIXTURE_TEARDOWN(my_fixture) {
  *     mytype_free(self->data);
  *   }
+ *   FIXTURE_SETUP_ONCE(my_fixture) {
+ *     self->awesomeness_level = compute_expensive_awesomeness();
+ *   }
  *   TEST_F(my_fixture, data_is_good) {
  *     EXPECT_EQ(1, is_my_data_good(self->data));
  *   }
@@ -41,16 +44,44 @@
 #ifndef TEST_HARNESS_H_
 #define TEST_HARNESS_H_
 
+#ifndef _GNU_SOURCE  // ANDROID: C++ compilers define it
 #define _GNU_SOURCE
+#endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <setjmp.h>
+#include <stdarg.h>
 #include <string.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/utsname.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <android/log.h>  // ANDROID
 
+#ifndef __NR_seccomp
+# if defined(__i386__)
+#  define __NR_seccomp 354
+# elif defined(__x86_64__)
+#  define __NR_seccomp 317
+# elif defined(__arm__)
+#  define __NR_seccomp 383
+# elif defined(__aarch64__)
+#  define __NR_seccomp 277
+# else
+#  warning "seccomp syscall number unknown for this architecture"
+#  define __NR_seccomp 0xffff
+# endif
+#endif
+
 /* All exported functionality should be declared through this macro. */
 #define TEST_API(x) _##x
 
@@ -60,7 +91,8 @@
 
 /* TEST(name) { implementation }
  * Defines a test by name.
- * Names must be unique and tests must not be run in parallel.  The
+ * Names must be unique.  Each test runs in its own process, possibly next to
+ * other tests when the harness is run with -j.  The
  * implementation containing block is a function and scoping should be treated
  * as such.  Returning early may be performed with a bare "return;" statement.
  *
@@ -70,7 +102,8 @@
 
 /* TEST_SIGNAL(name, signal) { implementation }
  * Defines a test by name and the expected term signal.
- * Names must be unique and tests must not be run in parallel.  The
+ * Names must be unique.  Each test runs in its own process, possibly next to
+ * other tests when the harness is run with -j.  The
  * implementation containing block is a function and scoping should be treated
  * as such.  Returning early may be performed with a bare "return;" statement.
  *
@@ -106,6 +139,20 @@
  */
 #define FIXTURE_SETUP TEST_API(FIXTURE_SETUP)
 
+/* FIXTURE_SETUP_ONCE(fixture name) { implementation }
+ * Optional.  Populates a fixture instance once, in the harness process, just
+ * before the first test of the fixture is forked.  Every TEST_F() child then
+ * starts from a copy of that instance -- and shares anything it points to
+ * copy-on-write -- before FIXTURE_SETUP runs, so expensive state (large
+ * filters, buffers) is built once per fixture instead of once per test.
+ * Must follow FIXTURE_SETUP.
+ *
+ * ASSERT_* are valid for use in this context; a failure marks every test in
+ * the fixture as failed without running it.  Anything allocated here is owned
+ * by the harness, so FIXTURE_TEARDOWN should not free it.
+ */
+#define FIXTURE_SETUP_ONCE TEST_API(FIXTURE_SETUP_ONCE)
+
 /* FIXTURE_TEARDOWN(fixture name) { implementation }
  * Populates the required "teardown" function for a fixture.  An instance of the
  * datatype defined with _FIXTURE_DATA will be exposed as |self| for the
@@ -124,8 +171,35 @@
 
 #define TEST_F_SIGNAL TEST_API(TEST_F_SIGNAL)
 
+/* REQUIRES(fixture or test name, requirement, ...);
+ * Declares what the tests of a fixture, or a single TEST(), need from the
+ * running system.  Requirements are designated initializers for
+ * struct __test_requires:
+ *   .features = TH_FEATURE_SECCOMP_SYSCALL | TH_FEATURE_TSYNC |
+ *               TH_FEATURE_PTRACE
+ *   .arch = "aarch64"                     (prefix of uname's machine)
+ *   .kernel = TH_KERNEL_VERSION(3, 17)    (minimum release)
+ * E.g.,
+ *   REQUIRES(TSYNC, .features = TH_FEATURE_TSYNC);
+ *
+ * Each feature is probed at most once per harness process.  Tests whose
+ * requirements are not met are reported as SKIP without being forked.
+ */
+#define REQUIRES TEST_API(REQUIRES)
+
+/* TEST_SIZE(fixture or test name, size);
+ * Hints how long the tests of a fixture, or a single TEST(), take:
+ * TH_SIZE_SMALL (the default), TH_SIZE_MEDIUM or TH_SIZE_LARGE.  Parallel
+ * runs start the longest tests first and use these hints for tests that have
+ * no recorded duration yet.
+ */
+#define TEST_SIZE TEST_API(TEST_SIZE)
+
 /* Use once to append a main() to the test file. E.g.,
  *   TEST_HARNESS_MAIN
+ * ANDROID: this defines seccomp_test_main() instead, so the file can also
+ * be linked into libctsos_jni; test_harness_main.c supplies the main() that
+ * calls it for the programs built from the test files.
  */
 #define TEST_HARNESS_MAIN TEST_API(TEST_HARNESS_MAIN)
 
@@ -202,6 +276,17 @@
 #  define TH_LOG_ENABLED 1
 #endif
 
+/* TH_FAST_FAIL
+ * When non-zero, a failed ASSERT_* records its line in a result page shared
+ * with the harness and leaves through _exit() rather than abort(), and tests
+ * expecting a termination signal run with that signal's handler reset and
+ * core dumps disabled.  This keeps crash dumpers (e.g., debuggerd) from
+ * spending seconds on failures and deaths that the harness already expects.
+ */
+#ifndef TH_FAST_FAIL
+#  define TH_FAST_FAIL 0
+#endif
+
 #define _TH_LOG(fmt, ...) do { \
   if (TH_LOG_ENABLED) \
     __TH_LOG(fmt, ##__VA_ARGS__); \
@@ -209,9 +294,17 @@
 
 /* Unconditional logger for internal use. */
 // ANDROID:begin
-#define __TH_LOG(fmt, ...) \
+// Goes to the log, except in a test child whose output the harness captures
+// (see __start_test()), where it has to end up in the captured output to be
+// reported with the failure.
+#define __TH_LOG(fmt, ...) do { \
+  if (__test_output_captured) \
+    fprintf(TH_LOG_STREAM, "%s:%d:%s:" fmt "\n", \
+            __FILE__, __LINE__, _metadata->name, ##__VA_ARGS__); \
+  else \
     __android_log_print(ANDROID_LOG_ERROR, "SeccompBpfTest-KernelUnit", "%s:%d:%s:" fmt "\n", \
-            __FILE__, __LINE__, _metadata->name, ##__VA_ARGS__)
+            __FILE__, __LINE__, _metadata->name, ##__VA_ARGS__); \
+} while (0)
 // ANDROID:end
 
 /* Defines the test function and creates the registration stub. */
@@ -229,6 +322,28 @@
   static void test_name( \
     struct __test_metadata __attribute__((unused)) *_metadata)
 
+/* Registers the requirements under the fixture or TEST() name. */
+#define _REQUIRES(fixture_or_test_name, ...) \
+  static struct __test_requires _##fixture_or_test_name##_requires = { \
+    name: #fixture_or_test_name, \
+    __VA_ARGS__ \
+  }; \
+  static void __attribute__((constructor)) \
+      _register_##fixture_or_test_name##_requires(void) { \
+    __register_requires(&_##fixture_or_test_name##_requires); \
+  }
+
+/* Registers the hint under the fixture or TEST() name. */
+#define _TEST_SIZE(fixture_or_test_name, _size) \
+  static struct __test_size _##fixture_or_test_name##_size = { \
+    name: #fixture_or_test_name, \
+    size: _size, \
+  }; \
+  static void __attribute__((constructor)) \
+      _register_##fixture_or_test_name##_size(void) { \
+    __register_size(&_##fixture_or_test_name##_size); \
+  }
+
 /* Wraps the struct name so we have one less argument to pass around. */
 #define _FIXTURE_DATA(fixture_name) struct _test_data_##fixture_name
 
@@ -244,9 +359,34 @@
  * so that ASSERT_* work as a convenience.
  */
 #define _FIXTURE_SETUP(fixture_name) \
+  static struct __fixture_metadata _##fixture_name##_fixture_object = { \
+    name: #fixture_name, \
+  }; \
   void fixture_name##_setup( \
     struct __test_metadata __attribute__((unused)) *_metadata, \
     _FIXTURE_DATA(fixture_name) __attribute__((unused)) *self)
+
+/* Keeps the instance populated by the harness process and hooks it up to the
+ * fixture so that TEST_F() wrappers start from it.
+ */
+#define _FIXTURE_SETUP_ONCE(fixture_name) \
+  static _FIXTURE_DATA(fixture_name) _##fixture_name##_once_self; \
+  static void fixture_name##_setup_once( \
+    struct __test_metadata *_metadata, \
+    _FIXTURE_DATA(fixture_name) *self); \
+  static void _##fixture_name##_setup_once_wrapper( \
+    struct __test_metadata *_metadata) { \
+    fixture_name##_setup_once(_metadata, &_##fixture_name##_once_self); \
+  } \
+  static void __attribute__((constructor)) \
+      _register_##fixture_name##_setup_once(void) { \
+    _##fixture_name##_fixture_object.setup_once = \
+        &_##fixture_name##_setup_once_wrapper; \
+    _##fixture_name##_fixture_object.self = &_##fixture_name##_once_self; \
+  } \
+  static void fixture_name##_setup_once( \
+    struct __test_metadata __attribute__((unused)) *_metadata, \
+    _FIXTURE_DATA(fixture_name) __attribute__((unused)) *self)
 #define _FIXTURE_TEARDOWN(fixture_name) \
   void fixture_name##_teardown( \
     struct __test_metadata __attribute__((unused)) *_metadata, \
@@ -271,6 +411,10 @@
     /* fixture data is allocated, setup, and torn down per call. */ \
     _FIXTURE_DATA(fixture_name) self; \
     memset(&self, 0, sizeof(_FIXTURE_DATA(fixture_name))); \
+    /* Inherit whatever FIXTURE_SETUP_ONCE built in the harness. */ \
+    if (_##fixture_name##_fixture_object.self) \
+      memcpy(&self, _##fixture_name##_fixture_object.self, \
+             sizeof(_FIXTURE_DATA(fixture_name))); \
     fixture_name##_setup(_metadata, &self); \
     /* Let setup failure terminate early. */ \
     if (!_metadata->passed) return; \
@@ -281,6 +425,7 @@
     name: #fixture_name "." #test_name, \
     fn: &wrapper_##fixture_name##_##test_name, \
     termsig: signal, \
+    fixture: &_##fixture_name##_fixture_object, \
    }; \
   static void __attribute__((constructor)) \
       _register_##fixture_name##_##test_name(void) { \
@@ -291,12 +436,22 @@
     _FIXTURE_DATA(fixture_name) __attribute__((unused)) *self)
 
 /* Exports a simple wrapper to run the test harness. */
+// ANDROID:begin
+// With C linkage, for test_harness_main.c to call from a C++ test file too.
+#ifdef __cplusplus
+#define __TEST_HARNESS_MAIN_LINKAGE extern "C"
+#else
+#define __TEST_HARNESS_MAIN_LINKAGE
+#endif
+// ANDROID:end
 #define _TEST_HARNESS_MAIN \
   static void __attribute__((constructor)) __constructor_order_last(void) { \
     if (!__constructor_order) \
       __constructor_order = _CONSTRUCTOR_ORDER_BACKWARD; \
   } \
-  int seccomp_test_main(int argc, char **argv) { return test_harness_run(argc, argv); }  // ANDROID
+  __TEST_HARNESS_MAIN_LINKAGE int seccomp_test_main(int argc, char **argv) { \
+    return test_harness_run(argc, argv); \
+  }  // ANDROID
 
 #define _ASSERT_EQ(_expected, _seen) \
   __EXPECT(_expected, _seen, ==, 1)
@@ -354,7 +509,8 @@
  * return while still providing an optional block to the API consumer.
  */
 #define OPTIONAL_HANDLER(_assert) \
-  for (; _metadata->trigger;  _metadata->trigger = __bail(_assert))
+  for (; _metadata->trigger; \
+       _metadata->trigger = __bail(_assert, _metadata, __LINE__))
 
 #define __EXPECT(_expected, _seen, _t, _assert) do { \
   /* Avoid multiple evaluation of the cases */ \
@@ -385,6 +541,25 @@
   } \
 } while (0); OPTIONAL_HANDLER(_assert)
 
+/* Written by a test child (or any of its descendants) when an ASSERT_* fails
+ * under TH_FAST_FAIL.  Lives in a MAP_SHARED page so the harness can tell an
+ * assertion exit apart from a test that called exit() itself.
+ */
+struct __test_result {
+  int bailed;
+  int line;
+};
+
+struct __test_metadata;
+
+/* Per-fixture state shared by all of its TEST_F() tests. */
+struct __fixture_metadata {
+  const char *name;
+  void (*setup_once)(struct __test_metadata *);
+  void *self; /* instance populated by setup_once, copied into each test */
+  int setup_once_state; /* 0: not run yet, 1: succeeded, -1: failed */
+};
+
 /* Contains all the information for test execution and status checking. */
 struct __test_metadata {
   const char *name;
@@ -392,13 +567,54 @@ struct __test_metadata {
   int termsig;
   int passed;
   int trigger; /* extra handler after the evaluation */
+  struct __test_result *result; /* shared with the child; may be NULL */
+  struct __fixture_metadata *fixture; /* NULL for TEST() */
+  jmp_buf *bail; /* set while running in the harness process */
+  int skipped; /* requirements were not met; passed is left set */
+  unsigned int index; /* declaration order */
+  unsigned long long history_ns; /* from the stats file, if any */
+  unsigned long long expected_ns; /* history_ns, or from TEST_SIZE() */
+  unsigned long long start_ns, duration_ns;
+  int output_fd; /* captures the child's stdout/stderr; -1 if not */
   struct __test_metadata *prev, *next;
 };
 
+#define TH_FEATURE_SECCOMP_SYSCALL  (1U << 0)
+#define TH_FEATURE_TSYNC            (1U << 1)
+#define TH_FEATURE_PTRACE           (1U << 2)
+
+#define TH_KERNEL_VERSION(major, minor) (((major) << 16) | ((minor) << 8))
+
+/* Relative cost hints for TEST_SIZE(); one unit is TH_SIZE_UNIT_NS. */
+#define TH_SIZE_SMALL   1
+#define TH_SIZE_MEDIUM  10
+#define TH_SIZE_LARGE   100
+#define TH_SIZE_UNIT_NS 10000000ULL
+
+/* Declared through TEST_SIZE(). */
+struct __test_size {
+  const char *name; /* fixture name, or TEST() name without "global." */
+  unsigned int size; /* TH_SIZE_* */
+  struct __test_size *next;
+};
+
+/* Declared through REQUIRES(). */
+struct __test_requires {
+  const char *name; /* fixture name, or TEST() name without "global." */
+  unsigned int features; /* TH_FEATURE_* */
+  const char *arch; /* prefix of utsname.machine */
+  unsigned int kernel; /* TH_KERNEL_VERSION() */
+  struct __test_requires *next;
+};
+
 /* Storage for the (global) tests to be run. */
 static struct __test_metadata *__test_list = NULL;
 static unsigned int __test_count = 0;
 static unsigned int __fixture_count = 0;
+static struct __test_requires *__requires_list = NULL;
+static struct __test_size *__size_list = NULL;
+static int __test_verbose = 0;
+static int __test_output_captured = 0; /* set in test children */
 static int __constructor_order = 0;
 
 #define _CONSTRUCTOR_ORDER_FORWARD   1
@@ -435,80 +651,578 @@ static inline void __register_test(struct __test_metadata *t) {
   }
 }
 
-static inline int __bail(int for_realz) {
-  if (for_realz)
+/* Exit code used for the TH_FAST_FAIL assertion path.  Any non-zero value
+ * works for nested helpers (e.g., tracers) whose parents treat non-zero as
+ * failure; the harness itself keys off the shared result record.
+ */
+#define _TH_BAIL_EXIT_CODE 0x7b
+
+/* Upper bound on tests running at once under test_harness_run -j. */
+#define TH_MAX_JOBS 64
+
+static inline void __register_requires(struct __test_requires *r) {
+  r->next = __requires_list;
+  __requires_list = r;
+}
+
+static inline void __register_size(struct __test_size *s) {
+  s->next = __size_list;
+  __size_list = s;
+}
+
+static inline unsigned long long __test_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int __bail(int for_realz, struct __test_metadata *t, int line) {
+  if (for_realz) {
+    /* Never take the harness process down with an assertion. */
+    if (t->bail)
+      longjmp(*t->bail, 1);
+#if TH_FAST_FAIL
+    if (t->result) {
+      t->result->line = line;
+      t->result->bailed = 1;
+      _exit(_TH_BAIL_EXIT_CODE);
+    }
+#else
+    (void)t;
+    (void)line;
+#endif
     abort();
+  }
   return 0;
 }
 
-void __run_test(struct __test_metadata *t) {
-  pid_t child_pid;
+/* Returns the records used to hand assertion results back from test
+ * children, one per concurrently running test, mapped once per harness
+ * instance.
+ */
+static inline struct __test_result *__test_result_page(void) {
+  static struct __test_result *page = NULL;
+  if (page == NULL) {
+    void *p = mmap(NULL, TH_MAX_JOBS * sizeof(*page), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED)
+      page = (struct __test_result *)p;
+  }
+  return page;
+}
+
+/* Tests that expect to die by a signal should not pay for crash reporting:
+ * restore the default disposition (dropping any dumper's handler) and make
+ * sure no core is written.  Runs in the test child only.
+ */
+static inline void __expect_termsig(int termsig) {
+  struct rlimit no_core = { 0, 0 };
+  if (termsig != SIGKILL)
+    signal(termsig, SIG_DFL);
+  setrlimit(RLIMIT_CORE, &no_core);
+}
+
+/* SECCOMP_SET_MODE_STRICT with bogus flags: EINVAL only if the syscall
+ * exists.
+ */
+static inline int __probe_seccomp_syscall(void) {
+#ifdef __NR_seccomp
+  errno = 0;
+  return syscall(__NR_seccomp, 0, -1, NULL) == -1 && errno == EINVAL;
+#else
+  return 0;
+#endif
+}
+
+/* SECCOMP_SET_MODE_FILTER with SECCOMP_FILTER_FLAG_TSYNC and no program:
+ * unknown flags are rejected (EINVAL) before the program is read (EFAULT).
+ */
+static inline int __probe_tsync(void) {
+#ifdef __NR_seccomp
+  errno = 0;
+  return syscall(__NR_seccomp, 1, 1, NULL) == -1 && errno == EFAULT;
+#else
+  return 0;
+#endif
+}
+
+/* The TRACE fixtures attach to their test from a child, so besides a
+ * working ptrace() they need Yama to allow non-ancestor attaches.
+ */
+static inline int __probe_ptrace(void) {
   int status;
+  int scope = 0;
+  FILE *fp;
+  pid_t pid = fork();
+
+  if (pid < 0)
+    return 0;
+  if (pid == 0)
+    _exit(ptrace(PTRACE_TRACEME, 0, NULL, NULL) == 0 ? 0 : 1);
+  if (waitpid(pid, &status, 0) != pid ||
+      !WIFEXITED(status) || WEXITSTATUS(status))
+    return 0;
+
+  fp = fopen("/proc/sys/kernel/yama/ptrace_scope", "re");
+  if (fp) {
+    if (fscanf(fp, "%d", &scope) != 1)
+      scope = 0;
+    fclose(fp);
+  }
+  return scope < 2 || (scope == 2 && geteuid() == 0);
+}
+
+/* Probes lazily, once per feature, and returns the features available. */
+static inline unsigned int __test_features(unsigned int wanted) {
+  static unsigned int probed = 0;
+  static unsigned int present = 0;
+  unsigned int todo = wanted & ~probed;
+
+  if ((todo & TH_FEATURE_SECCOMP_SYSCALL) && __probe_seccomp_syscall())
+    present |= TH_FEATURE_SECCOMP_SYSCALL;
+  if ((todo & TH_FEATURE_TSYNC) && __probe_tsync())
+    present |= TH_FEATURE_TSYNC;
+  if ((todo & TH_FEATURE_PTRACE) && __probe_ptrace())
+    present |= TH_FEATURE_PTRACE;
+  probed |= todo;
+  return present;
+}
+
+static inline struct utsname *__test_utsname(void) {
+  static struct utsname uts;
+  static int probed = 0;
+  if (!probed && uname(&uts))
+    memset(&uts, 0, sizeof(uts));
+  probed = 1;
+  return &uts;
+}
+
+/* Matches a fixture name, or the name of a TEST(), against |t|. */
+static inline int __test_name_matches(const char *name,
+                                      const struct __test_metadata *t) {
+  if (t->fixture)
+    return strcmp(name, t->fixture->name) == 0;
+  return strncmp(t->name, "global.", 7) == 0 &&
+         strcmp(name, t->name + 7) == 0;
+}
+
+static inline unsigned int __test_size_hint(const struct __test_metadata *t) {
+  const struct __test_size *s;
+  for (s = __size_list; s; s = s->next) {
+    if (__test_name_matches(s->name, t))
+      return s->size;
+  }
+  return TH_SIZE_SMALL;
+}
+
+/* Returns a description of the first requirement of |t| that the system
+ * does not meet, or NULL if the test can run.
+ */
+static inline const char *__test_unmet_requirement(
+    const struct __test_metadata *t) {
+  const struct __test_requires *r;
+
+  for (r = __requires_list; r; r = r->next) {
+    unsigned int missing;
+    if (!__test_name_matches(r->name, t))
+      continue;
+    missing = r->features & ~__test_features(r->features);
+    if (missing & TH_FEATURE_SECCOMP_SYSCALL)
+      return "seccomp() syscall";
+    if (missing & TH_FEATURE_TSYNC)
+      return "SECCOMP_FILTER_FLAG_TSYNC";
+    if (missing & TH_FEATURE_PTRACE)
+      return "ptrace attach";
+    if (r->arch && strncmp(__test_utsname()->machine, r->arch,
+                           strlen(r->arch)) != 0)
+      return r->arch;
+    if (r->kernel) {
+      unsigned int major = 0, minor = 0;
+      sscanf(__test_utsname()->release, "%u.%u", &major, &minor);
+      if (TH_KERNEL_VERSION(major, minor) < r->kernel)
+        return "newer kernel";
+    }
+  }
+  return NULL;
+}
+
+/* Harness diagnostics about |t|; kept with the test's own output when that
+ * is being captured.
+ */
+static inline void __attribute__((format(printf, 2, 3)))
+    __test_diag(struct __test_metadata *t, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  if (t->output_fd >= 0)
+    vdprintf(t->output_fd, fmt, args);
+  else
+    vfprintf(TH_LOG_STREAM, fmt, args);
+  va_end(args);
+}
+
+/* Runs the fixture's FIXTURE_SETUP_ONCE, if any, the first time one of its
+ * tests is about to be forked.  Returns zero if the fixture is unusable.
+ */
+static inline int __fixture_setup_once(struct __test_metadata *t) {
+  struct __fixture_metadata *f = t->fixture;
+  jmp_buf bail;
+
+  if (f == NULL || f->setup_once == NULL)
+    return 1;
+  if (f->setup_once_state == 0) {
+    t->bail = &bail;
+    if (setjmp(bail) == 0)
+      f->setup_once(t);
+    t->bail = NULL;
+    f->setup_once_state = t->passed ? 1 : -1;
+    if (f->setup_once_state < 0)
+      __test_diag(t, "%s: FIXTURE_SETUP_ONCE failed\n", f->name);
+  }
+  return f->setup_once_state > 0;
+}
+
+/* Returns a memfd (or, failing that, an unlinked temporary file) to capture
+ * a test child's stdout and stderr, or -1.
+ */
+static inline int __test_output_open(void) {
+  int fd = -1;
+  FILE *fp;
+#ifdef __NR_memfd_create
+  fd = syscall(__NR_memfd_create, "test_output", 1U /* MFD_CLOEXEC */);
+#endif
+  if (fd < 0 && (fp = tmpfile()) != NULL) {
+    fd = fcntl(fileno(fp), F_DUPFD_CLOEXEC, 0);
+    fclose(fp);
+  }
+  return fd;
+}
+
+/* Prints the verdict for |t|.  Captured output is only shown, together with
+ * its RUN line and in a single write, for tests that did not pass or when
+ * running verbosely.  The capture buffer is emptied for the next test.
+ */
+static inline void __report_test(struct __test_metadata *t) {
+  const char *verdict = t->skipped ? "SKIP" : (t->passed ? "OK" : "FAIL");
+  char *buf = NULL;
+  off_t len;
+
+  if (t->output_fd < 0) {
+    printf("[     %4s ] %s\n", verdict, t->name);
+    return;
+  }
+  len = lseek(t->output_fd, 0, SEEK_END);
+  if ((t->passed && !t->skipped && !__test_verbose) || len < 0)
+    len = 0;
+  if (len > 0 && (buf = (char *)malloc(len)) != NULL)
+    len = pread(t->output_fd, buf, len, 0);
+  if (buf == NULL || len < 0)
+    len = 0;
+  if (len || __test_verbose)
+    printf("[ RUN      ] %s\n%.*s", t->name, (int)len, buf ? buf : "");
+  printf("[     %4s ] %s\n", verdict, t->name);
+  fflush(stdout);
+  free(buf);
+  if (ftruncate(t->output_fd, 0) == 0)
+    lseek(t->output_fd, 0, SEEK_SET);
+}
+
+/* Forks the child for |t|, using result record |slot|.  Returns the child's
+ * pid, or 0 if the test finished (was skipped or failed) without one.
+ */
+static inline pid_t __start_test(struct __test_metadata *t, unsigned int slot) {
+  pid_t child_pid;
+  const char *unmet;
   t->passed = 1;
   t->trigger = 0;
-  printf("[ RUN      ] %s\n", t->name);
-  child_pid = fork();
-  if (child_pid < 0) {
-    printf("ERROR SPAWNING TEST CHILD\n");
+  t->skipped = 0;
+  t->duration_ns = 0;
+  t->result = TH_FAST_FAIL ? __test_result_page() : NULL;
+  if (t->result) {
+    t->result += slot;
+    memset(t->result, 0, sizeof(*t->result));
+  }
+  if (t->output_fd < 0)
+    printf("[ RUN      ] %s\n", t->name);
+  if ((unmet = __test_unmet_requirement(t)) != NULL) {
+    __test_diag(t, "%s: Skipped, requires %s\n", t->name, unmet);
+    t->skipped = 1;
+    __report_test(t);
+    return 0;
+  }
+  if (!__fixture_setup_once(t)) {
     t->passed = 0;
-  } else if (child_pid == 0) {
-    t->fn(t);
-    _exit(t->passed);
   } else {
+    t->start_ns = __test_now_ns();
+    /* Don't let children inherit (and later repeat) buffered output. */
+    fflush(stdout);
+    fflush(TH_LOG_STREAM);
+    child_pid = fork();
+    if (child_pid == 0) {
+      if (t->output_fd >= 0) {
+        dup2(t->output_fd, STDOUT_FILENO);
+        dup2(t->output_fd, STDERR_FILENO);
+        /* Tests leave through _exit(), which doesn't flush; this also keeps
+         * stdout and stderr in order. */
+        setvbuf(stdout, NULL, _IONBF, 0);
+        __test_output_captured = 1;
+      }
+      if (TH_FAST_FAIL && t->termsig != -1)
+        __expect_termsig(t->termsig);
+      t->fn(t);
+      _exit(t->passed);
+    }
+    if (child_pid > 0)
+      return child_pid;
+    __test_diag(t, "ERROR SPAWNING TEST CHILD\n");
+    t->passed = 0;
+  }
+  __report_test(t);
+  return 0;
+}
+
+/* Collects the result of a test child started by __start_test(). */
+static inline void __finish_test(struct __test_metadata *t, int status) {
+  t->duration_ns = __test_now_ns() - t->start_ns;
+  if (t->result && t->result->bailed) {
+    t->passed = 0;
+    __test_diag(t,
+            "%s: Test terminated by assertion at line %d\n",
+            t->name,
+            t->result->line);
+  } else if (WIFEXITED(status)) {
+    t->passed = t->termsig == -1 ? WEXITSTATUS(status) : 0;
+    if (t->termsig != -1) {
+     __test_diag(t,
+              "%s: Test exited normally instead of by signal (code: %d)\n",
+             t->name,
+             WEXITSTATUS(status));
+    }
+  } else if (WIFSIGNALED(status)) {
+    t->passed = 0;
+    if (WTERMSIG(status) == SIGABRT) {
+      __test_diag(t,
+              "%s: Test terminated by assertion\n",
+             t->name);
+    } else if (WTERMSIG(status) == t->termsig) {
+      t->passed = 1;
+    } else {
+      __test_diag(t,
+              "%s: Test terminated unexpectedly by signal %d\n",
+             t->name,
+             WTERMSIG(status));
+    }
+  } else {
+      __test_diag(t,
+              "%s: Test ended in some other way [%u]\n",
+             t->name,
+             status);
+  }
+  __report_test(t);
+}
+
+void __run_test(struct __test_metadata *t) {
+  int status;
+  pid_t child_pid;
+  t->output_fd = -1;
+  child_pid = __start_test(t, 0);
+  if (child_pid > 0) {
     /* TODO(wad) add timeout support. */
     waitpid(child_pid, &status, 0);
-    if (WIFEXITED(status)) {
-      t->passed = t->termsig == -1 ? WEXITSTATUS(status) : 0;
-      if (t->termsig != -1) {
-       fprintf(TH_LOG_STREAM,
-                "%s: Test exited normally instead of by signal (code: %d)\n",
-               t->name,
-               WEXITSTATUS(status));
-      }
-    } else if (WIFSIGNALED(status)) {
-      t->passed = 0;
-      if (WTERMSIG(status) == SIGABRT) {
-        fprintf(TH_LOG_STREAM,
-                "%s: Test terminated by assertion\n",
-               t->name);
-      } else if (WTERMSIG(status) == t->termsig) {
-        t->passed = 1;
-      } else {
-        fprintf(TH_LOG_STREAM,
-                "%s: Test terminated unexpectedly by signal %d\n",
-               t->name,
-               WTERMSIG(status));
+    __finish_test(t, status);
+  }
+}
+
+/* Loads "<nanoseconds> <test name>" lines recorded by an earlier run into
+ * the tests of |list|.
+ */
+static inline void __load_test_stats(struct __test_metadata *list,
+                                     const char *path) {
+  char line[256];
+  FILE *fp = fopen(path, "re");
+  if (fp == NULL)
+    return;
+  while (fgets(line, sizeof(line), fp)) {
+    struct __test_metadata *t;
+    unsigned long long ns;
+    char name[200];
+    if (sscanf(line, "%llu %199s", &ns, name) != 2)
+      continue;
+    for (t = list; t; t = t->next) {
+      if (strcmp(t->name, name) == 0) {
+        t->history_ns = ns;
+        break;
       }
-    } else {
-        fprintf(TH_LOG_STREAM,
-                "%s: Test ended in some other way [%u]\n",
-               t->name,
-               status);
     }
   }
-  printf("[     %4s ] %s\n", (t->passed ? "OK" : "FAIL"), t->name);
+  fclose(fp);
 }
 
-static int test_harness_run(int __attribute__((unused)) argc,
-                            char __attribute__((unused)) **argv) {
+/* Folds this run's durations into the stats file (as a running average, so
+ * one noisy run doesn't reorder the next one).
+ */
+static inline void __save_test_stats(struct __test_metadata *list,
+                                     const char *path) {
+  struct __test_metadata *t;
+  FILE *fp = fopen(path, "we");
+  if (fp == NULL) {
+    fprintf(TH_LOG_STREAM, "Unable to write %s\n", path);
+    return;
+  }
+  for (t = list; t; t = t->next) {
+    unsigned long long ns = t->duration_ns;
+    if (ns == 0)
+      ns = t->history_ns;
+    else if (t->history_ns)
+      ns = (ns + t->history_ns) / 2;
+    if (ns)
+      fprintf(fp, "%llu %s\n", ns, t->name);
+  }
+  fclose(fp);
+}
+
+/* Longest expected test first; declaration order breaks ties. */
+static int __compare_expected_cost(const void *a, const void *b) {
+  const struct __test_metadata *ta = *(struct __test_metadata * const *)a;
+  const struct __test_metadata *tb = *(struct __test_metadata * const *)b;
+  if (ta->expected_ns != tb->expected_ns)
+    return ta->expected_ns < tb->expected_ns ? 1 : -1;
+  return ta->index < tb->index ? -1 : ta->index > tb->index;
+}
+
+/* Fills |order| with the tests of |list| in the order they should start,
+ * and returns how many there are: declaration order for a single job, and
+ * longest expected first (LPT) for more.
+ */
+static inline unsigned int __schedule_tests(struct __test_metadata *list,
+                                            unsigned int jobs,
+                                            struct __test_metadata **order) {
   struct __test_metadata *t;
-  int ret = 0;
   unsigned int count = 0;
+  for (t = list; t; t = t->next) {
+    t->index = count;
+    t->expected_ns = t->history_ns;
+    if (t->expected_ns == 0)
+      t->expected_ns = __test_size_hint(t) * TH_SIZE_UNIT_NS;
+    order[count++] = t;
+  }
+  if (jobs > 1)
+    qsort(order, count, sizeof(*order), __compare_expected_cost);
+  return count;
+}
+
+/* Usage: [-j jobs] [-s stats_file] [-v]
+ * With more than one job, tests are started longest first (LPT), using the
+ * durations kept in |stats_file| and falling back to TEST_SIZE() hints.
+ * Each test's stdout and stderr are captured and only shown, in one piece,
+ * if it fails or with -v.
+ */
+static int test_harness_run(int argc, char **argv) {
+  struct __test_metadata *t;
+  struct __test_metadata **order;
+  struct __test_metadata *running[TH_MAX_JOBS];
+  pid_t pids[TH_MAX_JOBS];
+  int outputs[TH_MAX_JOBS];
+  const char *stats_path = NULL;
+  int ret = 0;
+  int opt;
+  unsigned int jobs = 1;
+  unsigned int active = 0;
+  unsigned int next = 0;
+  unsigned int i;
+  unsigned int count;
   unsigned int pass_count = 0;
+  unsigned int skip_count = 0;
+
+  while ((opt = getopt(argc, argv, "j:s:v")) != -1) {
+    switch (opt) {
+    case 'j':
+      jobs = (unsigned int)strtoul(optarg, NULL, 0);
+      if (jobs < 1)
+        jobs = 1;
+      if (jobs > TH_MAX_JOBS)
+        jobs = TH_MAX_JOBS;
+      break;
+    case 's':
+      stats_path = optarg;
+      break;
+    case 'v':
+      __test_verbose = 1;
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-j jobs] [-s stats_file] [-v]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  order = (struct __test_metadata **)calloc(__test_count, sizeof(*order));
+  if (order == NULL)
+    return 1;
+  if (stats_path)
+    __load_test_stats(__test_list, stats_path);
+  count = __schedule_tests(__test_list, jobs, order);
+  memset(running, 0, sizeof(running));
+  for (i = 0; i < jobs; i++)
+    outputs[i] = __test_output_open();
 
-  /* TODO(wad) add optional arguments similar to gtest. */
   printf("[==========] Running %u tests from %u test cases.\n",
           __test_count, __fixture_count + 1);
+  while (next < count || active) {
+    int status;
+    pid_t pid;
+
+    /* Fill free slots; tests that need no child finish right away. */
+    for (i = 0; i < jobs && next < count; ) {
+      if (running[i]) {
+        i++;
+        continue;
+      }
+      t = order[next++];
+      t->output_fd = outputs[i];
+      pid = __start_test(t, i);
+      if (pid > 0) {
+        running[i] = t;
+        pids[i] = pid;
+        active++;
+      }
+    }
+    if (!active)
+      continue;
+
+    pid = waitpid(-1, &status, 0);
+    if (pid < 0)
+      break;
+    for (i = 0; i < jobs; i++) {
+      if (running[i] && pids[i] == pid) {
+        __finish_test(running[i], status);
+        running[i] = NULL;
+        active--;
+        break;
+      }
+    }
+  }
+  free(order);
+  for (i = 0; i < jobs; i++) {
+    if (outputs[i] >= 0)
+      close(outputs[i]);
+  }
+
   for (t = __test_list; t; t = t->next) {
-    count++;
-    __run_test(t);
-    if (t->passed)
+    if (t->skipped)
+      skip_count++;
+    else if (t->passed)
       pass_count++;
     else
       ret = 1;
   }
+  if (stats_path)
+    __save_test_stats(__test_list, stats_path);
+
   /* TODO(wad) organize by fixtures since ordering is not guaranteed now. */
-  printf("[==========] %u / %u tests passed.\n", pass_count, count);
+  printf("[==========] %u / %u tests passed.\n", pass_count,
+         count - skip_count);
+  if (skip_count)
+    printf("[==========] %u tests skipped.\n", skip_count);
   printf("[  %s  ]\n", (ret ? "FAILED" : "PASSED"));
   return ret;
 }
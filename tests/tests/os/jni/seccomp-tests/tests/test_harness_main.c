@@ -0,0 +1,27 @@
+/* test_harness_main.c
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * main() for a test file built as a program of its own rather than into
+ * libctsos_jni, which runs the tests one at a time through __run_test():
+ *   seccomp_bpf_tests [-j jobs] [-s stats_file] [-v]
+ * See test_harness_run() for the options.
+ */
+
+int seccomp_test_main(int argc, char **argv);
+
+int main(int argc, char **argv)
+{
+	return seccomp_test_main(argc, argv);
+}
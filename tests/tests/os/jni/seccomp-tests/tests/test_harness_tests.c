@@ -0,0 +1,378 @@
+/* test_harness_tests.c
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Tests for test_harness.h itself: the order test_harness_run() starts
+ * tests in, the stats file it keeps between runs, the capture of each
+ * test's output, how TH_FAST_FAIL reports failed assertions and expected
+ * deaths, what a failed FIXTURE_SETUP_ONCE does to its fixture's tests,
+ * and REQUIRES().
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "test_harness.h"
+
+#if !TH_FAST_FAIL
+#error "build with -DTH_FAST_FAIL=1"
+#endif
+
+#define SCHED_TESTS 5
+
+/* Tests that are scheduled but never run, so not TEST()s. */
+static const char *sched_names[SCHED_TESTS] = {
+	"global.sched_a",
+	"global.sched_b",
+	"global.sched_c",
+	"global.sched_d",
+	"global.sched_e",
+};
+
+TEST_SIZE(sched_c, TH_SIZE_LARGE);
+
+static struct __test_metadata *sched_list(struct __test_metadata *tests)
+{
+	int i;
+
+	memset(tests, 0, SCHED_TESTS * sizeof(*tests));
+	for (i = 0; i < SCHED_TESTS; i++) {
+		tests[i].name = sched_names[i];
+		tests[i].next = i + 1 < SCHED_TESTS ? &tests[i + 1] : NULL;
+	}
+	return tests;
+}
+
+/* Returns a path that reads back what was written to |fd|. */
+static const char *fd_path(int fd, char *path, size_t size)
+{
+	snprintf(path, size, "/proc/self/fd/%d", fd);
+	return path;
+}
+
+/* The result record this test runs with, for the children it starts itself
+ * to use too: any other may belong to a test running alongside.
+ */
+static unsigned int own_slot(struct __test_metadata *_metadata)
+{
+	return _metadata->result ? _metadata->result - __test_result_page() : 0;
+}
+
+static void write_stats(struct __test_metadata *_metadata, int fd,
+			const char *stats)
+{
+	ASSERT_EQ(0, ftruncate(fd, 0));
+	ASSERT_EQ((ssize_t)strlen(stats), pwrite(fd, stats, strlen(stats), 0));
+}
+
+/* Recorded durations win over TEST_SIZE() hints, which win over the
+ * default; ties keep declaration order.
+ */
+TEST(schedule_longest_first) {
+	struct __test_metadata tests[SCHED_TESTS];
+	struct __test_metadata *order[SCHED_TESTS];
+	struct __test_metadata *list = sched_list(tests);
+	char path[64];
+	int fd = __test_output_open();
+
+	ASSERT_LE(0, fd);
+	write_stats(_metadata, fd,
+		    "50000000 global.sched_b\n"
+		    "900000000 global.sched_d\n"
+		    "garbage\n"
+		    "70000000 global.not_a_test\n");
+	__load_test_stats(list, fd_path(fd, path, sizeof(path)));
+	EXPECT_EQ(0, tests[0].history_ns);
+	EXPECT_EQ(50000000, tests[1].history_ns);
+	EXPECT_EQ(900000000, tests[3].history_ns);
+
+	ASSERT_EQ(SCHED_TESTS, __schedule_tests(list, 4, order));
+	EXPECT_STREQ("global.sched_c", order[0]->name);
+	EXPECT_STREQ("global.sched_d", order[1]->name);
+	EXPECT_STREQ("global.sched_b", order[2]->name);
+	EXPECT_STREQ("global.sched_a", order[3]->name);
+	EXPECT_STREQ("global.sched_e", order[4]->name);
+	EXPECT_EQ(TH_SIZE_LARGE * TH_SIZE_UNIT_NS, order[0]->expected_ns);
+	EXPECT_EQ(TH_SIZE_SMALL * TH_SIZE_UNIT_NS, order[4]->expected_ns);
+	close(fd);
+}
+
+TEST(schedule_one_job_in_order) {
+	struct __test_metadata tests[SCHED_TESTS];
+	struct __test_metadata *order[SCHED_TESTS];
+	struct __test_metadata *list = sched_list(tests);
+	int i;
+
+	tests[4].history_ns = 900000000;
+	ASSERT_EQ(SCHED_TESTS, __schedule_tests(list, 1, order));
+	for (i = 0; i < SCHED_TESTS; i++) {
+		EXPECT_EQ(&tests[i], order[i]);
+		EXPECT_EQ(i, order[i]->index);
+	}
+}
+
+/* Durations are averaged with the recorded ones, and tests that didn't run
+ * keep theirs.
+ */
+TEST(stats_running_average) {
+	struct __test_metadata tests[SCHED_TESTS];
+	struct __test_metadata *list = sched_list(tests);
+	char path[64];
+	char stats[256];
+	ssize_t length;
+	int fd = __test_output_open();
+
+	ASSERT_LE(0, fd);
+	tests[0].duration_ns = 20000000;
+	tests[1].history_ns = 50000000;
+	tests[1].duration_ns = 30000000;
+	tests[2].history_ns = 60000000;
+	__save_test_stats(list, fd_path(fd, path, sizeof(path)));
+	length = pread(fd, stats, sizeof(stats) - 1, 0);
+	ASSERT_LE(0, length);
+	stats[length] = '\0';
+	EXPECT_STREQ("20000000 global.sched_a\n"
+		     "40000000 global.sched_b\n"
+		     "60000000 global.sched_c\n", stats);
+	close(fd);
+}
+
+static void capture_child(struct __test_metadata *_metadata)
+{
+	printf("printed\n");
+	EXPECT_EQ(1, 2);
+}
+
+/* What a failing test prints, and what its expectations log, ends up in the
+ * buffer it is reported from rather than in the log.
+ */
+TEST(capture_failure_message) {
+	struct __test_metadata child;
+	char output[512];
+	ssize_t length;
+	int status;
+	pid_t pid;
+
+	memset(&child, 0, sizeof(child));
+	child.name = "global.capture_child";
+	child.fn = capture_child;
+	child.termsig = -1;
+	child.output_fd = __test_output_open();
+	ASSERT_LE(0, child.output_fd);
+	pid = __start_test(&child, own_slot(_metadata));
+	ASSERT_LT(0, pid);
+	ASSERT_EQ(pid, waitpid(pid, &status, 0));
+	EXPECT_TRUE(WIFEXITED(status));
+	EXPECT_EQ(0, WEXITSTATUS(status));
+	length = pread(child.output_fd, output, sizeof(output) - 1, 0);
+	ASSERT_LE(0, length);
+	output[length] = '\0';
+	EXPECT_NE(NULL, strstr(output, "printed\n")) {
+		TH_LOG("captured: %s", output);
+	}
+	EXPECT_NE(NULL, strstr(output,
+		"global.capture_child:Expected 1 (1) == 2 (2)")) {
+		TH_LOG("captured: %s", output);
+	}
+	close(child.output_fd);
+}
+
+static void bail_child(struct __test_metadata *_metadata)
+{
+	printf("line %d\n", __LINE__ + 1);
+	ASSERT_EQ(1, 2);
+	printf("not reached\n");
+}
+
+/* A failed ASSERT leaves the child through _exit(), with its line in the
+ * result record, rather than through abort().
+ */
+TEST(fast_fail_result_page) {
+	struct __test_metadata child;
+	struct __test_result result;
+	char output[512];
+	ssize_t length;
+	int line = 0;
+	int status;
+	pid_t pid;
+
+	ASSERT_NE(NULL, _metadata->result);
+	memset(&child, 0, sizeof(child));
+	child.name = "global.bail_child";
+	child.fn = bail_child;
+	child.termsig = -1;
+	child.output_fd = __test_output_open();
+	ASSERT_LE(0, child.output_fd);
+	pid = __start_test(&child, own_slot(_metadata));
+	ASSERT_LT(0, pid);
+	ASSERT_EQ(pid, waitpid(pid, &status, 0));
+	/* The child shared this test's record; take its result back out of
+	 * it before anything here can fail.
+	 */
+	ASSERT_EQ(_metadata->result, child.result);
+	result = *child.result;
+	memset(child.result, 0, sizeof(*child.result));
+
+	EXPECT_TRUE(WIFEXITED(status));
+	EXPECT_EQ(_TH_BAIL_EXIT_CODE, WEXITSTATUS(status));
+	EXPECT_EQ(1, result.bailed);
+	length = pread(child.output_fd, output, sizeof(output) - 1, 0);
+	ASSERT_LE(0, length);
+	output[length] = '\0';
+	ASSERT_EQ(1, sscanf(output, "line %d", &line)) {
+		TH_LOG("captured: %s", output);
+	}
+	EXPECT_EQ(line, result.line);
+	EXPECT_EQ(NULL, strstr(output, "not reached"));
+	close(child.output_fd);
+}
+
+static void termsig_child(struct __test_metadata *_metadata)
+{
+	struct sigaction action;
+	struct rlimit core;
+
+	ASSERT_EQ(0, sigaction(SIGUSR1, NULL, &action));
+	EXPECT_EQ(SIG_DFL, action.sa_handler);
+	ASSERT_EQ(0, getrlimit(RLIMIT_CORE, &core));
+	EXPECT_EQ(0, core.rlim_cur);
+	if (_metadata->passed)
+		raise(SIGUSR1);
+}
+
+static void ignore_signal(int sig)
+{
+	(void)sig;
+}
+
+/* Tests that expect a signal get its default action back, as a crash
+ * dumper would have replaced it, and no core dump.
+ */
+TEST(fast_fail_expected_signal) {
+	struct __test_metadata child;
+	struct rlimit core;
+	int status;
+	pid_t pid;
+
+	ASSERT_NE(SIG_ERR, signal(SIGUSR1, ignore_signal));
+	/* So that the child has a limit to lower, where the hard one allows. */
+	ASSERT_EQ(0, getrlimit(RLIMIT_CORE, &core));
+	core.rlim_cur = core.rlim_max;
+	ASSERT_EQ(0, setrlimit(RLIMIT_CORE, &core));
+	memset(&child, 0, sizeof(child));
+	child.name = "global.termsig_child";
+	child.fn = termsig_child;
+	child.termsig = SIGUSR1;
+	child.output_fd = -1;
+	pid = __start_test(&child, own_slot(_metadata));
+	ASSERT_LT(0, pid);
+	ASSERT_EQ(pid, waitpid(pid, &status, 0));
+	EXPECT_TRUE(WIFSIGNALED(status));
+	EXPECT_EQ(SIGUSR1, WTERMSIG(status));
+	EXPECT_EQ(0, _metadata->result->bailed);
+}
+
+static int setup_once_runs;
+static int fixture_test_runs;
+
+static void failing_setup_once(struct __test_metadata *_metadata)
+{
+	setup_once_runs++;
+	ASSERT_EQ(1, 2);
+}
+
+static void fixture_test(struct __test_metadata *_metadata)
+{
+	fixture_test_runs++;
+}
+
+/* Every test of a fixture whose FIXTURE_SETUP_ONCE fails is failed without
+ * being forked, and the setup is not tried again.
+ */
+TEST(failed_setup_once_fails_fixture) {
+	struct __fixture_metadata fixture;
+	struct __test_metadata tests[2];
+	unsigned int i;
+
+	memset(&fixture, 0, sizeof(fixture));
+	fixture.name = "failing_fixture";
+	fixture.setup_once = failing_setup_once;
+	memset(tests, 0, sizeof(tests));
+	tests[0].name = "failing_fixture.first";
+	tests[1].name = "failing_fixture.second";
+	for (i = 0; i < 2; i++) {
+		tests[i].fn = fixture_test;
+		tests[i].termsig = -1;
+		tests[i].fixture = &fixture;
+		tests[i].output_fd = -1;
+		EXPECT_EQ(0, __start_test(&tests[i], own_slot(_metadata)));
+		EXPECT_EQ(0, tests[i].passed);
+		EXPECT_EQ(0, tests[i].skipped);
+	}
+	EXPECT_EQ(-1, fixture.setup_once_state);
+	EXPECT_EQ(1, setup_once_runs);
+	EXPECT_EQ(0, fixture_test_runs);
+}
+
+/* Requirements of the made-up tests below, which no system can meet but the
+ * last, which every system running this does.
+ */
+REQUIRES(needs_arch, .arch = "no-such-arch");
+REQUIRES(needs_kernel, .kernel = TH_KERNEL_VERSION(999, 0));
+REQUIRES(needs_old_kernel, .kernel = TH_KERNEL_VERSION(2, 6));
+
+static void required_test(struct __test_metadata *_metadata)
+{
+	_exit(0x55);
+}
+
+/* A test whose requirements are not met is reported as SKIP, with passed
+ * left set, without being forked; one whose requirements are met runs.
+ */
+TEST(requires_skips) {
+	static const char *const names[] = {
+		"global.needs_arch", "global.needs_kernel", "global.needs_old_kernel",
+	};
+	struct __test_metadata child;
+	unsigned int i;
+	int status;
+	pid_t pid;
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		memset(&child, 0, sizeof(child));
+		child.name = names[i];
+		child.fn = required_test;
+		child.termsig = -1;
+		child.output_fd = -1;
+		pid = __start_test(&child, own_slot(_metadata));
+		EXPECT_EQ(1, child.passed);
+		if (i < 2) {
+			EXPECT_EQ(0, pid);
+			EXPECT_EQ(1, child.skipped);
+		} else {
+			ASSERT_LT(0, pid);
+			ASSERT_EQ(pid, waitpid(pid, &status, 0));
+			EXPECT_EQ(0, child.skipped);
+			EXPECT_TRUE(WIFEXITED(status));
+			EXPECT_EQ(0x55, WEXITSTATUS(status));
+		}
+	}
+}
+
+TEST_HARNESS_MAIN
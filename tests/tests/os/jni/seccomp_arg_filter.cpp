@@ -0,0 +1,747 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "seccomp_arg_filter.h"
+
+#include <linux/audit.h>
+#include <linux/seccomp.h>
+#include <math.h>
+#include <stdlib.h>
+
+#if defined(__aarch64__)
+#define ARCH_NR AUDIT_ARCH_AARCH64
+#elif defined(__arm__)
+#define ARCH_NR AUDIT_ARCH_ARM
+#elif defined(__x86_64__)
+#define ARCH_NR AUDIT_ARCH_X86_64
+#elif defined(__i386__)
+#define ARCH_NR AUDIT_ARCH_I386
+#endif
+
+#ifndef __X32_SYSCALL_BIT
+#define __X32_SYSCALL_BIT 0x40000000
+#endif
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define LOW_WORD 4
+#define HIGH_WORD 0
+#else
+#define LOW_WORD 0
+#define HIGH_WORD 4
+#endif
+
+#define WORD_MAX 0xffffffffU
+#define WORD_VALUES 4294967296.0
+
+// Sets no larger than this are checked one value at a time.
+#define SET_LEAF_SIZE 4
+
+// A jump target that is the next instruction.
+#define NEXT (-1)
+
+// The high words of arguments on 32-bit architectures are always zero.
+static const bool kHighWordsZero = sizeof(long) == 4;
+
+static uint32_t argWord(int arg, bool high) {
+    return offsetof(struct seccomp_data, args) + arg * sizeof(uint64_t) +
+            (high ? HIGH_WORD : LOW_WORD);
+}
+
+// Forward jumps to labels, patched in once every label is bound.
+
+struct Fixup {
+    int insn;
+    int label;
+    int field;  // 0 for jt, 1 for jf, 2 for the k of a JA
+};
+
+struct Assembler {
+    struct sock_filter* code;
+    int capacity;
+    int length;
+    int* labels;  // instruction each label is bound to, or -1
+    int labelCount;
+    int maxLabels;
+    Fixup* fixups;
+    int fixupCount;
+    int maxFixups;
+    bool overflow;
+};
+
+static int newLabel(Assembler* as) {
+    if (as->labelCount == as->maxLabels) {
+        as->overflow = true;
+        return NEXT;
+    }
+    as->labels[as->labelCount] = -1;
+    return as->labelCount++;
+}
+
+static void bind(Assembler* as, int label) {
+    if (label != NEXT) {
+        as->labels[label] = as->length;
+    }
+}
+
+static void addFixup(Assembler* as, int insn, int label, int field) {
+    if (label == NEXT) {
+        return;
+    }
+    if (as->fixupCount == as->maxFixups) {
+        as->overflow = true;
+        return;
+    }
+    Fixup fixup = { insn, label, field };
+    as->fixups[as->fixupCount++] = fixup;
+}
+
+static void emit(Assembler* as, uint16_t code, uint32_t k, int jt = NEXT, int jf = NEXT) {
+    if (as->length == as->capacity) {
+        as->overflow = true;
+        return;
+    }
+    struct sock_filter insn = BPF_JUMP(code, k, 0, 0);
+    as->code[as->length] = insn;
+    addFixup(as, as->length, jt, 0);
+    addFixup(as, as->length, jf, 1);
+    as->length++;
+}
+
+static void emitJa(Assembler* as, int label) {
+    emit(as, BPF_JMP | BPF_JA, 0);
+    if (!as->overflow) {
+        addFixup(as, as->length - 1, label, 2);
+    }
+}
+
+// Returns false if a conditional jump is too long for its 8-bit offset.
+static bool resolve(Assembler* as) {
+    for (int i = 0; i < as->fixupCount; i++) {
+        const Fixup* fixup = &as->fixups[i];
+        int offset = as->labels[fixup->label] - (fixup->insn + 1);
+        struct sock_filter* insn = &as->code[fixup->insn];
+        if (fixup->field == 2) {
+            insn->k = offset;
+        } else if (offset > 255) {
+            return false;
+        } else if (fixup->field == 0) {
+            insn->jt = offset;
+        } else {
+            insn->jf = offset;
+        }
+    }
+    return true;
+}
+
+// The checks a predicate is split into. All but the wide ones test the
+// word in A.
+
+enum CheckKind {
+    CHECK_EQ,          // word == k
+    CHECK_NONE_SET,    // (word & k) == 0
+    CHECK_ALL_SET,     // (word & k) == k, for a single bit
+    CHECK_MASKED_EQ,   // (word & mask) == k
+    CHECK_RANGE,       // k <= word <= high
+    CHECK_IN_SET,      // a low word of the set's values whose high word is k
+    CHECK_WIDE_RANGE,  // the predicate's range, across high words
+    CHECK_WIDE_SET,    // the predicate's set, across high words
+};
+
+struct Check {
+    CheckKind kind;
+    uint32_t word;
+    bool highWord;
+    uint32_t k;
+    uint32_t mask;
+    uint32_t high;
+    int count;  // values in the set
+    const SeccompArgPredicate* predicate;
+    double pass;  // chance of passing, for an argument below 2^32
+    int unit;
+};
+
+static double passRate(const Check* check) {
+    const SeccompArgPredicate* predicate = check->predicate;
+    switch (check->kind) {
+    case CHECK_EQ:
+        return check->highWord ? check->k == 0 : 1 / WORD_VALUES;
+    case CHECK_NONE_SET:
+        return check->highWord ? 1 : ldexp(1, -__builtin_popcount(check->k));
+    case CHECK_ALL_SET:
+        return check->highWord ? 0 : 0.5;
+    case CHECK_MASKED_EQ:
+        return check->highWord ? check->k == 0 : ldexp(1, -__builtin_popcount(check->mask));
+    case CHECK_RANGE:
+        return check->highWord ? check->k == 0 : (check->high - check->k + 1.0) / WORD_VALUES;
+    case CHECK_IN_SET:
+        return check->count / WORD_VALUES;
+    case CHECK_WIDE_RANGE:
+        if (predicate->value > WORD_MAX) {
+            return 0;
+        }
+        return (WORD_MAX - predicate->value + 1.0) / WORD_VALUES;
+    case CHECK_WIDE_SET:
+        return check->count / WORD_VALUES;
+    }
+    return 1;
+}
+
+static void addCheck(Check* checks, int* count, const SeccompArgPredicate* predicate,
+                     CheckKind kind, bool high, uint32_t k, uint32_t mask = 0,
+                     uint32_t highBound = 0) {
+    Check* check = &checks[(*count)++];
+    check->kind = kind;
+    check->word = argWord(predicate->arg, high);
+    check->highWord = high;
+    check->k = k;
+    check->mask = mask;
+    check->high = highBound;
+    check->count = 0;
+    check->predicate = predicate;
+    check->unit = -1;
+}
+
+// Adds the check for (word & mask) == value. Returns false if it can't hold.
+static bool addMaskedWord(Check* checks, int* count, const SeccompArgPredicate* predicate,
+                          bool high, uint32_t mask, uint32_t value) {
+    if (mask == 0) {
+        return true;
+    }
+    if (high && kHighWordsZero) {
+        return value == 0;
+    }
+    if (mask == WORD_MAX) {
+        addCheck(checks, count, predicate, CHECK_EQ, high, value);
+    } else if (value == 0) {
+        addCheck(checks, count, predicate, CHECK_NONE_SET, high, mask);
+    } else if (value == mask && __builtin_popcount(mask) == 1) {
+        addCheck(checks, count, predicate, CHECK_ALL_SET, high, mask);
+    } else {
+        addCheck(checks, count, predicate, CHECK_MASKED_EQ, high, value, mask);
+    }
+    return true;
+}
+
+static void addRangeWord(Check* checks, int* count, const SeccompArgPredicate* predicate,
+                         bool high, uint32_t low, uint32_t highBound) {
+    if (low == highBound) {
+        addCheck(checks, count, predicate, CHECK_EQ, high, low);
+    } else if (low != 0 || highBound != WORD_MAX) {
+        addCheck(checks, count, predicate, CHECK_RANGE, high, low, 0, highBound);
+    }
+}
+
+// Adds the checks for |predicate| to |checks|, which has room for two.
+// Returns false if the predicate can't hold.
+static bool splitPredicate(const SeccompArgPredicate* predicate, Check* checks, int* count) {
+    // Only the low word of the argument can differ from zero.
+    bool lowOnly = predicate->lowWordOnly || kHighWordsZero;
+    switch (predicate->compare) {
+    case SECCOMP_ARG_EQ:
+    case SECCOMP_ARG_MASKED_EQ: {
+        uint64_t mask = predicate->compare == SECCOMP_ARG_EQ ? ~0ULL : predicate->mask;
+        uint64_t value = predicate->value;
+        if (predicate->lowWordOnly) {
+            mask &= WORD_MAX;
+            value &= WORD_MAX;
+        }
+        if ((value & ~mask) != 0) {
+            return false;
+        }
+        return addMaskedWord(checks, count, predicate, false, mask, value) &&
+                addMaskedWord(checks, count, predicate, true, mask >> 32, value >> 32);
+    }
+
+    case SECCOMP_ARG_RANGE: {
+        uint64_t low = predicate->value;
+        uint64_t high = predicate->high;
+        if (lowOnly && high > WORD_MAX) {
+            high = WORD_MAX;
+        }
+        if (low > high) {
+            return false;
+        }
+        uint32_t lowHigh = low >> 32;
+        uint32_t highHigh = high >> 32;
+        if (lowHigh == highHigh) {
+            addRangeWord(checks, count, predicate, false, low, high);
+            return lowOnly || addMaskedWord(checks, count, predicate, true, WORD_MAX, lowHigh);
+        }
+        if ((uint32_t) low == 0 && (uint32_t) high == WORD_MAX) {
+            addRangeWord(checks, count, predicate, true, lowHigh, highHigh);
+        } else {
+            addCheck(checks, count, predicate, CHECK_WIDE_RANGE, false, 0);
+        }
+        return true;
+    }
+
+    case SECCOMP_ARG_IN_SET: {
+        if (predicate->setSize == 0) {
+            return false;
+        }
+        uint32_t high = lowOnly ? 0 : predicate->set[0] >> 32;
+        int matching = 0;
+        int single = 0;
+        for (int i = 0; i < predicate->setSize; i++) {
+            if (predicate->lowWordOnly || predicate->set[i] >> 32 == high) {
+                matching++;
+                single = i;
+            }
+        }
+        if (matching == 0) {
+            return false;
+        }
+        if (!lowOnly && matching < predicate->setSize) {
+            addCheck(checks, count, predicate, CHECK_WIDE_SET, false, 0);
+            checks[*count - 1].count = predicate->setSize;
+            for (int i = 0; i < predicate->setSize; i++) {
+                if (predicate->set[i] >> 32 != 0) {
+                    checks[*count - 1].count--;
+                }
+            }
+            return true;
+        }
+        if (matching == 1) {
+            addCheck(checks, count, predicate, CHECK_EQ, false, predicate->set[single]);
+        } else {
+            addCheck(checks, count, predicate, CHECK_IN_SET, false, high);
+            checks[*count - 1].count = matching;
+        }
+        return lowOnly || addMaskedWord(checks, count, predicate, true, WORD_MAX, high);
+    }
+    }
+    return false;
+}
+
+static int compareWords(const void* a, const void* b) {
+    uint32_t left = *reinterpret_cast<const uint32_t*>(a);
+    uint32_t right = *reinterpret_cast<const uint32_t*>(b);
+    return left < right ? -1 : left > right;
+}
+
+static int compareArgs(const void* a, const void* b) {
+    uint64_t left = *reinterpret_cast<const uint64_t*>(a);
+    uint64_t right = *reinterpret_cast<const uint64_t*>(b);
+    return left < right ? -1 : left > right;
+}
+
+// Jumps to |pass| if A is one of |values|, which are sorted and distinct,
+// and to |fail| if not.
+static void emitSet(Assembler* as, const uint32_t* values, int count, int pass, int fail,
+                    bool search) {
+    if (!search || count <= SET_LEAF_SIZE) {
+        for (int i = 0; i < count; i++) {
+            emit(as, BPF_JMP | BPF_JEQ | BPF_K, values[i], pass, i == count - 1 ? fail : NEXT);
+        }
+        return;
+    }
+    int half = count / 2;
+    int right = newLabel(as);
+    emit(as, BPF_JMP | BPF_JGE | BPF_K, values[half], right, NEXT);
+    emitSet(as, values, half, pass, fail, search);
+    bind(as, right);
+    emitSet(as, values + half, count - half, pass, fail, search);
+}
+
+// What A and X hold: an argument word, or -1.
+struct Registers {
+    int a;
+    int x;
+};
+
+static void loadWord(Assembler* as, Registers* regs, uint32_t word) {
+    if (regs->a == (int) word) {
+        return;
+    }
+    if (regs->x == (int) word) {
+        emit(as, BPF_MISC | BPF_TXA, 0);
+    } else {
+        emit(as, BPF_LD | BPF_W | BPF_ABS, word);
+    }
+    regs->a = word;
+}
+
+static void emitInSet(Assembler* as, const Check* check, int fail, bool search) {
+    const SeccompArgPredicate* predicate = check->predicate;
+    uint32_t* values = reinterpret_cast<uint32_t*>(malloc(predicate->setSize * sizeof(uint32_t)));
+    if (values == NULL) {
+        as->overflow = true;
+        return;
+    }
+    int count = 0;
+    for (int i = 0; i < predicate->setSize; i++) {
+        if (predicate->lowWordOnly || predicate->set[i] >> 32 == check->k) {
+            values[count++] = predicate->set[i];
+        }
+    }
+    // The value listed first is likely the most common; see the header.
+    uint32_t first = values[0];
+    qsort(values, count, sizeof(uint32_t), compareWords);
+    int distinct = 0;
+    for (int i = 0; i < count; i++) {
+        if (distinct == 0 || values[i] != values[distinct - 1]) {
+            values[distinct++] = values[i];
+        }
+    }
+    int pass = newLabel(as);
+    if (search && distinct > SET_LEAF_SIZE + 1) {
+        emit(as, BPF_JMP | BPF_JEQ | BPF_K, first, pass, NEXT);
+        int rest = 0;
+        for (int i = 0; i < distinct; i++) {
+            if (values[i] != first) {
+                values[rest++] = values[i];
+            }
+        }
+        distinct = rest;
+    }
+    emitSet(as, values, distinct, pass, fail, search);
+    bind(as, pass);
+    free(values);
+}
+
+static void emitWideRange(Assembler* as, Registers* regs, const Check* check, int fail) {
+    const SeccompArgPredicate* predicate = check->predicate;
+    uint32_t lowHigh = predicate->value >> 32;
+    uint32_t lowLow = predicate->value;
+    uint32_t highHigh = predicate->high >> 32;
+    uint32_t highLow = predicate->high;
+    uint32_t lowWord = argWord(predicate->arg, false);
+    int lower = newLabel(as);
+    int upper = newLabel(as);
+    int pass = newLabel(as);
+    loadWord(as, regs, argWord(predicate->arg, true));
+    if (highHigh != WORD_MAX) {
+        emit(as, BPF_JMP | BPF_JGT | BPF_K, highHigh, fail, NEXT);
+    }
+    emit(as, BPF_JMP | BPF_JEQ | BPF_K, highHigh, upper, NEXT);
+    emit(as, BPF_JMP | BPF_JGT | BPF_K, lowHigh, pass, NEXT);
+    if (lowHigh != 0) {
+        emit(as, BPF_JMP | BPF_JEQ | BPF_K, lowHigh, lower, fail);
+    }
+    // The high word is the lower bound's.
+    bind(as, lower);
+    if (lowLow != 0) {
+        emit(as, BPF_LD | BPF_W | BPF_ABS, lowWord);
+        emit(as, BPF_JMP | BPF_JGE | BPF_K, lowLow, pass, fail);
+    } else {
+        emitJa(as, pass);
+    }
+    // The high word is the upper bound's.
+    bind(as, upper);
+    if (highLow != WORD_MAX) {
+        emit(as, BPF_LD | BPF_W | BPF_ABS, lowWord);
+        emit(as, BPF_JMP | BPF_JGT | BPF_K, highLow, fail, pass);
+    }
+    bind(as, pass);
+    regs->a = -1;
+}
+
+static void emitWideSet(Assembler* as, Registers* regs, const Check* check, int fail,
+                        bool search) {
+    const SeccompArgPredicate* predicate = check->predicate;
+    int count = predicate->setSize;
+    uint64_t* values = reinterpret_cast<uint64_t*>(malloc(count * sizeof(uint64_t)));
+    uint32_t* lows = reinterpret_cast<uint32_t*>(malloc(count * sizeof(uint32_t)));
+    int* groups = reinterpret_cast<int*>(malloc(count * sizeof(int)));
+    if (values == NULL || lows == NULL || groups == NULL) {
+        free(values);
+        free(lows);
+        free(groups);
+        as->overflow = true;
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        values[i] = predicate->set[i];
+    }
+    qsort(values, count, sizeof(uint64_t), compareArgs);
+
+    // Dispatch on the high word, then search the low words that go with it.
+    loadWord(as, regs, argWord(predicate->arg, true));
+    int groupCount = 0;
+    for (int i = 0; i < count; i++) {
+        if (i == 0 || values[i] >> 32 != values[i - 1] >> 32) {
+            groups[groupCount++] = i;
+        }
+    }
+    int* labels = reinterpret_cast<int*>(malloc(groupCount * sizeof(int)));
+    if (labels == NULL) {
+        as->overflow = true;
+        groupCount = 0;
+    }
+    for (int g = 0; g < groupCount; g++) {
+        labels[g] = newLabel(as);
+        emit(as, BPF_JMP | BPF_JEQ | BPF_K, values[groups[g]] >> 32, labels[g],
+             g == groupCount - 1 ? fail : NEXT);
+    }
+    int pass = newLabel(as);
+    for (int g = 0; g < groupCount; g++) {
+        int end = g == groupCount - 1 ? count : groups[g + 1];
+        int distinct = 0;
+        for (int i = groups[g]; i < end; i++) {
+            if (distinct == 0 || (uint32_t) values[i] != lows[distinct - 1]) {
+                lows[distinct++] = values[i];
+            }
+        }
+        bind(as, labels[g]);
+        emit(as, BPF_LD | BPF_W | BPF_ABS, argWord(predicate->arg, false));
+        emitSet(as, lows, distinct, pass, fail, search);
+    }
+    bind(as, pass);
+    regs->a = argWord(predicate->arg, false);
+    free(labels);
+    free(values);
+    free(lows);
+    free(groups);
+}
+
+// Tests the word in A.
+static void emitCheck(Assembler* as, const Check* check, int fail, bool search) {
+    switch (check->kind) {
+    case CHECK_EQ:
+        emit(as, BPF_JMP | BPF_JEQ | BPF_K, check->k, NEXT, fail);
+        break;
+    case CHECK_NONE_SET:
+        emit(as, BPF_JMP | BPF_JSET | BPF_K, check->k, fail, NEXT);
+        break;
+    case CHECK_ALL_SET:
+        emit(as, BPF_JMP | BPF_JSET | BPF_K, check->k, NEXT, fail);
+        break;
+    case CHECK_MASKED_EQ:
+        emit(as, BPF_ALU | BPF_AND | BPF_K, check->mask);
+        emit(as, BPF_JMP | BPF_JEQ | BPF_K, check->k, NEXT, fail);
+        break;
+    case CHECK_RANGE:
+        if (check->k != 0) {
+            emit(as, BPF_JMP | BPF_JGE | BPF_K, check->k, NEXT, fail);
+        }
+        if (check->high != WORD_MAX) {
+            emit(as, BPF_JMP | BPF_JGT | BPF_K, check->high, fail, NEXT);
+        }
+        break;
+    case CHECK_IN_SET:
+        emitInSet(as, check, fail, search);
+        break;
+    case CHECK_WIDE_RANGE:
+    case CHECK_WIDE_SET:
+        break;
+    }
+}
+
+enum RuleResult {
+    RULE_NEVER,
+    RULE_SOMETIMES,
+    RULE_ALWAYS,
+};
+
+static RuleResult emitRule(Assembler* as, const SeccompArgRule* rule, bool optimize) {
+    int maxChecks = 2 * rule->predicateCount;
+    Check* checks = reinterpret_cast<Check*>(malloc((maxChecks + 1) * sizeof(Check)));
+    int* order = reinterpret_cast<int*>(malloc((2 * maxChecks + 1) * sizeof(int)));
+    double* unitPass = reinterpret_cast<double*>(malloc((maxChecks + 1) * sizeof(double)));
+    if (checks == NULL || order == NULL || unitPass == NULL) {
+        free(checks);
+        free(order);
+        free(unitPass);
+        as->overflow = true;
+        return RULE_NEVER;
+    }
+    int count = 0;
+    RuleResult result = RULE_SOMETIMES;
+    for (int i = 0; i < rule->predicateCount; i++) {
+        if (!splitPredicate(&rule->predicates[i], checks, &count)) {
+            result = RULE_NEVER;
+            break;
+        }
+    }
+    if (result == RULE_NEVER) {
+        // Nothing to emit.
+    } else if (count == 0) {
+        emit(as, BPF_RET | BPF_K, rule->action);
+        result = RULE_ALWAYS;
+    } else {
+        // Group the checks on each word into a unit, to load the word once.
+        int units = 0;
+        for (int i = 0; i < count; i++) {
+            checks[i].pass = passRate(&checks[i]);
+            bool wide = checks[i].kind == CHECK_WIDE_RANGE || checks[i].kind == CHECK_WIDE_SET;
+            for (int j = 0; optimize && !wide && j < i; j++) {
+                if (checks[j].word == checks[i].word && checks[j].kind != CHECK_WIDE_RANGE &&
+                        checks[j].kind != CHECK_WIDE_SET) {
+                    checks[i].unit = checks[j].unit;
+                    break;
+                }
+            }
+            if (checks[i].unit < 0) {
+                unitPass[units] = 1;
+                checks[i].unit = units++;
+            }
+            unitPass[checks[i].unit] *= checks[i].pass;
+        }
+
+        // Units that are likelier to fail go first, and so do checks within
+        // them, keeping the order they were given in otherwise.
+        int* unitOrder = order;
+        int* checkOrder = order + units;
+        for (int u = 0; u < units; u++) {
+            int j = u;
+            for (; optimize && j > 0 && unitPass[unitOrder[j - 1]] > unitPass[u]; j--) {
+                unitOrder[j] = unitOrder[j - 1];
+            }
+            unitOrder[j] = u;
+        }
+
+        int fail = newLabel(as);
+        Registers regs = { -1, -1 };
+        for (int n = 0; n < units; n++) {
+            int unit = unitOrder[n];
+            int unitChecks = 0;
+            for (int i = 0; i < count; i++) {
+                if (checks[i].unit != unit) {
+                    continue;
+                }
+                int j = unitChecks++;
+                for (; optimize && j > 0 && checks[checkOrder[j - 1]].pass > checks[i].pass;
+                        j--) {
+                    checkOrder[j] = checkOrder[j - 1];
+                }
+                checkOrder[j] = i;
+            }
+            for (int n2 = 0; n2 < unitChecks; n2++) {
+                const Check* check = &checks[checkOrder[n2]];
+                if (!optimize) {
+                    regs.a = -1;
+                    regs.x = -1;
+                }
+                if (check->kind == CHECK_WIDE_RANGE) {
+                    emitWideRange(as, &regs, check, fail);
+                    continue;
+                }
+                if (check->kind == CHECK_WIDE_SET) {
+                    emitWideSet(as, &regs, check, fail, optimize);
+                    continue;
+                }
+                loadWord(as, &regs, check->word);
+                // Masking clobbers A, so keep the word in X for what follows.
+                if (check->kind == CHECK_MASKED_EQ && optimize && n2 < unitChecks - 1 &&
+                        regs.x != (int) check->word) {
+                    emit(as, BPF_MISC | BPF_TAX, 0);
+                    regs.x = check->word;
+                }
+                emitCheck(as, check, fail, optimize);
+                if (check->kind == CHECK_MASKED_EQ) {
+                    regs.a = -1;
+                }
+            }
+        }
+        emit(as, BPF_RET | BPF_K, rule->action);
+        bind(as, fail);
+    }
+    free(checks);
+    free(order);
+    free(unitPass);
+    return result;
+}
+
+// Returns the length of the program, -1 if it doesn't fit, or -2 if a jump
+// is too long.
+static int generate(const SeccompArgRule* rules, int ruleCount, uint32_t mismatchAction,
+                    uint32_t defaultAction, int flags, struct sock_filter* filter, int capacity,
+                    bool longSkips) {
+#ifdef ARCH_NR
+    bool optimize = (flags & SECCOMP_ARG_FILTER_UNOPTIMIZED) == 0;
+    Assembler as;
+    as.code = filter;
+    as.capacity = capacity;
+    as.length = 0;
+    as.labelCount = 0;
+    as.maxLabels = 2 * capacity + 8;
+    as.labels = reinterpret_cast<int*>(malloc(as.maxLabels * sizeof(int)));
+    as.fixupCount = 0;
+    as.maxFixups = 2 * capacity;
+    as.fixups = reinterpret_cast<Fixup*>(malloc(as.maxFixups * sizeof(Fixup)));
+    bool* done = reinterpret_cast<bool*>(calloc(ruleCount + 1, sizeof(bool)));
+    as.overflow = as.labels == NULL || as.fixups == NULL || done == NULL;
+
+    if (!as.overflow) {
+        int archOk = newLabel(&as);
+        emit(&as, BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch));
+        emit(&as, BPF_JMP | BPF_JEQ | BPF_K, ARCH_NR, archOk, NEXT);
+        emit(&as, BPF_RET | BPF_K, SECCOMP_RET_KILL);
+        bind(&as, archOk);
+        emit(&as, BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr));
+#if defined(__x86_64__)
+        // x32 syscalls have their own numbers.
+        int native = newLabel(&as);
+        emit(&as, BPF_JMP | BPF_JGE | BPF_K, __X32_SYSCALL_BIT, NEXT, native);
+        emit(&as, BPF_RET | BPF_K, SECCOMP_RET_KILL);
+        bind(&as, native);
+#endif
+    }
+
+    // Each syscall's rules, in the order given, with a jump over them for
+    // other syscalls.
+    for (int i = 0; i < ruleCount && !as.overflow; i++) {
+        if (done[i]) {
+            continue;
+        }
+        int syscall = rules[i].syscall;
+        int skip = newLabel(&as);
+        if (longSkips) {
+            int enter = newLabel(&as);
+            emit(&as, BPF_JMP | BPF_JEQ | BPF_K, syscall, enter, NEXT);
+            emitJa(&as, skip);
+            bind(&as, enter);
+        } else {
+            emit(&as, BPF_JMP | BPF_JEQ | BPF_K, syscall, NEXT, skip);
+        }
+        RuleResult result = RULE_NEVER;
+        for (int j = i; j < ruleCount; j++) {
+            if (rules[j].syscall == syscall) {
+                done[j] = true;
+                if (result != RULE_ALWAYS) {
+                    result = emitRule(&as, &rules[j], optimize);
+                }
+            }
+        }
+        if (result != RULE_ALWAYS) {
+            emit(&as, BPF_RET | BPF_K, mismatchAction);
+        }
+        bind(&as, skip);
+    }
+    emit(&as, BPF_RET | BPF_K, defaultAction);
+
+    int length = as.overflow ? -1 : resolve(&as) ? as.length : -2;
+    free(as.labels);
+    free(as.fixups);
+    free(done);
+    return length;
+#else
+    return -1;
+#endif
+}
+
+int seccompArgFilterGenerate(const SeccompArgRule* rules, int ruleCount,
+                             uint32_t mismatchAction, uint32_t defaultAction, int flags,
+                             struct sock_filter* filter, int capacity) {
+    int length = generate(rules, ruleCount, mismatchAction, defaultAction, flags, filter,
+                          capacity, false);
+    if (length == -2) {
+        // A syscall's rules are too long to skip with a conditional jump.
+        length = generate(rules, ruleCount, mismatchAction, defaultAction, flags, filter,
+                          capacity, true);
+    }
+    return length < 0 ? -1 : length;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECCOMP_ARG_FILTER_H_
+#define SECCOMP_ARG_FILTER_H_
+
+#include <linux/filter.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Generates seccomp-bpf programs that check the arguments of syscalls like
+// mmap, ioctl and prctl, where the sample policy has JSET blocks that load
+// each half of an argument again for every test.
+//
+// Classic BPF loads 32 bits at a time, so every argument is compared as
+// its high and low words. The generator:
+//  - splits each predicate into a check on each word where it can, and
+//    runs all the checks on a word after a single load, keeping the word
+//    in X for the checks that have to mask it;
+//  - runs the checks that are most likely to fail first, taking high words
+//    to be zero, as they are for any argument that isn't a pointer or a
+//    64-bit offset;
+//  - searches large sets with a tree of JGEs, like the syscall dispatch in
+//    the sample policy, after checking the value listed first: sets of
+//    prctl options or ioctl commands list the common ones first;
+//  - leaves out the high-word checks on 32-bit architectures, where those
+//    words are always zero.
+
+enum SeccompArgCompare {
+    SECCOMP_ARG_EQ,         // arg == value
+    SECCOMP_ARG_MASKED_EQ,  // (arg & mask) == value
+    SECCOMP_ARG_RANGE,      // value <= arg <= high, unsigned
+    SECCOMP_ARG_IN_SET,     // arg is one of set[0] to set[setSize - 1]
+};
+
+struct SeccompArgPredicate {
+    int arg;  // 0 to 5
+    SeccompArgCompare compare;
+    // Compare the low word only, for int arguments: the kernel passes the
+    // whole register, and nothing clears the high half of an int in it.
+    bool lowWordOnly;
+    uint64_t value;
+    uint64_t mask;
+    uint64_t high;
+    const uint64_t* set;
+    int setSize;
+};
+
+// Applies to |syscall| when all of its predicates hold.
+struct SeccompArgRule {
+    int syscall;
+    uint32_t action;
+    const SeccompArgPredicate* predicates;
+    int predicateCount;
+};
+
+// For generating the checks one predicate at a time, loading each word
+// for each check, as they would be written by hand.
+#define SECCOMP_ARG_FILTER_UNOPTIMIZED 1
+
+// Writes a program to |filter| that kills the process for a syscall of
+// another architecture; for a syscall that has rules, returns the action of
+// the first of them that applies, or |mismatchAction| if none does; and
+// returns |defaultAction| for any other syscall. Returns the number of
+// instructions, or -1 if they don't fit in |capacity| or a set is too large
+// to jump over.
+int seccompArgFilterGenerate(const SeccompArgRule* rules, int ruleCount,
+                             uint32_t mismatchAction, uint32_t defaultAction, int flags,
+                             struct sock_filter* filter, int capacity);
+
+static inline SeccompArgPredicate seccompArgEq(int arg, uint64_t value) {
+    SeccompArgPredicate predicate = { arg, SECCOMP_ARG_EQ, false, value, 0, 0, NULL, 0 };
+    return predicate;
+}
+
+static inline SeccompArgPredicate seccompArgMaskedEq(int arg, uint64_t mask, uint64_t value) {
+    SeccompArgPredicate predicate =
+            { arg, SECCOMP_ARG_MASKED_EQ, false, value, mask, 0, NULL, 0 };
+    return predicate;
+}
+
+static inline SeccompArgPredicate seccompArgRange(int arg, uint64_t low, uint64_t high) {
+    SeccompArgPredicate predicate = { arg, SECCOMP_ARG_RANGE, false, low, 0, high, NULL, 0 };
+    return predicate;
+}
+
+static inline SeccompArgPredicate seccompArgInSet(int arg, const uint64_t* set, int setSize) {
+    SeccompArgPredicate predicate =
+            { arg, SECCOMP_ARG_IN_SET, false, 0, 0, 0, set, setSize };
+    return predicate;
+}
+
+static inline SeccompArgPredicate seccompArgLowWord(SeccompArgPredicate predicate) {
+    predicate.lowWordOnly = true;
+    return predicate;
+}
+
+#endif  // SECCOMP_ARG_FILTER_H_
@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "seccomp_filter_chain.h"
+
+#include <errno.h>
+#include <linux/seccomp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "proc_scanner.h"
+
+#ifndef PR_SET_NO_NEW_PRIVS
+#define PR_SET_NO_NEW_PRIVS 38
+#endif
+
+#ifndef SECCOMP_SET_MODE_FILTER
+#define SECCOMP_SET_MODE_FILTER 1
+#endif
+#ifndef SECCOMP_FILTER_FLAG_TSYNC
+#define SECCOMP_FILTER_FLAG_TSYNC 1
+#endif
+
+// Linux 3.4 and later.
+#ifndef PTRACE_SEIZE
+#define PTRACE_SEIZE 0x4206
+#define PTRACE_INTERRUPT 0x4207
+#define PTRACE_EVENT_STOP 128
+#endif
+
+// Linux 4.4 and later.
+#ifndef PTRACE_SECCOMP_GET_FILTER
+#define PTRACE_SECCOMP_GET_FILTER 0x420c
+#endif
+
+struct RecordedFilter {
+    SeccompFilterProgram program;
+    // Whether every thread has it, or only |tid| and the threads it went
+    // on to create, which can't be told apart from the others.
+    bool allThreads;
+    pid_t tid;
+    RecordedFilter* next;  // installed before this one
+};
+
+static pthread_mutex_t gRecordedLock = PTHREAD_MUTEX_INITIALIZER;
+static RecordedFilter* gRecorded;  // most recent first
+static int gRecordedCount;
+static bool gRecordedPerThread;
+
+// Reads the fields of a status file that aren't NULL, leaving those it
+// doesn't find alone. Returns false if the file can't be opened.
+static bool readStatus(const char* path, int* mode, int* filterCount, int* threads) {
+    ProcScanner scanner;
+    if (!procScannerOpen(&scanner, path)) {
+        return false;
+    }
+    const char* line;
+    size_t length;
+    while ((line = procScannerNextLine(&scanner, &length)) != NULL) {
+        const char* end = line + length;
+        const char* colon = procScannerFind(line, end, ':');
+        if (colon == end) {
+            continue;
+        }
+        int* field;
+        if (colon - line == 7 && memcmp(line, "Seccomp", 7) == 0) {
+            field = mode;
+        } else if (colon - line == 15 && memcmp(line, "Seccomp_filters", 15) == 0) {
+            field = filterCount;
+        } else if (colon - line == 7 && memcmp(line, "Threads", 7) == 0) {
+            field = threads;
+        } else {
+            continue;
+        }
+        const char* p = procScannerSkipSpaces(colon + 1, end);
+        uint64_t value;
+        if (field != NULL && procScannerParseDecimal(&p, end, &value)) {
+            *field = value;
+        }
+    }
+    procScannerClose(&scanner);
+    return true;
+}
+
+static bool copyProgram(const struct sock_filter* code, int length,
+                        SeccompFilterProgram* program) {
+    program->code = reinterpret_cast<struct sock_filter*>(
+            malloc((length > 0 ? length : 1) * sizeof(struct sock_filter)));
+    if (program->code == NULL) {
+        return false;
+    }
+    memcpy(program->code, code, length * sizeof(struct sock_filter));
+    program->length = length;
+    return true;
+}
+
+static bool addProgram(SeccompFilterChain* chain, const SeccompFilterProgram* program) {
+    SeccompFilterProgram* programs = reinterpret_cast<SeccompFilterProgram*>(
+            realloc(chain->programs, (chain->programCount + 1) * sizeof(SeccompFilterProgram)));
+    if (programs == NULL) {
+        return false;
+    }
+    chain->programs = programs;
+    chain->programs[chain->programCount++] = *program;
+    return true;
+}
+
+bool seccompFilterInstallRecorded(const struct sock_fprog* filter) {
+    return seccompFilterInstallRecordedWithFlags(filter, 0);
+}
+
+bool seccompFilterInstallRecordedWithFlags(const struct sock_fprog* filter, unsigned int flags) {
+    RecordedFilter* recorded = reinterpret_cast<RecordedFilter*>(malloc(sizeof(RecordedFilter)));
+    if (recorded == NULL) {
+        return false;
+    }
+    if (!copyProgram(filter->filter, filter->len, &recorded->program)) {
+        free(recorded);
+        return false;
+    }
+    pthread_mutex_lock(&gRecordedLock);
+    // Without TSYNC a filter only covers the calling thread, and the threads
+    // it creates from then on, which is all of them if it is the only one.
+    recorded->allThreads = (flags & SECCOMP_FILTER_FLAG_TSYNC) != 0;
+    if (!recorded->allThreads) {
+        int threads = 0;
+        readStatus("/proc/self/status", NULL, NULL, &threads);
+        recorded->allThreads = threads == 1;
+    }
+    recorded->tid = syscall(__NR_gettid);
+    bool installed = prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0;
+    if (installed && flags == 0) {
+        installed = prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, filter) == 0;
+    } else if (installed) {
+        // With SECCOMP_FILTER_FLAG_TSYNC, a thread that couldn't be synced
+        // comes back as a positive thread ID.
+        installed = syscall(__NR_seccomp, SECCOMP_SET_MODE_FILTER, flags, filter) == 0;
+    }
+    if (installed) {
+        recorded->next = gRecorded;
+        gRecorded = recorded;
+        if (!recorded->allThreads) {
+            __atomic_store_n(&gRecordedPerThread, true, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&gRecordedCount, gRecordedCount + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&gRecordedLock);
+    if (!installed) {
+        free(recorded->program.code);
+        free(recorded);
+    }
+    return installed;
+}
+
+int seccompFilterRecordedCount() {
+    return __atomic_load_n(&gRecordedCount, __ATOMIC_ACQUIRE);
+}
+
+bool seccompFilterRecordedPerThread() {
+    return __atomic_load_n(&gRecordedPerThread, __ATOMIC_RELAXED);
+}
+
+// /proc/pid/status is that of the thread group leader; filters are per
+// thread.
+static void readChainStatus(pid_t pid, SeccompFilterChain* chain) {
+    char path[64];
+    if (pid != 0) {
+        snprintf(path, sizeof(path), "/proc/%d/status", pid);
+        readStatus(path, &chain->mode, &chain->filterCount, NULL);
+    } else if (!readStatus("/proc/thread-self/status", &chain->mode, &chain->filterCount, NULL)) {
+        // /proc/thread-self is Linux 3.17 and later.
+        snprintf(path, sizeof(path), "/proc/self/task/%d/status", (int) syscall(__NR_gettid));
+        readStatus(path, &chain->mode, &chain->filterCount, NULL);
+    }
+}
+
+static bool loadRecorded(SeccompFilterChain* chain) {
+    bool ok = true;
+    pid_t tid = syscall(__NR_gettid);
+    pthread_mutex_lock(&gRecordedLock);
+    for (RecordedFilter* recorded = gRecorded; recorded != NULL && ok;
+            recorded = recorded->next) {
+        if (!recorded->allThreads && recorded->tid != tid) {
+            continue;
+        }
+        SeccompFilterProgram program;
+        ok = copyProgram(recorded->program.code, recorded->program.length, &program);
+        if (ok && !addProgram(chain, &program)) {
+            free(program.code);
+            ok = false;
+        }
+    }
+    pthread_mutex_unlock(&gRecordedLock);
+    if (!ok) {
+        chain->error = ENOMEM;
+    }
+    return ok;
+}
+
+static bool loadWithPtrace(pid_t pid, SeccompFilterChain* chain) {
+    if (ptrace(PTRACE_SEIZE, pid, 0, 0) != 0) {
+        chain->error = errno;
+        return false;
+    }
+    // The filters can only be read while the tracee is stopped.
+    int status;
+    bool ok = ptrace(PTRACE_INTERRUPT, pid, 0, 0) == 0 &&
+            TEMP_FAILURE_RETRY(waitpid(pid, &status, __WALL)) == pid && WIFSTOPPED(status);
+    // A signal that arrived first stopped it instead, and has to be passed on.
+    int pendingSignal = 0;
+    if (ok && (status >> 16) != PTRACE_EVENT_STOP) {
+        pendingSignal = WSTOPSIG(status);
+    }
+
+    for (int index = 0; ok; index++) {
+        long length = ptrace(PTRACE_SECCOMP_GET_FILTER, pid, index, NULL);
+        if (length < 0) {
+            // ENOENT past the oldest filter, and EINVAL if there are none.
+            ok = errno == ENOENT || (index == 0 && errno == EINVAL);
+            break;
+        }
+        SeccompFilterProgram program;
+        program.length = length;
+        program.code = reinterpret_cast<struct sock_filter*>(
+                malloc((length > 0 ? length : 1) * sizeof(struct sock_filter)));
+        if (program.code == NULL) {
+            errno = ENOMEM;
+            ok = false;
+        } else if (ptrace(PTRACE_SECCOMP_GET_FILTER, pid, index, program.code) != length ||
+                !addProgram(chain, &program)) {
+            free(program.code);
+            ok = false;
+        }
+    }
+    if (!ok) {
+        chain->error = errno;
+    }
+    ptrace(PTRACE_DETACH, pid, 0, pendingSignal);
+
+    // The kernel counts from the oldest filter.
+    for (int i = 0, j = chain->programCount - 1; i < j; i++, j--) {
+        SeccompFilterProgram program = chain->programs[i];
+        chain->programs[i] = chain->programs[j];
+        chain->programs[j] = program;
+    }
+    return ok;
+}
+
+bool seccompFilterChainLoad(pid_t pid, SeccompFilterChain* chain) {
+    memset(chain, 0, sizeof(*chain));
+    chain->source = SECCOMP_CHAIN_NONE;
+    chain->mode = -1;
+    chain->filterCount = -1;
+    if (pid == getpid()) {
+        pid = 0;
+    }
+    readChainStatus(pid, chain);
+    if (pid == 0) {
+        if (loadRecorded(chain)) {
+            chain->source = SECCOMP_CHAIN_RECORDED;
+        }
+    } else if (loadWithPtrace(pid, chain)) {
+        chain->source = SECCOMP_CHAIN_PTRACE;
+    } else {
+        // Don't report half a chain.
+        seccompFilterChainFree(chain);
+    }
+    return chain->source != SECCOMP_CHAIN_NONE || chain->mode >= 0;
+}
+
+void seccompFilterChainFree(SeccompFilterChain* chain) {
+    for (int i = 0; i < chain->programCount; i++) {
+        free(chain->programs[i].code);
+    }
+    free(chain->programs);
+    chain->programs = NULL;
+    chain->programCount = 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECCOMP_FILTER_CHAIN_H_
+#define SECCOMP_FILTER_CHAIN_H_
+
+#include <linux/filter.h>
+#include <sys/types.h>
+
+// The seccomp filters attached to a process. Each library that sandboxes
+// part of a process adds its own, and the kernel runs all of them on every
+// syscall, most recent first.
+//
+// The programs of another process come from PTRACE_SECCOMP_GET_FILTER,
+// which needs CAP_SYS_ADMIN and a tracer that isn't itself under seccomp.
+// A process can't trace itself, so it reports the filters it installed with
+// seccompFilterInstallRecorded() instead. Either way, /proc/pid/status says
+// how many filters there really are (Linux 5.9 and later).
+//
+// Filters belong to threads. A filter installed without
+// SECCOMP_FILTER_FLAG_TSYNC while the process had other threads is only
+// reported to the thread that installed it, though the threads that thread
+// creates afterwards have it as well; their filter counts say so.
+
+enum SeccompChainSource {
+    SECCOMP_CHAIN_NONE,      // no programs, only what /proc says
+    SECCOMP_CHAIN_PTRACE,    // read from the kernel
+    SECCOMP_CHAIN_RECORDED,  // recorded when installed
+};
+
+struct SeccompFilterProgram {
+    struct sock_filter* code;
+    int length;
+};
+
+struct SeccompFilterChain {
+    SeccompChainSource source;
+    int mode;         // the Seccomp: line of /proc/pid/status, or -1
+    int filterCount;  // the Seccomp_filters: line, or -1
+    // Most recent first.
+    SeccompFilterProgram* programs;
+    int programCount;
+    int error;  // errno of the failure to read the programs, if any
+};
+
+// Fills in |chain| for |pid|, or the calling thread if |pid| is 0.
+// Returns false if nothing at all could be learned.
+bool seccompFilterChainLoad(pid_t pid, SeccompFilterChain* chain);
+
+void seccompFilterChainFree(SeccompFilterChain* chain);
+
+// Installs |filter| on the calling thread, as prctl(PR_SET_SECCOMP,
+// SECCOMP_MODE_FILTER) does after setting PR_SET_NO_NEW_PRIVS, and records a
+// copy to report for this process. Returns false on failure.
+bool seccompFilterInstallRecorded(const struct sock_fprog* filter);
+
+// The same through seccomp(SECCOMP_SET_MODE_FILTER), with |flags| such as
+// SECCOMP_FILTER_FLAG_TSYNC.
+bool seccompFilterInstallRecordedWithFlags(const struct sock_fprog* filter, unsigned int flags);
+
+// The number of filters recorded so far, which only goes up; cheap enough
+// to check before trusting anything worked out from them.
+int seccompFilterRecordedCount();
+
+// Whether any of them were recorded for one thread only, so that what is
+// worked out from them only holds on the thread it was worked out on.
+bool seccompFilterRecordedPerThread();
+
+#endif  // SECCOMP_FILTER_CHAIN_H_
@@ -0,0 +1,531 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "seccomp_filter_eval.h"
+
+#include <linux/audit.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Unknown branches followed at once, and instructions stepped through in
+// all, before an analysis gives up.
+#define MAX_DEPTH 1024
+#define MAX_WORK (1 << 24)
+
+// Most states an analysis remembers the outcomes of.
+#define MAX_MEMO 65536
+
+// A register or scratch word, which the analysis may not know.
+struct Value {
+    uint32_t value;
+    bool known;
+};
+
+struct State {
+    int pc;
+    int count;  // instructions executed
+    Value a;
+    Value x;
+    Value mem[BPF_MEMWORDS];
+};
+
+static Value known(uint32_t value) {
+    Value v = { value, true };
+    return v;
+}
+
+static const Value kUnknown = { 0, false };
+
+// Where a path ends: its instruction count and action.
+struct Outcome {
+    int count;
+    Value action;
+};
+
+// Runs |filter| from |*state| until it returns or reaches a jump that
+// depends on something unknown. Returns true with |*outcome| set if it
+// returned; otherwise sets |*other| to the state down the jump's other
+// branch and |*state| to this one, and returns false.
+static bool step(const struct sock_filter* filter, int length, const struct seccomp_data* data,
+                 bool argsKnown, bool* dependsOnArgs, State* state, State* other,
+                 Outcome* outcome) {
+    for (;;) {
+        if (state->pc < 0 || state->pc >= length) {
+            outcome->count = state->count;
+            outcome->action = known(SECCOMP_RET_KILL);
+            return true;
+        }
+        const struct sock_filter* insn = &filter[state->pc++];
+        state->count++;
+        uint32_t k = insn->k;
+        switch (insn->code) {
+        case BPF_LD | BPF_W | BPF_ABS:
+            if ((k & 3) != 0 || k >= sizeof(struct seccomp_data)) {
+                state->pc = length;
+                break;
+            }
+            if (argsKnown || k < offsetof(struct seccomp_data, instruction_pointer)) {
+                uint32_t word;
+                memcpy(&word, reinterpret_cast<const char*>(data) + k, sizeof(word));
+                state->a = known(word);
+            } else {
+                state->a = kUnknown;
+                *dependsOnArgs = true;
+            }
+            break;
+        case BPF_LD | BPF_W | BPF_LEN:
+            state->a = known(sizeof(struct seccomp_data));
+            break;
+        case BPF_LDX | BPF_W | BPF_LEN:
+            state->x = known(sizeof(struct seccomp_data));
+            break;
+        case BPF_LD | BPF_IMM:
+            state->a = known(k);
+            break;
+        case BPF_LDX | BPF_IMM:
+            state->x = known(k);
+            break;
+        case BPF_LD | BPF_MEM:
+        case BPF_LDX | BPF_MEM:
+        case BPF_ST:
+        case BPF_STX:
+            if (k >= BPF_MEMWORDS) {
+                state->pc = length;
+            } else if (insn->code == (BPF_LD | BPF_MEM)) {
+                state->a = state->mem[k];
+            } else if (insn->code == (BPF_LDX | BPF_MEM)) {
+                state->x = state->mem[k];
+            } else if (insn->code == BPF_ST) {
+                state->mem[k] = state->a;
+            } else {
+                state->mem[k] = state->x;
+            }
+            break;
+        case BPF_MISC | BPF_TAX:
+            state->x = state->a;
+            break;
+        case BPF_MISC | BPF_TXA:
+            state->a = state->x;
+            break;
+
+        case BPF_ALU | BPF_NEG:
+            state->a.value = -state->a.value;
+            break;
+        case BPF_ALU | BPF_ADD | BPF_K: case BPF_ALU | BPF_ADD | BPF_X:
+        case BPF_ALU | BPF_SUB | BPF_K: case BPF_ALU | BPF_SUB | BPF_X:
+        case BPF_ALU | BPF_MUL | BPF_K: case BPF_ALU | BPF_MUL | BPF_X:
+        case BPF_ALU | BPF_DIV | BPF_K: case BPF_ALU | BPF_DIV | BPF_X:
+        case BPF_ALU | BPF_AND | BPF_K: case BPF_ALU | BPF_AND | BPF_X:
+        case BPF_ALU | BPF_OR | BPF_K: case BPF_ALU | BPF_OR | BPF_X:
+        case BPF_ALU | BPF_XOR | BPF_K: case BPF_ALU | BPF_XOR | BPF_X:
+        case BPF_ALU | BPF_LSH | BPF_K: case BPF_ALU | BPF_LSH | BPF_X:
+        case BPF_ALU | BPF_RSH | BPF_K: case BPF_ALU | BPF_RSH | BPF_X: {
+            Value operand = BPF_SRC(insn->code) == BPF_X ? state->x : known(k);
+            if (!state->a.known || !operand.known) {
+                state->a = kUnknown;
+                break;
+            }
+            uint32_t a = state->a.value;
+            uint32_t b = operand.value;
+            switch (BPF_OP(insn->code)) {
+            case BPF_ADD: a += b; break;
+            case BPF_SUB: a -= b; break;
+            case BPF_MUL: a *= b; break;
+            case BPF_AND: a &= b; break;
+            case BPF_OR: a |= b; break;
+            case BPF_XOR: a ^= b; break;
+            case BPF_LSH: a = b < 32 ? a << b : 0; break;
+            case BPF_RSH: a = b < 32 ? a >> b : 0; break;
+            case BPF_DIV:
+                // Dividing by zero ends the program with 0.
+                if (b == 0) {
+                    outcome->count = state->count;
+                    outcome->action = known(0);
+                    return true;
+                }
+                a /= b;
+                break;
+            }
+            state->a = known(a);
+            break;
+        }
+
+        case BPF_JMP | BPF_JA:
+            state->pc += k;
+            break;
+        case BPF_JMP | BPF_JEQ | BPF_K: case BPF_JMP | BPF_JEQ | BPF_X:
+        case BPF_JMP | BPF_JGT | BPF_K: case BPF_JMP | BPF_JGT | BPF_X:
+        case BPF_JMP | BPF_JGE | BPF_K: case BPF_JMP | BPF_JGE | BPF_X:
+        case BPF_JMP | BPF_JSET | BPF_K: case BPF_JMP | BPF_JSET | BPF_X: {
+            Value operand = BPF_SRC(insn->code) == BPF_X ? state->x : known(k);
+            if (!state->a.known || !operand.known) {
+                *other = *state;
+                other->pc += insn->jf;
+                state->pc += insn->jt;
+                return false;
+            }
+            uint32_t a = state->a.value;
+            uint32_t b = operand.value;
+            bool taken = false;
+            switch (BPF_OP(insn->code)) {
+            case BPF_JEQ: taken = a == b; break;
+            case BPF_JGT: taken = a > b; break;
+            case BPF_JGE: taken = a >= b; break;
+            case BPF_JSET: taken = (a & b) != 0; break;
+            }
+            state->pc += taken ? insn->jt : insn->jf;
+            break;
+        }
+
+        case BPF_RET | BPF_K:
+            outcome->count = state->count;
+            outcome->action = known(k);
+            return true;
+        case BPF_RET | BPF_A:
+            outcome->count = state->count;
+            outcome->action = state->a;
+            return true;
+
+        default:
+            // Not something seccomp accepts.
+            state->pc = length;
+            break;
+        }
+    }
+}
+
+static void initState(State* state) {
+    memset(state, 0, sizeof(*state));
+    // The kernel clears A and X, but not the scratch words.
+    state->a = known(0);
+    state->x = known(0);
+    for (int i = 0; i < BPF_MEMWORDS; i++) {
+        state->mem[i] = kUnknown;
+    }
+}
+
+uint32_t seccompFilterRun(const struct sock_filter* filter, int length,
+                          const struct seccomp_data* data, int* instructions) {
+    State state;
+    initState(&state);
+    State other;
+    Outcome outcome;
+    bool dependsOnArgs = false;
+    // With everything known, the only unknowns are scratch words that were
+    // never stored: a jump on one of those takes its true branch.
+    while (!step(filter, length, data, true, &dependsOnArgs, &state, &other, &outcome)) {
+    }
+    if (instructions != NULL) {
+        *instructions = outcome.count;
+    }
+    return outcome.action.value;
+}
+
+// Every path from some state to the end of the filter.
+struct Summary {
+    int minInstructions;
+    int maxInstructions;
+    int actionCount;
+    uint32_t actions[SECCOMP_MAX_ACTIONS];
+    bool actionsTruncated;
+    bool unknownAction;
+};
+
+static void addAction(Summary* summary, uint32_t action) {
+    for (int i = 0; i < summary->actionCount; i++) {
+        if (summary->actions[i] == action) {
+            return;
+        }
+    }
+    if (summary->actionCount == SECCOMP_MAX_ACTIONS) {
+        summary->actionsTruncated = true;
+        return;
+    }
+    summary->actions[summary->actionCount++] = action;
+}
+
+static bool sameValue(Value a, Value b) {
+    return a.known == b.known && (!a.known || a.value == b.value);
+}
+
+static bool sameState(const State* a, const State* b) {
+    if (a->pc != b->pc || !sameValue(a->a, b->a) || !sameValue(a->x, b->x)) {
+        return false;
+    }
+    for (int i = 0; i < BPF_MEMWORDS; i++) {
+        if (!sameValue(a->mem[i], b->mem[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint32_t hashValue(uint32_t hash, Value value) {
+    return (hash ^ (value.known ? value.value : 0x9e3779b9)) * 16777619;
+}
+
+static uint32_t hashState(const State* state) {
+    uint32_t hash = hashValue(2166136261U, known(state->pc));
+    hash = hashValue(hash, state->a);
+    hash = hashValue(hash, state->x);
+    for (int i = 0; i < BPF_MEMWORDS; i++) {
+        hash = hashValue(hash, state->mem[i]);
+    }
+    return hash;
+}
+
+struct MemoEntry {
+    bool used;
+    State state;
+    Summary summary;
+};
+
+struct Analysis {
+    const struct sock_filter* filter;
+    int length;
+    const struct seccomp_data* data;
+    bool dependsOnArgs;
+    bool truncated;
+    long work;
+    // Two states for each unknown branch being followed, to keep them off
+    // the stack.
+    State* states;
+    int depth;
+    // Branches of a filter join again, usually with the same state, so
+    // each state that follows a branch is only followed once.
+    MemoEntry* memo;
+    int memoSize;  // a power of two, or 0
+    int memoUsed;
+};
+
+static void summarize(Analysis* an, const State* start, Summary* summary);
+
+static void explore(Analysis* an, const State* start, Summary* summary) {
+    memset(summary, 0, sizeof(*summary));
+    if (an->depth == MAX_DEPTH || an->work > MAX_WORK) {
+        an->truncated = true;
+        return;
+    }
+    State* state = &an->states[2 * an->depth];
+    State* other = &an->states[2 * an->depth + 1];
+    an->depth++;
+    *state = *start;
+    state->count = 0;
+    Outcome outcome;
+    if (step(an->filter, an->length, an->data, false, &an->dependsOnArgs, state, other,
+             &outcome)) {
+        an->work += outcome.count;
+        summary->minInstructions = outcome.count;
+        summary->maxInstructions = outcome.count;
+        if (outcome.action.known) {
+            addAction(summary, outcome.action.value);
+        } else {
+            summary->unknownAction = true;
+        }
+    } else {
+        an->work += state->count;
+        Summary taken;
+        Summary notTaken;
+        summarize(an, state, &taken);
+        summarize(an, other, &notTaken);
+        *summary = taken;
+        if (notTaken.minInstructions < summary->minInstructions) {
+            summary->minInstructions = notTaken.minInstructions;
+        }
+        if (notTaken.maxInstructions > summary->maxInstructions) {
+            summary->maxInstructions = notTaken.maxInstructions;
+        }
+        summary->minInstructions += state->count;
+        summary->maxInstructions += state->count;
+        for (int i = 0; i < notTaken.actionCount; i++) {
+            addAction(summary, notTaken.actions[i]);
+        }
+        summary->actionsTruncated |= notTaken.actionsTruncated;
+        summary->unknownAction |= notTaken.unknownAction;
+    }
+    an->depth--;
+}
+
+static void summarize(Analysis* an, const State* start, Summary* summary) {
+    uint32_t mask = an->memoSize - 1;
+    uint32_t hash = hashState(start);
+    for (int i = 0; an->memoSize != 0 && i < an->memoSize; i++) {
+        const MemoEntry* entry = &an->memo[(hash + i) & mask];
+        if (!entry->used) {
+            break;
+        }
+        if (sameState(&entry->state, start)) {
+            *summary = entry->summary;
+            return;
+        }
+    }
+    explore(an, start, summary);
+    // Leave a quarter of the table free, to keep the probes short.
+    if (an->truncated || an->memoUsed >= an->memoSize - an->memoSize / 4) {
+        return;
+    }
+    for (int i = 0; ; i++) {
+        MemoEntry* entry = &an->memo[(hash + i) & mask];
+        if (!entry->used) {
+            entry->used = true;
+            entry->state = *start;
+            entry->summary = *summary;
+            an->memoUsed++;
+            return;
+        }
+    }
+}
+
+void seccompFilterAnalyze(const struct sock_filter* filter, int length, uint32_t arch, int nr,
+                          SeccompSyscallCost* cost) {
+    memset(cost, 0, sizeof(*cost));
+    struct seccomp_data data;
+    memset(&data, 0, sizeof(data));
+    data.nr = nr;
+    data.arch = arch;
+
+    Analysis an;
+    memset(&an, 0, sizeof(an));
+    an.filter = filter;
+    an.length = length;
+    an.data = &data;
+    an.states = reinterpret_cast<State*>(malloc(2 * MAX_DEPTH * sizeof(State)));
+    if (an.states == NULL) {
+        cost->pathsTruncated = true;
+        return;
+    }
+    an.memoSize = 64;
+    while (an.memoSize < 4 * length && an.memoSize < MAX_MEMO) {
+        an.memoSize *= 2;
+    }
+    an.memo = reinterpret_cast<MemoEntry*>(calloc(an.memoSize, sizeof(MemoEntry)));
+    if (an.memo == NULL) {
+        an.memoSize = 0;
+    }
+
+    State start;
+    initState(&start);
+    Summary summary;
+    explore(&an, &start, &summary);
+    cost->minInstructions = summary.minInstructions;
+    cost->maxInstructions = summary.maxInstructions;
+    cost->dependsOnArgs = an.dependsOnArgs;
+    cost->actionCount = summary.actionCount;
+    memcpy(cost->actions, summary.actions, sizeof(cost->actions));
+    cost->actionsTruncated = summary.actionsTruncated;
+    cost->unknownAction = summary.unknownAction;
+    cost->pathsTruncated = an.truncated;
+    free(an.states);
+    free(an.memo);
+}
+
+bool seccompFilterConstAllow(const struct sock_filter* filter, int length, uint32_t arch,
+                             int nr) {
+    uint32_t a = 0;
+    for (int pc = 0; pc < length; pc++) {
+        const struct sock_filter* insn = &filter[pc];
+        uint32_t k = insn->k;
+        switch (insn->code) {
+        case BPF_LD | BPF_W | BPF_ABS:
+            if (k == offsetof(struct seccomp_data, nr)) {
+                a = nr;
+            } else if (k == offsetof(struct seccomp_data, arch)) {
+                a = arch;
+            } else {
+                return false;
+            }
+            break;
+        case BPF_RET | BPF_K:
+            return k == SECCOMP_RET_ALLOW;
+        case BPF_JMP | BPF_JA:
+            pc += k;
+            break;
+        case BPF_JMP | BPF_JEQ | BPF_K:
+            pc += a == k ? insn->jt : insn->jf;
+            break;
+        case BPF_JMP | BPF_JGE | BPF_K:
+            pc += a >= k ? insn->jt : insn->jf;
+            break;
+        case BPF_JMP | BPF_JGT | BPF_K:
+            pc += a > k ? insn->jt : insn->jf;
+            break;
+        case BPF_JMP | BPF_JSET | BPF_K:
+            pc += (a & k) != 0 ? insn->jt : insn->jf;
+            break;
+        case BPF_ALU | BPF_AND | BPF_K:
+            a &= k;
+            break;
+        default:
+            return false;
+        }
+    }
+    return false;
+}
+
+uint32_t seccompActionPrecedence(uint32_t a, uint32_t b) {
+    // The kernel compares the actions as signed, so KILL_PROCESS comes first.
+    int32_t left = a & SECCOMP_RET_ACTION_FULL;
+    int32_t right = b & SECCOMP_RET_ACTION_FULL;
+    return right < left ? b : a;
+}
+
+void seccompActionFormat(uint32_t action, char* buffer, size_t size) {
+    uint32_t data = action & SECCOMP_RET_DATA;
+    switch (action & SECCOMP_RET_ACTION_FULL) {
+    case SECCOMP_RET_KILL_PROCESS:
+        snprintf(buffer, size, "KILL_PROCESS");
+        break;
+    case SECCOMP_RET_KILL:
+        snprintf(buffer, size, "KILL");
+        break;
+    case SECCOMP_RET_TRAP:
+        snprintf(buffer, size, "TRAP(%u)", data);
+        break;
+    case SECCOMP_RET_ERRNO:
+        snprintf(buffer, size, "ERRNO(%u)", data);
+        break;
+    case SECCOMP_RET_USER_NOTIF:
+        snprintf(buffer, size, "USER_NOTIF");
+        break;
+    case SECCOMP_RET_TRACE:
+        snprintf(buffer, size, "TRACE(%u)", data);
+        break;
+    case SECCOMP_RET_LOG:
+        snprintf(buffer, size, "LOG");
+        break;
+    case SECCOMP_RET_ALLOW:
+        snprintf(buffer, size, "ALLOW");
+        break;
+    default:
+        snprintf(buffer, size, "0x%08x", action);
+        break;
+    }
+}
+
+uint32_t seccompNativeArch() {
+#if defined(__aarch64__)
+    return AUDIT_ARCH_AARCH64;
+#elif defined(__arm__)
+    return AUDIT_ARCH_ARM;
+#elif defined(__x86_64__)
+    return AUDIT_ARCH_X86_64;
+#elif defined(__i386__)
+    return AUDIT_ARCH_I386;
+#else
+    return 0;
+#endif
+}
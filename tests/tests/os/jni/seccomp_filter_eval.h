@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECCOMP_FILTER_EVAL_H_
+#define SECCOMP_FILTER_EVAL_H_
+
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Linux 4.14 and later.
+#ifndef SECCOMP_RET_KILL_PROCESS
+#define SECCOMP_RET_KILL_PROCESS 0x80000000U
+#define SECCOMP_RET_ACTION_FULL 0xffff0000U
+#define SECCOMP_RET_LOG 0x7ffc0000U
+#endif
+
+// Linux 5.0 and later.
+#ifndef SECCOMP_RET_USER_NOTIF
+#define SECCOMP_RET_USER_NOTIF 0x7fc00000U
+#endif
+
+// Runs seccomp filters in user space the way the kernel does, counting the
+// instructions they execute: for one syscall, or for every path a syscall
+// can take through a filter whatever its arguments.
+//
+// A program the kernel would refuse to load, say one that jumps past its
+// end or loads outside struct seccomp_data, returns SECCOMP_RET_KILL where
+// it goes wrong.
+
+// Returns the action |filter| takes for |data|, and stores the number of
+// instructions it executed in |*instructions| unless that is NULL.
+uint32_t seccompFilterRun(const struct sock_filter* filter, int length,
+                          const struct seccomp_data* data, int* instructions);
+
+// Distinct actions kept in a SeccompSyscallCost.
+#define SECCOMP_MAX_ACTIONS 8
+
+struct SeccompSyscallCost {
+    int minInstructions;
+    int maxInstructions;
+    // Some path loads an argument or the instruction pointer.
+    bool dependsOnArgs;
+    // The actions the syscall can get. More than SECCOMP_MAX_ACTIONS sets
+    // |actionsTruncated|; a RET A of something that depends on the
+    // arguments sets |unknownAction|.
+    int actionCount;
+    uint32_t actions[SECCOMP_MAX_ACTIONS];
+    bool actionsTruncated;
+    bool unknownAction;
+    // The filter branches too much on the arguments to follow every path,
+    // and the rest are left out.
+    bool pathsTruncated;
+};
+
+// Follows every path |filter| can take for syscall |nr| of architecture
+// |arch|, treating the arguments and instruction pointer as unknown.
+void seccompFilterAnalyze(const struct sock_filter* filter, int length, uint32_t arch, int nr,
+                          SeccompSyscallCost* cost);
+
+// Returns true if |filter| allows syscall |nr| of |arch| without looking at
+// anything else, as decided by the kernel's seccomp_is_const_allow(): since
+// Linux 5.11, a syscall that every filter allows that way skips running the
+// filters at all.
+bool seccompFilterConstAllow(const struct sock_filter* filter, int length, uint32_t arch,
+                             int nr);
+
+// Returns the higher-precedence of two actions, for combining the results
+// of the filters in a chain the way the kernel does.
+uint32_t seccompActionPrecedence(uint32_t a, uint32_t b);
+
+// Formats |action| as, for example, "ERRNO(1)" or "ALLOW".
+void seccompActionFormat(uint32_t action, char* buffer, size_t size);
+
+// The AUDIT_ARCH_ value of the calling process's syscalls, or 0 if it isn't
+// known.
+uint32_t seccompNativeArch();
+
+#endif  // SECCOMP_FILTER_EVAL_H_
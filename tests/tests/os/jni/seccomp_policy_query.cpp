@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "seccomp_policy_query.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "seccomp_filter_chain.h"
+#include "seccomp_filter_eval.h"
+
+// Syscall numbers whose verdicts are kept; others are worked out each time.
+#define MAX_CACHED_SYSCALL 1024
+
+// Answers for particular arguments kept, direct-mapped; a power of two.
+#define ACTION_CACHE_SIZE 256
+
+struct CachedAction {
+    bool valid;
+    int nr;
+    uint64_t args[6];
+    uint32_t action;
+};
+
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+// What seccompFilterRecordedCount() was when the chain was loaded, or -1,
+// and the thread it was loaded for, if it only holds on that one.
+static int gLoadedCount = -1;
+static pid_t gLoadedTid;
+static SeccompFilterChain gChain;
+static bool gComplete;
+static uint32_t gArch;
+// Verdict + 1, or 0 if not worked out yet.
+static uint8_t gVerdicts[MAX_CACHED_SYSCALL];
+static CachedAction gActions[ACTION_CACHE_SIZE];
+
+// Reloads the recorded filters if there are new ones, and drops what was
+// worked out from the old ones. Returns false if they couldn't be loaded.
+// Called with gLock held.
+static bool refresh() {
+    int count = seccompFilterRecordedCount();
+    pid_t tid = seccompFilterRecordedPerThread() ? syscall(__NR_gettid) : 0;
+    if (count == gLoadedCount && tid == gLoadedTid) {
+        return true;
+    }
+    seccompFilterChainFree(&gChain);
+    memset(gVerdicts, 0, sizeof(gVerdicts));
+    memset(gActions, 0, sizeof(gActions));
+    gArch = seccompNativeArch();
+    // A filter recorded in the meantime makes the count differ next time,
+    // which only costs another load.
+    if (!seccompFilterChainLoad(0, &gChain) || gChain.source != SECCOMP_CHAIN_RECORDED) {
+        seccompFilterChainFree(&gChain);
+        gLoadedCount = -1;
+        return false;
+    }
+    // Without a count (before Linux 5.9), any filter might not have been
+    // recorded, and strict mode allows next to nothing.
+    gComplete = (gChain.mode == 0 && gChain.programCount == 0) ||
+            (gChain.mode == SECCOMP_MODE_FILTER && gChain.filterCount == gChain.programCount);
+    gLoadedCount = count;
+    gLoadedTid = tid;
+    return true;
+}
+
+static bool actionAllows(uint32_t action) {
+    action &= SECCOMP_RET_ACTION_FULL;
+    return action == SECCOMP_RET_ALLOW || action == SECCOMP_RET_LOG;
+}
+
+static SeccompPolicyVerdict analyze(int nr) {
+    SeccompPolicyVerdict verdict = SECCOMP_POLICY_ALLOWED;
+    for (int i = 0; i < gChain.programCount; i++) {
+        SeccompSyscallCost cost;
+        seccompFilterAnalyze(gChain.programs[i].code, gChain.programs[i].length, gArch, nr,
+                             &cost);
+        // Actions left out might include one either way.
+        bool allowed = false;
+        bool denied = cost.unknownAction || cost.actionsTruncated || cost.pathsTruncated;
+        for (int j = 0; j < cost.actionCount; j++) {
+            if (actionAllows(cost.actions[j])) {
+                allowed = true;
+            } else {
+                denied = true;
+            }
+        }
+        if (!allowed && !cost.unknownAction && !cost.actionsTruncated && !cost.pathsTruncated) {
+            return SECCOMP_POLICY_DENIED;
+        }
+        if (denied) {
+            verdict = SECCOMP_POLICY_DEPENDS;
+        }
+    }
+    return verdict;
+}
+
+// Runs the chain; the kernel starts from ALLOW and keeps the action with
+// the highest precedence.
+static uint32_t run(int nr, const uint64_t* args) {
+    struct seccomp_data data;
+    memset(&data, 0, sizeof(data));
+    data.nr = nr;
+    data.arch = gArch;
+    memcpy(data.args, args, sizeof(data.args));
+    uint32_t action = SECCOMP_RET_ALLOW;
+    for (int i = 0; i < gChain.programCount; i++) {
+        action = seccompActionPrecedence(action,
+                seccompFilterRun(gChain.programs[i].code, gChain.programs[i].length, &data,
+                                 NULL));
+    }
+    return action;
+}
+
+static uint32_t hashCall(int nr, const uint64_t* args) {
+    uint32_t hash = 2166136261u ^ nr;
+    for (int i = 0; i < 6; i++) {
+        hash = (hash ^ (uint32_t) args[i] ^ (uint32_t) (args[i] >> 32)) * 16777619u;
+    }
+    return hash ^ (hash >> 16);
+}
+
+// Called with gLock held, after refresh().
+static SeccompPolicyVerdict lockedVerdict(int nr) {
+    if (nr < 0 || nr >= MAX_CACHED_SYSCALL) {
+        return analyze(nr);
+    }
+    if (gVerdicts[nr] == 0) {
+        gVerdicts[nr] = analyze(nr) + 1;
+    }
+    return static_cast<SeccompPolicyVerdict>(gVerdicts[nr] - 1);
+}
+
+// Called with gLock held, after refresh().
+static uint32_t lockedAction(int nr, const uint64_t* args) {
+    CachedAction* cached = &gActions[hashCall(nr, args) & (ACTION_CACHE_SIZE - 1)];
+    if (!cached->valid || cached->nr != nr || memcmp(cached->args, args, sizeof(cached->args))) {
+        cached->valid = true;
+        cached->nr = nr;
+        memcpy(cached->args, args, sizeof(cached->args));
+        cached->action = run(nr, args);
+    }
+    return cached->action;
+}
+
+SeccompPolicyVerdict seccompPolicyQuerySyscall(int nr) {
+    pthread_mutex_lock(&gLock);
+    SeccompPolicyVerdict verdict = refresh() ? lockedVerdict(nr) : SECCOMP_POLICY_DEPENDS;
+    pthread_mutex_unlock(&gLock);
+    return verdict;
+}
+
+// If the filters can't be loaded, which takes running out of memory, the
+// answer is the worst there is.
+uint32_t seccompPolicyQueryAction(int nr, const uint64_t* args) {
+    pthread_mutex_lock(&gLock);
+    uint32_t action = refresh() ? lockedAction(nr, args) : SECCOMP_RET_KILL_PROCESS;
+    pthread_mutex_unlock(&gLock);
+    return action;
+}
+
+bool seccompPolicyAllows(int nr, const uint64_t* args) {
+    pthread_mutex_lock(&gLock);
+    bool allowed = false;
+    if (refresh()) {
+        // Most syscalls don't depend on their arguments, and are answered
+        // without running anything.
+        SeccompPolicyVerdict verdict = lockedVerdict(nr);
+        allowed = verdict == SECCOMP_POLICY_ALLOWED ||
+                (verdict == SECCOMP_POLICY_DEPENDS && actionAllows(lockedAction(nr, args)));
+    }
+    pthread_mutex_unlock(&gLock);
+    return allowed;
+}
+
+bool seccompPolicyComplete() {
+    pthread_mutex_lock(&gLock);
+    bool complete = refresh() && gComplete;
+    pthread_mutex_unlock(&gLock);
+    return complete;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECCOMP_POLICY_QUERY_H_
+#define SECCOMP_POLICY_QUERY_H_
+
+#include <stdint.h>
+
+// Says whether the seccomp filters this process has installed would let a
+// syscall through, without making it, so that code can pick the fastest
+// mechanism it is allowed (memfd_create over a temporary file, io_uring
+// over preadv, getrandom over /dev/urandom, mmap with particular flags)
+// without trying each one and risking SIGSYS or worse.
+//
+// The answers come from running the filters recorded by
+// seccompFilterInstallRecorded() and seccompFilterInstallRecordedWithFlags()
+// (see seccomp_filter_chain.h) in user space with seccomp_filter_eval.h,
+// and are cached until another filter is recorded. They are for the calling
+// thread, which only matters for filters installed without
+// SECCOMP_FILTER_FLAG_TSYNC once there were other threads. Filters
+// installed any other way, like the one app processes start with, aren't
+// known; seccompPolicyComplete() says whether there are any.
+//
+// Syscalls are those of the process's own architecture, made from an
+// instruction pointer of 0, which only matters to filters that trust one
+// particular syscall instruction. A syscall is allowed if every filter
+// returns SECCOMP_RET_ALLOW or SECCOMP_RET_LOG for it.
+
+enum SeccompPolicyVerdict {
+    SECCOMP_POLICY_ALLOWED,  // whatever the arguments
+    SECCOMP_POLICY_DENIED,   // whatever the arguments
+    SECCOMP_POLICY_DEPENDS,  // on the arguments; ask with them
+};
+
+// Whether syscall |nr| gets through, for any arguments.
+SeccompPolicyVerdict seccompPolicyQuerySyscall(int nr);
+
+// The action the filters, taken together as the kernel does, would take
+// for syscall |nr| with the six arguments |args|.
+uint32_t seccompPolicyQueryAction(int nr, const uint64_t* args);
+
+// Whether that action lets the syscall run.
+bool seccompPolicyAllows(int nr, const uint64_t* args);
+
+// False if the calling thread has filters that weren't recorded, or might
+// have, because the kernel is too old to count them, so that the answers
+// may be too generous.
+bool seccompPolicyComplete();
+
+#endif  // SECCOMP_POLICY_QUERY_H_
@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "seccomp_supervisor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cutils/log.h>
+
+// Notifications answered per epoll_wait().
+#define MAX_EVENTS 64
+
+// Room for the kernel's seccomp_notif and seccomp_notif_resp, which are a
+// few dozen bytes today.
+#define MAX_NOTIF_SIZE 256
+
+struct Listener {
+    int fd;
+    SeccompNotifyHandler handler;
+    void* arg;
+    bool slow;
+    int refs;  // one for being registered, one per queued notification
+    Listener* prev;
+    Listener* next;
+};
+
+// A notification waiting for a slow handler.
+struct Job {
+    Listener* listener;
+    Job* next;
+    // Followed by the notification, gNotifSize bytes.
+};
+
+struct SeccompSupervisor {
+    int epollFd;
+    int stopFd;  // eventfd that ends the epoll loop
+    pthread_t thread;
+
+    pthread_mutex_t lock;
+    Listener* listeners;
+    Job* head;
+    Job* tail;
+    bool stopping;
+    pthread_cond_t jobReady;
+    int slowThreadCount;
+    pthread_t* slowThreads;
+
+    uint64_t handled;
+};
+
+// The kernel's structures may be larger than ours; see seccomp_unotify(2).
+static size_t gNotifSize;
+static size_t gRespSize;
+static pthread_once_t gSizesOnce = PTHREAD_ONCE_INIT;
+
+static void initSizes() {
+    struct seccomp_notif_sizes sizes;
+    gNotifSize = sizeof(struct seccomp_notif);
+    gRespSize = sizeof(struct seccomp_notif_resp);
+    if (syscall(__NR_seccomp, SECCOMP_GET_NOTIF_SIZES, 0, &sizes) == 0) {
+        if (sizes.seccomp_notif > gNotifSize) {
+            gNotifSize = sizes.seccomp_notif;
+        }
+        if (sizes.seccomp_notif_resp > gRespSize) {
+            gRespSize = sizes.seccomp_notif_resp;
+        }
+    }
+}
+
+static void releaseListener(Listener* listener) {
+    if (__atomic_sub_fetch(&listener->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        close(listener->fd);
+        free(listener);
+    }
+}
+
+static void answer(SeccompSupervisor* supervisor, Listener* listener,
+                   const struct seccomp_notif* request) {
+    uint64_t buffer[MAX_NOTIF_SIZE / 8];
+    struct seccomp_notif_resp* response = reinterpret_cast<struct seccomp_notif_resp*>(buffer);
+    memset(buffer, 0, gRespSize);
+    response->id = request->id;
+    listener->handler(listener->fd, request, response, listener->arg);
+    // ENOENT means the target was killed or its syscall interrupted, and
+    // no longer wants an answer.
+    if (ioctl(listener->fd, SECCOMP_IOCTL_NOTIF_SEND, response) != 0 && errno != ENOENT) {
+        ALOGE("SECCOMP_IOCTL_NOTIF_SEND failed: %s", strerror(errno));
+    }
+    __atomic_add_fetch(&supervisor->handled, 1, __ATOMIC_RELAXED);
+}
+
+static void* runSlowThread(void* arg) {
+    SeccompSupervisor* supervisor = reinterpret_cast<SeccompSupervisor*>(arg);
+    pthread_mutex_lock(&supervisor->lock);
+    for (;;) {
+        while (supervisor->head == NULL && !supervisor->stopping) {
+            pthread_cond_wait(&supervisor->jobReady, &supervisor->lock);
+        }
+        Job* job = supervisor->head;
+        if (job == NULL) {
+            break;
+        }
+        supervisor->head = job->next;
+        if (supervisor->head == NULL) {
+            supervisor->tail = NULL;
+        }
+        pthread_mutex_unlock(&supervisor->lock);
+
+        answer(supervisor, job->listener, reinterpret_cast<struct seccomp_notif*>(job + 1));
+        releaseListener(job->listener);
+        free(job);
+
+        pthread_mutex_lock(&supervisor->lock);
+    }
+    pthread_mutex_unlock(&supervisor->lock);
+    return NULL;
+}
+
+// Takes |listener| out of the epoll set and the supervisor's list.
+static void removeListener(SeccompSupervisor* supervisor, Listener* listener) {
+    epoll_ctl(supervisor->epollFd, EPOLL_CTL_DEL, listener->fd, NULL);
+    pthread_mutex_lock(&supervisor->lock);
+    if (listener->prev != NULL) {
+        listener->prev->next = listener->next;
+    } else {
+        supervisor->listeners = listener->next;
+    }
+    if (listener->next != NULL) {
+        listener->next->prev = listener->prev;
+    }
+    pthread_mutex_unlock(&supervisor->lock);
+    releaseListener(listener);
+}
+
+// Takes one pending notification from |listener|, answering it or queueing
+// it for a slow thread.
+static void receive(SeccompSupervisor* supervisor, Listener* listener, void* scratch) {
+    void* request = scratch;
+    Job* job = NULL;
+    if (listener->slow && supervisor->slowThreadCount > 0) {
+        job = reinterpret_cast<Job*>(malloc(sizeof(Job) + gNotifSize));
+        if (job == NULL) {
+            return;  // The notification stays pending for the next round.
+        }
+        request = job + 1;
+    }
+    // The kernel insists on a zeroed buffer.
+    memset(request, 0, gNotifSize);
+    if (ioctl(listener->fd, SECCOMP_IOCTL_NOTIF_RECV, request) != 0) {
+        // ENOENT: the target went away between epoll_wait() and here.
+        if (errno != ENOENT && errno != EINTR) {
+            ALOGE("SECCOMP_IOCTL_NOTIF_RECV failed: %s", strerror(errno));
+        }
+        free(job);
+        return;
+    }
+    if (job == NULL) {
+        answer(supervisor, listener, reinterpret_cast<struct seccomp_notif*>(request));
+        return;
+    }
+
+    __atomic_add_fetch(&listener->refs, 1, __ATOMIC_RELAXED);
+    job->listener = listener;
+    job->next = NULL;
+    pthread_mutex_lock(&supervisor->lock);
+    if (supervisor->tail != NULL) {
+        supervisor->tail->next = job;
+    } else {
+        supervisor->head = job;
+    }
+    supervisor->tail = job;
+    pthread_cond_signal(&supervisor->jobReady);
+    pthread_mutex_unlock(&supervisor->lock);
+}
+
+static void* runEpollLoop(void* arg) {
+    SeccompSupervisor* supervisor = reinterpret_cast<SeccompSupervisor*>(arg);
+    uint64_t scratch[MAX_NOTIF_SIZE / 8];
+    struct epoll_event events[MAX_EVENTS];
+    for (;;) {
+        int count = TEMP_FAILURE_RETRY(epoll_wait(supervisor->epollFd, events, MAX_EVENTS, -1));
+        if (count < 0) {
+            ALOGE("epoll_wait failed: %s", strerror(errno));
+            return NULL;
+        }
+        for (int i = 0; i < count; i++) {
+            Listener* listener = reinterpret_cast<Listener*>(events[i].data.ptr);
+            if (listener == NULL) {
+                return NULL;  // seccompSupervisorDestroy()
+            }
+            if (events[i].events & EPOLLIN) {
+                receive(supervisor, listener, scratch);
+            } else if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                // Every process using the filter has exited.
+                removeListener(supervisor, listener);
+            }
+        }
+    }
+}
+
+SeccompSupervisor* seccompSupervisorCreate(int slowThreads) {
+    pthread_once(&gSizesOnce, initSizes);
+    if (gNotifSize > MAX_NOTIF_SIZE || gRespSize > MAX_NOTIF_SIZE) {
+        ALOGE("seccomp notifications too large: %zu and %zu bytes", gNotifSize, gRespSize);
+        return NULL;
+    }
+
+    SeccompSupervisor* supervisor =
+            reinterpret_cast<SeccompSupervisor*>(calloc(1, sizeof(SeccompSupervisor)));
+    if (supervisor == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&supervisor->lock, NULL);
+    pthread_cond_init(&supervisor->jobReady, NULL);
+    supervisor->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    supervisor->stopFd = eventfd(0, EFD_CLOEXEC);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    if (supervisor->epollFd < 0 || supervisor->stopFd < 0 ||
+            epoll_ctl(supervisor->epollFd, EPOLL_CTL_ADD, supervisor->stopFd, &event) != 0) {
+        goto fail;
+    }
+
+    supervisor->slowThreads =
+            reinterpret_cast<pthread_t*>(calloc(slowThreads > 0 ? slowThreads : 1,
+                                                sizeof(pthread_t)));
+    if (supervisor->slowThreads == NULL) {
+        goto fail;
+    }
+    for (int i = 0; i < slowThreads; i++) {
+        if (pthread_create(&supervisor->slowThreads[i], NULL, runSlowThread, supervisor) != 0) {
+            break;
+        }
+        supervisor->slowThreadCount++;
+    }
+    if (pthread_create(&supervisor->thread, NULL, runEpollLoop, supervisor) != 0) {
+        goto fail;
+    }
+    return supervisor;
+
+fail:
+    if (supervisor->slowThreads != NULL) {
+        pthread_mutex_lock(&supervisor->lock);
+        supervisor->stopping = true;
+        pthread_cond_broadcast(&supervisor->jobReady);
+        pthread_mutex_unlock(&supervisor->lock);
+        for (int i = 0; i < supervisor->slowThreadCount; i++) {
+            pthread_join(supervisor->slowThreads[i], NULL);
+        }
+        free(supervisor->slowThreads);
+    }
+    if (supervisor->epollFd >= 0) {
+        close(supervisor->epollFd);
+    }
+    if (supervisor->stopFd >= 0) {
+        close(supervisor->stopFd);
+    }
+    pthread_cond_destroy(&supervisor->jobReady);
+    pthread_mutex_destroy(&supervisor->lock);
+    free(supervisor);
+    return NULL;
+}
+
+bool seccompSupervisorAdd(SeccompSupervisor* supervisor, int listenerFd,
+                          SeccompNotifyHandler handler, void* arg, bool slow) {
+    Listener* listener = reinterpret_cast<Listener*>(calloc(1, sizeof(Listener)));
+    if (listener == NULL) {
+        close(listenerFd);
+        return false;
+    }
+    listener->fd = listenerFd;
+    listener->handler = handler;
+    listener->arg = arg;
+    listener->slow = slow;
+    listener->refs = 1;
+
+    // When the supervisor answers on the thread that waits, have the kernel
+    // wake the target on this CPU rather than migrate it. Older kernels
+    // don't know the flag, which is fine.
+    if (!slow) {
+        ioctl(listenerFd, SECCOMP_IOCTL_NOTIF_SET_FLAGS, SECCOMP_USER_NOTIF_FD_SYNC_WAKE_UP);
+    }
+
+    pthread_mutex_lock(&supervisor->lock);
+    listener->next = supervisor->listeners;
+    if (listener->next != NULL) {
+        listener->next->prev = listener;
+    }
+    supervisor->listeners = listener;
+    pthread_mutex_unlock(&supervisor->lock);
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = listener;
+    if (epoll_ctl(supervisor->epollFd, EPOLL_CTL_ADD, listenerFd, &event) != 0) {
+        removeListener(supervisor, listener);
+        return false;
+    }
+    return true;
+}
+
+uint64_t seccompSupervisorHandled(SeccompSupervisor* supervisor) {
+    return __atomic_load_n(&supervisor->handled, __ATOMIC_RELAXED);
+}
+
+void seccompSupervisorDestroy(SeccompSupervisor* supervisor) {
+    uint64_t one = 1;
+    TEMP_FAILURE_RETRY(write(supervisor->stopFd, &one, sizeof(one)));
+    pthread_join(supervisor->thread, NULL);
+
+    pthread_mutex_lock(&supervisor->lock);
+    supervisor->stopping = true;
+    pthread_cond_broadcast(&supervisor->jobReady);
+    pthread_mutex_unlock(&supervisor->lock);
+    for (int i = 0; i < supervisor->slowThreadCount; i++) {
+        pthread_join(supervisor->slowThreads[i], NULL);
+    }
+
+    while (supervisor->listeners != NULL) {
+        removeListener(supervisor, supervisor->listeners);
+    }
+    close(supervisor->epollFd);
+    close(supervisor->stopFd);
+    free(supervisor->slowThreads);
+    pthread_cond_destroy(&supervisor->jobReady);
+    pthread_mutex_destroy(&supervisor->lock);
+    free(supervisor);
+}
+
+bool seccompNotifyWriteMemory(int listener, const struct seccomp_notif* request,
+                              uintptr_t address, const void* data, size_t size) {
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%u/mem", request->pid);
+    int fd = TEMP_FAILURE_RETRY(open(path, O_WRONLY | O_CLOEXEC));
+    if (fd < 0) {
+        return false;
+    }
+    __u64 id = request->id;
+    bool written = ioctl(listener, SECCOMP_IOCTL_NOTIF_ID_VALID, &id) == 0 &&
+            TEMP_FAILURE_RETRY(pwrite64(fd, data, size, address)) == (ssize_t) size;
+    close(fd);
+    return written;
+}
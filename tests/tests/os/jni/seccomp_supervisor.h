@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECCOMP_SUPERVISOR_H_
+#define SECCOMP_SUPERVISOR_H_
+
+#include <linux/ioctl.h>
+#include <linux/seccomp.h>
+#include <linux/types.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// From include/uapi/linux/seccomp.h, Linux 5.0 and later.
+#ifndef SECCOMP_IOCTL_NOTIF_RECV
+#define SECCOMP_GET_NOTIF_SIZES 3
+#define SECCOMP_FILTER_FLAG_NEW_LISTENER (1UL << 3)
+#define SECCOMP_RET_USER_NOTIF 0x7fc00000U
+
+struct seccomp_notif_sizes {
+    __u16 seccomp_notif;
+    __u16 seccomp_notif_resp;
+    __u16 seccomp_data;
+};
+
+struct seccomp_notif {
+    __u64 id;
+    __u32 pid;
+    __u32 flags;
+    struct seccomp_data data;
+};
+
+struct seccomp_notif_resp {
+    __u64 id;
+    __s64 val;
+    __s32 error;
+    __u32 flags;
+};
+
+#define SECCOMP_IOC_MAGIC '!'
+#define SECCOMP_IOW(nr, type) _IOW(SECCOMP_IOC_MAGIC, nr, type)
+#define SECCOMP_IOWR(nr, type) _IOWR(SECCOMP_IOC_MAGIC, nr, type)
+#define SECCOMP_IOCTL_NOTIF_RECV SECCOMP_IOWR(0, struct seccomp_notif)
+#define SECCOMP_IOCTL_NOTIF_SEND SECCOMP_IOWR(1, struct seccomp_notif_resp)
+#define SECCOMP_IOCTL_NOTIF_ID_VALID SECCOMP_IOW(2, __u64)
+#endif
+
+// Linux 5.5 and later.
+#ifndef SECCOMP_USER_NOTIF_FLAG_CONTINUE
+#define SECCOMP_USER_NOTIF_FLAG_CONTINUE (1UL << 0)
+#endif
+
+// Linux 6.6 and later.
+#ifndef SECCOMP_IOCTL_NOTIF_SET_FLAGS
+#define SECCOMP_IOCTL_NOTIF_SET_FLAGS SECCOMP_IOW(4, __u64)
+#define SECCOMP_USER_NOTIF_FD_SYNC_WAKE_UP (1UL << 0)
+#endif
+
+// A supervisor for the SECCOMP_RET_USER_NOTIF listeners of many sandboxed
+// processes: one thread waits on all of them with epoll, and answers each
+// notification that an epoll_wait() reports before waiting again. Handlers
+// that block (on I/O, or on the target's memory) are registered as slow and
+// run on a small pool of worker threads instead, so that they don't hold
+// up everyone else's notifications.
+//
+// Handlers fill in the response the way the TRACE_* fixtures in
+// seccomp_bpf_tests.c do with ptrace, minus the register writes:
+//   skip      set val (or error), and the syscall isn't run
+//   continue  set SECCOMP_USER_NOTIF_FLAG_CONTINUE, and it runs as usual
+//   redirect  run the other syscall on the target's behalf and set val
+//   poke      write the target's memory with seccompNotifyWriteMemory()
+//             and then skip or continue
+
+struct SeccompSupervisor;
+
+// Fills in |response| for |request|, which arrived on |listener|. The
+// response's id is already set, and everything else is zero, so by default
+// the syscall is skipped and returns 0.
+typedef void (*SeccompNotifyHandler)(int listener, const struct seccomp_notif* request,
+                                     struct seccomp_notif_resp* response, void* arg);
+
+// Starts the supervisor's thread and |slowThreads| worker threads. Returns
+// NULL on failure.
+SeccompSupervisor* seccompSupervisorCreate(int slowThreads);
+
+// Supervises |listener|, a descriptor from SECCOMP_FILTER_FLAG_NEW_LISTENER,
+// answering its notifications with |handler|. The supervisor takes the
+// descriptor, and closes it once every process using the filter is gone.
+// Returns false on failure, closing the descriptor.
+bool seccompSupervisorAdd(SeccompSupervisor* supervisor, int listener,
+                          SeccompNotifyHandler handler, void* arg, bool slow);
+
+// Returns the number of notifications answered so far.
+uint64_t seccompSupervisorHandled(SeccompSupervisor* supervisor);
+
+// Stops the supervisor's threads and closes the listeners it still has.
+// Notifications already taken by a slow handler are answered first.
+void seccompSupervisorDestroy(SeccompSupervisor* supervisor);
+
+// Writes |size| bytes at |address| in the process that sent |request|,
+// through /proc/pid/mem. The notification is checked to still be pending
+// once the file is open, in case the target died and its pid was reused.
+// Returns false on failure.
+bool seccompNotifyWriteMemory(int listener, const struct seccomp_notif* request,
+                              uintptr_t address, const void* data, size_t size);
+
+#endif  // SECCOMP_SUPERVISOR_H_
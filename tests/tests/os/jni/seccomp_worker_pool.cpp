@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "seccomp_worker_pool.h"
+
+#include <errno.h>
+#include <linux/seccomp.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "fd_passing.h"
+
+#ifndef PR_SET_NO_NEW_PRIVS
+#define PR_SET_NO_NEW_PRIVS 38
+#endif
+
+static void __attribute__((noreturn)) runTemplate(int control, const struct sock_fprog* filter,
+                                                  SeccompWorkerMain workerMain, void* arg) {
+    // Let the kernel reap the workers.
+    signal(SIGCHLD, SIG_IGN);
+    char status = 0;
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0 ||
+            prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, filter) != 0) {
+        status = 1;
+    }
+    if (TEMP_FAILURE_RETRY(write(control, &status, sizeof(status))) != sizeof(status) ||
+            status != 0) {
+        _exit(1);
+    }
+
+    int fd;
+    while ((fd = receiveFd(control)) >= 0) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            // Workers reap their own children.
+            signal(SIGCHLD, SIG_DFL);
+            close(control);
+            workerMain(fd, arg);
+            _exit(0);
+        }
+        close(fd);
+        if (TEMP_FAILURE_RETRY(write(control, &pid, sizeof(pid))) != sizeof(pid)) {
+            break;
+        }
+    }
+    _exit(0);
+}
+
+bool seccompWorkerPoolStart(SeccompWorkerPool* pool, const struct sock_fprog* filter,
+                            SeccompWorkerMain workerMain, void* arg) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) != 0) {
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(sv[0]);
+        runTemplate(sv[1], filter, workerMain, arg);
+    }
+    close(sv[1]);
+    if (pid < 0) {
+        close(sv[0]);
+        return false;
+    }
+
+    // Wait for the template to report whether the filter went in.
+    char status = 1;
+    if (TEMP_FAILURE_RETRY(read(sv[0], &status, sizeof(status))) != sizeof(status) ||
+            status != 0) {
+        close(sv[0]);
+        TEMP_FAILURE_RETRY(waitpid(pid, NULL, 0));
+        return false;
+    }
+    pool->templatePid = pid;
+    pool->control = sv[0];
+    pthread_mutex_init(&pool->lock, NULL);
+    return true;
+}
+
+pid_t seccompWorkerPoolSpawn(SeccompWorkerPool* pool, int* fd) {
+    int sv[2];
+    pid_t pid = -1;
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (sendFd(pool->control, sv[1]) &&
+            TEMP_FAILURE_RETRY(read(pool->control, &pid, sizeof(pid))) != sizeof(pid)) {
+        pid = -1;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    close(sv[1]);
+    if (pid <= 0) {
+        close(sv[0]);
+        return -1;
+    }
+    *fd = sv[0];
+    return pid;
+}
+
+void seccompWorkerPoolStop(SeccompWorkerPool* pool) {
+    // The template exits at the end of its request stream.
+    close(pool->control);
+    TEMP_FAILURE_RETRY(waitpid(pool->templatePid, NULL, 0));
+    pthread_mutex_destroy(&pool->lock);
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SECCOMP_WORKER_POOL_H_
+#define SECCOMP_WORKER_POOL_H_
+
+#include <linux/filter.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+// Sandboxed workers forked from a template process that installed the
+// seccomp policy once, so that workers inherit the filter instead of each
+// setting PR_SET_NO_NEW_PRIVS and installing it themselves.
+//
+// The template is forked from the caller when the pool starts. Filters may
+// forbid socketpair(), so the caller makes each worker's socket and hands
+// one end to the template over SCM_RIGHTS; the template only needs
+// recvmsg(), fork(), close() and write(), which the sample policy in
+// seccomp_sample_program.cpp allows. Workers are reaped by the template;
+// the caller sees a worker exit as the end of its socket. Workers start
+// with SIGCHLD back at its default, so they can wait for their own
+// children.
+
+// Runs in a worker with its end of the socket, |fd|; the worker exits when
+// it returns.
+typedef void (*SeccompWorkerMain)(int fd, void* arg);
+
+struct SeccompWorkerPool {
+    pid_t templatePid;
+    int control;  // our end of the template's SOCK_SEQPACKET socket
+    pthread_mutex_t lock;  // serializes spawn requests
+};
+
+// Forks the template, which installs |filter| and then waits for spawn
+// requests. Returns false on failure.
+bool seccompWorkerPoolStart(SeccompWorkerPool* pool, const struct sock_fprog* filter,
+                            SeccompWorkerMain workerMain, void* arg);
+
+// Forks a worker off the template, returning its pid and storing the
+// caller's end of a socket connected to the worker in |fd|. Returns -1 on
+// failure.
+pid_t seccompWorkerPoolSpawn(SeccompWorkerPool* pool, int* fd);
+
+// Stops the template and waits for it. Running workers are not killed.
+void seccompWorkerPoolStop(SeccompWorkerPool* pool);
+
+#endif  // SECCOMP_WORKER_POOL_H_
@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "syscall_resumption.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/ucontext.h>
+#include <unistd.h>
+
+#if defined(__aarch64__)
+#define ARCH_NR AUDIT_ARCH_AARCH64
+#elif defined(__x86_64__)
+#define ARCH_NR AUDIT_ARCH_X86_64
+#endif
+
+#ifndef PR_SET_NO_NEW_PRIVS
+#define PR_SET_NO_NEW_PRIVS 38
+#endif
+
+// Linux 5.11 and later.
+#ifndef PR_SET_SYSCALL_USER_DISPATCH
+#define PR_SET_SYSCALL_USER_DISPATCH 59
+#endif
+#ifndef PR_SYS_DISPATCH_ON
+#define PR_SYS_DISPATCH_ON 1
+#endif
+#ifndef SYSCALL_DISPATCH_FILTER_ALLOW
+#define SYSCALL_DISPATCH_FILTER_ALLOW 0
+#define SYSCALL_DISPATCH_FILTER_BLOCK 1
+#endif
+
+#ifndef SYS_SECCOMP
+#define SYS_SECCOMP 1
+#endif
+#ifndef SYS_USER_DISPATCH
+#define SYS_USER_DISPATCH 2
+#endif
+
+#ifndef SA_RESTORER
+#define SA_RESTORER 0x04000000
+#endif
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define LOW_WORD 4
+#define HIGH_WORD 0
+#else
+#define LOW_WORD 0
+#define HIGH_WORD 4
+#endif
+
+#define STRINGIFY(x) #x
+#define TO_STRING(x) STRINGIFY(x)
+
+static uint64_t gCount;
+
+#ifdef ARCH_NR
+// The thunk makes the syscall the caller's registers describe and returns
+// to the caller. On x86_64 the stack pointer points at the caller's address
+// and stack pointer, which resumeAtThunk() leaves in the old signal frame,
+// and the thunk only uses %rcx, which the syscall clobbers anyway. On arm64
+// the caller's address is in x16; ret x16, rather than br, so that BTI
+// doesn't mind where it lands. The restorer is where SYSCALL_BYPASS_THREAD_FLAG's handler
+// returns through; the dispatch region, which syscall user dispatch always
+// lets through, runs from the thunk to the end of the restorer.
+#if defined(__x86_64__)
+asm(".pushsection .text, \"ax\", @progbits\n"
+    ".balign 16\n"
+    ".globl resumptionThunk, resumptionThunkReturn, resumptionRestorer, resumptionEnd\n"
+    ".hidden resumptionThunk, resumptionThunkReturn, resumptionRestorer, resumptionEnd\n"
+    "resumptionThunk:\n"
+    "    syscall\n"
+    "resumptionThunkReturn:\n"
+    "    pop %rcx\n"
+    "    pop %rsp\n"
+    "    jmp *%rcx\n"
+    "resumptionRestorer:\n"
+    "    mov $" TO_STRING(__NR_rt_sigreturn) ", %eax\n"
+    "    syscall\n"
+    "    ud2\n"
+    "resumptionEnd:\n"
+    ".popsection\n");
+#elif defined(__aarch64__)
+asm(".pushsection .text, \"ax\", %progbits\n"
+    ".balign 16\n"
+    ".globl resumptionThunk, resumptionThunkReturn, resumptionRestorer, resumptionEnd\n"
+    ".hidden resumptionThunk, resumptionThunkReturn, resumptionRestorer, resumptionEnd\n"
+    "resumptionThunk:\n"
+    "    svc #0\n"
+    "resumptionThunkReturn:\n"
+    "    ret x16\n"
+    "resumptionRestorer:\n"
+    "    mov x8, #" TO_STRING(__NR_rt_sigreturn) "\n"
+    "    svc #0\n"
+    "    brk #0\n"
+    "resumptionEnd:\n"
+    ".popsection\n");
+#endif
+
+extern "C" char resumptionThunk[] __attribute__((visibility("hidden")));
+extern "C" char resumptionThunkReturn[] __attribute__((visibility("hidden")));
+extern "C" void resumptionRestorer() __attribute__((visibility("hidden")));
+extern "C" char resumptionEnd[] __attribute__((visibility("hidden")));
+
+// What rt_sigaction takes, which isn't what sigaction() does.
+struct KernelSigaction {
+    void (*handler)(int, siginfo_t*, void*);
+    unsigned long flags;
+    void (*restorer)();
+    uint64_t mask;
+};
+
+// ld arch, the check and its RET ALLOW, and ld nr; a check per syscall;
+// then RET ALLOW, the six instructions of the instruction pointer check,
+// and RET TRAP.
+#define FILTER_HEAD 4
+#define FILTER_TAIL 7
+#define FILTER_LENGTH(count) (FILTER_HEAD + (count) + FILTER_TAIL)
+#define MAX_FILTER FILTER_LENGTH(SYSCALL_RESUMPTION_MAX_SYSCALLS)
+
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+static bool gStarted;
+static SyscallBypass gBypass;
+static int gSyscalls[SYSCALL_RESUMPTION_MAX_SYSCALLS];
+static int gSyscallCount;
+static SyscallEmulator gEmulator;
+static __thread volatile char gSelector;
+
+static void getArgs(const ucontext_t* uc, uint64_t* args) {
+#if defined(__x86_64__)
+    args[0] = uc->uc_mcontext.gregs[REG_RDI];
+    args[1] = uc->uc_mcontext.gregs[REG_RSI];
+    args[2] = uc->uc_mcontext.gregs[REG_RDX];
+    args[3] = uc->uc_mcontext.gregs[REG_R10];
+    args[4] = uc->uc_mcontext.gregs[REG_R8];
+    args[5] = uc->uc_mcontext.gregs[REG_R9];
+#else
+    for (int i = 0; i < 6; i++) {
+        args[i] = uc->uc_mcontext.regs[i];
+    }
+#endif
+}
+
+static void setResult(ucontext_t* uc, long result) {
+#if defined(__x86_64__)
+    uc->uc_mcontext.gregs[REG_RAX] = result;
+#else
+    uc->uc_mcontext.regs[0] = result;
+#endif
+}
+
+// Has the caller make the syscall again from the thunk. rt_sigreturn
+// doesn't come back, and finds its frame from the stack pointer, so that
+// has to stay where it is.
+//
+// On x86_64 the caller's address goes in |info|, the one part of the signal
+// frame that rt_sigreturn doesn't read back. Just below the red zone, where
+// it would otherwise go, is where the kernel puts the extended FPU state,
+// and overwriting its end has rt_sigreturn restore only the legacy part.
+// The frame is below the red zone, so the thunk can use it as its stack
+// until it has the caller's back, and signals arriving meanwhile land
+// below it.
+static void resumeAtThunk(ucontext_t* uc, siginfo_t* info, bool returns) {
+#if defined(__x86_64__)
+    if (returns) {
+        uint64_t* slot = reinterpret_cast<uint64_t*>(info);
+        slot[0] = uc->uc_mcontext.gregs[REG_RIP];
+        slot[1] = uc->uc_mcontext.gregs[REG_RSP];
+        uc->uc_mcontext.gregs[REG_RSP] = reinterpret_cast<greg_t>(slot);
+    }
+    uc->uc_mcontext.gregs[REG_RIP] = reinterpret_cast<greg_t>(resumptionThunk);
+#else
+    (void) info;
+    if (returns) {
+        uc->uc_mcontext.regs[16] = uc->uc_mcontext.pc;
+    }
+    uc->uc_mcontext.pc = reinterpret_cast<uint64_t>(resumptionThunk);
+#endif
+}
+
+static bool isListed(int nr) {
+    for (int i = 0; i < gSyscallCount; i++) {
+        if (gSyscalls[i] == nr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void onSigsys(int, siginfo_t* info, void* context) {
+    bool dispatching = gBypass == SYSCALL_BYPASS_THREAD_FLAG;
+    if (dispatching) {
+        gSelector = SYSCALL_DISPATCH_FILTER_ALLOW;
+    }
+    int savedErrno = errno;
+    ucontext_t* uc = reinterpret_cast<ucontext_t*>(context);
+    if (info->si_code != (dispatching ? SYS_USER_DISPATCH : SYS_SECCOMP)) {
+        // Another filter's; making it again would only trap it again.
+        setResult(uc, -ENOSYS);
+    } else {
+        __atomic_fetch_add(&gCount, 1, __ATOMIC_RELAXED);
+        TrappedSyscall call;
+        call.nr = info->si_syscall;
+        getArgs(uc, call.args);
+        long result;
+        if (call.nr == __NR_rt_sigreturn) {
+            // Another handler returning, on a dispatching thread; this
+            // frame isn't the one it means.
+            resumeAtThunk(uc, info, false);
+        } else if (gEmulator != NULL && isListed(call.nr) && gEmulator(&call, &result)) {
+            setResult(uc, result);
+        } else if (!dispatching) {
+            resumeAtThunk(uc, info, true);
+        } else {
+            result = syscall(call.nr, call.args[0], call.args[1], call.args[2], call.args[3],
+                             call.args[4], call.args[5]);
+            setResult(uc, result == -1 ? -errno : result);
+        }
+    }
+    errno = savedErrno;
+    if (dispatching) {
+        gSelector = SYSCALL_DISPATCH_FILTER_BLOCK;
+    }
+}
+
+// Traps the listed syscalls unless they come from the thunk. Syscalls of
+// another architecture go through, as they do in exec_mapping_monitor.cpp.
+static bool installFilter() {
+    static struct sock_filter filter[MAX_FILTER];
+    int count = gSyscallCount;
+    assert(FILTER_LENGTH(count) <= MAX_FILTER);
+    uint64_t thunk = reinterpret_cast<uintptr_t>(resumptionThunkReturn);
+    int n = 0;
+    filter[n++] = (struct sock_filter)
+            BPF_STMT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, arch));
+    filter[n++] = (struct sock_filter) BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, ARCH_NR, 1, 0);
+    filter[n++] = (struct sock_filter) BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW);
+    filter[n++] = (struct sock_filter)
+            BPF_STMT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, nr));
+    for (int i = 0; i < count; i++) {
+        filter[n++] = (struct sock_filter)
+                BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, (uint32_t) gSyscalls[i], (uint8_t) (count - i), 0);
+    }
+    filter[n++] = (struct sock_filter) BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW);
+    filter[n++] = (struct sock_filter) BPF_STMT(BPF_LD|BPF_W|BPF_ABS,
+            offsetof(struct seccomp_data, instruction_pointer) + LOW_WORD);
+    filter[n++] = (struct sock_filter)
+            BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, (uint32_t) thunk, 0, 3);
+    filter[n++] = (struct sock_filter) BPF_STMT(BPF_LD|BPF_W|BPF_ABS,
+            offsetof(struct seccomp_data, instruction_pointer) + HIGH_WORD);
+    filter[n++] = (struct sock_filter)
+            BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, (uint32_t) (thunk >> 32), 0, 1);
+    filter[n++] = (struct sock_filter) BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW);
+    filter[n++] = (struct sock_filter) BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_TRAP);
+    assert(n == FILTER_LENGTH(count));
+
+    struct sock_fprog prog = { (unsigned short) n, filter };
+    return prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 &&
+            prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) == 0;
+}
+
+static bool installHandler(SyscallBypass bypass) {
+    if (bypass == SYSCALL_BYPASS_THREAD_FLAG) {
+        // The C library's restorer is outside the dispatch region, and its
+        // rt_sigreturn would be trapped with SIGSYS still blocked. So would
+        // that of any other handler that ran between this one putting the
+        // flag back and returning, so all signals wait until it has.
+        struct KernelSigaction action;
+        memset(&action, 0, sizeof(action));
+        action.handler = onSigsys;
+        action.flags = SA_SIGINFO | SA_RESTORER;
+        action.restorer = resumptionRestorer;
+        action.mask = ~0ULL;
+        if (syscall(__NR_rt_sigaction, SIGSYS, &action, NULL, sizeof(action.mask)) != 0) {
+            return false;
+        }
+    } else {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = onSigsys;
+        action.sa_flags = SA_SIGINFO;
+        if (sigaction(SIGSYS, &action, NULL) != 0) {
+            return false;
+        }
+    }
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGSYS);
+    errno = pthread_sigmask(SIG_UNBLOCK, &mask, NULL);
+    return errno == 0;
+}
+#endif
+
+bool syscallResumptionStart(SyscallBypass bypass, const int* syscalls, int count,
+                            SyscallEmulator emulator) {
+#ifndef ARCH_NR
+    (void) bypass;
+    (void) syscalls;
+    (void) count;
+    (void) emulator;
+    errno = ENOSYS;
+    return false;
+#else
+    if (count < 0 || count > SYSCALL_RESUMPTION_MAX_SYSCALLS) {
+        errno = EINVAL;
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        if (syscalls[i] == __NR_rt_sigreturn) {
+            errno = EINVAL;
+            return false;
+        }
+    }
+    pthread_mutex_lock(&gLock);
+    if (gStarted) {
+        pthread_mutex_unlock(&gLock);
+        errno = EBUSY;
+        return false;
+    }
+    // All set before anything can be trapped, and never changed after.
+    gBypass = bypass;
+    memcpy(gSyscalls, syscalls, count * sizeof(syscalls[0]));
+    gSyscallCount = count;
+    gEmulator = emulator;
+    bool started = installHandler(bypass);
+    if (started && bypass == SYSCALL_BYPASS_THREAD_FLAG) {
+        started = prctl(PR_SET_SYSCALL_USER_DISPATCH, PR_SYS_DISPATCH_ON,
+                        reinterpret_cast<unsigned long>(resumptionThunk),
+                        resumptionEnd - resumptionThunk, &gSelector) == 0;
+        if (started) {
+            gSelector = SYSCALL_DISPATCH_FILTER_BLOCK;
+        }
+    } else if (started) {
+        started = installFilter();
+    }
+    gStarted = started;
+    int error = errno;
+    pthread_mutex_unlock(&gLock);
+    errno = error;
+    return started;
+#endif
+}
+
+uint64_t syscallResumptionCount() {
+    return __atomic_load_n(&gCount, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SYSCALL_RESUMPTION_H_
+#define SYSCALL_RESUMPTION_H_
+
+#include <stdint.h>
+
+// Emulates syscalls in the process that makes them, from a SIGSYS handler,
+// and lets through the ones it doesn't emulate, as
+// seccomp-tests/tests/resumption.c does, on x86_64 and arm64. A trapped
+// syscall can't simply be made again from the handler when the bypass is a
+// seccomp filter, because the filter traps it again; there are two ways
+// around that:
+//
+// SYSCALL_BYPASS_INSTRUCTION_POINTER is resumption.c's. The filter traps
+// the listed syscalls unless they come from one syscall instruction, in a
+// thunk. The handler points the caller at the thunk, which makes the
+// syscall once the handler has returned, and goes back to the caller. The
+// kernel has already put the syscall's registers back the way they were,
+// so the only register this touches on x86_64 is %rcx, which the syscall
+// clobbers anyway. On arm64 it is x16, which is only safe where the syscall
+// is made at a call boundary, as the C library's wrappers make them; an
+// inline svc with something live in x16 loses it. vfork, and clone without
+// a new stack, can't be made this way, because the child runs on the
+// stack the thunk is using. The filter,
+// once installed, covers the calling thread and the threads and processes
+// it creates from then on, and syscalls not listed cost a few filter
+// instructions.
+//
+// SYSCALL_BYPASS_THREAD_FLAG uses syscall user dispatch (Linux 5.11 and
+// later) instead, which traps every syscall the calling thread makes while
+// a thread-local flag says to. The handler clears the flag, makes the
+// syscall itself if it isn't emulating it, and sets the flag again. This
+// needs no filter and no change to the caller's registers, but only covers
+// the calling thread, and traps all of its syscalls, not only the listed
+// ones, which are then made from the handler, with its stack and signal
+// mask, so clone and sigprocmask can't be left to run. Kernels that lack
+// it, which include arm64 ones so far, fail with EINVAL.
+
+struct TrappedSyscall {
+    int nr;
+    uint64_t args[6];
+};
+
+// Called from the SIGSYS handler for the listed syscalls; it has to be
+// async-signal-safe. To emulate |call|, stores what the syscall returns, or
+// -errno, in |*result| and returns true; returns false to make the syscall.
+typedef bool (*SyscallEmulator)(const TrappedSyscall* call, long* result);
+
+enum SyscallBypass {
+    SYSCALL_BYPASS_INSTRUCTION_POINTER,
+    SYSCALL_BYPASS_THREAD_FLAG,
+};
+
+// The most syscalls syscallResumptionStart() takes.
+#define SYSCALL_RESUMPTION_MAX_SYSCALLS 32
+
+// Starts trapping |syscalls|, which can't include rt_sigreturn, and passing
+// them to |emulator|, if it isn't NULL. Replaces any SIGSYS handler, and
+// can't be undone. Returns false, with errno set, if it has already been
+// started, the kernel can't do it, or this architecture isn't supported.
+bool syscallResumptionStart(SyscallBypass bypass, const int* syscalls, int count,
+                            SyscallEmulator emulator);
+
+// The number of syscalls trapped so far, emulated or not.
+uint64_t syscallResumptionCount();
+
+#endif  // SYSCALL_RESUMPTION_H_
@@ -0,0 +1,95 @@
+# Copyright (C) 2015 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+
+# Finds loaded code that uses instructions the kernel may emulate. Run on a
+# device with
+#   adb shell /data/nativetest/CtsOsEmulatedInstructionScan [library...]
+LOCAL_MODULE := CtsOsEmulatedInstructionScan
+
+# Don't include this package in any configuration by default.
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE_PATH := $(TARGET_OUT_DATA_NATIVE_TESTS)
+
+LOCAL_SRC_FILES := \
+		emulated_instruction_scan.cpp \
+		../emulated_instructions.cpp
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+
+LOCAL_SHARED_LIBRARIES := libdl
+LOCAL_CXX_STL := none
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+# Compares two saved runs of CtsOsNativeBenchmarks. Run on a device with
+#   adb shell /data/nativetest/CtsOsBenchmarkCompare [-t percent] baseline new
+LOCAL_MODULE := CtsOsBenchmarkCompare
+
+# Don't include this package in any configuration by default.
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE_PATH := $(TARGET_OUT_DATA_NATIVE_TESTS)
+
+LOCAL_SRC_FILES := benchmark_compare.cpp
+
+LOCAL_CXX_STL := none
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+# The same, to compare runs on the host.
+LOCAL_MODULE := CtsOsBenchmarkCompare
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_SRC_FILES := benchmark_compare.cpp
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# ARCH_SUPPORTS_SECCOMP is set by ../Android.mk, which includes this file.
+ifeq ($(ARCH_SUPPORTS_SECCOMP),1)
+
+include $(CLEAR_VARS)
+
+# Reports the seccomp filters a process carries and what they cost. Run on
+# a device with
+#   adb shell /data/nativetest/CtsOsSeccompFilterReport [-p pid] [-n count]
+LOCAL_MODULE := CtsOsSeccompFilterReport
+
+# Don't include this package in any configuration by default.
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE_PATH := $(TARGET_OUT_DATA_NATIVE_TESTS)
+
+LOCAL_SRC_FILES := \
+		seccomp_filter_report.cpp \
+		../proc_scanner.cpp
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+
+LOCAL_STATIC_LIBRARIES := libctsos_seccomp
+
+LOCAL_CXX_STL := none
+
+include $(BUILD_EXECUTABLE)
+
+endif
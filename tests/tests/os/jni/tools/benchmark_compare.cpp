@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Compares two runs of the benchmarks, as saved from their output (see
+// benchmarks/benchmark_harness.h), benchmark by benchmark:
+//
+//   benchmark                               baseline ns           new ns  change
+//   exec_monitor_getppid_monitored         211.2 +- 5.2    194.9 +- 24.1    -7.7% [-19.4%, +4.0%]  !
+//   exec_monitor_mprotect_read_unmonitored 473.5 +- 36.4    322.2 +- 53.1   -31.9% [-43.5%, -20.4%]  faster
+//   atomic_fetch_add_compiler_contended_near       skip             skip
+//   atomic_fetch_add_selected                         -      13.7 +- 0.7  only in new
+//
+// Each side is the mean over that run's samples, +- the half-width of its
+// 95% confidence interval. The change comes with the 95% confidence
+// interval of the difference of the means (Welch's), relative to the
+// baseline mean, and is called faster or slower only when that interval
+// leaves out zero. "!" marks a benchmark that was throttled in either run.
+//
+// Both files are mapped rather than read, and the samples are folded into
+// running means and variances as they are parsed, so a run of any size
+// costs one pass and memory per benchmark, not per sample.
+
+enum Side {
+    BASELINE,
+    CANDIDATE,
+    SIDES,
+};
+
+// Welford's running mean and sum of squared deviations.
+struct RunningStats {
+    uint64_t count;
+    double mean;
+    double m2;
+};
+
+enum Outcome {
+    NOT_RUN,
+    SAMPLED,
+    SKIPPED,
+    FAILED,
+};
+
+struct Benchmark {
+    const char* name;  // in the mapping of the file it first appeared in
+    int nameLength;
+    uint32_t hash;
+    RunningStats stats[SIDES];
+    Outcome outcome[SIDES];
+    bool throttled;
+};
+
+struct BenchmarkTable {
+    Benchmark* benchmarks;  // in the order they first appear
+    int count;
+    int capacity;
+    int* slots;  // indices into benchmarks, or -1; a power of two of them
+    int slotCount;
+};
+
+static void addSample(RunningStats* stats, double value) {
+    stats->count++;
+    double delta = value - stats->mean;
+    stats->mean += delta / stats->count;
+    stats->m2 += delta * (value - stats->mean);
+}
+
+static double variance(const RunningStats* stats) {
+    return stats->count > 1 ? stats->m2 / (stats->count - 1) : 0;
+}
+
+// Student's t for a two-sided 95% interval with |df| degrees of freedom.
+// Past the table, 1.96 + 2.4 / df is within 0.005.
+static double tCritical(double df) {
+    static const double kTable[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+    int entries = sizeof(kTable) / sizeof(kTable[0]);
+    if (df < 1) {
+        return kTable[0];
+    }
+    if (df <= entries) {
+        return kTable[(int) df - 1];
+    }
+    return 1.96 + 2.4 / df;
+}
+
+// Half the width of the 95% confidence interval of the mean.
+static double halfWidth(const RunningStats* stats) {
+    if (stats->count < 2) {
+        return NAN;
+    }
+    return tCritical(stats->count - 1) * sqrt(variance(stats) / stats->count);
+}
+
+static uint32_t hashName(const char* name, int length) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char) name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool growSlots(BenchmarkTable* table) {
+    int slotCount = table->slotCount == 0 ? 256 : table->slotCount * 2;
+    int* slots = reinterpret_cast<int*>(malloc(slotCount * sizeof(int)));
+    if (slots == NULL) {
+        return false;
+    }
+    memset(slots, -1, slotCount * sizeof(int));
+    for (int i = 0; i < table->count; i++) {
+        uint32_t slot = table->benchmarks[i].hash & (slotCount - 1);
+        while (slots[slot] != -1) {
+            slot = (slot + 1) & (slotCount - 1);
+        }
+        slots[slot] = i;
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->slotCount = slotCount;
+    return true;
+}
+
+// Returns the benchmark called |name|, adding it if it's new, or NULL if
+// out of memory.
+static Benchmark* findBenchmark(BenchmarkTable* table, const char* name, int length) {
+    // Kept under three quarters full.
+    if ((table->count + 1) * 4 > table->slotCount * 3 && !growSlots(table)) {
+        return NULL;
+    }
+    uint32_t hash = hashName(name, length);
+    uint32_t slot = hash & (table->slotCount - 1);
+    while (table->slots[slot] != -1) {
+        Benchmark* benchmark = &table->benchmarks[table->slots[slot]];
+        if (benchmark->hash == hash && benchmark->nameLength == length &&
+                memcmp(benchmark->name, name, length) == 0) {
+            return benchmark;
+        }
+        slot = (slot + 1) & (table->slotCount - 1);
+    }
+    if (table->count == table->capacity) {
+        int capacity = table->capacity == 0 ? 128 : table->capacity * 2;
+        Benchmark* benchmarks = reinterpret_cast<Benchmark*>(
+                realloc(table->benchmarks, capacity * sizeof(Benchmark)));
+        if (benchmarks == NULL) {
+            return NULL;
+        }
+        table->benchmarks = benchmarks;
+        table->capacity = capacity;
+    }
+    Benchmark* benchmark = &table->benchmarks[table->count];
+    memset(benchmark, 0, sizeof(*benchmark));
+    benchmark->name = name;
+    benchmark->nameLength = length;
+    benchmark->hash = hash;
+    table->slots[slot] = table->count++;
+    return benchmark;
+}
+
+// Splits off the next space-separated word of [*p, end).
+static bool nextWord(const char** p, const char* end, const char** word, int* length) {
+    while (*p < end && **p == ' ') {
+        (*p)++;
+    }
+    *word = *p;
+    while (*p < end && **p != ' ') {
+        (*p)++;
+    }
+    *length = *p - *word;
+    return *length > 0;
+}
+
+// Parses a non-negative decimal like "152.125"; the mapping may end right
+// after it, so strtod() won't do.
+static bool parseNumber(const char* word, int length, double* value) {
+    double result = 0;
+    double scale = 0;
+    bool digits = false;
+    for (int i = 0; i < length; i++) {
+        char c = word[i];
+        if (c == '.' && scale == 0) {
+            scale = 1;
+        } else if (c >= '0' && c <= '9') {
+            result = result * 10 + (c - '0');
+            scale *= 10;
+            digits = true;
+        } else {
+            return false;
+        }
+    }
+    *value = scale > 1 ? result / scale : result;
+    return digits;
+}
+
+static bool wordIs(const char* word, int length, const char* expected) {
+    return length == (int) strlen(expected) && memcmp(word, expected, length) == 0;
+}
+
+static void parseLine(BenchmarkTable* table, Side side, const char* p, const char* end,
+                      bool* outOfMemory) {
+    const char* kind;
+    int kindLength;
+    const char* name;
+    int nameLength;
+    if (!nextWord(&p, end, &kind, &kindLength) || kind[0] == '#' ||
+            !nextWord(&p, end, &name, &nameLength)) {
+        return;
+    }
+    bool sample = wordIs(kind, kindLength, "sample");
+    Outcome outcome = sample ? SAMPLED : wordIs(kind, kindLength, "skip") ? SKIPPED :
+            wordIs(kind, kindLength, "error") ? FAILED : NOT_RUN;
+    bool throttled = wordIs(kind, kindLength, "throttled");
+    if (outcome == NOT_RUN && !throttled) {
+        return;
+    }
+    double ns = 0;
+    if (sample) {
+        const char* value;
+        int valueLength;
+        if (!nextWord(&p, end, &value, &valueLength) || !parseNumber(value, valueLength, &ns)) {
+            return;
+        }
+    }
+    Benchmark* benchmark = findBenchmark(table, name, nameLength);
+    if (benchmark == NULL) {
+        *outOfMemory = true;
+        return;
+    }
+    if (throttled) {
+        benchmark->throttled = true;
+        return;
+    }
+    // An error anywhere in the run spoils it; otherwise samples win over
+    // a skip.
+    if (benchmark->outcome[side] != FAILED &&
+            (outcome == FAILED || benchmark->outcome[side] != SAMPLED)) {
+        benchmark->outcome[side] = outcome;
+    }
+    if (sample) {
+        addSample(&benchmark->stats[side], ns);
+    }
+}
+
+static bool readRun(BenchmarkTable* table, Side side, const char* path) {
+    int fd = TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC));
+    if (fd == -1) {
+        fprintf(stderr, "unable to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "unable to stat %s: %s\n", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+    // Left mapped: the benchmark names point into it.
+    void* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "unable to map %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+    const char* p = reinterpret_cast<const char*>(mapping);
+    const char* end = p + st.st_size;
+    bool outOfMemory = false;
+    while (p < end && !outOfMemory) {
+        const char* eol = reinterpret_cast<const char*>(memchr(p, '\n', end - p));
+        if (eol == NULL) {
+            eol = end;
+        }
+        parseLine(table, side, p, eol, &outOfMemory);
+        p = eol + 1;
+    }
+    if (outOfMemory) {
+        fprintf(stderr, "out of memory reading %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+static void formatMean(char* buffer, size_t size, const Benchmark* benchmark, Side side) {
+    const RunningStats* stats = &benchmark->stats[side];
+    switch (benchmark->outcome[side]) {
+    case NOT_RUN:
+        snprintf(buffer, size, "-");
+        return;
+    case SKIPPED:
+        snprintf(buffer, size, "skip");
+        return;
+    case FAILED:
+        snprintf(buffer, size, "error");
+        return;
+    case SAMPLED:
+        break;
+    }
+    if (stats->count < 2) {
+        snprintf(buffer, size, "%.1f", stats->mean);
+    } else {
+        snprintf(buffer, size, "%.1f +- %.1f", stats->mean, halfWidth(stats));
+    }
+}
+
+// Returns 1 if |benchmark| got slower by more than |threshold| percent,
+// with the interval agreeing, and 0 otherwise.
+static int printComparison(const Benchmark* benchmark, int nameWidth, double threshold) {
+    char baseline[64];
+    char candidate[64];
+    formatMean(baseline, sizeof(baseline), benchmark, BASELINE);
+    formatMean(candidate, sizeof(candidate), benchmark, CANDIDATE);
+    printf("%-*.*s  %15s  %15s", nameWidth, benchmark->nameLength, benchmark->name, baseline,
+           candidate);
+
+    const RunningStats* a = &benchmark->stats[BASELINE];
+    const RunningStats* b = &benchmark->stats[CANDIDATE];
+    int regression = 0;
+    if (benchmark->outcome[BASELINE] == NOT_RUN) {
+        printf("  only in new");
+    } else if (benchmark->outcome[CANDIDATE] == NOT_RUN) {
+        printf("  only in baseline");
+    } else if (benchmark->outcome[BASELINE] == SAMPLED &&
+            benchmark->outcome[CANDIDATE] == SAMPLED && a->mean > 0) {
+        double change = 100 * (b->mean - a->mean) / a->mean;
+        printf("  %+6.1f%%", change);
+        if (a->count > 1 && b->count > 1) {
+            // Welch's interval, with the Welch-Satterthwaite degrees of
+            // freedom.
+            double va = variance(a) / a->count;
+            double vb = variance(b) / b->count;
+            double se = sqrt(va + vb);
+            double df = se > 0 ? (va + vb) * (va + vb) /
+                    (va * va / (a->count - 1) + vb * vb / (b->count - 1)) : 1e9;
+            double margin = 100 * tCritical(df) * se / a->mean;
+            double low = change - margin;
+            double high = change + margin;
+            printf(" [%+.1f%%, %+.1f%%]", low, high);
+            if (low > 0) {
+                printf("  slower");
+                regression = low > threshold ? 1 : 0;
+            } else if (high < 0) {
+                printf("  faster");
+            }
+        }
+    }
+    printf("%s\n", benchmark->throttled ? "  !" : "");
+    return regression;
+}
+
+int main(int argc, char** argv) {
+    double threshold = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        switch (opt) {
+        case 't':
+            threshold = atof(optarg);
+            break;
+        default:
+            optind = argc + 1;
+            break;
+        }
+    }
+    if (argc - optind != 2) {
+        fprintf(stderr, "Usage: %s [-t percent] baseline new\n"
+                "  -t percent  exit with status 2 if a benchmark is slower by more than\n"
+                "              this, over all of its confidence interval\n", argv[0]);
+        return 1;
+    }
+
+    BenchmarkTable table;
+    memset(&table, 0, sizeof(table));
+    if (!readRun(&table, BASELINE, argv[optind]) || !readRun(&table, CANDIDATE, argv[optind + 1])) {
+        return 1;
+    }
+    int nameWidth = strlen("benchmark");
+    for (int i = 0; i < table.count; i++) {
+        if (table.benchmarks[i].nameLength > nameWidth) {
+            nameWidth = table.benchmarks[i].nameLength;
+        }
+    }
+    printf("%-*s  %15s  %15s  change\n", nameWidth, "benchmark", "baseline ns", "new ns");
+    int regressions = 0;
+    for (int i = 0; i < table.count; i++) {
+        regressions += printComparison(&table.benchmarks[i], nameWidth, threshold);
+    }
+    if (threshold >= 0 && regressions > 0) {
+        printf("%d benchmarks slower by more than %.1f%%\n", regressions, threshold);
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "emulated_instructions.h"
+
+// Loads the libraries named on the command line, then lists the loaded
+// code that uses instructions the kernel may emulate:
+//
+//   abi.swp: emulated, abi.setend: emulated, abi.cp15_barrier: emulated
+//   /system/lib/libfoo.so: 12 swp, 3 cp15-barrier
+//       10 swp           spin_lock
+//        3 cp15-barrier  memory_barrier
+//        2 swp           ?
+//
+// "?" is code no function symbol covers. The /proc/sys/abi settings say
+// what an arm64 kernel does with each AArch32 instruction; they aren't
+// there for 64-bit kernels without 32-bit support, or other architectures.
+// cp15-thumb barriers raise SIGILL whatever abi.cp15_barrier says.
+
+static const char* const kAbiSettings[] = { "swp", "setend", "cp15_barrier" };
+
+// From arch/arm64/kernel/armv8_deprecated.c.
+static const char* const kAbiModes[] = { "undefined", "emulated", "hardware" };
+
+static void printAbiSettings() {
+    bool any = false;
+    for (size_t i = 0; i < sizeof(kAbiSettings) / sizeof(kAbiSettings[0]); i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/sys/abi/%s", kAbiSettings[i]);
+        int fd = TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC));
+        if (fd == -1) {
+            continue;
+        }
+        char value[16];
+        ssize_t length = TEMP_FAILURE_RETRY(read(fd, value, sizeof(value) - 1));
+        close(fd);
+        int mode = length > 0 ? value[0] - '0' : -1;
+        printf("%sabi.%s: %s", any ? ", " : "", kAbiSettings[i],
+               mode >= 0 && mode <= 2 ? kAbiModes[mode] : "?");
+        any = true;
+    }
+    if (any) {
+        printf("\n");
+    }
+}
+
+static void printLibrary(const EmulatedLibraryCounts* library, int limit) {
+    printf("%s:", library->path);
+    const char* separator = " ";
+    for (int i = 0; i < EMULATED_INSTRUCTION_KINDS; i++) {
+        if (library->counts[i] != 0) {
+            printf("%s%d %s", separator, library->counts[i],
+                   emulatedInstructionName(static_cast<EmulatedInstruction>(i)));
+            separator = ", ";
+        }
+    }
+    if (library->unreadable) {
+        printf("%sexecute-only code not scanned", separator);
+    }
+    if (library->symbolsMissing) {
+        printf(" (no symbols)");
+    }
+    printf("\n");
+    for (int i = 0; i < library->symbolCount && (limit == 0 || i < limit); i++) {
+        const EmulatedSymbolCounts* symbol = &library->symbols[i];
+        for (int j = 0; j < EMULATED_INSTRUCTION_KINDS; j++) {
+            if (symbol->counts[j] != 0) {
+                printf("  %6d %-13s %s\n", symbol->counts[j],
+                       emulatedInstructionName(static_cast<EmulatedInstruction>(j)),
+                       symbol->name);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    int limit = 10;
+    bool all = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "an:")) != -1) {
+        switch (opt) {
+        case 'a':
+            all = true;
+            break;
+        case 'n':
+            limit = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-a] [-n count] [library...]\n"
+                    "  -a        list every library scanned, not only those with candidates\n"
+                    "  -n count  the symbols to list per library, most first; 0 for all\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    for (int i = optind; i < argc; i++) {
+        if (dlopen(argv[i], RTLD_NOW) == NULL) {
+            fprintf(stderr, "unable to load %s: %s\n", argv[i], dlerror());
+            return 1;
+        }
+    }
+
+    printAbiSettings();
+    EmulatedInstructionReport report;
+    if (!emulatedInstructionScan(&report)) {
+        fprintf(stderr, "unable to scan: %s\n", strerror(errno));
+        return 1;
+    }
+    int found = 0;
+    for (int i = 0; i < report.libraryCount; i++) {
+        const EmulatedLibraryCounts* library = &report.libraries[i];
+        bool interesting = library->symbolCount != 0 || library->unreadable;
+        if (library->symbolCount != 0) {
+            found++;
+        }
+        if (all || interesting) {
+            printLibrary(library, limit);
+        }
+    }
+    printf("%d of %d objects have candidates\n", found, report.libraryCount);
+    emulatedInstructionReportFree(&report);
+    return 0;
+}
@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "seccomp_filter_chain.h"
+#include "seccomp_filter_eval.h"
+#include "seccomp_sample_program.h"
+
+// Prints the seccomp filters attached to a process and what each syscall
+// costs to get through all of them, to find where sandbox overhead comes
+// from:
+//
+//   pid 1234: seccomp mode 2, 2 filters, read with ptrace
+//   filter  length   mean  worst
+//        0      86   12.4     40
+//        1     200    8.1     30
+//   1024 syscalls, 312 that skip the filters
+//   syscall    min    max  args  actions
+//         9     20     40   yes  ALLOW ERRNO(1)
+//
+// Filter 0 is the most recent, and runs first. "mean" and "worst" are the
+// instructions a filter executes on the longest path of each syscall,
+// averaged over syscalls and at worst. Syscalls that every filter allows
+// without looking at the arguments skip the filters on Linux 5.11 and
+// later, count as free, and are left out of both. "args" says whether the
+// cost depends on the arguments, and "actions" lists what the syscall can
+// get.
+
+// Syscall numbers checked.
+#define MAX_SYSCALL 1024
+
+struct SyscallRow {
+    int nr;
+    int minInstructions;
+    int maxInstructions;
+    bool dependsOnArgs;
+    bool skipsFilters;
+    int actionCount;
+    uint32_t actions[SECCOMP_MAX_ACTIONS];
+    bool actionsTruncated;
+};
+
+static void addAction(SyscallRow* row, uint32_t* actions, int* count, uint32_t action) {
+    for (int i = 0; i < *count; i++) {
+        if (actions[i] == action) {
+            return;
+        }
+    }
+    if (*count == SECCOMP_MAX_ACTIONS) {
+        row->actionsTruncated = true;
+        return;
+    }
+    actions[(*count)++] = action;
+}
+
+// The kernel starts from ALLOW and keeps the action with the highest
+// precedence over the filters.
+static void combineActions(SyscallRow* row, const SeccompSyscallCost* cost) {
+    uint32_t combined[SECCOMP_MAX_ACTIONS];
+    int count = 0;
+    for (int i = 0; i < row->actionCount; i++) {
+        for (int j = 0; j < cost->actionCount; j++) {
+            addAction(row, combined, &count,
+                      seccompActionPrecedence(row->actions[i], cost->actions[j]));
+        }
+    }
+    if (cost->actionsTruncated || cost->unknownAction) {
+        row->actionsTruncated = true;
+    }
+    memcpy(row->actions, combined, count * sizeof(uint32_t));
+    row->actionCount = count;
+}
+
+// Costliest first, and syscalls that skip the filters last.
+static bool costsMore(const SyscallRow* left, const SyscallRow* right) {
+    if (left->skipsFilters != right->skipsFilters) {
+        return right->skipsFilters;
+    }
+    return left->maxInstructions > right->maxInstructions;
+}
+
+// Not qsort(), which calls sysinfo() in some C libraries, and the sample
+// policy traps that.
+static void sortRows(SyscallRow* rows, int count) {
+    for (int i = 1; i < count; i++) {
+        SyscallRow row = rows[i];
+        int j = i;
+        for (; j > 0 && costsMore(&row, &rows[j - 1]); j--) {
+            rows[j] = rows[j - 1];
+        }
+        rows[j] = row;
+    }
+}
+
+static const char* sourceName(const SeccompFilterChain* chain) {
+    switch (chain->source) {
+    case SECCOMP_CHAIN_PTRACE:
+        return "read with ptrace";
+    case SECCOMP_CHAIN_RECORDED:
+        return "recorded when installed";
+    case SECCOMP_CHAIN_NONE:
+        break;
+    }
+    return "programs unavailable";
+}
+
+static void report(pid_t pid, const SeccompFilterChain* chain, int limit) {
+    printf("pid %d: seccomp mode %d, %d filters, %s", pid, chain->mode,
+           chain->filterCount >= 0 ? chain->filterCount : chain->programCount,
+           sourceName(chain));
+    if (chain->source == SECCOMP_CHAIN_NONE && chain->error != 0) {
+        printf(" (%s)", strerror(chain->error));
+    }
+    printf("\n");
+    if (chain->filterCount > chain->programCount && chain->source == SECCOMP_CHAIN_RECORDED) {
+        printf("%d filters weren't recorded, and are left out\n",
+               chain->filterCount - chain->programCount);
+    }
+    if (chain->programCount == 0) {
+        return;
+    }
+
+    SyscallRow* rows = reinterpret_cast<SyscallRow*>(calloc(MAX_SYSCALL, sizeof(SyscallRow)));
+    long* filterTotals = reinterpret_cast<long*>(calloc(chain->programCount, sizeof(long)));
+    int* filterWorst = reinterpret_cast<int*>(calloc(chain->programCount, sizeof(int)));
+    int* filterCosts = reinterpret_cast<int*>(calloc(chain->programCount, sizeof(int)));
+    if (rows == NULL || filterTotals == NULL || filterWorst == NULL || filterCosts == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    uint32_t arch = seccompNativeArch();
+    int skipping = 0;
+    bool pathsTruncated = false;
+    for (int nr = 0; nr < MAX_SYSCALL; nr++) {
+        SyscallRow* row = &rows[nr];
+        row->nr = nr;
+        row->skipsFilters = true;
+        row->actionCount = 1;
+        row->actions[0] = SECCOMP_RET_ALLOW;
+        for (int i = 0; i < chain->programCount; i++) {
+            const SeccompFilterProgram* program = &chain->programs[i];
+            SeccompSyscallCost cost;
+            seccompFilterAnalyze(program->code, program->length, arch, nr, &cost);
+            row->minInstructions += cost.minInstructions;
+            row->maxInstructions += cost.maxInstructions;
+            row->dependsOnArgs |= cost.dependsOnArgs;
+            pathsTruncated |= cost.pathsTruncated;
+            row->skipsFilters &= seccompFilterConstAllow(program->code, program->length, arch, nr);
+            combineActions(row, &cost);
+            filterCosts[i] = cost.maxInstructions;
+        }
+        if (row->skipsFilters) {
+            skipping++;
+            continue;
+        }
+        for (int i = 0; i < chain->programCount; i++) {
+            filterTotals[i] += filterCosts[i];
+            if (filterCosts[i] > filterWorst[i]) {
+                filterWorst[i] = filterCosts[i];
+            }
+        }
+    }
+
+    printf("filter  length   mean  worst\n");
+    int filtered = MAX_SYSCALL - skipping;
+    for (int i = 0; i < chain->programCount; i++) {
+        printf("%6d  %6d  %5.1f  %5d\n", i, chain->programs[i].length,
+               filtered > 0 ? static_cast<double>(filterTotals[i]) / filtered : 0.0,
+               filterWorst[i]);
+    }
+    printf("%d syscalls, %d that skip the filters\n", MAX_SYSCALL, skipping);
+    if (pathsTruncated) {
+        printf("some syscalls had too many paths to follow, and may cost more\n");
+    }
+
+    sortRows(rows, MAX_SYSCALL);
+    printf("syscall    min    max  args  actions\n");
+    for (int n = 0; n < MAX_SYSCALL && (limit == 0 || n < limit); n++) {
+        const SyscallRow* row = &rows[n];
+        printf("%7d  %5d  %5d  %4s ", row->nr, row->skipsFilters ? 0 : row->minInstructions,
+               row->skipsFilters ? 0 : row->maxInstructions, row->dependsOnArgs ? "yes" : "no");
+        for (int i = 0; i < row->actionCount; i++) {
+            char action[32];
+            seccompActionFormat(row->actions[i], action, sizeof(action));
+            printf(" %s", action);
+        }
+        printf("%s\n", row->actionsTruncated ? " ..." : "");
+    }
+    free(rows);
+    free(filterTotals);
+    free(filterCosts);
+    free(filterWorst);
+}
+
+int main(int argc, char** argv) {
+    pid_t pid = getpid();
+    int limit = 20;
+    bool sample = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:n:s")) != -1) {
+        switch (opt) {
+        case 'p':
+            pid = atoi(optarg);
+            break;
+        case 'n':
+            limit = atoi(optarg);
+            break;
+        case 's':
+            sample = true;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-p pid] [-n count] [-s]\n"
+                    "  -p pid    the process to report on, by default this one\n"
+                    "  -n count  the syscalls to list, costliest first; 0 for all\n"
+                    "  -s        install the sample policy here first\n", argv[0]);
+            return 1;
+        }
+    }
+    if (sample) {
+        struct sock_fprog prog = GetTestSeccompFilterProgram();
+        if (prog.len == 0 || !seccompFilterInstallRecorded(&prog)) {
+            fprintf(stderr, "unable to install the sample policy: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+    SeccompFilterChain chain;
+    if (!seccompFilterChainLoad(pid, &chain)) {
+        fprintf(stderr, "unable to read the filters of pid %d: %s\n", pid,
+                strerror(chain.error));
+        return 1;
+    }
+    report(pid, &chain, limit);
+    seccompFilterChainFree(&chain);
+    return 0;
+}
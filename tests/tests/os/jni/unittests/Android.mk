@@ -0,0 +1,51 @@
+# Copyright (C) 2015 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+
+# Correctness tests for the native code that the tests, benchmarks and tools
+# share. Run on a device with
+#   adb shell /data/nativetest/CtsOsNativeUnitTests [-j jobs] [-v]
+LOCAL_MODULE := CtsOsNativeUnitTests
+
+# Don't include this package in any configuration by default.
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE_PATH := $(TARGET_OUT_DATA_NATIVE_TESTS)
+
+LOCAL_SRC_FILES := \
+		native_unittests.cpp \
+		../emulated_instructions.cpp \
+		../proc_scanner.cpp \
+		../seccomp-tests/tests/test_harness_main.c
+
+# ARCH_SUPPORTS_SECCOMP is set by ../Android.mk, which includes this file.
+ifeq ($(ARCH_SUPPORTS_SECCOMP),1)
+	LOCAL_SRC_FILES += ../sandbox_executor.cpp \
+			../seccomp_arg_filter.cpp \
+			../seccomp_filter_chain.cpp \
+			../seccomp_filter_eval.cpp \
+			../seccomp_policy_query.cpp \
+			../syscall_resumption.cpp
+	LOCAL_CFLAGS += -DARCH_SUPPORTS_SECCOMP
+endif
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/.. $(LOCAL_PATH)/../seccomp-tests/tests
+
+LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_CXX_STL := none
+
+include $(BUILD_EXECUTABLE)
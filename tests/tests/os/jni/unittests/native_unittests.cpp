@@ -0,0 +1,844 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/seccomp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "emulated_instructions.h"
+#include "proc_scanner.h"
+#include "sandbox_executor.h"
+#include "seccomp_arg_filter.h"
+#include "seccomp_filter_chain.h"
+#include "seccomp_filter_eval.h"
+#include "seccomp_policy_query.h"
+#include "syscall_resumption.h"
+#include "test_harness.h"
+
+// Correctness tests for the native code that the tests, benchmarks and
+// tools share, each against the simplest thing that gets the same answer.
+// They all live in this one file, as test_harness.h keeps its tests per
+// translation unit.
+
+// Returns a file holding |text|, with a path to open it by in |path|.
+static int sampleFile(const char* text, size_t length, char* path, size_t size) {
+    // A memfd, where there are memfds.
+    int fd = __test_output_open();
+    if (fd < 0 || TEMP_FAILURE_RETRY(pwrite(fd, text, length, 0)) != (ssize_t) length) {
+        return -1;
+    }
+    snprintf(path, size, "/proc/self/fd/%d", fd);
+    return fd;
+}
+
+// /proc scanner, against sscanf().
+
+static const char kMapsSample[] =
+        "12c00000-12e00000 rw-p 00000000 00:05 10267      /dev/ashmem/dalvik-main space (deleted)\n"
+        "5581a0c000-5581a0e000 r-xp 00000000 fd:00 1234             /system/bin/app_process64\n"
+        "7f3c9a2000-7f3c9a3000 ---p 00000000 00:00 0 \n"
+        "7f3c9a3000-7f3c9c4000 rw-p 00000000 00:00 0\n"
+        "7fd1e8b000-7fd1eac000 rw-p 00000000 00:00 0                          [stack]\n"
+        "ffffffffff600000-ffffffffff601000 --xp 00000000 00:00 0              [vsyscall]\n";
+
+TEST(proc_scanner_maps_like_sscanf) {
+    char path[64];
+    int fd = sampleFile(kMapsSample, sizeof(kMapsSample) - 1, path, sizeof(path));
+    ASSERT_LE(0, fd);
+    ProcScanner scanner;
+    ASSERT_TRUE(procScannerOpen(&scanner, path));
+    const char* expected = kMapsSample;
+    const char* line;
+    size_t length;
+    int lines = 0;
+    while ((line = procScannerNextLine(&scanner, &length)) != NULL) {
+        const char* newline = strchr(expected, '\n');
+        ASSERT_TRUE(newline != NULL);
+        EXPECT_EQ(static_cast<size_t>(newline - expected), length);
+        EXPECT_EQ(0, strncmp(expected, line, length));
+        EXPECT_EQ('\0', line[length]);
+
+        uint64_t start, end, offset, inode;
+        unsigned major, minor;
+        char perms[5];
+        int pathStart = 0;
+        ASSERT_EQ(7, sscanf(line, "%" SCNx64 "-%" SCNx64 " %4s %" SCNx64 " %x:%x %" SCNu64 " %n",
+                            &start, &end, perms, &offset, &major, &minor, &inode, &pathStart));
+
+        const char* p = line;
+        const char* lineEnd = line + length;
+        uint64_t value;
+        ASSERT_TRUE(procScannerParseHex(&p, lineEnd, &value));
+        EXPECT_EQ(start, value);
+        ASSERT_EQ('-', *p++);
+        ASSERT_TRUE(procScannerParseHex(&p, lineEnd, &value));
+        EXPECT_EQ(end, value);
+        p = procScannerSkipSpaces(p, lineEnd);
+        EXPECT_EQ(0, strncmp(perms, p, 4));
+        p = procScannerSkipSpaces(procScannerFind(p, lineEnd, ' '), lineEnd);
+        ASSERT_TRUE(procScannerParseHex(&p, lineEnd, &value));
+        EXPECT_EQ(offset, value);
+        p = procScannerSkipSpaces(p, lineEnd);
+        ASSERT_TRUE(procScannerParseHex(&p, lineEnd, &value));
+        EXPECT_EQ(major, value);
+        ASSERT_EQ(':', *p++);
+        ASSERT_TRUE(procScannerParseHex(&p, lineEnd, &value));
+        EXPECT_EQ(minor, value);
+        p = procScannerSkipSpaces(p, lineEnd);
+        ASSERT_TRUE(procScannerParseDecimal(&p, lineEnd, &value));
+        EXPECT_EQ(inode, value);
+        p = procScannerSkipSpaces(p, lineEnd);
+        EXPECT_EQ(line + pathStart, p);
+
+        expected = newline + 1;
+        lines++;
+    }
+    EXPECT_EQ(6, lines);
+    EXPECT_EQ('\0', *expected);
+    procScannerClose(&scanner);
+    close(fd);
+}
+
+static const char kStatusSample[] =
+        "Name:\tsystem_server\n"
+        "Umask:\t0077\n"
+        "Tgid:\t1234\n"
+        "VmRSS:\t  184320 kB\n"
+        "Threads:\t97\n"
+        "SigBlk:\t0000000000001204\n"
+        "Seccomp:\t2\n"
+        "Seccomp_filters:\t18446744073709551615";  // no newline at the end
+
+TEST(proc_scanner_status_like_sscanf) {
+    char path[64];
+    int fd = sampleFile(kStatusSample, sizeof(kStatusSample) - 1, path, sizeof(path));
+    ASSERT_LE(0, fd);
+    ProcScanner scanner;
+    ASSERT_TRUE(procScannerOpen(&scanner, path));
+    const char* line;
+    size_t length;
+    int lines = 0;
+    while ((line = procScannerNextLine(&scanner, &length)) != NULL) {
+        const char* end = line + length;
+        const char* colon = procScannerFind(line, end, ':');
+        ASSERT_NE(end, colon);
+        const char* p = procScannerSkipSpaces(colon + 1, end);
+        uint64_t value;
+        uint64_t expected;
+        bool hex = strncmp(line, "SigBlk:", 7) == 0;
+        bool parsed = hex ? procScannerParseHex(&p, end, &value) :
+                procScannerParseDecimal(&p, end, &value);
+        int scanned = sscanf(colon + 1, hex ? " %" SCNx64 : " %" SCNu64, &expected);
+        EXPECT_EQ(scanned == 1, parsed) {
+            TH_LOG("%s", line);
+        }
+        if (parsed) {
+            EXPECT_EQ(expected, value);
+        }
+        lines++;
+    }
+    EXPECT_EQ(8, lines);
+    procScannerClose(&scanner);
+    close(fd);
+}
+
+// Lines of every length up to a few vectors, and more of them than fit in
+// the buffer at once, so that lines straddle refills.
+TEST(proc_scanner_lines_across_reads) {
+    size_t size = 4 * PROC_SCANNER_BUFFER_SIZE;
+    char* text = reinterpret_cast<char*>(malloc(size));
+    ASSERT_TRUE(text != NULL);
+    size_t used = 0;
+    int written = 0;
+    for (int n = 0; used + 80 < size; n++) {
+        int length = n % 70;
+        for (int i = 0; i < length; i++) {
+            text[used++] = 'a' + (n + i) % 26;
+        }
+        text[used++] = '\n';
+        written++;
+    }
+    char path[64];
+    int fd = sampleFile(text, used, path, sizeof(path));
+    ASSERT_LE(0, fd);
+    ProcScanner scanner;
+    ASSERT_TRUE(procScannerOpen(&scanner, path));
+    const char* expected = text;
+    const char* line;
+    size_t length;
+    int lines = 0;
+    while ((line = procScannerNextLine(&scanner, &length)) != NULL) {
+        const char* newline = reinterpret_cast<const char*>(
+                memchr(expected, '\n', text + used - expected));
+        ASSERT_TRUE(newline != NULL);
+        ASSERT_EQ(static_cast<size_t>(newline - expected), length) {
+            TH_LOG("line %d", lines);
+        }
+        ASSERT_EQ(0, memcmp(expected, line, length));
+        expected = newline + 1;
+        lines++;
+    }
+    EXPECT_EQ(written, lines);
+    procScannerClose(&scanner);
+    close(fd);
+    free(text);
+}
+
+TEST(proc_scanner_numbers_like_sscanf) {
+    static const char* const kNumbers[] = {
+        "0", "7", "42kB", "ff", "DeadBeef", "ffffffffffffffff", "0000000000001204", "12 34",
+        "x", "", "kB", ":1",
+    };
+    for (size_t i = 0; i < sizeof(kNumbers) / sizeof(kNumbers[0]); i++) {
+        const char* text = kNumbers[i];
+        const char* end = text + strlen(text);
+        for (int hex = 0; hex < 2; hex++) {
+            uint64_t expected = 0;
+            int consumed = 0;
+            // Neither parser skips leading spaces or takes a sign or 0x.
+            bool scanned = text[0] >= '0' && text[0] <= '9' ? true : hex && isxdigit(text[0]);
+            if (scanned) {
+                scanned = sscanf(text, hex ? "%" SCNx64 "%n" : "%" SCNu64 "%n",
+                                 &expected, &consumed) == 1;
+            }
+            const char* p = text;
+            uint64_t value = 0;
+            bool parsed = hex ? procScannerParseHex(&p, end, &value) :
+                    procScannerParseDecimal(&p, end, &value);
+            EXPECT_EQ(scanned, parsed) {
+                TH_LOG("\"%s\" as %s", text, hex ? "hex" : "decimal");
+            }
+            if (parsed) {
+                EXPECT_EQ(expected, value);
+                EXPECT_EQ(text + consumed, p);
+            } else {
+                EXPECT_EQ(text, p);
+            }
+        }
+    }
+}
+
+
+// Emulated instruction encodings, against a table of them. The scanner
+// only looks at bytes, so this runs on any architecture.
+
+#define MAX_FOUND 8
+
+struct Found {
+    uintptr_t addresses[MAX_FOUND];
+    EmulatedInstruction kinds[MAX_FOUND];
+    int count;
+};
+
+static void recordFound(uintptr_t address, EmulatedInstruction kind, void* arg) {
+    Found* found = reinterpret_cast<Found*>(arg);
+    if (found->count < MAX_FOUND) {
+        found->addresses[found->count] = address;
+        found->kinds[found->count] = kind;
+    }
+    found->count++;
+}
+
+// mrs x0 of the system register op0:op1:CRn:CRm:op2, with op0 3.
+#define MRS(op1, crn, crm, op2) \
+    (0xd5380000U | (op1) << 16 | (crn) << 12 | (crm) << 8 | (op2) << 5)
+
+#define NOT_EMULATED (-1)
+
+struct EncodingCase {
+    const char* name;
+    EmulatedInstructionIsa isa;
+    // 32-bit Thumb instructions have their first halfword on top.
+    uint32_t insn;
+    int kind;
+};
+
+static const EncodingCase kEncodings[] = {
+    { "swp r0, r1, [r2]", EMULATED_ISA_A32, 0xe1020091, EMULATED_SWP },
+    { "swpb r0, r1, [r2]", EMULATED_ISA_A32, 0xe1420091, EMULATED_SWP },
+    { "swpne r0, r1, [r2]", EMULATED_ISA_A32, 0x11020091, EMULATED_SWP },
+    { "swp, unconditional", EMULATED_ISA_A32, 0xf1020091, NOT_EMULATED },
+    { "ldrex r0, [r2]", EMULATED_ISA_A32, 0xe1920f9f, NOT_EMULATED },
+    { "setend le", EMULATED_ISA_A32, 0xf1010000, EMULATED_SETEND },
+    { "setend be", EMULATED_ISA_A32, 0xf1010200, EMULATED_SETEND },
+    { "mcr p15 dsb", EMULATED_ISA_A32, 0xee070f9a, EMULATED_CP15_BARRIER },
+    { "mcr p15 dmb", EMULATED_ISA_A32, 0xee070fba, EMULATED_CP15_BARRIER },
+    { "mcr p15 isb", EMULATED_ISA_A32, 0xee070f95, EMULATED_CP15_BARRIER },
+    { "mcrne p15 dmb, r3", EMULATED_ISA_A32, 0x1e073fba, EMULATED_CP15_BARRIER },
+    { "mcr p15 c7, c14, 4", EMULATED_ISA_A32, 0xee070f9e, NOT_EMULATED },
+    { "mcr p15 c7, c10, 1", EMULATED_ISA_A32, 0xee070f3a, NOT_EMULATED },
+    { "mcr p15 c7, c5, 5", EMULATED_ISA_A32, 0xee070fb5, NOT_EMULATED },
+    { "mrc p15 dsb", EMULATED_ISA_A32, 0xee170f9a, NOT_EMULATED },
+    { "mcr p14 dsb", EMULATED_ISA_A32, 0xee070e9a, NOT_EMULATED },
+    { "mcr2 p15 dsb", EMULATED_ISA_A32, 0xfe070f9a, NOT_EMULATED },
+    { "dmb ish", EMULATED_ISA_A32, 0xf57ff05b, NOT_EMULATED },
+    { "setend le", EMULATED_ISA_T32, 0xb650, EMULATED_SETEND },
+    { "setend be", EMULATED_ISA_T32, 0xb658, EMULATED_SETEND },
+    { "cpsie i", EMULATED_ISA_T32, 0xb662, NOT_EMULATED },
+    { "mcr p15 dsb", EMULATED_ISA_T32, 0xee070f9a, EMULATED_CP15_THUMB },
+    { "mcr p15 dmb", EMULATED_ISA_T32, 0xee070fba, EMULATED_CP15_THUMB },
+    { "mcr p15 isb", EMULATED_ISA_T32, 0xee070f95, EMULATED_CP15_THUMB },
+    { "mcr p15 c7, c14, 4", EMULATED_ISA_T32, 0xee070f9e, NOT_EMULATED },
+    { "mrc p15 dsb", EMULATED_ISA_T32, 0xee170f9a, NOT_EMULATED },
+    { "dmb ish", EMULATED_ISA_T32, 0xf3bf8f5b, NOT_EMULATED },
+    { "mrs MIDR_EL1", EMULATED_ISA_A64, MRS(0, 0, 0, 0), EMULATED_ID_REGISTER },
+    { "mrs ID_AA64PFR0_EL1", EMULATED_ISA_A64, MRS(0, 0, 4, 0), EMULATED_ID_REGISTER },
+    { "mrs ID_AA64ISAR0_EL1", EMULATED_ISA_A64, MRS(0, 0, 6, 0), EMULATED_ID_REGISTER },
+    { "mrs ID_AA64MMFR1_EL1", EMULATED_ISA_A64, MRS(0, 0, 7, 1), EMULATED_ID_REGISTER },
+    { "mrs CTR_EL0", EMULATED_ISA_A64, MRS(3, 0, 0, 1), EMULATED_CACHE_TYPE },
+    { "mrs CNTFRQ_EL0", EMULATED_ISA_A64, MRS(3, 14, 0, 0), EMULATED_COUNTER },
+    { "mrs CNTVCT_EL0", EMULATED_ISA_A64, MRS(3, 14, 0, 2), EMULATED_COUNTER },
+    { "mrs CNTVCTSS_EL0", EMULATED_ISA_A64, MRS(3, 14, 0, 6), EMULATED_COUNTER },
+    { "mrs CNTPCT_EL0", EMULATED_ISA_A64, MRS(3, 14, 0, 1), NOT_EMULATED },
+    { "mrs TPIDR_EL0", EMULATED_ISA_A64, MRS(3, 13, 0, 2), NOT_EMULATED },
+    { "mrs DCZID_EL0", EMULATED_ISA_A64, MRS(3, 0, 0, 7), NOT_EMULATED },
+    { "mrs op1 0, CRn 0, CRm 8", EMULATED_ISA_A64, MRS(0, 0, 8, 0), NOT_EMULATED },
+    { "msr, CNTVCT_EL0 encoding", EMULATED_ISA_A64, MRS(3, 14, 0, 2) & ~0x00200000U, NOT_EMULATED },
+    { "nop", EMULATED_ISA_A64, 0xd503201f, NOT_EMULATED },
+};
+
+TEST(emulated_instruction_encodings) {
+    for (size_t i = 0; i < sizeof(kEncodings) / sizeof(kEncodings[0]); i++) {
+        const EncodingCase* encoding = &kEncodings[i];
+        uint16_t code[2];
+        size_t size;
+        if (encoding->isa == EMULATED_ISA_T32) {
+            bool wide = encoding->insn > 0xffff;
+            code[0] = wide ? encoding->insn >> 16 : encoding->insn;
+            code[1] = encoding->insn;
+            size = wide ? 4 : 2;
+        } else {
+            memcpy(code, &encoding->insn, sizeof(encoding->insn));
+            size = 4;
+        }
+        Found found;
+        memset(&found, 0, sizeof(found));
+        emulatedInstructionScanCode(code, size, encoding->isa, 0x1000, recordFound, &found);
+        bool emulated = encoding->kind != NOT_EMULATED;
+        EXPECT_EQ(emulated ? 1 : 0, found.count) {
+            TH_LOG("%s (%#x)", encoding->name, encoding->insn);
+        }
+        if (emulated && found.count == 1) {
+            EXPECT_EQ(0x1000U, found.addresses[0]);
+            EXPECT_EQ(encoding->kind, found.kinds[0]) {
+                TH_LOG("%s (%#x)", encoding->name, encoding->insn);
+            }
+        }
+    }
+}
+
+// Thumb code has to be walked an instruction at a time, as the halves of a
+// 32-bit instruction can look like other instructions.
+TEST(emulated_instruction_thumb_steps) {
+    static const struct {
+        const char* name;
+        uint16_t code[6];
+        int size;
+        uintptr_t address;  // of the one match, or 0 for none
+    } kSequences[] = {
+        { "mov, mcr p15 dsb", { 0x4600, 0xee07, 0x0f9a }, 3, 0x1002 },
+        { "32-bit, setend as its second half", { 0xf000, 0xb650 }, 2, 0 },
+        { "ldr.w over mcr p15 dsb", { 0xf8d0, 0xee07, 0x0f9a }, 3, 0 },
+        { "two movs, setend", { 0x4600, 0x4600, 0xb650 }, 3, 0x1004 },
+        { "ldr.w, setend", { 0xf8d0, 0x0000, 0xb650 }, 3, 0x1004 },
+        { "mcr p15 dsb cut short", { 0x4600, 0xee07 }, 2, 0 },
+    };
+    for (size_t i = 0; i < sizeof(kSequences) / sizeof(kSequences[0]); i++) {
+        Found found;
+        memset(&found, 0, sizeof(found));
+        emulatedInstructionScanCode(kSequences[i].code, kSequences[i].size * 2,
+                                    EMULATED_ISA_T32, 0x1000, recordFound, &found);
+        bool matched = kSequences[i].address != 0;
+        EXPECT_EQ(matched ? 1 : 0, found.count) {
+            TH_LOG("%s", kSequences[i].name);
+        }
+        if (matched && found.count == 1) {
+            EXPECT_EQ(kSequences[i].address, found.addresses[0]) {
+                TH_LOG("%s", kSequences[i].name);
+            }
+        }
+    }
+    // Thumb code only has to be halfword aligned.
+    uint16_t code[3] = { 0x4600, 0xee07, 0x0f95 };
+    Found found;
+    memset(&found, 0, sizeof(found));
+    emulatedInstructionScanCode(code + 1, 4, EMULATED_ISA_T32, 0x1002, recordFound, &found);
+    EXPECT_EQ(1, found.count);
+    EXPECT_EQ(0x1002U, found.addresses[0]);
+}
+
+#if defined(ARCH_SUPPORTS_SECCOMP)
+
+#ifndef PR_SET_NO_NEW_PRIVS
+#define PR_SET_NO_NEW_PRIVS 38
+#endif
+
+// Argument filters, against a rule-by-rule interpreter, with the kernel
+// running the programs. Each rule returns its own errno, and no rule
+// matching another, for syscalls these tests don't otherwise make, so that
+// every call fails without running, and the errno says which path the
+// program took.
+
+#define MAX_FILTER 1024
+#define MAX_RULES 8
+#define MAX_PREDICATES 3
+#define MAX_SET 12
+#define ARG_FILTER_PROGRAMS 100
+#define KERNEL_CALLS 100
+
+// Syscalls these tests don't otherwise make.
+static const int kKernelSyscalls[] = { __NR_getpriority, __NR_setpriority, __NR_getpgid };
+
+// Words that sit on the edges the generator splits arguments at.
+static const uint64_t kEdgeValues[] = {
+    0, 1, 2, 0x7f, 0x80, 0xfff, 0x1000, 0x7fffffff, 0x80000000, 0xfffffffe, 0xffffffff,
+    0x100000000ULL, 0x100000001ULL, 0x1ffffffffULL, 0xffffffff00000000ULL,
+    0x8000000000000000ULL, 0xfffffffffffffffeULL, 0xffffffffffffffffULL,
+};
+
+struct RandomRules {
+    SeccompArgRule rules[MAX_RULES];
+    SeccompArgPredicate predicates[MAX_RULES][MAX_PREDICATES];
+    uint64_t sets[MAX_RULES][MAX_PREDICATES][MAX_SET];
+    int ruleCount;
+};
+
+static uint64_t randomWord(unsigned* seed) {
+    uint64_t value = kEdgeValues[rand_r(seed) % (sizeof(kEdgeValues) / sizeof(kEdgeValues[0]))];
+    switch (rand_r(seed) % 4) {
+    case 0:
+        return value;
+    case 1:
+        return value + rand_r(seed) % 3 - 1;
+    case 2:
+        return (static_cast<uint64_t>(rand_r(seed)) << 33) ^ rand_r(seed);
+    default:
+        return rand_r(seed) % 64;
+    }
+}
+
+static uint64_t randomArg(unsigned* seed) {
+    uint64_t value = randomWord(seed);
+    // The high words of arguments are zero on 32-bit architectures.
+    return sizeof(long) == 4 ? static_cast<uint32_t>(value) : value;
+}
+
+static SeccompArgPredicate randomPredicate(unsigned* seed, uint64_t* set) {
+    int arg = rand_r(seed) % 6;
+    SeccompArgPredicate predicate;
+    switch (rand_r(seed) % 4) {
+    case 0:
+        predicate = seccompArgEq(arg, randomWord(seed));
+        break;
+    case 1: {
+        uint64_t mask = randomWord(seed);
+        uint64_t value = randomWord(seed) & (rand_r(seed) % 4 ? mask : ~0ULL);
+        predicate = seccompArgMaskedEq(arg, mask, value);
+        break;
+    }
+    case 2: {
+        uint64_t low = randomWord(seed);
+        uint64_t high = randomWord(seed);
+        predicate = seccompArgRange(arg, low < high ? low : high, low < high ? high : low);
+        break;
+    }
+    default: {
+        int size = 1 + rand_r(seed) % MAX_SET;
+        for (int i = 0; i < size; i++) {
+            set[i] = randomWord(seed);
+        }
+        predicate = seccompArgInSet(arg, set, size);
+        break;
+    }
+    }
+    return rand_r(seed) % 3 == 0 ? seccompArgLowWord(predicate) : predicate;
+}
+
+// Rules for each of |syscalls|, and then some, so that they always get an
+// action from a rule or the mismatch action, never the default one.
+static void randomRules(unsigned* seed, const int* syscalls, int syscallCount,
+                        RandomRules* rules) {
+    rules->ruleCount = syscallCount + rand_r(seed) % (MAX_RULES - syscallCount + 1);
+    int first = rand_r(seed);
+    for (int i = 0; i < rules->ruleCount; i++) {
+        SeccompArgRule* rule = &rules->rules[i];
+        rule->syscall = syscalls[(i < syscallCount ? first + i : rand_r(seed)) % syscallCount];
+        rule->action = SECCOMP_RET_ERRNO | (100 + i);
+        rule->predicates = rules->predicates[i];
+        rule->predicateCount = rand_r(seed) % (MAX_PREDICATES + 1);
+        for (int j = 0; j < rule->predicateCount; j++) {
+            rules->predicates[i][j] = randomPredicate(seed, rules->sets[i][j]);
+        }
+    }
+}
+
+static bool predicateHolds(const SeccompArgPredicate* predicate,
+                           const struct seccomp_data* data) {
+    uint64_t arg = data->args[predicate->arg];
+    uint64_t width = predicate->lowWordOnly ? 0xffffffffULL : ~0ULL;
+    arg &= width;
+    switch (predicate->compare) {
+    case SECCOMP_ARG_EQ:
+        return arg == (predicate->value & width);
+    case SECCOMP_ARG_MASKED_EQ:
+        return (arg & predicate->mask) == (predicate->value & width);
+    case SECCOMP_ARG_RANGE:
+        return predicate->value <= arg && arg <= predicate->high;
+    case SECCOMP_ARG_IN_SET:
+        for (int i = 0; i < predicate->setSize; i++) {
+            if ((predicate->set[i] & width) == arg) {
+                return true;
+            }
+        }
+        return false;
+    }
+    return false;
+}
+
+
+// What seccompArgFilterGenerate() says its programs do with a syscall of
+// the native architecture.
+static uint32_t referenceAction(const SeccompArgRule* rules, int ruleCount,
+                                uint32_t mismatchAction, uint32_t defaultAction,
+                                const struct seccomp_data* data) {
+    bool any = false;
+    for (int i = 0; i < ruleCount; i++) {
+        if (rules[i].syscall != data->nr) {
+            continue;
+        }
+        any = true;
+        bool holds = true;
+        for (int j = 0; j < rules[i].predicateCount && holds; j++) {
+            holds = predicateHolds(&rules[i].predicates[j], data);
+        }
+        if (holds) {
+            return rules[i].action;
+        }
+    }
+    return any ? mismatchAction : defaultAction;
+}
+
+// Fills |data| with a call to one of |syscalls| with arguments that the
+// predicates of |rules| are likely to be on the edge of.
+static void randomCall(unsigned* seed, const RandomRules* rules, const int* syscalls,
+                       int syscallCount, struct seccomp_data* data) {
+    memset(data, 0, sizeof(*data));
+    data->nr = syscalls[rand_r(seed) % syscallCount];
+    for (int i = 0; i < 6; i++) {
+        data->args[i] = randomArg(seed);
+    }
+    // Often make some predicate's value the argument.
+    const SeccompArgRule* rule = &rules->rules[rand_r(seed) % rules->ruleCount];
+    for (int j = 0; j < rule->predicateCount; j++) {
+        const SeccompArgPredicate* predicate = &rule->predicates[j];
+        if (rand_r(seed) % 2 == 0) {
+            continue;
+        }
+        uint64_t value = predicate->compare == SECCOMP_ARG_IN_SET ?
+                predicate->set[rand_r(seed) % predicate->setSize] :
+                predicate->compare == SECCOMP_ARG_RANGE && rand_r(seed) % 2 ?
+                predicate->high : predicate->value;
+        data->args[predicate->arg] = sizeof(long) == 4 ? static_cast<uint32_t>(value) : value;
+    }
+}
+
+static const char* formatArgs(const struct seccomp_data* data, char* buffer, size_t size) {
+    snprintf(buffer, size, "%#llx %#llx %#llx %#llx %#llx %#llx",
+             static_cast<unsigned long long>(data->args[0]),
+             static_cast<unsigned long long>(data->args[1]),
+             static_cast<unsigned long long>(data->args[2]),
+             static_cast<unsigned long long>(data->args[3]),
+             static_cast<unsigned long long>(data->args[4]),
+             static_cast<unsigned long long>(data->args[5]));
+    return buffer;
+}
+
+static bool installFilter(const struct sock_filter* filter, int length) {
+    struct sock_fprog prog = { static_cast<unsigned short>(length),
+                               const_cast<struct sock_filter*>(filter) };
+    return prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 &&
+            prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) == 0;
+}
+
+// The errno that |data|'s syscall fails with.
+static int kernelErrno(const struct seccomp_data* data) {
+    errno = 0;
+    long result = syscall(data->nr, data->args[0], data->args[1], data->args[2],
+                          data->args[3], data->args[4], data->args[5]);
+    return result == -1 ? errno : 0;
+}
+
+// The errno |action| makes a syscall fail with, or -1 if it isn't an ERRNO.
+static int actionErrno(uint32_t action) {
+    return (action & SECCOMP_RET_ACTION) == SECCOMP_RET_ERRNO ?
+            static_cast<int>(action & SECCOMP_RET_DATA) : -1;
+}
+
+// Expects the kernel to agree with |expected| for each of |calls|, under
+// the filters already installed.
+static void checkCalls(struct __test_metadata* _metadata, int program,
+                       const struct seccomp_data* calls, const uint32_t* expected) {
+    bool agreed = true;
+    for (int call = 0; call < KERNEL_CALLS && agreed; call++) {
+        const struct seccomp_data* data = &calls[call];
+        // Never let a syscall with made-up arguments run.
+        ASSERT_LT(0, actionErrno(expected[call]));
+        EXPECT_EQ(actionErrno(expected[call]), kernelErrno(data)) {
+            char args[128];
+            TH_LOG("program %d, syscall %d, args %s", program, data->nr,
+                   formatArgs(data, args, sizeof(args)));
+            agreed = false;
+        }
+    }
+}
+
+// The same, with |filter| installed in a child, where it goes away again.
+static void checkKernel(struct __test_metadata* _metadata, int program,
+                        const struct sock_filter* filter, int length,
+                        const struct seccomp_data* calls, const uint32_t* expected) {
+    pid_t pid = fork();
+    ASSERT_LE(0, pid);
+    if (pid == 0) {
+        if (!installFilter(filter, length)) {
+            TH_LOG("unable to install the filter: %s", strerror(errno));
+            _exit(0);
+        }
+        checkCalls(_metadata, program, calls, expected);
+        _exit(_metadata->passed);
+    }
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 1);
+}
+
+TEST_SIZE(arg_filter_matches_reference, TH_SIZE_MEDIUM);
+
+TEST(arg_filter_matches_reference) {
+    unsigned seed = 1;
+    struct sock_filter filter[MAX_FILTER];
+    for (int program = 0; program < ARG_FILTER_PROGRAMS && _metadata->passed; program++) {
+        RandomRules rules;
+        randomRules(&seed, kKernelSyscalls, 3, &rules);
+        struct seccomp_data calls[KERNEL_CALLS];
+        uint32_t expected[KERNEL_CALLS];
+        for (int call = 0; call < KERNEL_CALLS; call++) {
+            randomCall(&seed, &rules, kKernelSyscalls, 3, &calls[call]);
+            expected[call] = referenceAction(rules.rules, rules.ruleCount,
+                                             SECCOMP_RET_ERRNO | 99, SECCOMP_RET_ALLOW,
+                                             &calls[call]);
+        }
+        for (int flags = 0; flags <= SECCOMP_ARG_FILTER_UNOPTIMIZED; flags++) {
+            int length = seccompArgFilterGenerate(rules.rules, rules.ruleCount,
+                                                  SECCOMP_RET_ERRNO | 99, SECCOMP_RET_ALLOW,
+                                                  flags, filter, MAX_FILTER);
+            ASSERT_LT(0, length);
+            checkKernel(_metadata, program * 2 + flags, filter, length, calls, expected);
+        }
+    }
+}
+
+// The filter evaluator, against the kernel.
+
+#define KERNEL_PROGRAMS 40
+
+TEST_SIZE(filter_eval_matches_kernel, TH_SIZE_MEDIUM);
+
+TEST(filter_eval_matches_kernel) {
+    unsigned seed = 2;
+    struct sock_filter filter[MAX_FILTER];
+    for (int program = 0; program < KERNEL_PROGRAMS && _metadata->passed; program++) {
+        RandomRules rules;
+        randomRules(&seed, kKernelSyscalls, 3, &rules);
+        int length = seccompArgFilterGenerate(rules.rules, rules.ruleCount,
+                                              SECCOMP_RET_ERRNO | 99, SECCOMP_RET_ALLOW,
+                                              program % 2, filter, MAX_FILTER);
+        ASSERT_LT(0, length);
+        struct seccomp_data calls[KERNEL_CALLS];
+        uint32_t expected[KERNEL_CALLS];
+        for (int call = 0; call < KERNEL_CALLS; call++) {
+            randomCall(&seed, &rules, kKernelSyscalls, 3, &calls[call]);
+            calls[call].arch = seccompNativeArch();
+            expected[call] = seccompFilterRun(filter, length, &calls[call], NULL);
+        }
+        // The kernel can't be asked about another architecture.
+        struct seccomp_data foreign = calls[0];
+        foreign.arch ^= 1;
+        EXPECT_EQ(SECCOMP_RET_KILL, seccompFilterRun(filter, length, &foreign, NULL));
+        checkKernel(_metadata, program, filter, length, calls, expected);
+    }
+}
+
+// Arithmetic on the arguments, with the result as the errno, through
+// RET A, which the generated filters don't use.
+TEST(filter_eval_alu_matches_kernel) {
+    struct sock_filter filter[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, __NR_getpriority, 1, 0),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, args[1])),
+        BPF_STMT(BPF_ST, 0),
+        BPF_STMT(BPF_LDX | BPF_W | BPF_MEM, 0),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, args[0])),
+        BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 2654435761U),
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+        BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 7),
+        BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 3),
+        BPF_STMT(BPF_ALU | BPF_SUB | BPF_K, 12345),
+        BPF_STMT(BPF_ALU | BPF_NEG, 0),
+        BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0x7ff),
+        BPF_STMT(BPF_ALU | BPF_OR | BPF_K, SECCOMP_RET_ERRNO | 1),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    int length = sizeof(filter) / sizeof(filter[0]);
+    unsigned seed = 3;
+    struct seccomp_data calls[KERNEL_CALLS];
+    uint32_t expected[KERNEL_CALLS];
+    for (int call = 0; call < KERNEL_CALLS; call++) {
+        memset(&calls[call], 0, sizeof(calls[call]));
+        calls[call].nr = __NR_getpriority;
+        calls[call].arch = seccompNativeArch();
+        calls[call].args[0] = randomArg(&seed);
+        calls[call].args[1] = randomArg(&seed);
+        expected[call] = seccompFilterRun(filter, length, &calls[call], NULL);
+    }
+    checkKernel(_metadata, 0, filter, length, calls, expected);
+}
+
+// The policy query, against the kernel, with filters recorded as they are
+// installed and stacked.
+TEST(policy_query_matches_kernel) {
+    unsigned seed = 4;
+    bool unfiltered = prctl(PR_GET_SECCOMP, 0, 0, 0, 0) == 0;
+    struct sock_filter filter[MAX_FILTER];
+    struct seccomp_data calls[KERNEL_CALLS];
+    for (int program = 0; program < 3; program++) {
+        RandomRules rules;
+        randomRules(&seed, kKernelSyscalls, 3, &rules);
+        int length = seccompArgFilterGenerate(rules.rules, rules.ruleCount,
+                                              SECCOMP_RET_ERRNO | (90 + program),
+                                              SECCOMP_RET_ALLOW, 0, filter, MAX_FILTER);
+        ASSERT_LT(0, length);
+        struct sock_fprog prog = { static_cast<unsigned short>(length), filter };
+        ASSERT_TRUE(seccompFilterInstallRecorded(&prog)) {
+            TH_LOG("unable to install the filter: %s", strerror(errno));
+        }
+        for (int call = 0; call < KERNEL_CALLS; call++) {
+            randomCall(&seed, &rules, kKernelSyscalls, 3, &calls[call]);
+        }
+        uint32_t expected[KERNEL_CALLS];
+        for (int call = 0; call < KERNEL_CALLS; call++) {
+            uint64_t args[6];
+            for (int i = 0; i < 6; i++) {
+                args[i] = calls[call].args[i];
+            }
+            expected[call] = seccompPolicyQueryAction(calls[call].nr, args);
+            EXPECT_FALSE(seccompPolicyAllows(calls[call].nr, args));
+        }
+        checkCalls(_metadata, program, calls, expected);
+        EXPECT_EQ(SECCOMP_POLICY_ALLOWED, seccompPolicyQuerySyscall(__NR_getpid));
+        EXPECT_EQ(unfiltered, seccompPolicyComplete());
+    }
+}
+
+// The sandbox executor, with a job that makes a syscall strict mode doesn't
+// allow when it is given "!".
+
+static uint32_t echoJob(const void* in, uint32_t inSize, void* out, uint32_t outCapacity) {
+    if (inSize == 1 && *reinterpret_cast<const char*>(in) == '!') {
+        syscall(__NR_getppid);
+    }
+    uint32_t size = inSize < outCapacity ? inSize : outCapacity;
+    memcpy(out, in, size);
+    return size;
+}
+
+TEST(sandbox_executor_kills_forbidden_syscall) {
+    SandboxExecutor* executor = sandboxExecutorCreate(2, echoJob, NULL);
+    ASSERT_TRUE(executor != NULL);
+    ASSERT_TRUE(sandboxExecutorSubmit(executor, 0, 1, "a", 1));
+    ASSERT_TRUE(sandboxExecutorSubmit(executor, 1, 2, "b", 1));
+    for (int i = 0; i < 2; i++) {
+        uint64_t id;
+        char out[8];
+        uint32_t size;
+        ASSERT_TRUE(sandboxExecutorReceive(executor, &id, out, sizeof(out), &size));
+        ASSERT_TRUE(id == 1 || id == 2);
+        EXPECT_EQ(1U, size);
+        EXPECT_EQ(id == 1 ? 'a' : 'b', out[0]);
+    }
+    // Worker 1 is killed, and worker 0 goes on.
+    ASSERT_TRUE(sandboxExecutorSubmit(executor, 1, 3, "!", 1));
+    ASSERT_TRUE(sandboxExecutorSubmit(executor, 0, 4, "c", 1));
+    uint64_t id;
+    char out[8];
+    uint32_t size;
+    ASSERT_TRUE(sandboxExecutorReceive(executor, &id, out, sizeof(out), &size));
+    EXPECT_EQ(4U, id);
+    EXPECT_EQ(1, sandboxExecutorDestroy(executor));
+}
+
+#if defined(__x86_64__) || defined(__aarch64__)
+
+// Syscall resumption, trapping as many syscalls as it takes, which makes
+// the longest filter it installs.
+
+static bool emulateGetppid(const TrappedSyscall* call, long* result) {
+    if (call->nr != __NR_getppid) {
+        return false;
+    }
+    *result = 12345;
+    return true;
+}
+
+TEST(syscall_resumption_max_syscalls) {
+    // Made-up syscalls first, so that the two that are made take the last
+    // two checks.
+    int syscalls[SYSCALL_RESUMPTION_MAX_SYSCALLS];
+    for (int i = 0; i < SYSCALL_RESUMPTION_MAX_SYSCALLS - 2; i++) {
+        syscalls[i] = 5000 + i;
+    }
+    syscalls[SYSCALL_RESUMPTION_MAX_SYSCALLS - 2] = __NR_getuid;
+    syscalls[SYSCALL_RESUMPTION_MAX_SYSCALLS - 1] = __NR_getppid;
+    long uid = getuid();
+    long pid = getpid();
+    ASSERT_TRUE(syscallResumptionStart(SYSCALL_BYPASS_INSTRUCTION_POINTER, syscalls,
+                                       SYSCALL_RESUMPTION_MAX_SYSCALLS, emulateGetppid)) {
+        TH_LOG("unable to trap syscalls: %s", strerror(errno));
+    }
+    EXPECT_EQ(12345, syscall(__NR_getppid));
+    EXPECT_EQ(1U, syscallResumptionCount());
+    // Trapped, and made from the thunk.
+    EXPECT_EQ(uid, syscall(__NR_getuid));
+    EXPECT_EQ(2U, syscallResumptionCount());
+    // Not trapped.
+    EXPECT_EQ(pid, syscall(__NR_getpid));
+    EXPECT_EQ(2U, syscallResumptionCount());
+}
+
+#endif  // __x86_64__ || __aarch64__
+
+#endif  // ARCH_SUPPORTS_SECCOMP
+
+TEST_HARNESS_MAIN